@@ -0,0 +1,298 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_batch.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define BATCH_MIN_ELEMENTS		1000U
+#define BATCH_MAX_ELEMENTS		1000000U
+#define BATCH_TARGET_ELEMENTS	20000000ULL		// elements converted per measurement
+#define BATCH_VERIFY_ELEMENTS	4099U			// odd count, the vector tails are checked too
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef void (*bench_batch_fn_t)(const uint64_t *_src, uint64_t *_dst, size_t _count);
+
+typedef struct {
+	const char			*name;
+	bench_batch_fn_t	loop;		// per-element reference
+	bench_batch_fn_t	batch;
+	int					kernel;		// runs on the conversion kernels
+} bench_batch_op_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static double bench_batch__measure(bench_batch_fn_t _fn, const uint64_t *_src, uint64_t *_dst, size_t _count, int _quick);
+static void bench_batch__stamp_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__stamp(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__ns_to_us_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__ns_to_ms_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__us_to_ns_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__ms_to_ns_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__ticks_to_ns_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__ns_to_ticks_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static void bench_batch__ticks_to_us_loop(const uint64_t *_src, uint64_t *_dst, size_t _count);
+static uint64_t bench_batch__verify(const bench_batch_op_t *_op, const uint64_t *_src, uint64_t *_ref, uint64_t *_dst);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const bench_batch_op_t s_ops[] = {
+	{ "stamp_ns",		&bench_batch__stamp_loop,			&bench_batch__stamp,			0 },
+	{ "ns_to_us",		&bench_batch__ns_to_us_loop,		&lib_clock__batch_ns_to_us,		1 },
+	{ "ns_to_ms",		&bench_batch__ns_to_ms_loop,		&lib_clock__batch_ns_to_ms,		1 },
+	{ "us_to_ns",		&bench_batch__us_to_ns_loop,		&lib_clock__batch_us_to_ns,		1 },
+	{ "ms_to_ns",		&bench_batch__ms_to_ns_loop,		&lib_clock__batch_ms_to_ns,		1 },
+	{ "ticks_to_ns",	&bench_batch__ticks_to_ns_loop,		&lib_clock__batch_ticks_to_ns,	1 },
+	{ "ns_to_ticks",	&bench_batch__ns_to_ticks_loop,		&lib_clock__batch_ns_to_ticks,	1 },
+	{ "ticks_to_us",	&bench_batch__ticks_to_us_loop,		&lib_clock__batch_ticks_to_us,	1 },
+};
+
+static const char *const s_isas[] = { "scalar", "sse2", "avx2" };
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	batch APIs against per-element loops, ns per element
+ *
+ * Every kernel set the CPU supports is timed and its output compared
+ * with the per-element loop, the automatic selection is timed last.
+ * ****************************************************************************/
+void bench_batch__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	uint64_t *src, *dst, *ref = NULL, x = 0x9E3779B97F4A7C15ULL, mismatch = 0, wrong;
+	size_t count, o, i, k;
+	double loop, batch;
+
+	src = malloc(BATCH_MAX_ELEMENTS * sizeof(*src));
+	dst = malloc(BATCH_MAX_ELEMENTS * sizeof(*dst));
+	ref = malloc(BATCH_VERIFY_ELEMENTS * sizeof(*ref));
+	if ((src == NULL) || (dst == NULL) || (ref == NULL)) {
+		goto CLEANUP;
+	}
+
+	// timestamps of a long running process, full 64bit range for the divisions
+	for (i = 0; i < BATCH_MAX_ELEMENTS; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		src[i] = x >> (x & 15);
+	}
+	// limits and the neighbours of the divisors
+	src[0] = 0;
+	src[1] = UINT64_MAX;
+	src[2] = 999;
+	src[3] = 1000;
+	src[4] = 999999;
+	src[5] = 1000000;
+	src[6] = UINT64_MAX - UINT64_MAX % 1000000ULL - 1;
+
+	bench_json__string(_json, "isa", lib_clock__batch_isa());
+	bench_json__begin_object(_json, "mismatches");
+	for (k = 0; k < sizeof(s_isas) / sizeof(s_isas[0]); k++) {
+		if (lib_clock__batch_select(s_isas[k]) < EOK) {
+			continue;
+		}
+		wrong = 0;
+		for (o = 0; o < sizeof(s_ops) / sizeof(s_ops[0]); o++) {
+			wrong += s_ops[o].kernel ? bench_batch__verify(&s_ops[o], src, ref, dst) : 0;
+		}
+		bench_json__uint(_json, s_isas[k], wrong);
+		mismatch += wrong;
+	}
+	lib_clock__batch_select(NULL);
+	bench_json__end_object(_json);
+
+	for (o = 0; o < sizeof(s_ops) / sizeof(s_ops[0]); o++) {
+		bench_json__begin_array(_json, s_ops[o].name);
+		for (count = BATCH_MIN_ELEMENTS; count <= BATCH_MAX_ELEMENTS; count *= 10) {
+			loop = bench_batch__measure(s_ops[o].loop, src, dst, count, _cfg->quick);
+
+			bench_json__begin_object(_json, NULL);
+			bench_json__uint(_json, "elements", count);
+			bench_json__double(_json, "loop_ns_per_element", loop);
+			for (k = 0; s_ops[o].kernel && (k < sizeof(s_isas) / sizeof(s_isas[0])); k++) {
+				if (lib_clock__batch_select(s_isas[k]) == EOK) {
+					bench_json__double(_json, s_isas[k], bench_batch__measure(s_ops[o].batch, src, dst, count, _cfg->quick));
+				}
+			}
+			lib_clock__batch_select(NULL);
+			batch = bench_batch__measure(s_ops[o].batch, src, dst, count, _cfg->quick);
+			bench_json__double(_json, "batch_ns_per_element", batch);
+			bench_json__double(_json, "speedup", (batch > 0) ? loop / batch : 0.0);
+			bench_json__end_object(_json);
+		}
+		bench_json__end_array(_json);
+	}
+	bench_json__string(_json, "result", (mismatch == 0) ? "pass" : "fail");
+
+CLEANUP:
+	free(src);
+	free(dst);
+	free(ref);
+}
+
+/* ************************************************************************//**
+ * \brief	number of values the selected kernels convert differently than the loop
+ * ****************************************************************************/
+static uint64_t bench_batch__verify(const bench_batch_op_t *_op, const uint64_t *_src, uint64_t *_ref, uint64_t *_dst)
+{
+	uint64_t wrong = 0;
+	size_t i;
+
+	_op->loop(_src, _ref, BATCH_VERIFY_ELEMENTS);
+	memset(_dst, 0, BATCH_VERIFY_ELEMENTS * sizeof(*_dst));
+	_op->batch(_src, _dst, BATCH_VERIFY_ELEMENTS);
+
+	for (i = 0; i < BATCH_VERIFY_ELEMENTS; i++) {
+		wrong += (_dst[i] != _ref[i]) ? 1U : 0U;
+	}
+
+	return wrong;
+}
+
+/* ************************************************************************//**
+ * \brief	best ns per element out of several rounds
+ * ****************************************************************************/
+static double bench_batch__measure(bench_batch_fn_t _fn, const uint64_t *_src, uint64_t *_dst, size_t _count, int _quick)
+{
+	uint64_t target = _quick ? BATCH_TARGET_ELEMENTS / 10 : BATCH_TARGET_ELEMENTS;
+	uint64_t reps = (target + _count - 1) / _count;
+	uint64_t start, elapsed, best = UINT64_MAX, r;
+	int round;
+
+	for (round = 0; round < 3; round++) {
+		start = bench__ref_ns();
+		for (r = 0; r < reps; r++) {
+			_fn(_src, _dst, _count);
+			bench__sink(_dst[r % _count]);
+		}
+		elapsed = bench__ref_ns() - start;
+		if (elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	return (double)best / (double)(reps * _count);
+}
+
+static void bench_batch__stamp_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	(void)_src;
+	for (i = 0; i < _count; i++) {
+		_dst[i] = lib_clock__get_time_ns();
+	}
+}
+
+static void bench_batch__stamp(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	(void)_src;
+	lib_clock__batch_stamp_ns(_dst, _count, 0);
+}
+
+static void bench_batch__ns_to_us_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = _src[i] / 1000ULL;
+	}
+}
+
+static void bench_batch__ns_to_ms_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = _src[i] / 1000000ULL;
+	}
+}
+
+static void bench_batch__us_to_ns_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = _src[i] * 1000ULL;
+	}
+}
+
+static void bench_batch__ms_to_ns_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = _src[i] * 1000000ULL;
+	}
+}
+
+static void bench_batch__ticks_to_ns_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = lib_clock__ticks_to_ns(_src[i]);
+	}
+}
+
+static void bench_batch__ns_to_ticks_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = lib_clock__ns_to_ticks(_src[i]);
+	}
+}
+
+static void bench_batch__ticks_to_us_loop(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = lib_clock__ticks_to_ns(_src[i]) / 1000ULL;
+	}
+}
@@ -0,0 +1,224 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <chrono>
+#include <type_traits>
+
+/* system */
+#include <time.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_chrono.hpp>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define CHRONO_CALLS			1000000U	// calls per measurement
+#define CHRONO_QUICK_CALLS		200000U
+#define CHRONO_ROUNDS			5			// the fastest round is reported
+#define CHRONO_CACHED_US		1000U
+#define CHRONO_TICKS_SPAN_NS	10000000L	// span of the ticks_to_duration check
+#define CHRONO_TICKS_ERROR_NS	50000		// tolerated deviation over the span
+
+/* *******************************************************************
+ * compile-time checks of the TrivialClock requirements
+ * ******************************************************************/
+template <class Clock>
+struct bench_chrono_trivial_clock {
+	static constexpr bool value =
+		std::is_arithmetic<typename Clock::rep>::value &&
+		std::is_same<typename Clock::duration, std::chrono::duration<typename Clock::rep, typename Clock::period> >::value &&
+		std::is_same<typename Clock::time_point, std::chrono::time_point<Clock> >::value &&
+		std::is_same<typename Clock::time_point::duration, typename Clock::duration>::value &&
+		std::is_same<decltype(Clock::now()), typename Clock::time_point>::value &&
+		noexcept(Clock::now()) &&
+		std::is_same<decltype(Clock::is_steady), const bool>::value;
+};
+
+static_assert(bench_chrono_trivial_clock<lib_clock::monotonic_clock>::value, "monotonic_clock is no TrivialClock");
+static_assert(bench_chrono_trivial_clock<lib_clock::coarse_clock>::value, "coarse_clock is no TrivialClock");
+static_assert(bench_chrono_trivial_clock<lib_clock::cached_clock>::value, "cached_clock is no TrivialClock");
+static_assert(bench_chrono_trivial_clock<lib_clock::tsc_clock>::value, "tsc_clock is no TrivialClock");
+static_assert(lib_clock::monotonic_clock::is_steady && lib_clock::tsc_clock::is_steady, "clocks must be steady");
+
+// conversions are constant expressions
+static_assert(lib_clock::to_ticks<lib_clock::monotonic_clock>(std::chrono::microseconds(3)) == 3000, "us -> ns ticks");
+static_assert(lib_clock::to_ticks<lib_clock::coarse_clock>(std::chrono::seconds(2)) == 2000000000LL, "s -> ns ticks");
+static_assert(lib_clock::to_ticks<lib_clock::cached_clock>(std::chrono::duration<double, std::milli>(1.5)) == 1500000, "fractional ms -> ns ticks");
+static_assert(lib_clock::to_duration<lib_clock::monotonic_clock>(1500) == std::chrono::nanoseconds(1500), "ns ticks -> duration");
+static_assert(std::chrono::duration_cast<std::chrono::microseconds>(lib_clock::to_duration<lib_clock::tsc_clock>(2500)).count() == 2, "truncation");
+
+// the wrappers add no state to the time points
+static_assert(sizeof(lib_clock::monotonic_clock::time_point) == sizeof(std::int64_t), "time_point size");
+static_assert(sizeof(lib_clock::stopwatch<>) == sizeof(std::int64_t), "stopwatch size");
+static_assert(sizeof(lib_clock::deadline<lib_clock::tsc_clock>) == sizeof(std::int64_t), "deadline size");
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+template <class Read>
+static double bench_chrono__cost(Read _read, unsigned int _calls);
+static void bench_chrono__types(bench_json_t *_json);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	cost of the inline chrono clocks against the raw reads and the
+ * 			C API
+ * ****************************************************************************/
+extern "C" void bench_chrono__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	unsigned int calls = _cfg->quick ? CHRONO_QUICK_CALLS : CHRONO_CALLS;
+
+	bench_json__begin_object(_json, "monotonic");
+	bench_json__double(_json, "clock_gettime_ns", bench_chrono__cost([]() {
+		struct timespec tp;
+		clock_gettime(CLOCK_MONOTONIC, &tp);
+		return (std::uint64_t)tp.tv_nsec + (std::uint64_t)tp.tv_sec * 1000000000ULL;
+	}, calls));
+	bench_json__double(_json, "chrono_ns", bench_chrono__cost([]() {
+		return (std::uint64_t)lib_clock::monotonic_clock::now().time_since_epoch().count();
+	}, calls));
+	bench_json__double(_json, "get_time_ns", bench_chrono__cost([]() {
+		return lib_clock__get_time_ns();
+	}, calls));
+	bench_json__end_object(_json);
+
+	bench_json__begin_object(_json, "coarse");
+	bench_json__double(_json, "clock_gettime_ns", bench_chrono__cost([]() {
+		struct timespec tp;
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &tp);
+		return (std::uint64_t)tp.tv_nsec + (std::uint64_t)tp.tv_sec * 1000000000ULL;
+	}, calls));
+	bench_json__double(_json, "chrono_ns", bench_chrono__cost([]() {
+		return (std::uint64_t)lib_clock::coarse_clock::now().time_since_epoch().count();
+	}, calls));
+	bench_json__end_object(_json);
+
+	if (lib_clock__cached_start(CHRONO_CACHED_US) == 0) {
+		bench_json__begin_object(_json, "cached");
+		bench_json__double(_json, "get_cached_time_ns", bench_chrono__cost([]() {
+			return lib_clock__get_cached_time_ns();
+		}, calls));
+		bench_json__double(_json, "chrono_ns", bench_chrono__cost([]() {
+			return (std::uint64_t)lib_clock::cached_clock::now().time_since_epoch().count();
+		}, calls));
+		bench_json__end_object(_json);
+		lib_clock__cached_stop();
+	}
+
+	bench_json__begin_object(_json, "tsc");
+	bench_json__uint(_json, "available", lib_clock::tsc_clock::is_available() ? 1 : 0);
+#if defined(__x86_64__)
+	if (lib_clock::tsc_clock::is_available()) {
+		const lib_clock_tsc_conv_t &conv = lib_clock::detail::tsc().conv;
+
+		bench_json__double(_json, "rdtsc_ns", bench_chrono__cost([]() {
+			return (std::uint64_t)__rdtsc();
+		}, calls));
+		bench_json__double(_json, "rdtsc_scaled_ns", bench_chrono__cost([&conv]() {
+			return conv.ns_base + (std::uint64_t)(((__int128)(std::int64_t)(__rdtsc() - conv.tsc_base) * conv.mult) >> conv.shift);
+		}, calls));
+		bench_json__double(_json, "chrono_ticks_ns", bench_chrono__cost([]() {
+			return lib_clock::tsc_clock::ticks();
+		}, calls));
+		bench_json__double(_json, "chrono_ns", bench_chrono__cost([]() {
+			return (std::uint64_t)lib_clock::tsc_clock::now().time_since_epoch().count();
+		}, calls));
+		bench_json__int(_json, "offset_to_monotonic_ns",
+			(lib_clock::tsc_clock::now().time_since_epoch() - lib_clock::monotonic_clock::now().time_since_epoch()).count());
+	}
+#endif
+	{
+		// a ticks() difference against CLOCK_MONOTONIC, with and without a usable TSC
+		struct timespec rqtp = { 0, CHRONO_TICKS_SPAN_NS };
+		std::uint64_t t0 = lib_clock::tsc_clock::ticks();
+		lib_clock::monotonic_clock::time_point m0 = lib_clock::monotonic_clock::now();
+		std::int64_t error;
+
+		nanosleep(&rqtp, NULL);
+		error = (lib_clock::tsc_clock::ticks_to_duration(lib_clock::tsc_clock::ticks() - t0)
+			- (lib_clock::monotonic_clock::now() - m0)).count();
+		bench_json__int(_json, "ticks_to_duration_error_ns", error);
+		bench_json__string(_json, "result", ((error >= -CHRONO_TICKS_ERROR_NS) && (error <= CHRONO_TICKS_ERROR_NS)) ? "pass" : "fail");
+	}
+	bench_json__end_object(_json);
+
+	bench_chrono__types(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	stopwatch and deadline against the clock they wrap
+ * ****************************************************************************/
+static void bench_chrono__types(bench_json_t *_json)
+{
+	lib_clock::stopwatch<> watch;
+	lib_clock::deadline<> timeout(std::chrono::milliseconds(2));
+	std::uint64_t spins = 0;
+
+	while (!timeout.expired()) {
+		spins++;
+	}
+	bench__sink(spins);
+
+	bench_json__begin_object(_json, "types");
+	bench_json__int(_json, "deadline_2ms_elapsed_ns", watch.elapsed().count());
+	bench_json__int(_json, "remaining_after_expiry_ns", timeout.remaining().count());
+	bench_json__string(_json, "result", ((watch.lap() >= std::chrono::milliseconds(2)) && (timeout.remaining() == std::chrono::nanoseconds::zero())) ? "pass" : "fail");
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	mean cost of a read in the fastest of several rounds
+ * ****************************************************************************/
+template <class Read>
+static double bench_chrono__cost(Read _read, unsigned int _calls)
+{
+	double best = 0.0;
+	std::uint64_t start, elapsed;
+	unsigned int round, i;
+
+	for (round = 0; round < CHRONO_ROUNDS; round++) {
+		start = bench__ref_ns();
+		for (i = 0; i < _calls; i++) {
+			bench__sink(_read());
+		}
+		elapsed = bench__ref_ns() - start;
+		if ((round == 0) || ((double)elapsed < best)) {
+			best = (double)elapsed;
+		}
+	}
+
+	return best / _calls;
+}
@@ -0,0 +1,523 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <stdatomic.h>
+
+/* system */
+#include <pthread.h>
+#include <time.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_posix.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LATENCY_BATCH		16			// calls per latency sample
+#define RESOLUTION_READS	100000		// consecutive reads of the resolution run
+#define DRIFT_MIN_MS		2000		// minimal length of the drift run
+#define DRIFT_STEP_MS		100			// drift sampling interval
+#define DRIFT_PAIRS			8			// bracketed reads per sample, the tightest one is used
+#define DRIFT_MAX_PPM		10.0		// calibration error of the TSC against CLOCK_MONOTONIC
+#define DELAY_BUDGET_NS		300000000ULL	// time spent per delay measurement
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	const char	*name;
+	uint64_t	(*read)(void);
+} bench_clock_api_t;
+
+typedef struct {
+	const bench_clock_api_t	*api;
+	_Atomic int				*go;
+	_Atomic int				*stop;
+	uint64_t				calls;
+} bench_clock_worker_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t bench_clock__ms(void);
+static uint64_t bench_clock__cached_ms(void);
+static uint64_t bench_clock__raw_monotonic(void);
+static void bench_clock__latency(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_clock__throughput(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void *bench_clock__worker(void *_arg);
+static unsigned int bench_clock__next_threads(unsigned int _n, unsigned int _max);
+static void bench_clock__resolution(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_clock__delay(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_clock__drift(bench_json_t *_json, const bench_cfg_t *_cfg);
+static int64_t bench_clock__drift_offset(void);
+static void bench_clock__cached(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_clock__sleep_ms(unsigned int _ms);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const bench_clock_api_t s_apis[] = {
+	{ "get_time_ns",			&lib_clock__get_time_ns },
+	{ "get_time_us",			&lib_clock__get_time_us },
+	{ "get_time_ms",			&bench_clock__ms },
+	{ "get_clock_ticks",		&lib_clock__get_clock_ticks },
+	{ "get_cached_time_ns",		&lib_clock__get_cached_time_ns },
+	{ "get_cached_time_ms",		&bench_clock__cached_ms },
+	{ "clock_gettime_monotonic",	&bench_clock__raw_monotonic },
+};
+#define API_COUNT	(sizeof(s_apis) / sizeof(s_apis[0]))
+
+static const struct {
+	const char					*name;
+	lib_clock_delay_policy_t	policy;
+} s_policies[] = {
+	{ "sleep",	LIB_CLOCK_DELAY_SLEEP },
+	{ "hybrid",	LIB_CLOCK_DELAY_HYBRID },
+	{ "spin",	LIB_CLOCK_DELAY_SPIN },
+};
+
+static const uint32_t s_delays_us[] = { 1, 10, 50, 100, 500, 1000, 10000 };
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	core lib_clock API benchmark section
+ * ****************************************************************************/
+void bench_clock__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	bench_clock__latency(_json, _cfg);
+	bench_clock__throughput(_json, _cfg);
+	bench_clock__resolution(_json, _cfg);
+	bench_clock__delay(_json, _cfg);
+	bench_clock__drift(_json, _cfg);
+	bench_clock__cached(_json, _cfg);
+}
+
+/* ************************************************************************//**
+ * \brief	per-call latency in ns, each sample averages a small batch
+ * ****************************************************************************/
+static void bench_clock__latency(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	bench_stats_t stats;
+	double *samples;
+	size_t a;
+	unsigned int i, j;
+
+	samples = malloc(_cfg->samples * sizeof(double));
+	if (samples == NULL) {
+		return;
+	}
+
+	bench_json__begin_object(_json, "latency_ns");
+	for (a = 0; a < API_COUNT; a++) {
+		for (i = 0; i < _cfg->samples; i++) {
+			uint64_t start = bench__ref_ns();
+			for (j = 0; j < LATENCY_BATCH; j++) {
+				bench__sink(s_apis[a].read());
+			}
+			samples[i] = (double)(bench__ref_ns() - start) / LATENCY_BATCH;
+		}
+		bench__stats(samples, _cfg->samples, &stats);
+		bench_json__stats(_json, s_apis[a].name, &stats);
+	}
+	bench_json__end_object(_json);
+
+	free(samples);
+}
+
+/* ************************************************************************//**
+ * \brief	aggregated calls per second for 1, 2, 4 .. max_threads threads
+ * ****************************************************************************/
+static void bench_clock__throughput(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	bench_clock_worker_t *workers;
+	pthread_t *threads;
+	_Atomic int go, stop;
+	unsigned int n, t, started;
+	size_t a;
+
+	workers = calloc(_cfg->max_threads, sizeof(*workers));
+	threads = calloc(_cfg->max_threads, sizeof(*threads));
+	if ((workers == NULL) || (threads == NULL)) {
+		free(workers);
+		free(threads);
+		return;
+	}
+
+	bench_json__begin_object(_json, "throughput_calls_per_s");
+	for (a = 0; a < API_COUNT; a++) {
+		bench_json__begin_array(_json, s_apis[a].name);
+		for (n = 1; n <= _cfg->max_threads; n = bench_clock__next_threads(n, _cfg->max_threads)) {
+			uint64_t total = 0;
+
+			atomic_store(&go, 0);
+			atomic_store(&stop, 0);
+			for (started = 0; started < n; started++) {
+				workers[started].api = &s_apis[a];
+				workers[started].go = &go;
+				workers[started].stop = &stop;
+				workers[started].calls = 0;
+				if (pthread_create(&threads[started], NULL, &bench_clock__worker, &workers[started]) != 0) {
+					break;
+				}
+			}
+
+			atomic_store(&go, 1);
+			bench_clock__sleep_ms(_cfg->duration_ms);
+			atomic_store(&stop, 1);
+
+			for (t = 0; t < started; t++) {
+				pthread_join(threads[t], NULL);
+				total += workers[t].calls;
+			}
+
+			bench_json__begin_object(_json, NULL);
+			bench_json__uint(_json, "threads", started);
+			bench_json__double(_json, "calls_per_s", (double)total * 1000.0 / (double)_cfg->duration_ms);
+			bench_json__end_object(_json);
+		}
+		bench_json__end_array(_json);
+	}
+	bench_json__end_object(_json);
+
+	free(workers);
+	free(threads);
+}
+
+/* 1, 2, 4 .. up to _max, _max itself is always part of the series */
+static unsigned int bench_clock__next_threads(unsigned int _n, unsigned int _max)
+{
+	if (_n == _max) {
+		return _max + 1;
+	}
+	return (_n * 2 > _max) ? _max : _n * 2;
+}
+
+static void *bench_clock__worker(void *_arg)
+{
+	bench_clock_worker_t *worker = (bench_clock_worker_t *)_arg;
+	uint64_t calls = 0;
+	int i;
+
+	while (!atomic_load_explicit(worker->go, memory_order_relaxed)) {
+	}
+
+	while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+		for (i = 0; i < 64; i++) {
+			bench__sink(worker->api->read());
+		}
+		calls += 64;
+	}
+
+	worker->calls = calls;
+	return NULL;
+}
+
+/* ************************************************************************//**
+ * \brief	observed step sizes and monotonicity of consecutive reads
+ * ****************************************************************************/
+static void bench_clock__resolution(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	size_t a;
+	unsigned int i;
+
+	(void)_cfg;
+
+	bench_json__begin_object(_json, "resolution");
+	for (a = 0; a < API_COUNT; a++) {
+		uint64_t prev, now, step, min_step = UINT64_MAX, max_step = 0;
+		uint64_t zero_steps = 0, backward_steps = 0;
+
+		prev = s_apis[a].read();
+		for (i = 0; i < RESOLUTION_READS; i++) {
+			now = s_apis[a].read();
+			if (now < prev) {
+				backward_steps++;
+			}
+			else if (now == prev) {
+				zero_steps++;
+			}
+			else {
+				step = now - prev;
+				if (step < min_step) {
+					min_step = step;
+				}
+				if (step > max_step) {
+					max_step = step;
+				}
+			}
+			prev = now;
+		}
+
+		bench_json__begin_object(_json, s_apis[a].name);
+		bench_json__uint(_json, "reads", RESOLUTION_READS);
+		bench_json__uint(_json, "min_step", (min_step == UINT64_MAX) ? 0 : min_step);
+		bench_json__uint(_json, "max_step", max_step);
+		bench_json__uint(_json, "zero_steps", zero_steps);
+		bench_json__uint(_json, "backward_steps", backward_steps);
+		bench_json__end_object(_json);
+	}
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	delay_us overshoot in ns per requested duration and policy
+ * ****************************************************************************/
+static void bench_clock__delay(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	lib_clock_delay_policy_t saved = lib_clock__get_delay_policy();
+	bench_stats_t stats;
+	double *samples;
+	size_t p, d;
+	unsigned int i, count;
+
+	samples = malloc(_cfg->samples * sizeof(double));
+	if (samples == NULL) {
+		return;
+	}
+
+	bench_json__begin_object(_json, "delay_overshoot_ns");
+	for (p = 0; p < sizeof(s_policies) / sizeof(s_policies[0]); p++) {
+		lib_clock__set_delay_policy(s_policies[p].policy);
+		bench_json__begin_array(_json, s_policies[p].name);
+		for (d = 0; d < sizeof(s_delays_us) / sizeof(s_delays_us[0]); d++) {
+			uint64_t requested = (uint64_t)s_delays_us[d] * 1000ULL;
+
+			count = (unsigned int)(DELAY_BUDGET_NS / (requested + 50000ULL));
+			if (_cfg->quick) {
+				count /= 10;
+			}
+			if (count > _cfg->samples) {
+				count = _cfg->samples;
+			}
+			if (count < 10) {
+				count = 10;
+			}
+			if (count > _cfg->samples) {
+				count = _cfg->samples;
+			}
+
+			for (i = 0; i < count; i++) {
+				uint64_t start = bench__ref_ns();
+				lib_clock__delay_us(s_delays_us[d]);
+				samples[i] = (double)(int64_t)(bench__ref_ns() - start - requested);
+			}
+			bench__stats(samples, count, &stats);
+
+			bench_json__begin_object(_json, NULL);
+			bench_json__uint(_json, "delay_us", s_delays_us[d]);
+			bench_json__uint(_json, "runs", count);
+			bench_json__stats(_json, "overshoot_ns", &stats);
+			bench_json__end_object(_json);
+		}
+		bench_json__end_array(_json);
+	}
+	bench_json__end_object(_json);
+	bench_json__uint(_json, "delay_slack_ns", lib_clock__get_delay_slack_ns());
+
+	lib_clock__set_delay_policy(saved);
+	free(samples);
+}
+
+/* ************************************************************************//**
+ * \brief	offset of the TSC backed lib_clock__get_time_ns against
+ * 			CLOCK_MONOTONIC over time
+ *
+ * The TSC is forced for the nanosecond API, the drift bounds the error
+ * of its calibration. The previous sources are restored afterwards.
+ * ****************************************************************************/
+static void bench_clock__drift(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	unsigned int duration = (_cfg->duration_ms > DRIFT_MIN_MS) ? _cfg->duration_ms : DRIFT_MIN_MS;
+	int64_t offset, first = 0, last = 0, min = INT64_MAX, max = INT64_MIN;
+	lib_clock_cfg_t saved = { 0 }, tsc;
+	lib_clock_src_info_t info;
+	uint64_t start;
+	unsigned int elapsed;
+	double ppm;
+	int api;
+
+	if (_cfg->quick) {
+		duration /= 4;
+	}
+
+	for (api = 0; api < LIB_CLOCK_API_COUNT; api++) {
+		if (lib_clock__get_source_info((lib_clock_api_t)api, &info) == 0) {
+			saved.source[api] = info.source;
+		}
+	}
+	tsc = saved;
+	tsc.source[LIB_CLOCK_API_NS] = LIB_CLOCK_SRC_TSC;
+
+	bench_json__begin_object(_json, "drift_vs_monotonic");
+	if ((lib_clock__init_cfg(&tsc) < 0) || (lib_clock__get_source_info(LIB_CLOCK_API_NS, &info) < 0)
+		|| (info.source != LIB_CLOCK_SRC_TSC)) {
+		bench_json__string(_json, "skipped", "TSC not available");
+		bench_json__end_object(_json);
+		lib_clock__init_cfg(&saved);
+		return;
+	}
+
+	start = bench__ref_ns();
+	for (elapsed = 0; elapsed <= duration; elapsed += DRIFT_STEP_MS) {
+		offset = bench_clock__drift_offset();
+		if (elapsed == 0) {
+			first = offset;
+		}
+		last = offset;
+		if (offset < min) {
+			min = offset;
+		}
+		if (offset > max) {
+			max = offset;
+		}
+		bench_clock__sleep_ms(DRIFT_STEP_MS);
+	}
+
+	// 1ns of drift per ms run time is 1ppm
+	elapsed = (unsigned int)((bench__ref_ns() - start) / 1000000ULL);
+	ppm = (double)(last - first) / (double)(elapsed ? elapsed : 1);
+
+	bench_json__string(_json, "source", info.name);
+	bench_json__uint(_json, "duration_ms", elapsed);
+	bench_json__int(_json, "offset_min_ns", min);
+	bench_json__int(_json, "offset_max_ns", max);
+	bench_json__int(_json, "drift_ns", last - first);
+	bench_json__double(_json, "drift_ppm", ppm);
+	bench_json__double(_json, "drift_bound_ppm", DRIFT_MAX_PPM);
+	bench_json__string(_json, "result", ((ppm >= -DRIFT_MAX_PPM) && (ppm <= DRIFT_MAX_PPM)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+
+	lib_clock__init_cfg(&saved);
+}
+
+/* ************************************************************************//**
+ * \brief	lib_clock__get_time_ns minus CLOCK_MONOTONIC
+ *
+ * The reading is bracketed by two CLOCK_MONOTONIC readings, the tightest
+ * bracket is used, so a preemption does not show up as drift.
+ * ****************************************************************************/
+static int64_t bench_clock__drift_offset(void)
+{
+	uint64_t before, after, lib, width = UINT64_MAX;
+	int64_t offset = 0;
+	int i;
+
+	for (i = 0; i < DRIFT_PAIRS; i++) {
+		before = bench_clock__raw_monotonic();
+		lib = lib_clock__get_time_ns();
+		after = bench_clock__raw_monotonic();
+		if (after - before < width) {
+			width = after - before;
+			offset = (int64_t)(lib - (before + width / 2));
+		}
+	}
+
+	return offset;
+}
+
+/* ************************************************************************//**
+ * \brief	staleness of the cached clock against lib_clock__get_time_ns
+ * ****************************************************************************/
+static void bench_clock__cached(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	static const uint32_t periods_us[] = { 100, 1000 };
+	bench_stats_t stats;
+	double *samples;
+	size_t p;
+	unsigned int i;
+
+	samples = malloc(_cfg->samples * sizeof(double));
+	if (samples == NULL) {
+		return;
+	}
+
+	bench_json__begin_array(_json, "cached_staleness_ns");
+	for (p = 0; p < sizeof(periods_us) / sizeof(periods_us[0]); p++) {
+		// a ticker started by lib_clock__init stays untouched
+		if (lib_clock__cached_start(periods_us[p]) != 0) {
+			break;
+		}
+
+		for (i = 0; i < _cfg->samples; i++) {
+			uint64_t cached = lib_clock__get_cached_time_ns();
+			uint64_t now = lib_clock__get_time_ns();
+
+			samples[i] = (double)(int64_t)(now - cached);
+			if ((i % 64) == 0) {
+				lib_clock__delay_us(7);
+			}
+		}
+		bench__stats(samples, _cfg->samples, &stats);
+
+		bench_json__begin_object(_json, NULL);
+		bench_json__uint(_json, "period_us", periods_us[p]);
+		bench_json__stats(_json, "staleness_ns", &stats);
+		bench_json__uint(_json, "max_update_gap_ns", lib_clock__cached_max_staleness_ns());
+		bench_json__end_object(_json);
+
+		lib_clock__cached_stop();
+	}
+	bench_json__end_array(_json);
+
+	free(samples);
+}
+
+static uint64_t bench_clock__ms(void)
+{
+	return lib_clock__get_time_ms();
+}
+
+static uint64_t bench_clock__cached_ms(void)
+{
+	return lib_clock__get_cached_time_ms();
+}
+
+static uint64_t bench_clock__raw_monotonic(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
+
+static void bench_clock__sleep_ms(unsigned int _ms)
+{
+	struct timespec rqtp;
+
+	rqtp.tv_sec = (time_t)(_ms / 1000);
+	rqtp.tv_nsec = (long)(_ms % 1000) * 1000000L;
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+}
@@ -0,0 +1,282 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_codec.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define CODEC_VALUES			4000000U	// timestamps per stream
+#define CODEC_DECODE_CHUNK		4096U		// values per decode call
+#define CODEC_SEEKS				1000U
+#define CODEC_START_NS			1700000000000000000ULL
+#define CODEC_PERIOD_NS			1000000ULL	// 1kHz sampling
+#define CODEC_JITTER_NS			1000U		// +-1us around the nominal sample time
+#define CODEC_BURST				64U			// values per burst
+#define CODEC_BURST_SPACING_NS	250U
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef enum {
+	CODEC_REGULAR = 0,
+	CODEC_JITTERED,
+	CODEC_BURSTY,
+	CODEC_STREAMS
+} bench_codec_stream_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_codec__generate(uint64_t *_values, size_t _count, bench_codec_stream_t _stream);
+static void bench_codec__stream(bench_json_t *_json, const char *_name, const uint64_t *_values, size_t _count, uint64_t *_out, uint8_t *_buf, size_t _size);
+static int64_t bench_codec__decode_all(const void *_data, size_t _size, uint64_t *_out, size_t _max);
+static uint64_t bench_codec__seek_errors(const void *_data, size_t _size, const uint64_t *_values, size_t _count);
+static uint64_t bench_codec__rand(uint64_t *_state);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const char *s_stream_names[CODEC_STREAMS] = { "regular", "jittered", "bursty" };
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	compression ratio and encode / decode throughput of the
+ * 			delta-of-delta codec on synthetic capture streams
+ * ****************************************************************************/
+void bench_codec__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	size_t count = _cfg->quick ? CODEC_VALUES / 10 : CODEC_VALUES;
+	size_t size = count * 10U + LIB_CLOCK_CODEC_HEADER_SIZE;
+	uint64_t *values, *out;
+	uint8_t *buf;
+	int s;
+
+	values = malloc(count * sizeof(*values));
+	out = malloc(count * sizeof(*out));
+	buf = malloc(size);
+	if ((values == NULL) || (out == NULL) || (buf == NULL)) {
+		goto CLEANUP;
+	}
+
+	for (s = 0; s < CODEC_STREAMS; s++) {
+		bench_codec__generate(values, count, (bench_codec_stream_t)s);
+		bench_codec__stream(_json, s_stream_names[s], values, count, out, buf, size);
+	}
+
+CLEANUP:
+	free(values);
+	free(out);
+	free(buf);
+}
+
+/* ************************************************************************//**
+ * \brief	encode, decode from memory and from a mmap'd file, seek
+ * ****************************************************************************/
+static void bench_codec__stream(bench_json_t *_json, const char *_name, const uint64_t *_values, size_t _count, uint64_t *_out, uint8_t *_buf, size_t _size)
+{
+	char path[] = "/tmp/lib_clock_codec_XXXXXX";
+	lib_clock_codec_enc_t enc;
+	uint64_t start, enc_ns = UINT64_MAX, dec_ns = UINT64_MAX, mmap_ns = UINT64_MAX, elapsed;
+	uint64_t mismatch = 0, seek_errors = 0;
+	size_t bytes = 0, i;
+	int64_t decoded = 0;
+	void *map = MAP_FAILED;
+	int round, fd;
+
+	for (round = 0; round < 3; round++) {
+		start = bench__ref_ns();
+		lib_clock__codec_enc_init(&enc, _buf, _size, 0);
+		lib_clock__codec_append_n(&enc, _values, _count);
+		bytes = lib_clock__codec_flush(&enc);
+		elapsed = bench__ref_ns() - start;
+		enc_ns = (elapsed < enc_ns) ? elapsed : enc_ns;
+
+		start = bench__ref_ns();
+		decoded = bench_codec__decode_all(_buf, bytes, _out, _count);
+		elapsed = bench__ref_ns() - start;
+		dec_ns = (elapsed < dec_ns) ? elapsed : dec_ns;
+	}
+	mismatch += ((size_t)decoded != _count) || (memcmp(_values, _out, _count * sizeof(*_out)) != 0);
+	seek_errors = bench_codec__seek_errors(_buf, bytes, _values, _count);
+
+	// the decoder reads the blocks in place from the page cache
+	fd = mkstemp(path);
+	if (fd >= 0) {
+		if (write(fd, _buf, bytes) == (ssize_t)bytes) {
+			map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		unlink(path);
+	}
+	if (map != MAP_FAILED) {
+		memset(_out, 0, _count * sizeof(*_out));
+		for (round = 0; round < 3; round++) {
+			start = bench__ref_ns();
+			decoded = bench_codec__decode_all(map, bytes, _out, _count);
+			elapsed = bench__ref_ns() - start;
+			mmap_ns = (elapsed < mmap_ns) ? elapsed : mmap_ns;
+		}
+		mismatch += ((size_t)decoded != _count) || (memcmp(_values, _out, _count * sizeof(*_out)) != 0);
+		munmap(map, bytes);
+	}
+
+	for (i = 0; i < _count; i++) {
+		bench__sink(_out[i]);
+	}
+
+	bench_json__begin_object(_json, _name);
+	bench_json__uint(_json, "values", _count);
+	bench_json__uint(_json, "encoded_bytes", bytes);
+	bench_json__double(_json, "bits_per_value", (double)bytes * 8.0 / (double)_count);
+	bench_json__double(_json, "ratio", (double)(_count * sizeof(uint64_t)) / (double)bytes);
+	bench_json__double(_json, "encode_gbps", (double)(_count * sizeof(uint64_t)) / (double)enc_ns);
+	bench_json__double(_json, "decode_gbps", (double)(_count * sizeof(uint64_t)) / (double)dec_ns);
+	if (mmap_ns != UINT64_MAX) {
+		bench_json__double(_json, "decode_mmap_gbps", (double)(_count * sizeof(uint64_t)) / (double)mmap_ns);
+	}
+	bench_json__uint(_json, "seek_errors", seek_errors);
+	bench_json__string(_json, "result", ((mismatch == 0) && (seek_errors == 0)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	decode a whole stream in chunks
+ * ****************************************************************************/
+static int64_t bench_codec__decode_all(const void *_data, size_t _size, uint64_t *_out, size_t _max)
+{
+	lib_clock_codec_dec_t dec;
+	size_t total = 0;
+	int64_t n;
+
+	lib_clock__codec_dec_init(&dec, _data, _size);
+	while (total < _max) {
+		n = lib_clock__codec_decode(&dec, &_out[total], (_max - total < CODEC_DECODE_CHUNK) ? _max - total : CODEC_DECODE_CHUNK);
+		if (n <= 0) {
+			break;
+		}
+		total += (size_t)n;
+	}
+
+	return (int64_t)total;
+}
+
+/* ************************************************************************//**
+ * \brief	seek to random values and decode forward until they are found
+ * ****************************************************************************/
+static uint64_t bench_codec__seek_errors(const void *_data, size_t _size, const uint64_t *_values, size_t _count)
+{
+	lib_clock_codec_dec_t dec;
+	uint64_t state = 0x853C49E6748FEA9BULL, errors = 0, value;
+	uint32_t i, k;
+	int found;
+
+	for (i = 0; i < CODEC_SEEKS; i++) {
+		uint64_t wanted = _values[bench_codec__rand(&state) % _count];
+
+		lib_clock__codec_dec_init(&dec, _data, _size);
+		if (lib_clock__codec_seek(&dec, wanted, NULL) < 0) {
+			errors++;
+			continue;
+		}
+
+		// the wanted value is within the block the decoder was placed at
+		found = 0;
+		for (k = 0; k < LIB_CLOCK_CODEC_BLOCK_VALUES; k++) {
+			if ((lib_clock__codec_decode(&dec, &value, 1) != 1) || (value > wanted)) {
+				break;
+			}
+			if (value == wanted) {
+				found = 1;
+				break;
+			}
+		}
+		errors += !found;
+	}
+
+	return errors;
+}
+
+/* ************************************************************************//**
+ * \brief	synthetic capture streams
+ *
+ * regular:		exact 1kHz sampling
+ * jittered:	1kHz sampling, every sample off by up to +-1us
+ * bursty:		bursts of 64 values 250ns apart, 0.5...5ms between bursts
+ * ****************************************************************************/
+static void bench_codec__generate(uint64_t *_values, size_t _count, bench_codec_stream_t _stream)
+{
+	uint64_t state = 0x9E3779B97F4A7C15ULL, t = CODEC_START_NS;
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		switch (_stream) {
+			case CODEC_REGULAR:
+				_values[i] = CODEC_START_NS + i * CODEC_PERIOD_NS;
+				break;
+
+			case CODEC_JITTERED:
+				_values[i] = CODEC_START_NS + i * CODEC_PERIOD_NS + bench_codec__rand(&state) % (2U * CODEC_JITTER_NS + 1U) - CODEC_JITTER_NS;
+				break;
+
+			default:
+				if ((i % CODEC_BURST) == 0) {
+					t += 500000U + bench_codec__rand(&state) % 4500000U;
+				}
+				else {
+					t += CODEC_BURST_SPACING_NS + bench_codec__rand(&state) % 8U;
+				}
+				_values[i] = t;
+				break;
+		}
+	}
+}
+
+static uint64_t bench_codec__rand(uint64_t *_state)
+{
+	*_state ^= *_state << 13;
+	*_state ^= *_state >> 7;
+	*_state ^= *_state << 17;
+	return *_state;
+}
@@ -0,0 +1,214 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <time.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_format.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define FORMAT_CALLS			1000000U	// calls per cost measurement
+#define FORMAT_CHECKS			1000000U	// random timestamps of the correctness check
+#define FORMAT_LOG_STEP_NS		1234567ULL	// spacing of consecutive log lines
+#define FORMAT_DECIMAL_MAX_NS	10000000000000000000ULL	// 10 digit seconds field
+#define FORMAT_EPOCH_MAX_NS		(16725225600ULL * 1000000000ULL)	// random timestamps up to 2500-01-01
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef int (*bench_format_fn_t)(char *_buf, size_t _size, uint64_t _value);
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static double bench_format__cost(bench_format_fn_t _fn, uint64_t _start, uint64_t _step);
+static int bench_format__iso(char *_buf, size_t _size, uint64_t _ns);
+static int bench_format__iso_nocache(char *_buf, size_t _size, uint64_t _ns);
+static int bench_format__sec_us_snprintf(char *_buf, size_t _size, uint64_t _us);
+static int bench_format__sec_ns_snprintf(char *_buf, size_t _size, uint64_t _ns);
+static int bench_format__iso_strftime(char *_buf, size_t _size, uint64_t _ns);
+static int bench_format__parse_iso(const char *_buf, uint64_t *_ns);
+static uint64_t bench_format__rand(uint64_t *_state);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static lib_clock_fmt_cache_t s_cache;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	formatter cost against snprintf / strftime and a round trip
+ * 			check over random timestamps
+ * ****************************************************************************/
+void bench_format__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	char buf[64], ref[64];
+	uint64_t checks = _cfg->quick ? FORMAT_CHECKS / 10 : FORMAT_CHECKS;
+	uint64_t state = 0x2545F4914F6CDD1DULL, ns, dec, parsed, i;
+	uint64_t mismatch = 0, roundtrip = 0;
+	uint64_t now = 1700000000ULL * 1000000000ULL;
+
+	lib_clock__fmt_cache_init(&s_cache);
+
+	// consecutive log lines, the date cache hits for most of them
+	bench_json__begin_object(_json, "cost_ns");
+	bench_json__double(_json, "sec_us_snprintf", bench_format__cost(&bench_format__sec_us_snprintf, now / 1000U, FORMAT_LOG_STEP_NS / 1000U));
+	bench_json__double(_json, "sec_us", bench_format__cost(&lib_clock__fmt_sec_us, now / 1000U, FORMAT_LOG_STEP_NS / 1000U));
+	bench_json__double(_json, "sec_ns_snprintf", bench_format__cost(&bench_format__sec_ns_snprintf, now, FORMAT_LOG_STEP_NS));
+	bench_json__double(_json, "sec_ns", bench_format__cost(&lib_clock__fmt_sec_ns, now, FORMAT_LOG_STEP_NS));
+	bench_json__double(_json, "iso_strftime", bench_format__cost(&bench_format__iso_strftime, now, FORMAT_LOG_STEP_NS));
+	bench_json__double(_json, "iso_cached", bench_format__cost(&bench_format__iso, now, FORMAT_LOG_STEP_NS));
+	bench_json__double(_json, "iso_uncached", bench_format__cost(&bench_format__iso_nocache, now, FORMAT_LOG_STEP_NS));
+	bench_json__end_object(_json);
+
+	// random timestamps: identical output to the libc reference and parsed back unchanged
+	for (i = 0; i < checks; i++) {
+		ns = bench_format__rand(&state) % FORMAT_EPOCH_MAX_NS;
+		dec = bench_format__rand(&state) % FORMAT_DECIMAL_MAX_NS;
+
+		lib_clock__fmt_sec_ns(buf, sizeof(buf), dec);
+		bench_format__sec_ns_snprintf(ref, sizeof(ref), dec);
+		mismatch += (strcmp(buf, ref) != 0);
+
+		lib_clock__fmt_sec_us(buf, sizeof(buf), dec / 1000U);
+		bench_format__sec_us_snprintf(ref, sizeof(ref), dec / 1000U);
+		mismatch += (strcmp(buf, ref) != 0);
+
+		// alternate between cache hits and misses
+		lib_clock__fmt_iso8601(buf, sizeof(buf), (i & 1) ? &s_cache : NULL, ns, 9);
+		bench_format__iso_strftime(ref, sizeof(ref), ns);
+		mismatch += (strcmp(buf, ref) != 0);
+
+		if ((bench_format__parse_iso(buf, &parsed) != 0) || (parsed != ns)) {
+			roundtrip++;
+		}
+	}
+
+	bench_json__begin_object(_json, "check");
+	bench_json__uint(_json, "timestamps", checks);
+	bench_json__uint(_json, "mismatches", mismatch);
+	bench_json__uint(_json, "roundtrip_errors", roundtrip);
+	bench_json__string(_json, "result", ((mismatch == 0) && (roundtrip == 0)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	ns per formatted timestamp
+ * ****************************************************************************/
+static double bench_format__cost(bench_format_fn_t _fn, uint64_t _start, uint64_t _step)
+{
+	char buf[64];
+	uint64_t start, elapsed, best = UINT64_MAX, value, i;
+	int round;
+
+	for (round = 0; round < 3; round++) {
+		value = _start;
+		start = bench__ref_ns();
+		for (i = 0; i < FORMAT_CALLS; i++) {
+			bench__sink((uint64_t)_fn(buf, sizeof(buf), value));
+			value += _step;
+		}
+		elapsed = bench__ref_ns() - start;
+		if (elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	return (double)best / FORMAT_CALLS;
+}
+
+static int bench_format__iso(char *_buf, size_t _size, uint64_t _ns)
+{
+	return lib_clock__fmt_iso8601(_buf, _size, &s_cache, _ns, 9);
+}
+
+static int bench_format__iso_nocache(char *_buf, size_t _size, uint64_t _ns)
+{
+	return lib_clock__fmt_iso8601(_buf, _size, NULL, _ns, 9);
+}
+
+static int bench_format__sec_us_snprintf(char *_buf, size_t _size, uint64_t _us)
+{
+	return snprintf(_buf, _size, "%010llu.%06llu", (unsigned long long)(_us / 1000000ULL), (unsigned long long)(_us % 1000000ULL));
+}
+
+static int bench_format__sec_ns_snprintf(char *_buf, size_t _size, uint64_t _ns)
+{
+	return snprintf(_buf, _size, "%010llu.%09llu", (unsigned long long)(_ns / 1000000000ULL), (unsigned long long)(_ns % 1000000000ULL));
+}
+
+static int bench_format__iso_strftime(char *_buf, size_t _size, uint64_t _ns)
+{
+	time_t sec = (time_t)(_ns / 1000000000ULL);
+	struct tm tm;
+	size_t len;
+
+	gmtime_r(&sec, &tm);
+	len = strftime(_buf, _size, "%Y-%m-%dT%H:%M:%S", &tm);
+	return (int)len + snprintf(&_buf[len], _size - len, ".%09lluZ", (unsigned long long)(_ns % 1000000000ULL));
+}
+
+static int bench_format__parse_iso(const char *_buf, uint64_t *_ns)
+{
+	unsigned long long frac;
+	struct tm tm;
+	char zone;
+
+	memset(&tm, 0, sizeof(tm));
+	if (sscanf(_buf, "%4d-%2d-%2dT%2d:%2d:%2d.%9llu%c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+			&tm.tm_hour, &tm.tm_min, &tm.tm_sec, &frac, &zone) != 8 || (zone != 'Z')) {
+		return -1;
+	}
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+
+	*_ns = (uint64_t)timegm(&tm) * 1000000000ULL + frac;
+	return 0;
+}
+
+static uint64_t bench_format__rand(uint64_t *_state)
+{
+	*_state ^= *_state << 13;
+	*_state ^= *_state >> 7;
+	*_state ^= *_state << 17;
+	return *_state;
+}
@@ -0,0 +1,158 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <math.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_histogram.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define HIST_HIGHEST		3600000000000ULL	// one hour in ns
+#define HIST_PRECISION		7
+#define HIST_BATCH			1024				// records per latency sample
+#define HIST_VALUES			(1U << 20)
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t bench_hist__rand(uint64_t *_state);
+static int bench_hist__cmp_u64(const void *_a, const void *_b);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	record and stopwatch cost, percentile accuracy
+ * ****************************************************************************/
+void bench_hist__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+	lib_clock_hist_t *hist;
+	bench_stats_t stats;
+	uint64_t *values, state = 0x9E3779B97F4A7C15ULL;
+	double *samples, max_error = 0.0;
+	unsigned int i, j, count = _cfg->quick ? HIST_VALUES / 16 : HIST_VALUES;
+	size_t p;
+
+	hist = lib_clock__hist_create(HIST_HIGHEST, HIST_PRECISION);
+	samples = malloc(_cfg->samples * sizeof(double));
+	values = malloc(count * sizeof(uint64_t));
+	if ((hist == NULL) || (samples == NULL) || (values == NULL)) {
+		goto CLEANUP;
+	}
+
+	// heavy tailed latencies: log-uniform between 100ns and 10ms
+	for (i = 0; i < count; i++) {
+		double u = (double)(bench_hist__rand(&state) >> 11) / 9007199254740992.0;
+		values[i] = (uint64_t)(100.0 * pow(100000.0, u));
+	}
+
+	bench_json__uint(_json, "precision_bits", HIST_PRECISION);
+	bench_json__uint(_json, "mem_size", lib_clock__hist_mem_size(HIST_HIGHEST, HIST_PRECISION));
+
+	for (i = 0; i < _cfg->samples; i++) {
+		const uint64_t *batch = &values[(i * HIST_BATCH) % (count - HIST_BATCH)];
+		uint64_t start = bench__ref_ns();
+		for (j = 0; j < HIST_BATCH; j++) {
+			lib_clock__hist_record(hist, batch[j]);
+		}
+		samples[i] = (double)(bench__ref_ns() - start) / HIST_BATCH;
+	}
+	bench__stats(samples, _cfg->samples, &stats);
+	bench_json__stats(_json, "record_ns", &stats);
+
+	for (i = 0; i < _cfg->samples; i++) {
+		uint64_t start = bench__ref_ns();
+		for (j = 0; j < HIST_BATCH; j++) {
+			LIB_CLOCK_STOPWATCH_SCOPED(sw, hist);
+		}
+		samples[i] = (double)(bench__ref_ns() - start) / HIST_BATCH;
+	}
+	bench__stats(samples, _cfg->samples, &stats);
+	bench_json__stats(_json, "scoped_stopwatch_ns", &stats);
+
+	// percentile accuracy against the exact percentiles of the sorted input
+	lib_clock__hist_reset(hist);
+	for (i = 0; i < count; i++) {
+		lib_clock__hist_record(hist, values[i]);
+	}
+	qsort(values, count, sizeof(uint64_t), &bench_hist__cmp_u64);
+
+	bench_json__begin_array(_json, "percentiles");
+	for (p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++) {
+		uint64_t rank = (uint64_t)(percentiles[p] / 100.0 * (double)count + 0.5);
+		uint64_t exact = values[(rank > 0) ? rank - 1 : 0];
+		uint64_t reported = lib_clock__hist_percentile(hist, percentiles[p]);
+		double error = fabs((double)reported - (double)exact) / (double)exact;
+
+		if (error > max_error) {
+			max_error = error;
+		}
+
+		bench_json__begin_object(_json, NULL);
+		bench_json__double(_json, "percentile", percentiles[p]);
+		bench_json__uint(_json, "exact", exact);
+		bench_json__uint(_json, "reported", reported);
+		bench_json__double(_json, "relative_error", error);
+		bench_json__end_object(_json);
+	}
+	bench_json__end_array(_json);
+	bench_json__double(_json, "max_relative_error", max_error);
+	bench_json__double(_json, "error_bound", ldexp(1.0, -HIST_PRECISION));
+	bench_json__string(_json, "result", (max_error <= ldexp(1.0, -HIST_PRECISION)) ? "pass" : "fail");
+
+CLEANUP:
+	lib_clock__hist_destroy(hist);
+	free(samples);
+	free(values);
+}
+
+/* xorshift64*, deterministic input for comparable runs */
+static uint64_t bench_hist__rand(uint64_t *_state)
+{
+	*_state ^= *_state >> 12;
+	*_state ^= *_state << 25;
+	*_state ^= *_state >> 27;
+	return *_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int bench_hist__cmp_u64(const void *_a, const void *_b)
+{
+	uint64_t a = *(const uint64_t *)_a;
+	uint64_t b = *(const uint64_t *)_b;
+
+	return (a > b) - (a < b);
+}
@@ -0,0 +1,251 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <string.h>
+
+/* system */
+#include <time.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_monitor.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define MONITOR_PERIOD_US		10000U		// simulated sampling period
+#define MONITOR_SAMPLES			(2 * LIB_CLOCK_MONITOR_WINDOW)	// samples per scenario
+#define MONITOR_FAST_NS			20U			// read cost of a TSC like source
+#define MONITOR_SLOW_NS			1500U		// read cost of an HPET fallback
+#define MONITOR_MAX_COST_NS		500.0
+#define MONITOR_DRIFT_PPB		100000LL	// 100ppm
+#define MONITOR_MAX_DRIFT_PPB	50000U
+#define MONITOR_NOISE_NS		50000U		// +-50us
+#define MONITOR_MAX_JITTER_NS	10000U
+#define MONITOR_STEP_NS			50000000LL	// simulated clock step, +50ms
+#define MONITOR_SUSPEND_NS		2000000000ULL	// simulated suspend, the reference runs on
+#define MONITOR_LIVE_MS			500U
+#define MONITOR_LIVE_QUICK_MS	200U
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* injected clocks: every read advances the true time by its cost */
+typedef struct {
+	uint64_t	true_ns;
+	uint32_t	src_cost_ns;
+	uint32_t	ref_cost_ns;
+	uint32_t	resolution_ns;
+	int64_t		drift_ppb;
+	int64_t		offset_ns;
+	uint32_t	noise_ns;
+	uint32_t	seed;
+} bench_monitor_sim_t;
+
+/* a simulated fault and the events it has to raise */
+typedef struct {
+	const char	*name;
+	uint32_t	src_cost_ns;
+	int64_t		drift_ppb;
+	uint32_t	noise_ns;
+	int64_t		step_ns;		// applied to the source half way
+	uint64_t	suspend_ns;		// applied to the true time behind the source half way
+	uint32_t	expected;
+} bench_monitor_case_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t bench_monitor__source(void *_arg);
+static uint64_t bench_monitor__reference(void *_arg);
+static void bench_monitor__callback(uint32_t _events, const lib_clock_monitor_stats_t *_stats, void *_arg);
+static void bench_monitor__scenarios(bench_json_t *_json);
+static void bench_monitor__live(bench_json_t *_json, const bench_cfg_t *_cfg);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const bench_monitor_case_t s_bench_monitor_cases[] = {
+	{ "steady",		MONITOR_FAST_NS, 0, 0, 0, 0, 0 },
+	{ "slow_source",	MONITOR_SLOW_NS, 0, 0, 0, 0, LIB_CLOCK_MONITOR_COST },
+	{ "drift",		MONITOR_FAST_NS, MONITOR_DRIFT_PPB, 0, 0, 0, LIB_CLOCK_MONITOR_DRIFT },
+	{ "jitter",		MONITOR_FAST_NS, 0, MONITOR_NOISE_NS, 0, 0, LIB_CLOCK_MONITOR_JITTER },
+	{ "step",		MONITOR_FAST_NS, 0, 0, MONITOR_STEP_NS, 0, LIB_CLOCK_MONITOR_STEP_FWD },
+	{ "step_back",	MONITOR_FAST_NS, 0, 0, -MONITOR_STEP_NS, 0, LIB_CLOCK_MONITOR_STEP_BACK },
+	{ "suspend",	MONITOR_FAST_NS, 0, 0, 0, MONITOR_SUSPEND_NS, LIB_CLOCK_MONITOR_STEP_BACK },
+};
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	detection of simulated clock faults and the cost of monitoring
+ * 			the real clock
+ * ****************************************************************************/
+void bench_monitor__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	bench_monitor__scenarios(_json);
+	bench_monitor__live(_json, _cfg);
+}
+
+/* ************************************************************************//**
+ * \brief	each fault raises exactly its events, with the source and the
+ * 			reference injected
+ * ****************************************************************************/
+static void bench_monitor__scenarios(bench_json_t *_json)
+{
+	const bench_monitor_case_t *test;
+	lib_clock_monitor_stats_t stats;
+	bench_monitor_sim_t sim;
+	uint32_t events, i, j;
+	lib_clock_monitor_cfg_t cfg = {
+		.period_us = MONITOR_PERIOD_US,
+		.manual = 1,
+		.source = &bench_monitor__source,
+		.reference = &bench_monitor__reference,
+		.arg = &sim,
+		.max_read_cost_ns = MONITOR_MAX_COST_NS,
+		.max_jitter_ns = MONITOR_MAX_JITTER_NS,
+		.max_drift_ppb = MONITOR_MAX_DRIFT_PPB,
+		.callback = &bench_monitor__callback,
+		.cb_arg = &events,
+	};
+
+	bench_json__begin_object(_json, "scenarios");
+	for (i = 0; i < sizeof(s_bench_monitor_cases) / sizeof(s_bench_monitor_cases[0]); i++) {
+		test = &s_bench_monitor_cases[i];
+
+		memset(&sim, 0, sizeof(sim));
+		sim.true_ns = 1000000000ULL;
+		sim.src_cost_ns = test->src_cost_ns;
+		sim.ref_cost_ns = MONITOR_FAST_NS;
+		sim.resolution_ns = 1;
+		sim.drift_ppb = test->drift_ppb;
+		sim.noise_ns = test->noise_ns;
+		sim.seed = 0x12345678U + i;
+		events = 0;
+
+		if (lib_clock__monitor_start(&cfg) < 0) {
+			break;
+		}
+		for (j = 0; j < MONITOR_SAMPLES; j++) {
+			if (j == MONITOR_SAMPLES / 2) {
+				sim.offset_ns += test->step_ns;
+				sim.true_ns += test->suspend_ns;
+				sim.offset_ns -= (int64_t)test->suspend_ns;
+			}
+			lib_clock__monitor_sample();
+			sim.true_ns += (uint64_t)MONITOR_PERIOD_US * 1000ULL;
+		}
+		lib_clock__monitor_get_stats(&stats);
+		lib_clock__monitor_stop();
+
+		bench_json__begin_object(_json, test->name);
+		bench_json__uint(_json, "events", events);
+		bench_json__uint(_json, "expected", test->expected);
+		bench_json__double(_json, "read_cost_ns", stats.read_cost_ns);
+		bench_json__uint(_json, "reads", stats.reads);
+		bench_json__uint(_json, "overhead_ppm", stats.overhead_ppm);
+		bench_json__int(_json, "drift_ppb", stats.drift_ppb);
+		bench_json__uint(_json, "jitter_ns", stats.jitter_ns);
+		bench_json__uint(_json, "steps_fwd", stats.steps_fwd);
+		bench_json__uint(_json, "steps_back", stats.steps_back);
+		bench_json__int(_json, "last_step_ns", stats.last_step_ns);
+		bench_json__string(_json, "result", (events == test->expected) ? "pass" : "fail");
+		bench_json__end_object(_json);
+	}
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	monitor the real clock with the sampling thread
+ * ****************************************************************************/
+static void bench_monitor__live(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	lib_clock_monitor_cfg_t cfg = { .period_us = MONITOR_PERIOD_US };
+	lib_clock_monitor_stats_t stats;
+	struct timespec rqtp;
+	unsigned int ms = _cfg->quick ? MONITOR_LIVE_QUICK_MS : MONITOR_LIVE_MS;
+
+	if (lib_clock__monitor_start(&cfg) < 0) {
+		return;
+	}
+	rqtp.tv_sec = (time_t)(ms / 1000U);
+	rqtp.tv_nsec = (long)(ms % 1000U) * 1000000L;
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+	lib_clock__monitor_stop();
+	lib_clock__monitor_get_stats(&stats);
+
+	bench_json__begin_object(_json, "live");
+	bench_json__uint(_json, "samples", stats.samples);
+	bench_json__uint(_json, "reads", stats.reads);
+	bench_json__double(_json, "read_cost_ns", stats.read_cost_ns);
+	bench_json__double(_json, "read_cost_max_ns", stats.read_cost_max_ns);
+	bench_json__uint(_json, "resolution_ns", stats.resolution_ns);
+	bench_json__int(_json, "drift_ppb", stats.drift_ppb);
+	bench_json__uint(_json, "jitter_ns", stats.jitter_ns);
+	bench_json__uint(_json, "steps", stats.steps_fwd + stats.steps_back);
+	bench_json__uint(_json, "overhead_ppm", stats.overhead_ppm);
+	bench_json__end_object(_json);
+}
+
+static void bench_monitor__callback(uint32_t _events, const lib_clock_monitor_stats_t *_stats, void *_arg)
+{
+	(void)_stats;
+	*(uint32_t *)_arg |= _events;
+}
+
+static uint64_t bench_monitor__source(void *_arg)
+{
+	bench_monitor_sim_t *sim = (bench_monitor_sim_t *)_arg;
+	int64_t value;
+
+	sim->true_ns += sim->src_cost_ns;
+	value = (int64_t)sim->true_ns + sim->offset_ns + (int64_t)((double)sim->true_ns * (double)sim->drift_ppb / 1e9);
+	if (sim->noise_ns != 0) {
+		sim->seed ^= sim->seed << 13;
+		sim->seed ^= sim->seed >> 17;
+		sim->seed ^= sim->seed << 5;
+		value += (int64_t)(sim->seed % (2U * sim->noise_ns + 1U)) - (int64_t)sim->noise_ns;
+	}
+
+	return (uint64_t)value - (uint64_t)value % sim->resolution_ns;
+}
+
+static uint64_t bench_monitor__reference(void *_arg)
+{
+	bench_monitor_sim_t *sim = (bench_monitor_sim_t *)_arg;
+
+	sim->true_ns += sim->ref_cost_ns;
+	return sim->true_ns;
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* system */
+#include <time.h>
+
+/* project */
+#include <lib_clock.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define PERIODIC_PERIOD_US		1000		// 1kHz control loop
+#define PERIODIC_MIN_MS			3000		// minimal run time
+#define PERIODIC_DRIFT_SLACK_NS	100000		// start of the run against the timer init, clock reads
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t bench_periodic__mono_ns(void);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	cumulative drift of a 1kHz loop, periodic timer against a
+ * 			relative delay loop
+ * ****************************************************************************/
+void bench_periodic__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	unsigned int duration = (_cfg->duration_ms > PERIODIC_MIN_MS) ? _cfg->duration_ms : PERIODIC_MIN_MS;
+	uint64_t loops, i, start, last, expected;
+	int64_t drift;
+	lib_clock_periodic_t periodic;
+
+	if (_cfg->quick) {
+		duration /= 6;
+	}
+	loops = (uint64_t)duration * 1000ULL / PERIODIC_PERIOD_US;
+
+	// periodic timer: deadlines are start + k * period
+	start = bench_periodic__mono_ns();
+	lib_clock__periodic_init(&periodic, PERIODIC_PERIOD_US);
+	for (i = 0; i < loops; i++) {
+		lib_clock__periodic_wait(&periodic);
+	}
+	last = bench_periodic__mono_ns();
+	expected = (loops + periodic.missed) * PERIODIC_PERIOD_US * 1000ULL;
+	drift = (int64_t)(last - start - expected);
+
+	bench_json__begin_object(_json, "periodic_wait");
+	bench_json__uint(_json, "period_us", PERIODIC_PERIOD_US);
+	bench_json__uint(_json, "periods", periodic.periods);
+	bench_json__uint(_json, "missed", periodic.missed);
+	bench_json__uint(_json, "max_lateness_ns", periodic.max_lateness_ns);
+	bench_json__int(_json, "cumulative_drift_ns", drift);
+	// the deadlines do not drift, the end lags by the lateness of the last wakeup only
+	bench_json__uint(_json, "drift_bound_ns", periodic.max_lateness_ns + PERIODIC_DRIFT_SLACK_NS);
+	bench_json__string(_json, "result", ((drift >= -PERIODIC_DRIFT_SLACK_NS)
+		&& (drift <= (int64_t)(periodic.max_lateness_ns + PERIODIC_DRIFT_SLACK_NS))) ? "pass" : "fail");
+	bench_json__end_object(_json);
+
+	// naive loop: work; delay_us(period - elapsed)
+	start = bench_periodic__mono_ns();
+	for (i = 0; i < loops; i++) {
+		lib_clock__delay_us(PERIODIC_PERIOD_US);
+	}
+	last = bench_periodic__mono_ns();
+	expected = loops * PERIODIC_PERIOD_US * 1000ULL;
+
+	bench_json__begin_object(_json, "relative_delay");
+	bench_json__uint(_json, "period_us", PERIODIC_PERIOD_US);
+	bench_json__uint(_json, "periods", loops);
+	bench_json__int(_json, "cumulative_drift_ns", (int64_t)(last - start - expected));
+	bench_json__end_object(_json);
+}
+
+static uint64_t bench_periodic__mono_ns(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
@@ -0,0 +1,400 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* system */
+#include <pthread.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_rate.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define RATE_MAX_THREADS		64
+#define RATE_POINT_MS			100U		// run time per contention point
+#define RATE_FAIR_THREADS		8
+#define RATE_FAIR_MS			1000U
+#define RATE_FAIR_TOKENS		20000U		// tokens per second of the fairness run
+#define RATE_SIM_CLIENTS		16
+#define RATE_SIM_HOURS			1U
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* the limiter which is replaced: a mutex and a microsecond clock read per call */
+typedef struct {
+	pthread_mutex_t	lock;
+	double			tokens;
+	double			per_us;
+	double			burst;
+	uint64_t		last_us;
+} rate_mutex_t;
+
+typedef enum {
+	RATE_VARIANT_ATOMIC = 0,
+	RATE_VARIANT_CACHED,
+	RATE_VARIANT_MUTEX,
+	RATE_VARIANT_COUNT
+} rate_variant_t;
+
+typedef struct {
+	pthread_t			thread;
+	rate_variant_t		variant;
+	lib_clock_rate_t	*rl;
+	rate_mutex_t		*mtx;
+	_Atomic int			*go;
+	_Atomic int			*stop;
+	int					pace;		// sleep for the returned wait time
+	uint64_t			calls;
+	uint64_t			grants;
+} rate_worker_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_rate__accuracy(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_rate__contention(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_rate__fairness(bench_json_t *_json, const bench_cfg_t *_cfg);
+static unsigned int bench_rate__spawn(rate_worker_t *_workers, unsigned int _threads, uint32_t _duration_ms);
+static void *bench_rate__worker(void *_arg);
+static int bench_rate__mutex_acquire(rate_mutex_t *_mtx);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const char *const s_variant_names[RATE_VARIANT_COUNT] = { "atomic", "atomic_cached", "mutex" };
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	rate limiter accuracy, contention and fairness
+ * ****************************************************************************/
+void bench_rate__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	bench_rate__accuracy(_json, _cfg);
+	bench_rate__contention(_json, _cfg);
+	bench_rate__fairness(_json, _cfg);
+}
+
+/* ************************************************************************//**
+ * \brief	granted tokens over a long simulated run against the exact budget
+ *
+ * Clients with random request sizes come back exactly after the wait
+ * time they were given, so the limiter is always saturated and grants
+ * burst + rate * duration tokens.
+ * ****************************************************************************/
+static void bench_rate__accuracy(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	static const struct {
+		uint32_t	tokens;
+		uint64_t	period_us;
+		uint32_t	burst;
+		uint32_t	max_n;
+	} cases[] = {
+		{ 1000,			1000000,	10,		1 },		// 1000/s
+		{ 3,			1000000,	3,		1 },		// interval with a fraction
+		{ 7,			1000,		50,		5 },		// 7000/s, multi-token
+		{ 300000000,	1000000,	1000,	16 },		// 3e8/s, sub-nanosecond interval
+	};
+	lib_clock_rate_t rl;
+	uint64_t next[RATE_SIM_CLIENTS], granted[RATE_SIM_CLIENTS];
+	uint64_t now, end, epoch, total, min, max, exact, jitter;
+	double nominal;
+	unsigned int failed = 0;
+	uint32_t wait_us, n, s_rnd = 1;
+	size_t c;
+	int k, first;
+
+	bench_json__begin_array(_json, "accuracy");
+	for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		lib_clock__rate_init(&rl, cases[c].tokens, cases[c].period_us, cases[c].burst);
+		epoch = rl.epoch_ns;
+		end = epoch + (uint64_t)(_cfg->quick ? 60U : RATE_SIM_HOURS * 3600U) * 1000000000ULL;
+		if (cases[c].tokens > 1000000U) {
+			// a second of the fast case already takes millions of grants
+			end = epoch + (_cfg->quick ? 100000000ULL : 1000000000ULL);
+		}
+
+		for (k = 0; k < RATE_SIM_CLIENTS; k++) {
+			next[k] = epoch + (uint64_t)k;
+			granted[k] = 0;
+		}
+
+		// the client with the earliest retry time goes next
+		for (;;) {
+			first = 0;
+			for (k = 1; k < RATE_SIM_CLIENTS; k++) {
+				if (next[k] < next[first]) {
+					first = k;
+				}
+			}
+			now = next[first];
+			if (now >= end) {
+				break;
+			}
+
+			s_rnd = s_rnd * 1664525U + 1013904223U;
+			n = 1U + (s_rnd >> 16) % cases[c].max_n;
+			// jitter below one interval, ties between clients would always go to the first one
+			jitter = 1U + s_rnd % ((rl.interval >> LIB_CLOCK_RATE_FRAC) + 1U);
+			if (lib_clock__rate_acquire_at(&rl, n, now, &wait_us) == 0) {
+				granted[first] += n;
+				next[first] = now + jitter;
+			}
+			else {
+				next[first] = now + (uint64_t)wait_us * 1000ULL + jitter;
+			}
+		}
+
+		total = 0;
+		min = UINT64_MAX;
+		max = 0;
+		for (k = 0; k < RATE_SIM_CLIENTS; k++) {
+			total += granted[k];
+			min = (granted[k] < min) ? granted[k] : min;
+			max = (granted[k] > max) ? granted[k] : max;
+		}
+
+		// the nominal rate differs from the quantized interval by less than 2^-LIB_CLOCK_RATE_FRAC ns per token
+		nominal = (double)cases[c].burst + (double)(end - epoch) * 1e-3 * (double)cases[c].tokens / (double)cases[c].period_us;
+		exact = cases[c].burst + ((end - epoch) << LIB_CLOCK_RATE_FRAC) / rl.interval;
+
+		// never more than the budget, less by the tokens refilled during the last wait (1us resolution)
+		if ((total > exact) || (exact - total > cases[c].max_n + (1000ULL << LIB_CLOCK_RATE_FRAC) / rl.interval)) {
+			failed++;
+		}
+
+		bench_json__begin_object(_json, NULL);
+		bench_json__uint(_json, "tokens", cases[c].tokens);
+		bench_json__uint(_json, "period_us", cases[c].period_us);
+		bench_json__uint(_json, "burst", cases[c].burst);
+		bench_json__uint(_json, "max_n", cases[c].max_n);
+		bench_json__double(_json, "simulated_s", (double)(end - epoch) / 1e9);
+		bench_json__uint(_json, "granted", total);
+		bench_json__uint(_json, "expected", exact);
+		bench_json__double(_json, "error_to_nominal_rate", ((double)total - nominal) / nominal);
+		bench_json__double(_json, "client_share_min_max", (double)min / (double)(max ? max : 1));
+		bench_json__end_object(_json);
+	}
+	bench_json__end_array(_json);
+	bench_json__string(_json, "accuracy_result", (failed == 0) ? "pass" : "fail");
+}
+
+/* ************************************************************************//**
+ * \brief	throughput of acquire calls from 1 to 64 threads
+ *
+ * The rate is high enough that most calls are granted, every grant is a
+ * compare and swap on the shared word.
+ * ****************************************************************************/
+static void bench_rate__contention(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	rate_worker_t workers[RATE_MAX_THREADS] = { 0 };
+	lib_clock_rate_t rl;
+	rate_mutex_t mtx = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	uint32_t duration_ms = _cfg->quick ? RATE_POINT_MS / 5U : RATE_POINT_MS;
+	uint64_t calls, grants;
+	unsigned int threads, started, t;
+	int variant, cached;
+
+	cached = (lib_clock__cached_start(100) == 0);
+
+	bench_json__begin_array(_json, "contention");
+	for (threads = 1; threads <= RATE_MAX_THREADS; threads *= 2) {
+		for (variant = 0; variant < RATE_VARIANT_COUNT; variant++) {
+			// the bucket outlasts an update period of the cached clock, nearly every call is granted
+			lib_clock__rate_init(&rl, 1000000000U, 1000000, 1000000);
+			mtx.per_us = 1000.0;
+			mtx.burst = 1000000.0;
+			mtx.tokens = mtx.burst;
+			mtx.last_us = lib_clock__get_time_us();
+
+			for (t = 0; t < threads; t++) {
+				workers[t].variant = (rate_variant_t)variant;
+				workers[t].rl = &rl;
+				workers[t].mtx = &mtx;
+				workers[t].pace = 0;
+			}
+			started = bench_rate__spawn(workers, threads, duration_ms);
+
+			calls = 0;
+			grants = 0;
+			for (t = 0; t < started; t++) {
+				calls += workers[t].calls;
+				grants += workers[t].grants;
+			}
+
+			bench_json__begin_object(_json, NULL);
+			bench_json__string(_json, "variant", s_variant_names[variant]);
+			bench_json__uint(_json, "threads", started);
+			bench_json__double(_json, "mcalls_per_s", (double)calls / (double)duration_ms / 1e3);
+			bench_json__double(_json, "granted_share", (double)grants / (double)(calls ? calls : 1));
+			bench_json__end_object(_json);
+		}
+	}
+	bench_json__end_array(_json);
+
+	if (cached) {
+		lib_clock__cached_stop();
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	threads pace themselves with the wait time of the limiter
+ *
+ * Achieved against configured rate and Jain's fairness index of the
+ * per-thread grants, 1.0 is a perfectly even split.
+ * ****************************************************************************/
+static void bench_rate__fairness(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	rate_worker_t workers[RATE_FAIR_THREADS] = { 0 };
+	lib_clock_rate_t rl;
+	uint32_t duration_ms = _cfg->quick ? RATE_FAIR_MS / 5U : RATE_FAIR_MS;
+	double sum = 0, sum_sq = 0, expected, jain;
+	uint64_t start, elapsed;
+	unsigned int started, t;
+
+	lib_clock__rate_init(&rl, RATE_FAIR_TOKENS, 1000000, 10);
+	for (t = 0; t < RATE_FAIR_THREADS; t++) {
+		workers[t].variant = RATE_VARIANT_ATOMIC;
+		workers[t].rl = &rl;
+		workers[t].pace = 1;
+	}
+
+	start = lib_clock__get_time_ns();
+	started = bench_rate__spawn(workers, RATE_FAIR_THREADS, duration_ms);
+	elapsed = lib_clock__get_time_ns() - start;
+
+	for (t = 0; t < started; t++) {
+		sum += (double)workers[t].grants;
+		sum_sq += (double)workers[t].grants * (double)workers[t].grants;
+	}
+	jain = (sum_sq > 0) ? (sum * sum) / ((double)started * sum_sq) : 0;
+	expected = 10.0 + (double)elapsed * 1e-9 * RATE_FAIR_TOKENS;
+
+	bench_json__begin_object(_json, "fairness");
+	bench_json__uint(_json, "threads", started);
+	bench_json__uint(_json, "rate_per_s", RATE_FAIR_TOKENS);
+	bench_json__double(_json, "elapsed_s", (double)elapsed / 1e9);
+	bench_json__double(_json, "granted", sum);
+	bench_json__double(_json, "achieved_share", sum / expected);
+	bench_json__double(_json, "jain_index", jain);
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	run the workers for a while, returns the number started
+ * ****************************************************************************/
+static unsigned int bench_rate__spawn(rate_worker_t *_workers, unsigned int _threads, uint32_t _duration_ms)
+{
+	_Atomic int go = 0, stop = 0;
+	unsigned int started = 0, t;
+
+	for (t = 0; t < _threads; t++) {
+		_workers[t].go = &go;
+		_workers[t].stop = &stop;
+		_workers[t].calls = 0;
+		_workers[t].grants = 0;
+		if (pthread_create(&_workers[t].thread, NULL, &bench_rate__worker, &_workers[t]) != 0) {
+			break;
+		}
+		started++;
+	}
+
+	atomic_store(&go, 1);
+	lib_clock__delay_us(_duration_ms * 1000U);
+	atomic_store(&stop, 1);
+
+	for (t = 0; t < started; t++) {
+		pthread_join(_workers[t].thread, NULL);
+	}
+
+	return started;
+}
+
+static void *bench_rate__worker(void *_arg)
+{
+	rate_worker_t *worker = (rate_worker_t *)_arg;
+	uint32_t wait_us;
+	int ret = 0;
+
+	while (!atomic_load_explicit(worker->go, memory_order_acquire)) {
+	}
+
+	while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+		switch (worker->variant) {
+			case RATE_VARIANT_ATOMIC:	ret = lib_clock__rate_acquire(worker->rl, 1, &wait_us); break;
+			case RATE_VARIANT_CACHED:	ret = lib_clock__rate_acquire_cached(worker->rl, 1, &wait_us); break;
+			case RATE_VARIANT_MUTEX:	ret = bench_rate__mutex_acquire(worker->mtx); wait_us = 0; break;
+			default:					return NULL;
+		}
+
+		worker->calls++;
+		if (ret == 0) {
+			worker->grants++;
+		}
+		else if (worker->pace) {
+			lib_clock__delay_us(wait_us);
+		}
+	}
+
+	return NULL;
+}
+
+/* ************************************************************************//**
+ * \brief	conventional token bucket, refilled under the mutex
+ * ****************************************************************************/
+static int bench_rate__mutex_acquire(rate_mutex_t *_mtx)
+{
+	uint64_t now;
+	int ret = -1;
+
+	pthread_mutex_lock(&_mtx->lock);
+	now = lib_clock__get_time_us();
+	_mtx->tokens += (double)(now - _mtx->last_us) * _mtx->per_us;
+	_mtx->last_us = now;
+	if (_mtx->tokens > _mtx->burst) {
+		_mtx->tokens = _mtx->burst;
+	}
+	if (_mtx->tokens >= 1.0) {
+		_mtx->tokens -= 1.0;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&_mtx->lock);
+
+	return ret;
+}
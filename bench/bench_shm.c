@@ -0,0 +1,226 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdio.h>
+
+/* system */
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_shm.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define SHM_MIN_PROCS		2
+#define SHM_MAX_PROCS		8
+#define SHM_COST_READS		1000000U
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	int			attached;
+	uint64_t	reads;
+	uint64_t	local_backwards;	// reading below the previous one of the same process
+	uint64_t	global_backwards;	// reading below one completed before it by any process
+	double		shm_ns;
+	double		coarse_ns;
+	double		clock_gettime_ns;
+} bench_shm_proc_t;
+
+/* shared between the processes, anonymous shared mapping */
+typedef struct {
+	_Atomic uint64_t	latest;		// highest completed reading of all processes
+	_Atomic int			ready;
+	_Atomic int			go;
+	bench_shm_proc_t	proc[SHM_MAX_PROCS];
+} bench_shm_shared_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_shm__child(bench_shm_shared_t *_shared, bench_shm_proc_t *_proc, const char *_name, unsigned int _duration_ms);
+static double bench_shm__cost(uint64_t (*_read)(void));
+static uint64_t bench_shm__clock_gettime(void);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	cross-process stress of the shared clock page
+ *
+ * Every process reads the page time in a loop and checks it against the
+ * highest reading completed by any process before its own read started.
+ * ****************************************************************************/
+void bench_shm__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	unsigned int procs = _cfg->max_threads;
+	unsigned int duration = _cfg->quick ? _cfg->duration_ms / 4 : _cfg->duration_ms;
+	bench_shm_shared_t *shared;
+	char name[64];
+	pid_t pids[SHM_MAX_PROCS];
+	uint64_t reads = 0, local = 0, global = 0;
+	unsigned int i, started = 0;
+	int ret, mode, live;
+
+	procs = (procs < SHM_MIN_PROCS) ? SHM_MIN_PROCS : (procs > SHM_MAX_PROCS) ? SHM_MAX_PROCS : procs;
+	snprintf(name, sizeof(name), "/lib_clock_bench_%d", (int)getpid());
+
+	shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		return;
+	}
+
+	ret = lib_clock__shm_publish_start(name, LIB_CLOCK_SHM_PERIOD_US);
+	if (ret < 0) {
+		bench_json__string(_json, "skipped", "lib_clock__shm_publish_start failed");
+		munmap(shared, sizeof(*shared));
+		return;
+	}
+
+	for (i = 0; i < procs; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			bench_shm__child(shared, &shared->proc[i], name, duration);
+			_exit(0);
+		}
+		if (pids[i] < 0) {
+			break;
+		}
+		started++;
+	}
+
+	while ((unsigned int)atomic_load(&shared->ready) < started) {
+		usleep(1000);
+	}
+	atomic_store(&shared->go, 1);
+	for (i = 0; i < started; i++) {
+		waitpid(pids[i], NULL, 0);
+	}
+
+	// the publishing process reads its own page like any other
+	lib_clock__shm_attach(name);
+	mode = lib_clock__shm_get_mode();
+	live = lib_clock__shm_is_live();
+	lib_clock__shm_detach();
+	lib_clock__shm_publish_stop();
+
+	bench_json__string(_json, "mode", (mode == LIB_CLOCK_SHM_TSC) ? "tsc" : "monotonic");
+	bench_json__int(_json, "live", live);
+	bench_json__begin_array(_json, "processes");
+	for (i = 0; i < started; i++) {
+		bench_shm_proc_t *proc = &shared->proc[i];
+
+		bench_json__begin_object(_json, NULL);
+		bench_json__int(_json, "attached", proc->attached);
+		bench_json__uint(_json, "reads", proc->reads);
+		bench_json__uint(_json, "local_backwards", proc->local_backwards);
+		bench_json__uint(_json, "global_backwards", proc->global_backwards);
+		bench_json__double(_json, "shm_read_ns", proc->shm_ns);
+		bench_json__double(_json, "coarse_read_ns", proc->coarse_ns);
+		bench_json__double(_json, "clock_gettime_ns", proc->clock_gettime_ns);
+		bench_json__end_object(_json);
+
+		reads += proc->reads;
+		local += proc->local_backwards;
+		global += proc->global_backwards;
+		live &= proc->attached;
+	}
+	bench_json__end_array(_json);
+	bench_json__uint(_json, "reads", reads);
+	bench_json__uint(_json, "local_backwards", local);
+	bench_json__uint(_json, "global_backwards", global);
+	bench_json__string(_json, "result", (live && (started == procs) && (reads > 0) && (local == 0) && (global == 0)) ? "pass" : "fail");
+
+	munmap(shared, sizeof(*shared));
+}
+
+/* ************************************************************************//**
+ * \brief	reader process
+ * ****************************************************************************/
+static void bench_shm__child(bench_shm_shared_t *_shared, bench_shm_proc_t *_proc, const char *_name, unsigned int _duration_ms)
+{
+	uint64_t end, now, seen, last = 0, latest;
+
+	_proc->attached = (lib_clock__shm_attach(_name) == 0);
+	atomic_fetch_add(&_shared->ready, 1);
+	if (!_proc->attached) {
+		return;
+	}
+	while (!atomic_load(&_shared->go)) {
+	}
+
+	end = bench__ref_ns() + (uint64_t)_duration_ms * 1000000ULL;
+	do {
+		seen = atomic_load(&_shared->latest);
+		now = lib_clock__shm_get_time_ns();
+		_proc->global_backwards += (now < seen);
+		_proc->local_backwards += (now < last);
+		last = now;
+		_proc->reads++;
+
+		latest = seen;
+		while ((latest < now) && !atomic_compare_exchange_weak(&_shared->latest, &latest, now)) {
+		}
+	} while (bench__ref_ns() < end);
+
+	_proc->shm_ns = bench_shm__cost(&lib_clock__shm_get_time_ns);
+	_proc->coarse_ns = bench_shm__cost(&lib_clock__shm_get_coarse_ns);
+	_proc->clock_gettime_ns = bench_shm__cost(&bench_shm__clock_gettime);
+	lib_clock__shm_detach();
+}
+
+static double bench_shm__cost(uint64_t (*_read)(void))
+{
+	uint64_t start = bench__ref_ns();
+	uint32_t i;
+
+	for (i = 0; i < SHM_COST_READS; i++) {
+		bench__sink(_read());
+	}
+
+	return (double)(bench__ref_ns() - start) / SHM_COST_READS;
+}
+
+static uint64_t bench_shm__clock_gettime(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
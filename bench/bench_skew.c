@@ -0,0 +1,279 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// pthread_setaffinity_np and the CPU_* macros
+#define _GNU_SOURCE
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* system */
+#include <pthread.h>
+#include <sched.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_posix.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define SKEW_MIN_THREADS		2
+#define SKEW_MAX_THREADS		16
+#define SKEW_MATRIX_PRINT		16			// larger matrices are not written
+#define SKEW_HOP_READS			64			// reads between two migrations
+#define SKEW_STRESS_MS			500U
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	pthread_t			thread;
+	const int			*cpus;
+	int					cpu_count;
+	int					first;
+	_Atomic int			*stop;
+	_Atomic uint64_t	*latest;		// highest reading completed by any thread
+	uint64_t			reads;
+	uint64_t			migrations;
+	uint64_t			local_backwards;	// reading below the previous one of the same thread
+	uint64_t			global_backwards;	// reading below one completed before it by any thread
+	uint64_t			max_backwards_ns;
+} skew_worker_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_skew__matrix(bench_json_t *_json, const lib_clock_skew_info_t *_info);
+static void bench_skew__stress(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void *bench_skew__worker(void *_arg);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	TSC synchronization check and cross-core monotonicity
+ *
+ * The sources are switched to the TSC for the run and restored after.
+ * ****************************************************************************/
+void bench_skew__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	lib_clock_cfg_t saved, tsc = { 0 };
+	lib_clock_src_info_t src;
+	lib_clock_skew_info_t info;
+	uint64_t start;
+	int api;
+
+	for (api = 0; api < LIB_CLOCK_API_COUNT; api++) {
+		lib_clock__get_source_info((lib_clock_api_t)api, &src);
+		saved.source[api] = src.source;
+		saved.precision_ns[api] = 0;
+		tsc.source[api] = LIB_CLOCK_SRC_TSC;
+	}
+
+	start = bench__ref_ns();
+	lib_clock__init_cfg(&tsc);
+	bench_json__double(_json, "init_ms", (double)(bench__ref_ns() - start) / 1e6);
+
+	lib_clock__get_source_info(LIB_CLOCK_API_NS, &src);
+	lib_clock__get_skew_info(&info);
+	bench_json__string(_json, "source", src.name);
+	bench_json__string(_json, "state",
+		(info.state == LIB_CLOCK_SKEW_SYNCED) ? "synced" :
+		(info.state == LIB_CLOCK_SKEW_CORRECTED) ? "corrected" :
+		(info.state == LIB_CLOCK_SKEW_REJECTED) ? "rejected" : "unchecked");
+	bench_json__uint(_json, "cpus_measured", info.measured);
+	bench_json__uint(_json, "reference_cpu", info.reference);
+	bench_json__uint(_json, "max_skew_ns", info.max_skew_ns);
+	bench_json__uint(_json, "uncertainty_ns", info.uncertainty_ns);
+	bench_json__uint(_json, "residual_ns", info.residual_ns);
+	bench_skew__matrix(_json, &info);
+
+	bench_skew__stress(_json, _cfg);
+
+	lib_clock__init_cfg(&saved);
+}
+
+/* ************************************************************************//**
+ * \brief	write the skew matrix of small machines
+ * ****************************************************************************/
+static void bench_skew__matrix(bench_json_t *_json, const lib_clock_skew_info_t *_info)
+{
+	int64_t *matrix;
+	uint32_t i, j;
+
+	if ((_info->cpus == 0) || (_info->cpus > SKEW_MATRIX_PRINT)) {
+		return;
+	}
+
+	matrix = malloc((size_t)_info->cpus * _info->cpus * sizeof(*matrix));
+	if (matrix == NULL) {
+		return;
+	}
+
+	if (lib_clock__get_skew_matrix(matrix, _info->cpus) == 0) {
+		bench_json__begin_array(_json, "matrix_ns");
+		for (i = 0; i < _info->cpus; i++) {
+			bench_json__begin_array(_json, NULL);
+			for (j = 0; j < _info->cpus; j++) {
+				if (matrix[i * _info->cpus + j] == LIB_CLOCK_SKEW_UNKNOWN) {
+					bench_json__string(_json, NULL, "unknown");
+				}
+				else {
+					bench_json__int(_json, NULL, matrix[i * _info->cpus + j]);
+				}
+			}
+			bench_json__end_array(_json);
+		}
+		bench_json__end_array(_json);
+	}
+
+	free(matrix);
+}
+
+/* ************************************************************************//**
+ * \brief	threads hop across all CPUs and check every reading
+ *
+ * A reading must not be below the previous one of the same thread, nor
+ * below the highest reading any thread completed before it started.
+ * ****************************************************************************/
+static void bench_skew__stress(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	skew_worker_t workers[SKEW_MAX_THREADS] = { 0 };
+	_Atomic uint64_t latest = 0;
+	_Atomic int stop = 0;
+	uint64_t reads = 0, migrations = 0, local = 0, global = 0, max_ns = 0;
+	cpu_set_t allowed;
+	int cpus[CPU_SETSIZE];
+	unsigned int threads, started = 0, t;
+	int cpu, count = 0;
+	struct timespec rqtp;
+	uint32_t duration_ms = _cfg->quick ? SKEW_STRESS_MS / 5U : SKEW_STRESS_MS;
+
+	if (pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) != 0) {
+		return;
+	}
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed)) {
+			cpus[count++] = cpu;
+		}
+	}
+
+	threads = (_cfg->max_threads < SKEW_MIN_THREADS) ? SKEW_MIN_THREADS : _cfg->max_threads;
+	threads = (threads > SKEW_MAX_THREADS) ? SKEW_MAX_THREADS : threads;
+
+	for (t = 0; t < threads; t++) {
+		workers[t].cpus = cpus;
+		workers[t].cpu_count = count;
+		workers[t].first = (int)t;
+		workers[t].stop = &stop;
+		workers[t].latest = &latest;
+		if (pthread_create(&workers[t].thread, NULL, &bench_skew__worker, &workers[t]) != 0) {
+			break;
+		}
+		started++;
+	}
+
+	rqtp.tv_sec = (time_t)(duration_ms / 1000U);
+	rqtp.tv_nsec = (long)(duration_ms % 1000U) * 1000000L;
+	nanosleep(&rqtp, NULL);
+	atomic_store(&stop, 1);
+
+	for (t = 0; t < started; t++) {
+		pthread_join(workers[t].thread, NULL);
+		reads += workers[t].reads;
+		migrations += workers[t].migrations;
+		local += workers[t].local_backwards;
+		global += workers[t].global_backwards;
+		if (workers[t].max_backwards_ns > max_ns) {
+			max_ns = workers[t].max_backwards_ns;
+		}
+	}
+
+	bench_json__begin_object(_json, "migration_stress");
+	bench_json__uint(_json, "threads", started);
+	bench_json__uint(_json, "cpus", (uint64_t)count);
+	bench_json__uint(_json, "reads", reads);
+	bench_json__uint(_json, "migrations", migrations);
+	bench_json__uint(_json, "local_backwards", local);
+	bench_json__uint(_json, "global_backwards", global);
+	bench_json__uint(_json, "max_backwards_ns", max_ns);
+	bench_json__string(_json, "result", ((local == 0) && (global == 0) && (started == threads)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	stress thread, reads the time and migrates to the next CPU
+ * ****************************************************************************/
+static void *bench_skew__worker(void *_arg)
+{
+	skew_worker_t *worker = (skew_worker_t *)_arg;
+	uint64_t last = 0, before, now, latest;
+	cpu_set_t set;
+	int next = worker->first;
+	int i;
+
+	while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+		CPU_ZERO(&set);
+		CPU_SET(worker->cpus[next % worker->cpu_count], &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+			worker->migrations++;
+		}
+		next++;
+
+		for (i = 0; i < SKEW_HOP_READS; i++) {
+			before = atomic_load_explicit(worker->latest, memory_order_acquire);
+			now = lib_clock__get_time_ns();
+
+			if (now < last) {
+				worker->local_backwards++;
+				if (last - now > worker->max_backwards_ns) {
+					worker->max_backwards_ns = last - now;
+				}
+			}
+			if (now < before) {
+				worker->global_backwards++;
+				if (before - now > worker->max_backwards_ns) {
+					worker->max_backwards_ns = before - now;
+				}
+			}
+			last = now;
+
+			latest = atomic_load_explicit(worker->latest, memory_order_relaxed);
+			while ((now > latest) && !atomic_compare_exchange_weak_explicit(worker->latest, &latest, now, memory_order_release, memory_order_relaxed)) {
+			}
+			worker->reads++;
+		}
+	}
+
+	return NULL;
+}
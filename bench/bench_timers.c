@@ -0,0 +1,187 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+
+/* system */
+#include <time.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/* project */
+#include <lib_clock_timers.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define TIMERS_MIN				1000U
+#define TIMERS_MAX				1000000U
+#define TIMERS_QUICK_MAX		100000U
+#define TIMERS_WINDOW_MS		500U		// deadlines are spread over this window
+#define TIMERS_QUICK_WINDOW_MS	200U
+#define TIMERS_LEAD_NS			1000000ULL	// first deadline after arming
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* lateness of every fired timer */
+typedef struct {
+	double		*lateness;
+	uint32_t	count;
+} bench_timers_log_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t bench_timers__now(void);
+static void bench_timers__fire(lib_clock_timer_t *_timer, void *_arg);
+static void bench_timers__measure(bench_json_t *_json, lib_clock_timer_t *_timers, bench_timers_log_t *_log,
+		uint32_t _count, uint64_t _slack_ns, uint64_t _window_ns);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const uint64_t s_bench_timers_slack[] = { 0, 100000ULL, 1000000ULL };
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	wakeups and dispatch latency of the timerfd service with 1K to
+ * 			1M timers and different slack windows
+ * ****************************************************************************/
+void bench_timers__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	uint32_t max = _cfg->quick ? TIMERS_QUICK_MAX : TIMERS_MAX;
+	uint64_t window = (uint64_t)(_cfg->quick ? TIMERS_QUICK_WINDOW_MS : TIMERS_WINDOW_MS) * 1000000ULL;
+	bench_timers_log_t log = { NULL, 0 };
+	lib_clock_timer_t *timers;
+	uint32_t count, s;
+
+	timers = malloc(max * sizeof(*timers));
+	log.lateness = malloc(max * sizeof(*log.lateness));
+	if ((timers == NULL) || (log.lateness == NULL)) {
+		goto CLEANUP;
+	}
+
+	bench_json__uint(_json, "window_ms", window / 1000000ULL);
+	bench_json__begin_array(_json, "runs");
+	for (count = TIMERS_MIN; count <= max; count *= 10) {
+		for (s = 0; s < sizeof(s_bench_timers_slack) / sizeof(s_bench_timers_slack[0]); s++) {
+			bench_timers__measure(_json, timers, &log, count, s_bench_timers_slack[s], window);
+		}
+	}
+	bench_json__end_array(_json);
+
+CLEANUP:
+	free(timers);
+	free(log.lateness);
+}
+
+/* ************************************************************************//**
+ * \brief	arm _count timers at random deadlines and run an epoll loop
+ * 			until all fired
+ * ****************************************************************************/
+static void bench_timers__measure(bench_json_t *_json, lib_clock_timer_t *_timers, bench_timers_log_t *_log,
+		uint32_t _count, uint64_t _slack_ns, uint64_t _window_ns)
+{
+	struct epoll_event event = { .events = EPOLLIN };
+	lib_clock_timers_t svc;
+	bench_stats_t stats;
+	uint64_t x = 0x9E3779B97F4A7C15ULL, start, arm_ns, loop_ns, epoll_wakeups = 0;
+	uint32_t i;
+	int epfd;
+
+	if (lib_clock__timers_init(&svc, _slack_ns) < 0) {
+		return;
+	}
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if ((epfd < 0) || (epoll_ctl(epfd, EPOLL_CTL_ADD, lib_clock__timers_fd(&svc), &event) != 0)) {
+		goto CLEANUP;
+	}
+
+	_log->count = 0;
+	start = bench_timers__now();
+	for (i = 0; i < _count; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		lib_clock__timer_init(&_timers[i], &bench_timers__fire, _log);
+		lib_clock__timers_arm(&svc, &_timers[i], start + TIMERS_LEAD_NS + x % _window_ns);
+	}
+	arm_ns = bench_timers__now() - start;
+
+	start = bench_timers__now();
+	while (svc.count != 0) {
+		if (epoll_wait(epfd, &event, 1, -1) == 1) {
+			epoll_wakeups++;
+			lib_clock__timers_dispatch(&svc, 0);
+		}
+	}
+	loop_ns = bench_timers__now() - start;
+
+	bench__stats(_log->lateness, _log->count, &stats);
+
+	bench_json__begin_object(_json, NULL);
+	bench_json__uint(_json, "timers", _count);
+	bench_json__uint(_json, "slack_ns", _slack_ns);
+	bench_json__double(_json, "arm_ns_per_timer", (double)arm_ns / _count);
+	bench_json__uint(_json, "wakeups", epoll_wakeups);
+	bench_json__double(_json, "wakeups_per_s", (double)epoll_wakeups * 1e9 / (double)loop_ns);
+	bench_json__double(_json, "timers_per_wakeup", (double)_count / (double)(epoll_wakeups ? epoll_wakeups : 1));
+	bench_json__uint(_json, "rearms", svc.rearms);
+	bench_json__stats(_json, "lateness_ns", &stats);
+	bench_json__string(_json, "result", ((_log->count == _count) && (svc.fired == _count)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+
+CLEANUP:
+	if (epfd >= 0) {
+		close(epfd);
+	}
+	lib_clock__timers_close(&svc);
+}
+
+static void bench_timers__fire(lib_clock_timer_t *_timer, void *_arg)
+{
+	bench_timers_log_t *log = (bench_timers_log_t *)_arg;
+
+	log->lateness[log->count++] = (double)(bench_timers__now() - _timer->deadline_ns);
+}
+
+static uint64_t bench_timers__now(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
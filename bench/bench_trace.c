@@ -0,0 +1,227 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_trace.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define TRACE_BATCH			256			// spans per latency sample
+#define TRACE_RING_RECORDS	(1U << 16)
+#define TRACE_CHECK_SPANS	1024U		// spans of the ring owner in the parked check
+#define TRACE_PARKED_SPANS	100U		// spans of the thread without a ring
+#define TRACE_PARKED_ID		0xFFFFFFFFU
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+#ifdef LIB_CLOCK_TRACE
+static void bench_trace__parked(bench_json_t *_json, const char *_path);
+static void *bench_trace__parked_worker(void *_arg);
+#endif
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	cost of a recorded span against two bare clock reads
+ * ****************************************************************************/
+void bench_trace__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	char path[] = "/tmp/lib_clock_bench_trace_XXXXXX";
+	bench_stats_t stats;
+	double *samples;
+	unsigned int i, j;
+	int fd;
+
+#ifndef LIB_CLOCK_TRACE
+	bench_json__string(_json, "skipped", "LIB_CLOCK_TRACE disabled");
+	(void)path; (void)stats; (void)samples; (void)i; (void)j; (void)fd; (void)_cfg;
+#else
+	samples = malloc(_cfg->samples * sizeof(double));
+	if (samples == NULL) {
+		return;
+	}
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		free(samples);
+		return;
+	}
+	close(fd);
+
+	if (lib_clock__trace_init(path, 4, TRACE_RING_RECORDS, (uint64_t)_cfg->samples * TRACE_BATCH) < 0) {
+		bench_json__string(_json, "skipped", "lib_clock__trace_init failed");
+		unlink(path);
+		free(samples);
+		return;
+	}
+
+	for (i = 0; i < _cfg->samples; i++) {
+		uint64_t start = bench__ref_ns();
+		for (j = 0; j < TRACE_BATCH; j++) {
+			bench__sink(lib_clock__get_clock_ticks());
+			bench__sink(lib_clock__get_clock_ticks());
+		}
+		samples[i] = (double)(bench__ref_ns() - start) / TRACE_BATCH;
+	}
+	bench__stats(samples, _cfg->samples, &stats);
+	bench_json__stats(_json, "two_clock_reads_ns", &stats);
+
+	for (i = 0; i < _cfg->samples; i++) {
+		uint64_t start = bench__ref_ns();
+		for (j = 0; j < TRACE_BATCH; j++) {
+			LIB_CLOCK_TRACE_BEGIN(span, j);
+			LIB_CLOCK_TRACE_END(span);
+		}
+		samples[i] = (double)(bench__ref_ns() - start) / TRACE_BATCH;
+
+		// drain outside of the measured section, the ring never overflows
+		lib_clock__trace_collect();
+	}
+	bench__stats(samples, _cfg->samples, &stats);
+	bench_json__stats(_json, "span_ns", &stats);
+
+	bench_trace__parked(_json, path);
+
+	unlink(path);
+	free(samples);
+#endif
+}
+
+#ifdef LIB_CLOCK_TRACE
+/* ************************************************************************//**
+ * \brief	a thread without a ring across a re-init, checked in the file
+ *
+ * The worker takes a ring of the running session. After a re-init with a
+ * single ring, which the calling thread owns, the worker is parked and
+ * exits. Its spans must be counted as dropped, the file holds exactly the
+ * spans of the ring owner.
+ * ****************************************************************************/
+static void bench_trace__parked(bench_json_t *_json, const char *_path)
+{
+	lib_clock_trace_file_hdr_t hdr;
+	lib_clock_trace_rec_t rec;
+	pthread_barrier_t barrier;
+	pthread_t worker;
+	uint64_t mismatches = 0, i;
+	int fd, ok = 0;
+
+	bench_json__begin_object(_json, "parked");
+	if (pthread_barrier_init(&barrier, NULL, 2) != 0) {
+		lib_clock__trace_cleanup();
+		bench_json__string(_json, "error", "pthread_barrier_init failed");
+		bench_json__end_object(_json);
+		return;
+	}
+	if (pthread_create(&worker, NULL, &bench_trace__parked_worker, &barrier) != 0) {
+		lib_clock__trace_cleanup();
+		pthread_barrier_destroy(&barrier);
+		bench_json__string(_json, "error", "pthread_create failed");
+		bench_json__end_object(_json);
+		return;
+	}
+
+	// the worker owns a ring of the running session
+	pthread_barrier_wait(&barrier);
+	lib_clock__trace_cleanup();
+	if (lib_clock__trace_init(_path, 1, TRACE_RING_RECORDS, TRACE_CHECK_SPANS + TRACE_PARKED_SPANS) >= 0) {
+		for (i = 0; i < TRACE_CHECK_SPANS; i++) {
+			LIB_CLOCK_TRACE_BEGIN(span, i);
+			LIB_CLOCK_TRACE_END(span);
+		}
+		ok = 1;
+	}
+	pthread_barrier_wait(&barrier);
+	pthread_join(worker, NULL);
+	pthread_barrier_destroy(&barrier);
+	if (!ok) {
+		bench_json__string(_json, "error", "lib_clock__trace_init failed");
+		bench_json__end_object(_json);
+		return;
+	}
+	lib_clock__trace_cleanup();
+
+	memset(&hdr, 0, sizeof(hdr));
+	fd = open(_path, O_RDONLY);
+	if ((fd < 0) || (read(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr))) {
+		ok = 0;
+	}
+	for (i = 0; ok && (i < hdr.records); i++) {
+		if (read(fd, &rec, sizeof(rec)) != (ssize_t)sizeof(rec)) {
+			ok = 0;
+		}
+		else if ((rec.id != (uint32_t)i) || (rec.thread != 0) || (rec.end < rec.start)) {
+			mismatches++;
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	bench_json__uint(_json, "records", hdr.records);
+	bench_json__uint(_json, "record_mismatches", mismatches);
+	bench_json__uint(_json, "dropped", hdr.dropped);
+	bench_json__string(_json, "result", (ok && (memcmp(hdr.magic, LIB_CLOCK_TRACE_MAGIC, sizeof(hdr.magic)) == 0)
+		&& (hdr.records == TRACE_CHECK_SPANS) && (mismatches == 0) && (hdr.dropped == TRACE_PARKED_SPANS)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+}
+
+static void *bench_trace__parked_worker(void *_arg)
+{
+	pthread_barrier_t *barrier = (pthread_barrier_t *)_arg;
+	unsigned int i;
+
+	LIB_CLOCK_TRACE_BEGIN(first, 0);
+	LIB_CLOCK_TRACE_END(first);
+	pthread_barrier_wait(barrier);
+
+	// re-initialized with one ring, held by the other thread
+	pthread_barrier_wait(barrier);
+	for (i = 0; i < TRACE_PARKED_SPANS; i++) {
+		LIB_CLOCK_TRACE_BEGIN(span, TRACE_PARKED_ID);
+		LIB_CLOCK_TRACE_END(span);
+	}
+
+	return NULL;
+}
+#endif
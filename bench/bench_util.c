@@ -0,0 +1,200 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* system */
+#include <time.h>
+
+/* project */
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_json__key(bench_json_t *_json, const char *_key);
+static int bench__cmp_double(const void *_a, const void *_b);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	JSON writer
+ * ****************************************************************************/
+void bench_json__begin_object(bench_json_t *_json, const char *_key)
+{
+	bench_json__key(_json, _key);
+	fputc('{', _json->out);
+	if (_json->depth < BENCH_JSON_MAX_DEPTH - 1) {
+		_json->depth++;
+	}
+	_json->first[_json->depth] = 1;
+}
+
+void bench_json__end_object(bench_json_t *_json)
+{
+	if (_json->depth > 0) {
+		_json->depth--;
+	}
+	fputc('}', _json->out);
+}
+
+void bench_json__begin_array(bench_json_t *_json, const char *_key)
+{
+	bench_json__key(_json, _key);
+	fputc('[', _json->out);
+	if (_json->depth < BENCH_JSON_MAX_DEPTH - 1) {
+		_json->depth++;
+	}
+	_json->first[_json->depth] = 1;
+}
+
+void bench_json__end_array(bench_json_t *_json)
+{
+	if (_json->depth > 0) {
+		_json->depth--;
+	}
+	fputc(']', _json->out);
+}
+
+void bench_json__uint(bench_json_t *_json, const char *_key, uint64_t _value)
+{
+	bench_json__key(_json, _key);
+	fprintf(_json->out, "%llu", (unsigned long long)_value);
+}
+
+void bench_json__int(bench_json_t *_json, const char *_key, int64_t _value)
+{
+	bench_json__key(_json, _key);
+	fprintf(_json->out, "%lld", (long long)_value);
+}
+
+void bench_json__double(bench_json_t *_json, const char *_key, double _value)
+{
+	bench_json__key(_json, _key);
+	if (isfinite(_value)) {
+		fprintf(_json->out, "%.3f", _value);
+	}
+	else {
+		fputs("null", _json->out);
+	}
+}
+
+void bench_json__string(bench_json_t *_json, const char *_key, const char *_value)
+{
+	const char *c;
+
+	// every check reports "pass" or "fail", the exit status follows the failures
+	if (strcmp(_value, "fail") == 0) {
+		_json->fails++;
+	}
+
+	bench_json__key(_json, _key);
+	fputc('"', _json->out);
+	for (c = _value; *c; c++) {
+		if ((*c == '"') || (*c == '\\')) {
+			fputc('\\', _json->out);
+		}
+		fputc(((unsigned char)*c < 0x20) ? ' ' : *c, _json->out);
+	}
+	fputc('"', _json->out);
+}
+
+void bench_json__stats(bench_json_t *_json, const char *_key, const bench_stats_t *_stats)
+{
+	bench_json__begin_object(_json, _key);
+	bench_json__double(_json, "min", _stats->min);
+	bench_json__double(_json, "median", _stats->median);
+	bench_json__double(_json, "p99", _stats->p99);
+	bench_json__double(_json, "p99_9", _stats->p999);
+	bench_json__double(_json, "max", _stats->max);
+	bench_json__double(_json, "mean", _stats->mean);
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	summary statistics of a sample set
+ * ****************************************************************************/
+void bench__stats(double *_samples, size_t _count, bench_stats_t *_stats)
+{
+	double sum = 0.0;
+	size_t i;
+
+	memset(_stats, 0, sizeof(*_stats));
+	if (_count == 0) {
+		return;
+	}
+
+	qsort(_samples, _count, sizeof(double), &bench__cmp_double);
+	for (i = 0; i < _count; i++) {
+		sum += _samples[i];
+	}
+
+	_stats->min = _samples[0];
+	_stats->median = _samples[_count / 2];
+	_stats->p99 = _samples[(size_t)((double)(_count - 1) * 0.99)];
+	_stats->p999 = _samples[(size_t)((double)(_count - 1) * 0.999)];
+	_stats->max = _samples[_count - 1];
+	_stats->mean = sum / (double)_count;
+}
+
+/* ************************************************************************//**
+ * \brief	reference clock of the benchmarks
+ * ****************************************************************************/
+uint64_t bench__ref_ns(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
+
+static void bench_json__key(bench_json_t *_json, const char *_key)
+{
+	if (!_json->first[_json->depth]) {
+		fputc(',', _json->out);
+	}
+	_json->first[_json->depth] = 0;
+
+	if (_key) {
+		fprintf(_json->out, "\"%s\":", _key);
+	}
+}
+
+static int bench__cmp_double(const void *_a, const void *_b)
+{
+	double a = *(const double *)_a;
+	double b = *(const double *)_b;
+
+	return (a > b) - (a < b);
+}
@@ -0,0 +1,260 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* system */
+#include <pthread.h>
+#include <time.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_wait.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define WAIT_RUNS			100U
+#define WAIT_TIMEOUT_NS		1000000000ULL	// a lost wakeup shows up as a timeout
+#define WAIT_OVERSHOOT_US	500U			// deadline of the timeout runs
+#define WAIT_POWER_CPU_SHARE	0.1			// a power saving wait must not spin near the deadline
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	pthread_t					thread;
+	const lib_clock_backoff_t	*backoff;
+	int							futex;		// lib_clock__wait_until_change instead of a predicate
+	uint32_t					flag;
+	_Atomic uint64_t			set_ns;		// time the flag was raised
+	_Atomic int					armed;		// the waiter entered the wait
+	uint64_t					wake_ns;
+	uint64_t					cpu_ns;		// CPU time of the waiter during the wait
+	uint64_t					wall_ns;
+	int							ret;
+} wait_run_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_wait__latency(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_wait__timeout(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void *bench_wait__waiter(void *_arg);
+static int bench_wait__flag(void *_arg);
+static uint64_t bench_wait__cpu_ns(void);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const char *const s_profile_names[LIB_CLOCK_BACKOFF_COUNT] = { "latency", "balanced", "power" };
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	wake latency against CPU usage of the backoff profiles
+ * ****************************************************************************/
+void bench_wait__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	bench_json__uint(_json, "check_interval", lib_clock__wait_check_interval());
+	bench_wait__latency(_json, _cfg);
+	bench_wait__timeout(_json, _cfg);
+}
+
+/* ************************************************************************//**
+ * \brief	a waiter is released after a delay, latency from release to wake
+ *
+ * cpu_share is the CPU time of the waiter over the wall time of its wait.
+ * ****************************************************************************/
+static void bench_wait__latency(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	static const uint32_t delays_us[] = { 10, 100, 1000, 5000 };
+	unsigned int runs = _cfg->quick ? WAIT_RUNS / 5U : WAIT_RUNS;
+	double *samples;
+	bench_stats_t stats;
+	wait_run_t run;
+	uint64_t cpu, wall, timeouts;
+	unsigned int i;
+	size_t d;
+	int profile, futex;
+
+	samples = malloc(runs * sizeof(*samples));
+	if (samples == NULL) {
+		return;
+	}
+
+	bench_json__begin_array(_json, "wake");
+	for (profile = 0; profile < LIB_CLOCK_BACKOFF_COUNT; profile++) {
+		for (futex = 0; futex < 2; futex++) {
+			for (d = 0; d < sizeof(delays_us) / sizeof(delays_us[0]); d++) {
+				cpu = 0;
+				wall = 0;
+				timeouts = 0;
+
+				for (i = 0; i < runs; i++) {
+					run = (wait_run_t){ .backoff = lib_clock__backoff_profile((lib_clock_backoff_profile_t)profile), .futex = futex };
+					if (pthread_create(&run.thread, NULL, &bench_wait__waiter, &run) != 0) {
+						break;
+					}
+					while (!atomic_load(&run.armed)) {
+						sched_yield();
+					}
+
+					lib_clock__delay_us(delays_us[d]);
+					atomic_store(&run.set_ns, lib_clock__get_time_ns());
+					__atomic_store_n(&run.flag, 1U, __ATOMIC_RELEASE);
+					if (futex) {
+						lib_clock__wait_wake(&run.flag);
+					}
+					pthread_join(run.thread, NULL);
+
+					samples[i] = (double)(run.wake_ns - atomic_load(&run.set_ns));
+					cpu += run.cpu_ns;
+					wall += run.wall_ns;
+					timeouts += (run.ret != 0) ? 1U : 0U;
+				}
+				bench__stats(samples, i, &stats);
+
+				bench_json__begin_object(_json, NULL);
+				bench_json__string(_json, "profile", s_profile_names[profile]);
+				bench_json__string(_json, "wait", futex ? "until_change" : "until");
+				bench_json__uint(_json, "release_after_us", delays_us[d]);
+				bench_json__stats(_json, "wake_latency_ns", &stats);
+				bench_json__double(_json, "cpu_share", (double)cpu / (double)(wall ? wall : 1));
+				bench_json__uint(_json, "timeouts", timeouts);
+				bench_json__end_object(_json);
+			}
+		}
+	}
+	bench_json__end_array(_json);
+
+	free(samples);
+}
+
+/* ************************************************************************//**
+ * \brief	overshoot of the deadline if the condition is never met
+ * ****************************************************************************/
+static void bench_wait__timeout(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	unsigned int runs = _cfg->quick ? WAIT_RUNS / 5U : WAIT_RUNS;
+	double *samples;
+	bench_stats_t stats;
+	uint32_t never = 0;
+	uint64_t deadline, cpu, cpu_sum, wall_sum;
+	unsigned int i, wrong;
+	int profile;
+
+	samples = malloc(runs * sizeof(*samples));
+	if (samples == NULL) {
+		return;
+	}
+
+	bench_json__begin_array(_json, "timeout");
+	for (profile = 0; profile < LIB_CLOCK_BACKOFF_COUNT; profile++) {
+		cpu_sum = 0;
+		wall_sum = 0;
+		wrong = 0;
+
+		for (i = 0; i < runs; i++) {
+			cpu = bench_wait__cpu_ns();
+			deadline = lib_clock__get_time_ns() + WAIT_OVERSHOOT_US * 1000ULL;
+			if (lib_clock__wait_until(&bench_wait__flag, &never, deadline, lib_clock__backoff_profile((lib_clock_backoff_profile_t)profile)) != -ESTD_TIMEDOUT) {
+				wrong++;
+			}
+			samples[i] = (double)(lib_clock__get_time_ns() - deadline);
+			cpu_sum += bench_wait__cpu_ns() - cpu;
+			wall_sum += WAIT_OVERSHOOT_US * 1000ULL + (uint64_t)samples[i];
+		}
+		bench__stats(samples, runs, &stats);
+
+		bench_json__begin_object(_json, NULL);
+		bench_json__string(_json, "profile", s_profile_names[profile]);
+		bench_json__uint(_json, "deadline_us", WAIT_OVERSHOOT_US);
+		bench_json__stats(_json, "overshoot_ns", &stats);
+		bench_json__double(_json, "cpu_share", (double)cpu_sum / (double)(wall_sum ? wall_sum : 1));
+		bench_json__uint(_json, "wrong_result", wrong);
+		if (profile == LIB_CLOCK_BACKOFF_POWER) {
+			bench_json__double(_json, "cpu_share_limit", WAIT_POWER_CPU_SHARE);
+		}
+		bench_json__string(_json, "result", ((wrong == 0) && ((profile != LIB_CLOCK_BACKOFF_POWER)
+			|| ((double)cpu_sum <= WAIT_POWER_CPU_SHARE * (double)(wall_sum ? wall_sum : 1)))) ? "pass" : "fail");
+		bench_json__end_object(_json);
+	}
+	bench_json__end_array(_json);
+
+	free(samples);
+}
+
+static void *bench_wait__waiter(void *_arg)
+{
+	wait_run_t *run = (wait_run_t *)_arg;
+	uint64_t deadline, cpu, start;
+
+	cpu = bench_wait__cpu_ns();
+	start = lib_clock__get_time_ns();
+	deadline = start + WAIT_TIMEOUT_NS;
+	atomic_store(&run->armed, 1);
+
+	if (run->futex) {
+		run->ret = lib_clock__wait_until_change(&run->flag, 0, deadline, run->backoff);
+	}
+	else {
+		run->ret = lib_clock__wait_until(&bench_wait__flag, &run->flag, deadline, run->backoff);
+	}
+
+	run->wake_ns = lib_clock__get_time_ns();
+	run->wall_ns = run->wake_ns - start;
+	run->cpu_ns = bench_wait__cpu_ns() - cpu;
+
+	return NULL;
+}
+
+static int bench_wait__flag(void *_arg)
+{
+	return (int)__atomic_load_n((uint32_t *)_arg, __ATOMIC_ACQUIRE);
+}
+
+/* ************************************************************************//**
+ * \brief	CPU time of the calling thread
+ * ****************************************************************************/
+static uint64_t bench_wait__cpu_ns(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
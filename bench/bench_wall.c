@@ -0,0 +1,236 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* system */
+#include <time.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_wall.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define WALL_CALLS				1000000U	// calls per cost measurement
+#define WALL_TOLERANCE_NS		50000ULL	// tolerance of the simulated scenarios
+#define WALL_STEP_NS			1000000ULL
+#define WALL_STEP				5000000000LL	// simulated settimeofday, +5s
+#define WALL_SLEW_PPB			500000LL	// simulated NTP slew, the 500ppm kernel limit
+#define WALL_SHORT_MS			50			// slewing stays below the tolerance
+#define WALL_LONG_MS			150			// slewing exceeds the tolerance
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* injected realtime source: lib_clock ns + base + step + slew since slew_start */
+typedef struct {
+	int64_t		base_ns;
+	int64_t		step_ns;
+	int64_t		slew_ppb;
+	uint64_t	slew_start;
+} bench_wall_sim_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t bench_wall__sim_read(void *_arg);
+static void bench_wall__cost(bench_json_t *_json);
+static void bench_wall__scenarios(bench_json_t *_json);
+static void bench_wall__sleep_ms(unsigned int _ms);
+static int64_t bench_wall__error_ns(bench_wall_sim_t *_sim);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	cost of a log timestamp and validation of the step and
+ * 			staleness detection against an injected realtime source
+ * ****************************************************************************/
+void bench_wall__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	(void)_cfg;
+
+	bench_wall__cost(_json);
+	bench_wall__scenarios(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	two clock reads per log line against the cached offset
+ * ****************************************************************************/
+static void bench_wall__cost(bench_json_t *_json)
+{
+	lib_clock_wall_status_t status;
+	struct timespec tp;
+	uint64_t start, pair, cached, convert, i;
+
+	if (lib_clock__wall_start(NULL) < 0) {
+		return;
+	}
+
+	start = bench__ref_ns();
+	for (i = 0; i < WALL_CALLS; i++) {
+		bench__sink(lib_clock__get_time_ns());
+		clock_gettime(CLOCK_REALTIME, &tp);
+		bench__sink((uint64_t)tp.tv_nsec);
+	}
+	pair = bench__ref_ns() - start;
+
+	start = bench__ref_ns();
+	for (i = 0; i < WALL_CALLS; i++) {
+		bench__sink(lib_clock__wall_now_ns());
+	}
+	cached = bench__ref_ns() - start;
+
+	start = bench__ref_ns();
+	for (i = 0; i < WALL_CALLS; i++) {
+		bench__sink(lib_clock__wall_from_ns(i));
+	}
+	convert = bench__ref_ns() - start;
+
+	lib_clock__wall_get_status(&status);
+	lib_clock__wall_stop();
+
+	bench_json__begin_object(_json, "cost");
+	bench_json__double(_json, "mono_plus_realtime_ns", (double)pair / WALL_CALLS);
+	bench_json__double(_json, "wall_now_ns", (double)cached / WALL_CALLS);
+	bench_json__double(_json, "wall_from_ns", (double)convert / WALL_CALLS);
+	bench_json__uint(_json, "uncertainty_ns", status.uncertainty_ns);
+	bench_json__end_object(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	clock step and NTP slew scenarios with manual refreshes
+ * ****************************************************************************/
+static void bench_wall__scenarios(bench_json_t *_json)
+{
+	bench_wall_sim_t sim = { .base_ns = 1700000000LL * 1000000000LL };
+	lib_clock_wall_cfg_t cfg = {
+		.manual = 1,
+		.tolerance_ns = WALL_TOLERANCE_NS,
+		.step_ns = WALL_STEP_NS,
+		.source = &bench_wall__sim_read,
+		.arg = &sim,
+	};
+	lib_clock_wall_status_t status;
+	int flags, stale_before, stale_after;
+	int64_t error;
+
+	if (lib_clock__wall_start(&cfg) < 0) {
+		return;
+	}
+
+	// steady: nothing to report
+	bench_wall__sleep_ms(WALL_SHORT_MS);
+	flags = lib_clock__wall_refresh();
+	bench_json__begin_object(_json, "steady");
+	bench_json__uint(_json, "flags", (uint64_t)flags);
+	bench_json__int(_json, "error_ns", bench_wall__error_ns(&sim));
+	bench_json__string(_json, "result", (flags == 0) ? "pass" : "fail");
+	bench_json__end_object(_json);
+
+	// step: the conversion is off until the refresh, exact after it
+	sim.step_ns += WALL_STEP;
+	error = bench_wall__error_ns(&sim);
+	flags = lib_clock__wall_refresh();
+	lib_clock__wall_get_status(&status);
+	bench_json__begin_object(_json, "step");
+	bench_json__int(_json, "error_before_ns", error);
+	bench_json__uint(_json, "flags", (uint64_t)flags);
+	bench_json__int(_json, "error_after_ns", bench_wall__error_ns(&sim));
+	bench_json__uint(_json, "steps", status.steps);
+	bench_json__string(_json, "result", ((flags & LIB_CLOCK_WALL_STEP) && (status.steps == 1)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+
+	// slew within the tolerance: the refresh learns the drift rate
+	sim.slew_start = lib_clock__get_time_ns();
+	sim.slew_ppb = WALL_SLEW_PPB;
+	bench_wall__sleep_ms(WALL_SHORT_MS);
+	flags = lib_clock__wall_refresh();
+	lib_clock__wall_get_status(&status);
+	bench_json__begin_object(_json, "slew_short");
+	bench_json__uint(_json, "flags", (uint64_t)flags);
+	bench_json__int(_json, "last_error_ns", status.last_error_ns);
+	bench_json__int(_json, "drift_ppb", status.drift_ppb);
+	bench_json__string(_json, "result", (flags == 0) ? "pass" : "fail");
+	bench_json__end_object(_json);
+
+	// slew beyond the tolerance: flagged by the estimate and by the refresh
+	stale_before = lib_clock__wall_is_stale();
+	bench_wall__sleep_ms(WALL_LONG_MS);
+	stale_after = lib_clock__wall_is_stale();
+	error = bench_wall__error_ns(&sim);
+	flags = lib_clock__wall_refresh();
+	lib_clock__wall_get_status(&status);
+	bench_json__begin_object(_json, "slew_long");
+	bench_json__int(_json, "stale_right_after_refresh", stale_before);
+	bench_json__int(_json, "stale_estimate", stale_after);
+	bench_json__int(_json, "error_before_ns", error);
+	bench_json__uint(_json, "flags", (uint64_t)flags);
+	bench_json__uint(_json, "stale_events", status.stale_events);
+	bench_json__int(_json, "error_after_ns", bench_wall__error_ns(&sim));
+	bench_json__string(_json, "result", (!stale_before && stale_after && (flags & LIB_CLOCK_WALL_STALE) && !(flags & LIB_CLOCK_WALL_STEP)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+
+	lib_clock__wall_stop();
+}
+
+/* ************************************************************************//**
+ * \brief	error of the cached conversion against the simulated source
+ * ****************************************************************************/
+static int64_t bench_wall__error_ns(bench_wall_sim_t *_sim)
+{
+	uint64_t now = lib_clock__get_time_ns();
+
+	return (int64_t)(lib_clock__wall_from_ns(now) - bench_wall__sim_read(_sim));
+}
+
+static uint64_t bench_wall__sim_read(void *_arg)
+{
+	bench_wall_sim_t *sim = (bench_wall_sim_t *)_arg;
+	uint64_t now = lib_clock__get_time_ns();
+	int64_t slew = 0;
+
+	if (sim->slew_ppb != 0) {
+		slew = (int64_t)((double)(now - sim->slew_start) * (double)sim->slew_ppb / 1e9);
+	}
+
+	return now + (uint64_t)(sim->base_ns + sim->step_ns + slew);
+}
+
+static void bench_wall__sleep_ms(unsigned int _ms)
+{
+	struct timespec rqtp;
+
+	rqtp.tv_sec = (time_t)(_ms / 1000U);
+	rqtp.tv_nsec = (long)(_ms % 1000U) * 1000000L;
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+}
@@ -0,0 +1,181 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_wheel.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define WHEEL_OPS			10000000U	// arms and cancels of a full run
+#define WHEEL_TIMERS		(1U << 20)	// concurrently pending timers
+#define WHEEL_MAX_TIMEOUT	600000U		// 10 minutes
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	lib_clock_wheel_timer_t	*timers;
+	uint32_t				*fire_ms;	// tick each timer fired at, 0 while unfired
+	const uint32_t			*now_ms;	// tick the wheel is advanced to
+	uint64_t				fired;
+	uint64_t				refired;	// timers fired more than once
+} bench_wheel_ctx_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_wheel__cb(lib_clock_wheel_timer_t *_timer, void *_arg);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	arm, cancel and expiry cost with a million pending timers
+ * ****************************************************************************/
+void bench_wheel__run(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	unsigned int ops = _cfg->quick ? WHEEL_OPS / 10 : WHEEL_OPS;
+	lib_clock_wheel_timer_t *timers;
+	lib_clock_wheel_t *wheel;
+	uint32_t *timeouts, *expect_ms, *fire_ms, now_ms = 0, rnd = 1;
+	uint64_t start, fired = 0, mismatches = 0, elapsed;
+	uint64_t armed = (ops < WHEEL_TIMERS) ? ops : WHEEL_TIMERS;
+	bench_wheel_ctx_t ctx;
+	unsigned int i;
+
+	wheel = malloc(sizeof(*wheel));
+	timers = malloc(WHEEL_TIMERS * sizeof(*timers));
+	timeouts = malloc(WHEEL_TIMERS * sizeof(*timeouts));
+	expect_ms = calloc(WHEEL_TIMERS, sizeof(*expect_ms));
+	fire_ms = calloc(WHEEL_TIMERS, sizeof(*fire_ms));
+	if ((wheel == NULL) || (timers == NULL) || (timeouts == NULL) || (expect_ms == NULL) || (fire_ms == NULL)) {
+		goto CLEANUP;
+	}
+
+	ctx.timers = timers;
+	ctx.fire_ms = fire_ms;
+	ctx.now_ms = &now_ms;
+	ctx.fired = 0;
+	ctx.refired = 0;
+
+	lib_clock__wheel_init(wheel, now_ms);
+	for (i = 0; i < WHEEL_TIMERS; i++) {
+		rnd = rnd * 1664525U + 1013904223U;
+		timeouts[i] = 1 + (rnd >> 8) % WHEEL_MAX_TIMEOUT;
+		lib_clock__wheel_timer_init(&timers[i], &bench_wheel__cb, &ctx);
+	}
+
+	bench_json__uint(_json, "operations", ops);
+	bench_json__uint(_json, "pending_timers", WHEEL_TIMERS);
+
+	// arm: the first pass fills the wheel, later passes re-arm pending timers
+	start = bench__ref_ns();
+	for (i = 0; i < ops; i++) {
+		lib_clock__wheel_arm(wheel, &timers[i & (WHEEL_TIMERS - 1)], timeouts[i & (WHEEL_TIMERS - 1)]);
+	}
+	elapsed = bench__ref_ns() - start;
+	bench_json__double(_json, "arm_ns", (double)elapsed / ops);
+
+	// cancel and re-arm pairs, the wheel stays populated
+	start = bench__ref_ns();
+	for (i = 0; i < ops; i++) {
+		lib_clock__wheel_cancel(wheel, &timers[i & (WHEEL_TIMERS - 1)]);
+		lib_clock__wheel_arm(wheel, &timers[i & (WHEEL_TIMERS - 1)], timeouts[(i * 7) & (WHEEL_TIMERS - 1)]);
+	}
+	elapsed = bench__ref_ns() - start;
+	bench_json__double(_json, "cancel_arm_pair_ns", (double)elapsed / ops);
+
+	// the wheel stayed at tick 0, every armed timer is due at the timeout of
+	// its last arm, a quick run leaves some timers unarmed
+	for (i = 0; i < ops; i++) {
+		expect_ms[i & (WHEEL_TIMERS - 1)] = timeouts[i & (WHEEL_TIMERS - 1)];
+	}
+	for (i = 0; i < ops; i++) {
+		expect_ms[i & (WHEEL_TIMERS - 1)] = timeouts[(i * 7) & (WHEEL_TIMERS - 1)];
+	}
+
+	// expiry: advance in 1ms ticks until every timer fired
+	start = bench__ref_ns();
+	while (wheel->pending) {
+		now_ms++;
+		fired += lib_clock__wheel_advance(wheel, now_ms);
+	}
+	elapsed = bench__ref_ns() - start;
+	bench_json__uint(_json, "fired", fired);
+	bench_json__uint(_json, "advanced_ticks", now_ms);
+	bench_json__double(_json, "expire_ns_per_timer", (fired > 0) ? (double)elapsed / (double)fired : 0.0);
+	bench_json__double(_json, "advance_ns_per_tick", (double)elapsed / now_ms);
+
+	for (i = 0; i < WHEEL_TIMERS; i++) {
+		if (fire_ms[i] != expect_ms[i]) {
+			mismatches++;
+		}
+	}
+	bench_json__uint(_json, "fire_tick_mismatches", mismatches);
+	bench_json__uint(_json, "refired", ctx.refired);
+	bench_json__string(_json, "result", ((fired == armed) && (ctx.fired == fired)
+		&& (mismatches == 0) && (ctx.refired == 0)) ? "pass" : "fail");
+
+	// cancel cost on a populated wheel
+	for (i = 0; i < WHEEL_TIMERS; i++) {
+		lib_clock__wheel_arm(wheel, &timers[i], timeouts[i]);
+	}
+	start = bench__ref_ns();
+	for (i = 0; i < WHEEL_TIMERS; i++) {
+		lib_clock__wheel_cancel(wheel, &timers[i]);
+	}
+	elapsed = bench__ref_ns() - start;
+	bench_json__double(_json, "cancel_ns", (double)elapsed / WHEEL_TIMERS);
+
+CLEANUP:
+	free(wheel);
+	free(timers);
+	free(timeouts);
+	free(expect_ms);
+	free(fire_ms);
+}
+
+static void bench_wheel__cb(lib_clock_wheel_timer_t *_timer, void *_arg)
+{
+	bench_wheel_ctx_t *ctx = (bench_wheel_ctx_t *)_arg;
+	size_t index = (size_t)(_timer - ctx->timers);
+
+	if (ctx->fire_ms[index] != 0) {
+		ctx->refired++;
+	}
+	ctx->fire_ms[index] = *ctx->now_ms;
+	ctx->fired++;
+}
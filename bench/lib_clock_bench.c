@@ -0,0 +1,182 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <unistd.h>
+#include <sys/utsname.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_posix.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench__usage(const char *_prog);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const bench_section_t s_sections[] = {
+	{ "clock",		&bench_clock__run },
+	{ "trace",		&bench_trace__run },
+	{ "histogram",	&bench_hist__run },
+	{ "periodic",	&bench_periodic__run },
+	{ "wheel",		&bench_wheel__run },
+	{ "batch",		&bench_batch__run },
+	{ "wall",		&bench_wall__run },
+	{ "format",	&bench_format__run },
+	{ "codec",		&bench_codec__run },
+	{ "shm",		&bench_shm__run },
+	{ "skew",		&bench_skew__run },
+	{ "rate",		&bench_rate__run },
+	{ "wait",		&bench_wait__run },
+	{ "monitor",	&bench_monitor__run },
+	{ "chrono",	&bench_chrono__run },
+	{ "timers",	&bench_timers__run },
+};
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+int main(int argc, char *argv[])
+{
+	bench_cfg_t cfg = { .samples = 10000, .max_threads = 0, .duration_ms = 200, .quick = 0 };
+	bench_json_t json = { .out = stdout, .depth = 0, .first = { 1 } };
+	lib_clock_cfg_t clock_cfg = { 0 };
+	lib_clock_src_info_t info;
+	const char *only = NULL;
+	int auto_sources = 0;
+	struct utsname uts;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:d:s:o:qah")) != -1) {
+		switch (opt) {
+			case 'n': cfg.samples = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 't': cfg.max_threads = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 'd': cfg.duration_ms = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 's': only = optarg; break;
+			case 'q': cfg.quick = 1; break;
+			case 'a': auto_sources = 1; break;
+			case 'o':
+				json.out = fopen(optarg, "w");
+				if (json.out == NULL) {
+					perror(optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				bench__usage(argv[0]);
+				return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (cfg.samples == 0) {
+		cfg.samples = 1;
+	}
+	if (cfg.max_threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		cfg.max_threads = (cpus > 0) ? (unsigned int)cpus : 1;
+	}
+
+	// a zeroed configuration selects every source automatically
+	if (lib_clock__init_cfg(auto_sources ? &clock_cfg : NULL) < 0) {
+		fprintf(stderr, "lib_clock__init failed\n");
+		return EXIT_FAILURE;
+	}
+
+	bench_json__begin_object(&json, NULL);
+	bench_json__begin_object(&json, "host");
+	if (uname(&uts) == 0) {
+		bench_json__string(&json, "sysname", uts.sysname);
+		bench_json__string(&json, "release", uts.release);
+		bench_json__string(&json, "machine", uts.machine);
+	}
+	bench_json__uint(&json, "cpus", (uint64_t)sysconf(_SC_NPROCESSORS_ONLN));
+	bench_json__uint(&json, "tick_freq", lib_clock__get_tick_freq());
+	bench_json__begin_object(&json, "sources");
+	for (i = 0; i < LIB_CLOCK_API_COUNT; i++) {
+		static const char *const api_names[LIB_CLOCK_API_COUNT] = { "ns", "us", "ms", "ticks" };
+
+		if (lib_clock__get_source_info((lib_clock_api_t)i, &info) == 0) {
+			bench_json__begin_object(&json, api_names[i]);
+			bench_json__string(&json, "source", info.name);
+			bench_json__uint(&json, "resolution_ns", info.resolution_ns);
+			bench_json__double(&json, "read_cost_ns", info.read_cost_ns);
+			bench_json__string(&json, "reason", info.reason);
+			bench_json__end_object(&json);
+		}
+	}
+	bench_json__end_object(&json);
+	bench_json__end_object(&json);
+
+	for (i = 0; i < sizeof(s_sections) / sizeof(s_sections[0]); i++) {
+		if (only && strcmp(only, s_sections[i].name) != 0) {
+			continue;
+		}
+		bench_json__begin_object(&json, s_sections[i].name);
+		s_sections[i].run(&json, &cfg);
+		bench_json__end_object(&json);
+		fflush(json.out);
+	}
+
+	bench_json__end_object(&json);
+	fputc('\n', json.out);
+
+	if (json.out != stdout) {
+		fclose(json.out);
+	}
+	if (json.fails) {
+		fprintf(stderr, "%u check(s) failed\n", json.fails);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static void bench__usage(const char *_prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n samples] [-t max_threads] [-d duration_ms] [-s section] [-q] [-a] [-o file]\n"
+		"  -n  latency samples per measurement (default 10000)\n"
+		"  -t  maximum number of threads of the throughput runs (default: online cpus)\n"
+		"  -d  duration of a throughput or drift run in ms (default 200)\n"
+		"  -s  only run the named section\n"
+		"  -q  quick run with reduced problem sizes\n"
+		"  -a  select the clock sources automatically instead of the build default\n"
+		"  -o  write the JSON result to a file instead of stdout\n"
+		"exits with a failure status if a check reports \"fail\"\n",
+		_prog);
+}
@@ -0,0 +1,132 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_BENCH_H_
+#define _LIB_CLOCK_BENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define BENCH_JSON_MAX_DEPTH	16
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* minimal streaming JSON writer, counts the "fail" values written */
+typedef struct {
+	FILE	*out;
+	int		depth;
+	int		first[BENCH_JSON_MAX_DEPTH];
+	unsigned int	fails;
+} bench_json_t;
+
+/* run parameters shared by all sections */
+typedef struct {
+	unsigned int	samples;		// latency samples per measurement
+	unsigned int	max_threads;	// upper bound of the throughput scaling
+	unsigned int	duration_ms;	// duration of a throughput / drift run
+	int				quick;			// reduced problem sizes
+} bench_cfg_t;
+
+/* a benchmark section, writes its results as one JSON object */
+typedef struct {
+	const char	*name;
+	void		(*run)(bench_json_t *_json, const bench_cfg_t *_cfg);
+} bench_section_t;
+
+/* summary of a sample set */
+typedef struct {
+	double	min;
+	double	median;
+	double	p99;
+	double	p999;
+	double	max;
+	double	mean;
+} bench_stats_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* JSON writer */
+void bench_json__begin_object(bench_json_t *_json, const char *_key);
+void bench_json__end_object(bench_json_t *_json);
+void bench_json__begin_array(bench_json_t *_json, const char *_key);
+void bench_json__end_array(bench_json_t *_json);
+void bench_json__uint(bench_json_t *_json, const char *_key, uint64_t _value);
+void bench_json__int(bench_json_t *_json, const char *_key, int64_t _value);
+void bench_json__double(bench_json_t *_json, const char *_key, double _value);
+void bench_json__string(bench_json_t *_json, const char *_key, const char *_value);
+void bench_json__stats(bench_json_t *_json, const char *_key, const bench_stats_t *_stats);
+
+/* statistics, sorts the given samples in place */
+void bench__stats(double *_samples, size_t _count, bench_stats_t *_stats);
+
+/* reference clock of the benchmarks, independent of lib_clock */
+uint64_t bench__ref_ns(void);
+
+/* keeps the compiler from dropping a benchmarked result */
+static inline void bench__sink(uint64_t _value)
+{
+	__asm volatile("" : : "r"(_value) : "memory");
+}
+
+/* sections */
+void bench_clock__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_trace__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_hist__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_periodic__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_wheel__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_batch__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_wall__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_format__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_codec__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_shm__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_skew__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_rate__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_wait__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_monitor__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_chrono__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+void bench_timers__run(bench_json_t *_json, const bench_cfg_t *_cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,499 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <unistd.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_stm32sim.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define SIM_CORE_HZ				72000000U
+#define SIM_MAX_GAP_CYCLES		(SIM_CORE_HZ / 1000U * 3U)	// up to 3ms of main code between samples
+#define SIM_DELAY_RUNS			200U
+#define SIM_NESTED_EVERY		5U							// register accesses between nested readers
+#define SIM_PERIODIC_US			1000U
+#define SIM_PERIODIC_WAITS		5000U
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Readings of the nested reader interrupt */
+typedef struct {
+	uint64_t	reads;
+	uint64_t	last;
+	uint64_t	backward;
+	int64_t		min_error_ns;
+	int64_t		max_error_ns;
+} sim_nested_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_sim__accuracy(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_sim__stress(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_sim__delay(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_sim__nested(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_sim__nested_reader(void *_arg);
+static void bench_sim__periodic(bench_json_t *_json, const bench_cfg_t *_cfg);
+static int bench_sim__start(uint32_t _latency, uint32_t _jitter, uint32_t _isr_cycles);
+static void bench_sim__timestamps(bench_json_t *_json, unsigned int _samples, uint32_t _max_gap);
+static void bench_sim__stats(bench_json_t *_json);
+static void bench__usage(const char *_prog);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const bench_section_t s_sections[] = {
+	{ "accuracy",	&bench_sim__accuracy },
+	{ "stress",		&bench_sim__stress },
+	{ "delay",		&bench_sim__delay },
+	{ "nested",		&bench_sim__nested },
+	{ "periodic",	&bench_sim__periodic },
+};
+
+static uint32_t s_rnd = 1;
+static lib_clock_sim_cfg_t s_sim_cfg;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+int main(int argc, char *argv[])
+{
+	bench_cfg_t cfg = { .samples = 1000000, .max_threads = 1, .duration_ms = 0, .quick = 0 };
+	bench_json_t json = { .out = stdout, .depth = 0, .first = { 1 } };
+	const char *only = NULL;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:o:qh")) != -1) {
+		switch (opt) {
+			case 'n': cfg.samples = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 's': only = optarg; break;
+			case 'q': cfg.quick = 1; break;
+			case 'o':
+				json.out = fopen(optarg, "w");
+				if (json.out == NULL) {
+					perror(optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				bench__usage(argv[0]);
+				return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (cfg.samples == 0) {
+		cfg.samples = 1;
+	}
+	if (cfg.quick) {
+		cfg.samples /= 10;
+	}
+
+	bench_json__begin_object(&json, NULL);
+	bench_json__begin_object(&json, "host");
+	bench_json__string(&json, "architecture", "stm32sim");
+	bench_json__uint(&json, "core_hz", SIM_CORE_HZ);
+	bench_json__end_object(&json);
+
+	for (i = 0; i < sizeof(s_sections) / sizeof(s_sections[0]); i++) {
+		if (only && strcmp(only, s_sections[i].name) != 0) {
+			continue;
+		}
+		bench_json__begin_object(&json, s_sections[i].name);
+		s_sections[i].run(&json, &cfg);
+		bench_json__end_object(&json);
+		fflush(json.out);
+	}
+
+	bench_json__end_object(&json);
+	fputc('\n', json.out);
+
+	if (json.out != stdout) {
+		fclose(json.out);
+	}
+	if (json.fails) {
+		fprintf(stderr, "%u check(s) failed\n", json.fails);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* ************************************************************************//**
+ * \brief	timestamp error against the exact simulated time, ideal interrupts
+ * ****************************************************************************/
+static void bench_sim__accuracy(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	if (bench_sim__start(12, 0, 40) < 0) {
+		bench_json__string(_json, "error", "lib_clock__init failed");
+		return;
+	}
+
+	bench_sim__timestamps(_json, _cfg->samples, SIM_MAX_GAP_CYCLES);
+	bench_sim__stats(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	timestamp error with a late and jittery overflow interrupt
+ *
+ * Reads are placed densely, so the interrupt often hits between the read
+ * of the overflow count and the counter register. A torn read which the
+ * s_jf_gen retry misses leaves the bracket of its read or steps back.
+ * ****************************************************************************/
+static void bench_sim__stress(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	if (bench_sim__start(200, 2000, 300) < 0) {
+		bench_json__string(_json, "error", "lib_clock__init failed");
+		return;
+	}
+
+	bench_sim__timestamps(_json, _cfg->samples, 64);
+	bench_sim__stats(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	overshoot of lib_clock__delay_us in simulated nanoseconds
+ * ****************************************************************************/
+static void bench_sim__delay(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	static const uint32_t delays_us[] = { 1, 10, 100, 999, 1000, 5000 };
+	double *samples;
+	bench_stats_t stats;
+	double min_overshoot = 0.0;
+	uint64_t start;
+	unsigned int runs = _cfg->quick ? SIM_DELAY_RUNS / 10 : SIM_DELAY_RUNS;
+	size_t d;
+	unsigned int i;
+
+	if (bench_sim__start(12, 0, 40) < 0) {
+		bench_json__string(_json, "error", "lib_clock__init failed");
+		return;
+	}
+
+	samples = malloc(runs * sizeof(*samples));
+	if (samples == NULL) {
+		return;
+	}
+
+	bench_json__begin_array(_json, "overshoot_ns");
+	for (d = 0; d < sizeof(delays_us) / sizeof(delays_us[0]); d++) {
+		for (i = 0; i < runs; i++) {
+			s_rnd = s_rnd * 1664525U + 1013904223U;
+			lib_clock__sim_run(s_rnd % SIM_MAX_GAP_CYCLES);
+
+			start = lib_clock__sim_time_ns();
+			lib_clock__delay_us(delays_us[d]);
+			samples[i] = (double)(int64_t)(lib_clock__sim_time_ns() - start - (uint64_t)delays_us[d] * 1000ULL);
+		}
+		bench__stats(samples, runs, &stats);
+		if ((d == 0) || (stats.min < min_overshoot)) {
+			min_overshoot = stats.min;
+		}
+
+		bench_json__begin_object(_json, NULL);
+		bench_json__uint(_json, "delay_us", delays_us[d]);
+		bench_json__uint(_json, "runs", runs);
+		bench_json__stats(_json, "overshoot_ns", &stats);
+		bench_json__end_object(_json);
+	}
+	bench_json__end_array(_json);
+	// a delay may run long but never return before the requested time
+	bench_json__string(_json, "result", (min_overshoot >= 0.0) ? "pass" : "fail");
+	bench_sim__stats(_json);
+
+	free(samples);
+}
+
+/* ************************************************************************//**
+ * \brief	timestamps read by an interrupt which preempts the timer ISR
+ *
+ * The nested reader sees the overflow count and the update flag at any
+ * point of the timer ISR, it must neither count an overflow twice nor
+ * miss it. The main code samples densely at the same time.
+ * ****************************************************************************/
+static void bench_sim__nested(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	sim_nested_t nested = { .min_error_ns = INT64_MAX, .max_error_ns = INT64_MIN };
+	int64_t bound;
+
+	if (bench_sim__start(200, 2000, 300) < 0) {
+		bench_json__string(_json, "error", "lib_clock__init failed");
+		return;
+	}
+
+	lib_clock__sim_set_nested(SIM_NESTED_EVERY, &bench_sim__nested_reader, &nested);
+	bench_sim__timestamps(_json, _cfg->samples, 64);
+	lib_clock__sim_set_nested(0, NULL, NULL);
+
+	// the tick truncates, the read itself takes a few register accesses
+	bound = (int64_t)(2000000000ULL / lib_clock__get_tick_freq());
+
+	bench_json__begin_object(_json, "nested_reader");
+	bench_json__uint(_json, "reads", nested.reads);
+	bench_json__int(_json, "min_error_ns", nested.reads ? nested.min_error_ns : 0);
+	bench_json__int(_json, "max_error_ns", nested.reads ? nested.max_error_ns : 0);
+	bench_json__uint(_json, "backward_steps", nested.backward);
+	bench_json__int(_json, "error_bound_ns", bound);
+	bench_json__string(_json, "result", ((nested.reads > 0) && (nested.backward == 0)
+		&& (nested.min_error_ns >= -bound) && (nested.max_error_ns <= bound)) ? "pass" : "fail");
+	bench_json__end_object(_json);
+	bench_sim__stats(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	handler of the nested interrupt, reads the clock
+ * ****************************************************************************/
+static void bench_sim__nested_reader(void *_arg)
+{
+	sim_nested_t *nested = (sim_nested_t *)_arg;
+	uint64_t ref_ns = lib_clock__sim_time_ns();
+	uint64_t ticks = lib_clock__get_clock_ticks();
+	int64_t error = (int64_t)(lib_clock__ticks_to_ns(ticks) - ref_ns);
+
+	if (nested->reads && (ticks < nested->last)) {
+		nested->backward++;
+	}
+	if (error < nested->min_error_ns) {
+		nested->min_error_ns = error;
+	}
+	if (error > nested->max_error_ns) {
+		nested->max_error_ns = error;
+	}
+	nested->last = ticks;
+	nested->reads++;
+}
+
+/* ************************************************************************//**
+ * \brief	cumulative drift of a periodic timer against the simulated time
+ *
+ * The deadlines are multiples of the period from the init, the end of the
+ * run lags by the lateness of the last wakeup only. A period which is off
+ * by a tick drifts by 1000ppm.
+ * ****************************************************************************/
+static void bench_sim__periodic(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	unsigned int waits = _cfg->quick ? SIM_PERIODIC_WAITS / 10U : SIM_PERIODIC_WAITS;
+	lib_clock_periodic_t periodic;
+	uint64_t start, expected;
+	int64_t drift, slack;
+	unsigned int i;
+
+	if (bench_sim__start(200, 2000, 300) < 0) {
+		bench_json__string(_json, "error", "lib_clock__init failed");
+		return;
+	}
+
+	start = lib_clock__sim_time_ns();
+	if (lib_clock__periodic_init(&periodic, SIM_PERIODIC_US) < 0) {
+		bench_json__string(_json, "error", "lib_clock__periodic_init failed");
+		return;
+	}
+	for (i = 0; i < waits; i++) {
+		lib_clock__periodic_wait(&periodic);
+	}
+	expected = (waits + periodic.missed) * SIM_PERIODIC_US * 1000ULL;
+	drift = (int64_t)(lib_clock__sim_time_ns() - start - expected);
+
+	// the init reads a truncated tick, the reads take a few register accesses
+	slack = (int64_t)(2000000000ULL / lib_clock__get_tick_freq());
+
+	bench_json__uint(_json, "period_us", SIM_PERIODIC_US);
+	bench_json__uint(_json, "periods", periodic.periods);
+	bench_json__uint(_json, "missed", periodic.missed);
+	bench_json__uint(_json, "max_lateness_ns", periodic.max_lateness_ns);
+	bench_json__int(_json, "cumulative_drift_ns", drift);
+	bench_json__uint(_json, "drift_bound_ns", periodic.max_lateness_ns + (uint64_t)slack);
+	bench_json__string(_json, "result", ((drift >= -slack)
+		&& (drift <= (int64_t)periodic.max_lateness_ns + slack)) ? "pass" : "fail");
+	bench_sim__stats(_json);
+}
+
+/* ************************************************************************//**
+ * \brief	reset the simulated core and initialize lib_clock on it
+ * ****************************************************************************/
+static int bench_sim__start(uint32_t _latency, uint32_t _jitter, uint32_t _isr_cycles)
+{
+	lib_clock_sim_cfg_t cfg = {
+		.core_hz = SIM_CORE_HZ,
+		.access_cycles = 4,
+		.irq_latency_cycles = _latency,
+		.irq_jitter_cycles = _jitter,
+		.isr_cycles = _isr_cycles,
+		.seed = 1
+	};
+
+	s_sim_cfg = cfg;
+	if (lib_clock__sim_configure(&cfg) < 0) {
+		return -1;
+	}
+
+	return lib_clock__init();
+}
+
+/* ************************************************************************//**
+ * \brief	sample all timestamp getters against the exact simulated time
+ *
+ * Each read is bracketed by the simulated time before and after it. It must
+ * not lie past the end of its bracket, nor before the start by more than
+ * one unit of the getter. The millisecond counter is advanced by the ISR,
+ * it may lag by the injected interrupt latency on top. Any backward step or
+ * read outside these bounds fails the section.
+ * ****************************************************************************/
+static void bench_sim__timestamps(bench_json_t *_json, unsigned int _samples, uint32_t _max_gap)
+{
+	static const char *const names[] = { "get_time_us", "get_time_ns", "get_clock_ticks", "get_time_ms" };
+	enum { API_US, API_NS, API_TICKS, API_MS, API_COUNT };
+	uint64_t last[API_COUNT] = { 0 }, backward[API_COUNT] = { 0 }, outside[API_COUNT] = { 0 }, value[API_COUNT];
+	uint64_t early_ns[API_COUNT];
+	double *err[API_COUNT] = { NULL };
+	bench_stats_t stats;
+	uint64_t wall, before, after, value_ns, tick_ns, latency_ns;
+	unsigned int i;
+	int api, ok = 1;
+
+	tick_ns = (1000000000ULL + lib_clock__get_tick_freq() - 1) / lib_clock__get_tick_freq();
+	latency_ns = ((uint64_t)s_sim_cfg.irq_latency_cycles + s_sim_cfg.irq_jitter_cycles + s_sim_cfg.isr_cycles)
+		* 1000000000ULL / s_sim_cfg.core_hz + 1;
+	early_ns[API_US] = (tick_ns > 1000ULL) ? tick_ns : 1000ULL;
+	early_ns[API_NS] = tick_ns;
+	early_ns[API_TICKS] = tick_ns;
+	early_ns[API_MS] = 1000000ULL + latency_ns;
+
+	for (api = 0; api < API_COUNT; api++) {
+		err[api] = malloc(_samples * sizeof(double));
+		if (err[api] == NULL) {
+			goto CLEANUP;
+		}
+	}
+
+	wall = bench__ref_ns();
+	for (i = 0; i < _samples; i++) {
+		s_rnd = s_rnd * 1664525U + 1013904223U;
+		lib_clock__sim_run(s_rnd % _max_gap);
+
+		for (api = 0; api < API_COUNT; api++) {
+			before = lib_clock__sim_time_ns();
+			switch (api) {
+				case API_US:
+					value[api] = lib_clock__get_time_us();
+					value_ns = value[api] * 1000ULL;
+					break;
+				case API_NS:
+					value[api] = lib_clock__get_time_ns();
+					value_ns = value[api];
+					break;
+				case API_TICKS:
+					value[api] = lib_clock__get_clock_ticks();
+					value_ns = lib_clock__ticks_to_ns(value[api]);
+					break;
+				default:
+					value[api] = lib_clock__get_time_ms();
+					value_ns = value[api] * 1000000ULL;
+					break;
+			}
+			after = lib_clock__sim_time_ns();
+
+			err[api][i] = (double)(int64_t)(value_ns - before);
+			if ((value_ns + early_ns[api] < before) || (value_ns > after)) {
+				outside[api]++;
+			}
+			if (i && (value[api] < last[api])) {
+				backward[api]++;
+			}
+			last[api] = value[api];
+		}
+	}
+	wall = bench__ref_ns() - wall;
+
+	bench_json__uint(_json, "samples", _samples);
+	bench_json__double(_json, "simulated_s", (double)lib_clock__sim_time_ns() / 1e9);
+	bench_json__double(_json, "simulated_s_per_wall_s", (double)lib_clock__sim_time_ns() / (double)(wall ? wall : 1));
+	bench_json__uint(_json, "tick_freq", lib_clock__get_tick_freq());
+	for (api = 0; api < API_COUNT; api++) {
+		bench_json__begin_object(_json, names[api]);
+		bench__stats(err[api], _samples, &stats);
+		bench_json__stats(_json, "error_ns", &stats);
+		bench_json__uint(_json, "backward_steps", backward[api]);
+		bench_json__int(_json, "error_bound_min_ns", -(int64_t)early_ns[api]);
+		bench_json__uint(_json, "outside_bounds", outside[api]);
+		bench_json__end_object(_json);
+		if ((backward[api] != 0) || (outside[api] != 0)) {
+			ok = 0;
+		}
+	}
+	bench_json__string(_json, "result", ok ? "pass" : "fail");
+
+CLEANUP:
+	for (api = 0; api < API_COUNT; api++) {
+		free(err[api]);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	event counters of the simulation
+ * ****************************************************************************/
+static void bench_sim__stats(bench_json_t *_json)
+{
+	lib_clock_sim_stats_t stats;
+
+	lib_clock__sim_get_stats(&stats);
+	bench_json__begin_object(_json, "sim");
+	bench_json__uint(_json, "irqs", stats.irqs);
+	bench_json__uint(_json, "update_events", stats.update_events);
+	bench_json__uint(_json, "lost_updates", stats.lost_updates);
+	bench_json__uint(_json, "max_irq_latency_cycles", stats.max_irq_latency_cycles);
+	bench_json__uint(_json, "masked_cycles", stats.masked_cycles);
+	bench_json__uint(_json, "max_masked_cycles", stats.max_masked_cycles);
+	bench_json__uint(_json, "register_reads", stats.register_reads);
+	bench_json__uint(_json, "nested_irqs", stats.nested_irqs);
+	bench_json__end_object(_json);
+}
+
+static void bench__usage(const char *_prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n samples] [-s section] [-q] [-o file]\n"
+		"  -n  timestamp samples per run (default 1000000)\n"
+		"  -s  only run the named section\n"
+		"  -q  quick run with reduced problem sizes\n"
+		"  -o  write the JSON result to a file instead of stdout\n"
+		"exits with a failure status if a check reports \"fail\"\n",
+		_prog);
+}
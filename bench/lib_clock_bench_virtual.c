@@ -0,0 +1,335 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <pthread.h>
+#include <unistd.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include <lib_clock.h>
+#include <lib_clock_virtual.h>
+#include "lib_clock_bench.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define VIRT_SIM_HOURS			24U
+#define VIRT_PARK_THREADS		4U
+#define VIRT_PARK_STEPS			20000U
+#define VIRT_PARK_TIMEOUT_MS	5000U
+#define VIRT_WRAP_MS			(1ULL << 32)
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	pthread_t	thread;
+	uint32_t	period_us;
+	uint32_t	rounds;
+	uint64_t	late;			// wakeups not exactly on the deadline
+	uint64_t	missed;
+} virt_worker_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void bench_virt__advance(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_virt__park(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void bench_virt__wrap(bench_json_t *_json, const bench_cfg_t *_cfg);
+static void *bench_virt__worker(void *_arg);
+static void bench__usage(const char *_prog);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const bench_section_t s_sections[] = {
+	{ "advance",	&bench_virt__advance },
+	{ "park",		&bench_virt__park },
+	{ "wrap",		&bench_virt__wrap },
+};
+
+static uint32_t s_active;	// park workers which did not finish yet
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+int main(int argc, char *argv[])
+{
+	bench_cfg_t cfg = { .samples = 1000000, .max_threads = VIRT_PARK_THREADS, .duration_ms = 0, .quick = 0 };
+	bench_json_t json = { .out = stdout, .depth = 0, .first = { 1 } };
+	const char *only = NULL;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:o:qh")) != -1) {
+		switch (opt) {
+			case 'n': cfg.samples = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 's': only = optarg; break;
+			case 'q': cfg.quick = 1; break;
+			case 'o':
+				json.out = fopen(optarg, "w");
+				if (json.out == NULL) {
+					perror(optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				bench__usage(argv[0]);
+				return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (cfg.samples == 0) {
+		cfg.samples = 1;
+	}
+	if (cfg.quick) {
+		cfg.samples /= 10;
+	}
+
+	bench_json__begin_object(&json, NULL);
+	bench_json__begin_object(&json, "host");
+	bench_json__string(&json, "architecture", "virtual");
+	bench_json__uint(&json, "tick_freq", lib_clock__get_tick_freq());
+	bench_json__end_object(&json);
+
+	for (i = 0; i < sizeof(s_sections) / sizeof(s_sections[0]); i++) {
+		if (only && strcmp(only, s_sections[i].name) != 0) {
+			continue;
+		}
+		bench_json__begin_object(&json, s_sections[i].name);
+		s_sections[i].run(&json, &cfg);
+		bench_json__end_object(&json);
+		fflush(json.out);
+	}
+
+	bench_json__end_object(&json);
+	fputc('\n', json.out);
+
+	if (json.out != stdout) {
+		fclose(json.out);
+	}
+	if (json.fails) {
+		fprintf(stderr, "%u check(s) failed\n", json.fails);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* ************************************************************************//**
+ * \brief	run a periodic loop over virtual hours, waits advance the time
+ * ****************************************************************************/
+static void bench_virt__advance(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	lib_clock_periodic_t periodic;
+	uint64_t wall, start_ns, reads = 0, backward = 0, last = 0, now;
+	uint32_t period_us = 1000;
+	uint64_t rounds = (uint64_t)(_cfg->quick ? 1U : VIRT_SIM_HOURS) * 3600ULL * 1000000ULL / period_us;
+	uint64_t i;
+	int ret;
+
+	lib_clock__virtual_reset(0);
+	lib_clock__virtual_set_delay_mode(LIB_CLOCK_VIRTUAL_ADVANCE);
+	start_ns = lib_clock__get_time_ns();
+
+	ret = lib_clock__periodic_init(&periodic, period_us);
+	if (ret < EOK) {
+		bench_json__string(_json, "error", "lib_clock__periodic_init failed");
+		return;
+	}
+
+	wall = bench__ref_ns();
+	for (i = 0; i < rounds; i++) {
+		lib_clock__periodic_wait(&periodic);
+
+		// a little work per period, which itself takes virtual time
+		lib_clock__delay_us(100);
+		now = lib_clock__get_time_ns();
+		if (now < last) {
+			backward++;
+		}
+		last = now;
+		reads++;
+	}
+	wall = bench__ref_ns() - wall;
+
+	bench_json__uint(_json, "period_us", period_us);
+	bench_json__uint(_json, "periods", periodic.periods);
+	bench_json__uint(_json, "missed", periodic.missed);
+	bench_json__uint(_json, "max_lateness_ns", periodic.max_lateness_ns);
+	bench_json__uint(_json, "backward_steps", backward);
+	bench_json__double(_json, "simulated_s", (double)(lib_clock__get_time_ns() - start_ns) / 1e9);
+	bench_json__double(_json, "wall_ms", (double)wall / 1e6);
+	bench_json__double(_json, "ns_per_period", (double)wall / (double)(reads ? reads : 1));
+	bench_json__string(_json, "result",
+		((periodic.periods == rounds) && (periodic.missed == 0) && (backward == 0)
+		 && (lib_clock__get_time_ns() - start_ns == rounds * period_us * 1000ULL + 100000ULL)) ? "pass" : "fail");
+}
+
+/* ************************************************************************//**
+ * \brief	threads park in periodic waits, the driver steps the time
+ *
+ * The driver waits until all workers are parked and jumps straight to the
+ * earliest deadline, so every wakeup has to be exactly on time.
+ * ****************************************************************************/
+static void bench_virt__park(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	static const uint32_t periods_us[VIRT_PARK_THREADS] = { 100, 250, 1000, 1300 };
+	virt_worker_t workers[VIRT_PARK_THREADS] = { 0 };
+	uint32_t threads = (_cfg->max_threads < VIRT_PARK_THREADS) ? _cfg->max_threads : VIRT_PARK_THREADS;
+	uint32_t steps_max = _cfg->quick ? VIRT_PARK_STEPS / 10U : VIRT_PARK_STEPS;
+	uint64_t wall, late = 0, missed = 0, steps = 0, timeouts = 0;
+	uint32_t t, started = 0, active, waits = 0;
+
+	lib_clock__virtual_reset(0);
+	lib_clock__virtual_set_delay_mode(LIB_CLOCK_VIRTUAL_PARK);
+
+	// each worker runs for the same virtual duration
+	__atomic_store_n(&s_active, threads, __ATOMIC_RELEASE);
+	for (t = 0; t < threads; t++) {
+		workers[t].period_us = periods_us[t];
+		workers[t].rounds = (uint32_t)((uint64_t)steps_max * periods_us[0] / periods_us[t]);
+		if (pthread_create(&workers[t].thread, NULL, &bench_virt__worker, &workers[t]) != 0) {
+			__atomic_sub_fetch(&s_active, threads - t, __ATOMIC_RELEASE);
+			break;
+		}
+		started++;
+	}
+
+	wall = bench__ref_ns();
+	while ((active = __atomic_load_n(&s_active, __ATOMIC_ACQUIRE)) != 0) {
+		// every running worker has to be parked before the time moves
+		if (lib_clock__virtual_parked() < active) {
+			if (lib_clock__virtual_wait_parked(active, 1) < EOK) {
+				if (++waits > VIRT_PARK_TIMEOUT_MS) {
+					timeouts++;
+					break;
+				}
+			}
+			continue;
+		}
+		waits = 0;
+		if (lib_clock__virtual_advance_next(NULL) < EOK) {
+			break;
+		}
+		steps++;
+	}
+	wall = bench__ref_ns() - wall;
+
+	for (t = 0; t < started; t++) {
+		pthread_join(workers[t].thread, NULL);
+		late += workers[t].late;
+		missed += workers[t].missed;
+	}
+	lib_clock__virtual_set_delay_mode(LIB_CLOCK_VIRTUAL_ADVANCE);
+
+	bench_json__uint(_json, "threads", started);
+	bench_json__uint(_json, "steps", steps);
+	bench_json__uint(_json, "late_wakeups", late);
+	bench_json__uint(_json, "missed", missed);
+	bench_json__uint(_json, "timeouts", timeouts);
+	bench_json__double(_json, "simulated_ms", (double)lib_clock__get_time_ns() / 1e6);
+	bench_json__double(_json, "wall_ms", (double)wall / 1e6);
+	bench_json__double(_json, "us_per_step", (double)wall / 1e3 / (double)(steps ? steps : 1));
+	bench_json__string(_json, "result", ((late == 0) && (missed == 0) && (timeouts == 0) && (started == threads)) ? "pass" : "fail");
+}
+
+/* ************************************************************************//**
+ * \brief	the millisecond counter wraps at 2^32 like on the other backends
+ * ****************************************************************************/
+static void bench_virt__wrap(bench_json_t *_json, const bench_cfg_t *_cfg)
+{
+	uint32_t before, after, since;
+	int ok;
+
+	(void)_cfg;
+
+	lib_clock__virtual_set_delay_mode(LIB_CLOCK_VIRTUAL_ADVANCE);
+	if (lib_clock__virtual_reset((VIRT_WRAP_MS - 5ULL) * 1000000ULL) < EOK) {
+		bench_json__string(_json, "error", "lib_clock__virtual_reset failed");
+		return;
+	}
+
+	before = lib_clock__get_time_ms();
+	lib_clock__delay_us(10000);
+	after = lib_clock__get_time_ms();
+	since = lib_clock__get_time_since_ms(before);
+
+	ok = (before == UINT32_MAX - 4U) && (after == 5U) && (since == 10U)
+		&& (lib_clock__get_time_us() == (VIRT_WRAP_MS + 5ULL) * 1000ULL)
+		&& (lib_clock__virtual_set_ns(0) == -ESTD_INVAL);
+
+	bench_json__uint(_json, "ms_before", before);
+	bench_json__uint(_json, "ms_after", after);
+	bench_json__uint(_json, "since_ms", since);
+	bench_json__string(_json, "result", ok ? "pass" : "fail");
+}
+
+/* ************************************************************************//**
+ * \brief	worker of the park section, checks every wakeup against its deadline
+ * ****************************************************************************/
+static void *bench_virt__worker(void *_arg)
+{
+	virt_worker_t *worker = (virt_worker_t *)_arg;
+	lib_clock_periodic_t periodic;
+	uint64_t deadline;
+	uint32_t i;
+
+	lib_clock__periodic_init(&periodic, worker->period_us);
+	for (i = 0; i < worker->rounds; i++) {
+		deadline = periodic.next;
+		if (lib_clock__periodic_wait(&periodic) != 0) {
+			worker->missed++;
+		}
+		if (lib_clock__get_time_ns() != deadline) {
+			worker->late++;
+		}
+	}
+
+	__atomic_sub_fetch(&s_active, 1U, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void bench__usage(const char *_prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s section] [-q] [-o file]\n"
+		"  -s  only run the named section\n"
+		"  -q  quick run with reduced problem sizes\n"
+		"  -o  write the JSON result to a file instead of stdout\n"
+		"exits with a failure status if a check reports \"fail\"\n",
+		_prog);
+}
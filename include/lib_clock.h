@@ -1,107 +1,242 @@
-/*
- * This file is part of the EMBTOM project
- * Copyright (c) 2018-2020 Thomas Willetal 
- * (https://github.com/embtom)
- *
- * Permission is hereby granted, free of charge, to any person obtaining
- * a copy of this software and associated documentation files (the
- * "Software"), to deal in the Software without restriction, including
- * without limitation the rights to use, copy, modify, merge, publish,
- * distribute, sublicense, and/or sell copies of the Software, and to
- * permit persons to whom the Software is furnished to do so, subject to
- * the following conditions:
- *
- * The above copyright notice and this permission notice shall be
- * included in all copies or substantial portions of the Software.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
- * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
- * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
- * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
- * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
- * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
- * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
- */
-
-#ifndef _LIB_CLOCK_H_
-#define _LIB_CLOCK_H_
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-
-/* *******************************************************************
- * includes
- * ******************************************************************/
-
-/* c-runtime */
-#include <stdint.h>
-
-/* *******************************************************************
- * Function Prototypes
- * ******************************************************************/
-
-/* ************************************************************************//**
- * \brief	Initialization of the timing module
- *
- * This function initialize the time module component.
- *
- * \return	error code (currently always EOK)
- * ****************************************************************************/
-int lib_clock__init(void);
-
-/* ************************************************************************//**
- * \brief	get current timestamp in milliseconds
- *
- * This function returns a monotonic timestamp.
- * The returned value overflows after approximately 49.7 days.
- *
- * \return	current timestamp in milliseconds
- * ****************************************************************************/
-uint32_t lib_clock__get_time_ms(void);
-
-/* ************************************************************************//**
- * \brief	get current timestamp in nanoseconds
- *
- * This function returns a monotonic timestamp 
- * 
- * \return	current timestamp in nanoseconds
- * ****************************************************************************/
-uint64_t lib_clock__get_time_ns(void);
-
-/* ************************************************************************//**
- * \brief	get current timestamp in microseconds
- *
-
- * \return	current timestamp in microseconds
- * ****************************************************************************/
-uint64_t lib_clock__get_time_us(void);
-
-/* ************************************************************************//**
- * \brief	get relative time difference since the given timestamp in milliseconds
- *
- * \param	_lasttime			timestamp to calculate the difference from
- * \return	relative time difference in milliseconds
- * ****************************************************************************/
-uint32_t lib_clock__get_time_since_ms(uint32_t _lasttime);
-
-/* ************************************************************************//**
- * \brief blocking delay 
- *
- *  \param _delay : number of microseconds to delay the caller
- * ****************************************************************************/
-void lib_clock__delay_us(uint32_t _delay);
-
-/* ************************************************************************//**
- * \brief	get clock ticks since system startup
- *
- * \return	number of clock ticks as 64bit value
- * ****************************************************************************/
-uint64_t lib_clock__get_clock_ticks(void);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal 
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_H_
+#define _LIB_CLOCK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Periodic timer on absolute deadlines, see lib_clock__periodic_init.
+ * The deadline fields are in backend specific units. */
+typedef struct {
+	uint64_t	period;				// period in backend units
+	uint64_t	next;				// next absolute deadline in backend units
+	uint32_t	period_rem;			// millionths of a unit the period exceeds 'period' by
+	uint32_t	next_rem;			// and the millionths collected towards 'next'
+	uint64_t	periods;			// number of completed waits
+	uint64_t	missed;				// number of skipped periods due to overruns
+	uint64_t	max_lateness_ns;	// worst observed wakeup after a deadline
+} lib_clock_periodic_t;
+
+/* Tick conversion factor: y = (x * mult) >> shift with a 128bit product */
+typedef struct {
+	uint64_t	mult;
+	uint32_t	shift;
+} lib_clock_tick_conv_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	Initialization of the timing module
+ *
+ * This function initialize the time module component.
+ *
+ * \return	error code (currently always EOK)
+ * ****************************************************************************/
+int lib_clock__init(void);
+
+/* ************************************************************************//**
+ * \brief	get current timestamp in milliseconds
+ *
+ * This function returns a monotonic timestamp.
+ * The returned value overflows after approximately 49.7 days.
+ *
+ * \return	current timestamp in milliseconds
+ * ****************************************************************************/
+uint32_t lib_clock__get_time_ms(void);
+
+/* ************************************************************************//**
+ * \brief	get current timestamp in nanoseconds
+ *
+ * This function returns a monotonic timestamp 
+ * 
+ * \return	current timestamp in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_time_ns(void);
+
+/* ************************************************************************//**
+ * \brief	get current timestamp in microseconds
+ *
+
+ * \return	current timestamp in microseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_time_us(void);
+
+/* ************************************************************************//**
+ * \brief	get relative time difference since the given timestamp in milliseconds
+ *
+ * \param	_lasttime			timestamp to calculate the difference from
+ * \return	relative time difference in milliseconds
+ * ****************************************************************************/
+uint32_t lib_clock__get_time_since_ms(uint32_t _lasttime);
+
+/* ************************************************************************//**
+ * \brief blocking delay 
+ *
+ *  \param _delay : number of microseconds to delay the caller
+ * ****************************************************************************/
+void lib_clock__delay_us(uint32_t _delay);
+
+/* ************************************************************************//**
+ * \brief	get clock ticks since system startup
+ *
+ * The tick source is the cheapest counter of the backend. Raw ticks can be
+ * stored and converted lazily with lib_clock__ticks_to_ns.
+ *
+ * \return	number of clock ticks as 64bit value
+ * ****************************************************************************/
+uint64_t lib_clock__get_clock_ticks(void);
+
+/* ************************************************************************//**
+ * \brief	convert a number of clock ticks to nanoseconds
+ *
+ * The conversion is a pure scaling, it is meant for tick differences.
+ *
+ * \param	_ticks				number of clock ticks
+ * \return	duration in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__ticks_to_ns(uint64_t _ticks);
+
+/* ************************************************************************//**
+ * \brief	convert nanoseconds to a number of clock ticks
+ *
+ * \param	_ns					duration in nanoseconds
+ * \return	number of clock ticks
+ * ****************************************************************************/
+uint64_t lib_clock__ns_to_ticks(uint64_t _ns);
+
+/* ************************************************************************//**
+ * \brief	get the frequency of the clock ticks
+ *
+ * \return	clock ticks per second
+ * ****************************************************************************/
+uint64_t lib_clock__get_tick_freq(void);
+
+/* ************************************************************************//**
+ * \brief	get the factors behind lib_clock__ticks_to_ns / lib_clock__ns_to_ticks
+ *
+ * Applying them gives the same results as the conversion functions, for
+ * code which converts many values at once.
+ *
+ * \param	_to_ns				ticks -> ns factor, may be NULL
+ * \param	_to_ticks			ns -> ticks factor, may be NULL
+ * ****************************************************************************/
+void lib_clock__get_tick_conv(lib_clock_tick_conv_t *_to_ns, lib_clock_tick_conv_t *_to_ticks);
+
+/* ************************************************************************//**
+ * \brief	set up a periodic timer
+ *
+ * The first deadline is one period after this call. All following
+ * deadlines are multiples of the period from there, so the loop does
+ * not accumulate drift however long the work between two waits takes.
+ *
+ * \param	_hdl				periodic timer handle
+ * \param	_period_us			period in microseconds
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__periodic_init(lib_clock_periodic_t *_hdl, uint32_t _period_us);
+
+/* ************************************************************************//**
+ * \brief	block until the next deadline of a periodic timer
+ *
+ * If the caller overran one or more complete periods, these are skipped
+ * and counted in _hdl->missed, the phase of the loop is kept.
+ *
+ * \param	_hdl				periodic timer handle
+ * \return	number of periods missed before this wait, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__periodic_wait(lib_clock_periodic_t *_hdl);
+
+/* ************************************************************************//**
+ * \brief	start the background ticker of the cached clock
+ *
+ * A ticker publishes the current time every _period_us microseconds.
+ * The lib_clock__get_cached_time_* functions then read the published
+ * value with a single load, their result is stale by at most one period
+ * plus the scheduling latency of the ticker.
+ *
+ * \param	_period_us			update period in microseconds
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__cached_start(uint32_t _period_us);
+
+/* ************************************************************************//**
+ * \brief	stop the background ticker of the cached clock
+ *
+ * After the ticker is stopped the cached getters read the clock directly.
+ *
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__cached_stop(void);
+
+/* ************************************************************************//**
+ * \brief	worst observed gap between two ticker updates
+ *
+ * \return	upper bound of the cached clock staleness in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__cached_max_staleness_ns(void);
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in nanoseconds
+ *
+ * \return	last published timestamp in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_ns(void);
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in microseconds
+ *
+ * \return	last published timestamp in microseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_us(void);
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in milliseconds
+ *
+ * \return	last published timestamp in milliseconds
+ * ****************************************************************************/
+uint32_t lib_clock__get_cached_time_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
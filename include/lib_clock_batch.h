@@ -0,0 +1,136 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_BATCH_H_
+#define _LIB_CLOCK_BATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stddef.h>
+
+/* project */
+#include "lib_clock.h"
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	stamp a batch with a single clock reading
+ *
+ * _stamps[i] = now + i * _spacing_ns, a spacing of 0 assigns the same
+ * timestamp to the whole batch.
+ *
+ * \param	_stamps				timestamps in nanoseconds
+ * \param	_count				number of slots
+ * \param	_spacing_ns			distance between two slots
+ * \return	the clock reading used for the batch
+ * ****************************************************************************/
+uint64_t lib_clock__batch_stamp_ns(uint64_t *_stamps, size_t _count, uint64_t _spacing_ns);
+
+/* ************************************************************************//**
+ * \brief	stamp a batch with a single clock tick reading
+ *
+ * Same as lib_clock__batch_stamp_ns with lib_clock__get_clock_ticks.
+ * ****************************************************************************/
+uint64_t lib_clock__batch_stamp_ticks(uint64_t *_stamps, size_t _count, uint64_t _spacing_ticks);
+
+/* ************************************************************************//**
+ * \brief	interpolate a batch linearly between two readings
+ *
+ * _stamps[0] is _first and _stamps[_count - 1] is _last, the slots in
+ * between are evenly spread without accumulating rounding errors. The
+ * unit does not matter, e.g. readings taken before and after receiving a
+ * batch of packets.
+ *
+ * \param	_stamps				interpolated timestamps
+ * \param	_count				number of slots
+ * \param	_first				reading belonging to the first slot
+ * \param	_last				reading belonging to the last slot, not below _first
+ * ****************************************************************************/
+void lib_clock__batch_interpolate(uint64_t *_stamps, size_t _count, uint64_t _first, uint64_t _last);
+
+/* ************************************************************************//**
+ * \brief	array unit conversions
+ *
+ * The divisions are exact (truncating) and done with precomputed
+ * reciprocal multipliers. On x86 the scalar, SSE2 and AVX2 kernels are
+ * timed on first use and the fastest one per operation is taken.
+ * _src and _dst may be the same array.
+ *
+ * \param	_src				input values
+ * \param	_dst				converted values
+ * \param	_count				number of values
+ * ****************************************************************************/
+void lib_clock__batch_ns_to_us(const uint64_t *_src, uint64_t *_dst, size_t _count);
+void lib_clock__batch_ns_to_ms(const uint64_t *_src, uint64_t *_dst, size_t _count);
+void lib_clock__batch_us_to_ns(const uint64_t *_src, uint64_t *_dst, size_t _count);
+void lib_clock__batch_ms_to_ns(const uint64_t *_src, uint64_t *_dst, size_t _count);
+
+/* ************************************************************************//**
+ * \brief	array tick conversions with the conversion of the backend
+ *
+ * \param	_src				input values
+ * \param	_dst				converted values
+ * \param	_count				number of values
+ * ****************************************************************************/
+void lib_clock__batch_ticks_to_ns(const uint64_t *_src, uint64_t *_dst, size_t _count);
+void lib_clock__batch_ns_to_ticks(const uint64_t *_src, uint64_t *_dst, size_t _count);
+void lib_clock__batch_ticks_to_us(const uint64_t *_src, uint64_t *_dst, size_t _count);
+
+/* ************************************************************************//**
+ * \brief	name of the conversion kernels in use
+ *
+ * "scalar", "sse2" or "avx2" if forced by lib_clock__batch_select,
+ * otherwise the instruction sets of the division, multiplication and
+ * scaling kernels, e.g. "scalar/avx2/avx2" on x86 or "scalar".
+ * ****************************************************************************/
+const char *lib_clock__batch_isa(void);
+
+/* ************************************************************************//**
+ * \brief	force the conversion kernels of an instruction set
+ *
+ * Meant for comparing the kernels, e.g. in a benchmark. Not thread safe
+ * against running conversions.
+ *
+ * \param	_isa				"scalar", "sse2" or "avx2", NULL for the automatic selection
+ * \return	EOK on success, -ESTD_NOTSUP if not built or not supported by the CPU
+ * ****************************************************************************/
+int lib_clock__batch_select(const char *_isa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
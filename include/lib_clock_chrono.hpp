@@ -0,0 +1,330 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_CHRONO_HPP_
+#define _LIB_CLOCK_CHRONO_HPP_
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <chrono>
+#include <cstdint>
+#include <ratio>
+#include <type_traits>
+
+/* system */
+#include <time.h>
+#if defined(__x86_64__)
+	#include <x86intrin.h>
+#endif
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_posix.h"
+
+/* *******************************************************************
+ * std::chrono clocks over the posix backend
+ *
+ * Every clock meets the TrivialClock requirements and reads its source
+ * inline, no call crosses into the library on the hot path. Durations
+ * are nanoseconds on the CLOCK_MONOTONIC scale, so time points of
+ * different clocks may be compared after a time_point_cast.
+ * ******************************************************************/
+namespace lib_clock {
+
+namespace detail {
+
+/* ************************************************************************//**
+ * \brief	read a posix clock in nanoseconds
+ * ****************************************************************************/
+inline std::int64_t read_posix(clockid_t _id) noexcept
+{
+	struct timespec tp;
+
+	::clock_gettime(_id, &tp);
+	return (std::int64_t)tp.tv_nsec + (std::int64_t)tp.tv_sec * 1000000000LL;
+}
+
+/* TSC calibration, usable is cleared if the TSC can not be read inline */
+struct tsc_state {
+	lib_clock_tsc_conv_t	conv;
+	bool					usable;
+};
+
+/* ************************************************************************//**
+ * \brief	TSC calibration, fetched from the library on first use
+ * ****************************************************************************/
+inline const tsc_state &tsc() noexcept
+{
+	static const tsc_state state = []() noexcept {
+		tsc_state s = {};
+		s.usable = (lib_clock__get_tsc_conv(&s.conv) == 0);
+		return s;
+	}();
+	return state;
+}
+
+/* ************************************************************************//**
+ * \brief	scale a TSC difference, signed so readings before tsc_base work
+ * ****************************************************************************/
+inline std::int64_t tsc_scale(std::int64_t _ticks, const lib_clock_tsc_conv_t &_conv) noexcept
+{
+#ifdef __SIZEOF_INT128__
+	return (std::int64_t)(((__int128)_ticks * (__int128)_conv.mult) >> _conv.shift);
+#else
+	// 32x32 partial products, _conv.shift is below 64 for every calibration
+	std::uint64_t x = (_ticks < 0) ? (std::uint64_t)0 - (std::uint64_t)_ticks : (std::uint64_t)_ticks;
+	std::uint64_t x_lo = x & 0xFFFFFFFFULL, x_hi = x >> 32;
+	std::uint64_t m_lo = _conv.mult & 0xFFFFFFFFULL, m_hi = _conv.mult >> 32;
+	std::uint64_t ll = x_lo * m_lo;
+	std::uint64_t u = x_hi * m_lo + (ll >> 32);
+	std::uint64_t v = x_lo * m_hi + (u & 0xFFFFFFFFULL);
+	std::uint64_t hi = x_hi * m_hi + (u >> 32) + (v >> 32);
+	std::uint64_t lo = (v << 32) | (ll & 0xFFFFFFFFULL);
+	std::uint64_t scaled = (_conv.shift == 0) ? lo : ((lo >> _conv.shift) | (hi << (64 - _conv.shift)));
+
+	return (_ticks < 0) ? -(std::int64_t)scaled : (std::int64_t)scaled;
+#endif
+}
+
+} // namespace detail
+
+/* ************************************************************************//**
+ * \brief	CLOCK_MONOTONIC
+ * ****************************************************************************/
+struct monotonic_clock {
+	typedef std::int64_t							rep;
+	typedef std::nano								period;
+	typedef std::chrono::duration<rep, period>		duration;
+	typedef std::chrono::time_point<monotonic_clock>	time_point;
+	static constexpr bool is_steady = true;
+
+	static time_point now() noexcept
+	{
+		return time_point(duration(detail::read_posix(CLOCK_MONOTONIC)));
+	}
+};
+
+/* ************************************************************************//**
+ * \brief	CLOCK_MONOTONIC_COARSE, cheap but with jiffy resolution
+ * ****************************************************************************/
+struct coarse_clock {
+	typedef std::int64_t							rep;
+	typedef std::nano								period;
+	typedef std::chrono::duration<rep, period>		duration;
+	typedef std::chrono::time_point<coarse_clock>	time_point;
+	static constexpr bool is_steady = true;
+
+	static time_point now() noexcept
+	{
+		return time_point(duration(detail::read_posix(CLOCK_MONOTONIC_COARSE)));
+	}
+};
+
+/* ************************************************************************//**
+ * \brief	timestamp published by the lib_clock__cached_start ticker
+ *
+ * A single relaxed load while the ticker runs, lib_clock__get_time_ns
+ * otherwise.
+ * ****************************************************************************/
+struct cached_clock {
+	typedef std::int64_t							rep;
+	typedef std::nano								period;
+	typedef std::chrono::duration<rep, period>		duration;
+	typedef std::chrono::time_point<cached_clock>	time_point;
+	static constexpr bool is_steady = true;
+
+	static time_point now() noexcept
+	{
+		static const std::uint64_t *const slot = lib_clock__get_cached_slot();
+		std::uint64_t ns = __atomic_load_n(slot, __ATOMIC_RELAXED);
+
+		if (ns == 0) {
+			ns = lib_clock__get_time_ns();
+		}
+		return time_point(duration((rep)ns));
+	}
+};
+
+/* ************************************************************************//**
+ * \brief	calibrated invariant TSC
+ *
+ * The TSC rate is only known at run time, so the clock counts in
+ * nanoseconds and converts every reading with the calibration of
+ * lib_clock__get_tsc_conv. Raw ticks are available through ticks() and
+ * ticks_to_duration() for code which stores them and converts later.
+ * Without a usable TSC the clock reads CLOCK_MONOTONIC, ticks() counts
+ * its nanoseconds and ticks_to_duration() keeps them as they are.
+ * ****************************************************************************/
+struct tsc_clock {
+	typedef std::int64_t							rep;
+	typedef std::nano								period;
+	typedef std::chrono::duration<rep, period>		duration;
+	typedef std::chrono::time_point<tsc_clock>		time_point;
+	static constexpr bool is_steady = true;
+
+	static bool is_available() noexcept
+	{
+		return detail::tsc().usable;
+	}
+
+	static std::uint64_t ticks() noexcept
+	{
+#if defined(__x86_64__)
+		if (detail::tsc().usable) {
+			return __rdtsc();
+		}
+#endif
+		return (std::uint64_t)detail::read_posix(CLOCK_MONOTONIC);
+	}
+
+	/* converts a difference of ticks() readings, not named to_duration
+	 * as lib_clock::to_duration<tsc_clock> takes nanoseconds */
+	static duration ticks_to_duration(std::uint64_t _ticks) noexcept
+	{
+		const detail::tsc_state &tsc = detail::tsc();
+
+		if (!tsc.usable) {
+			return duration((rep)_ticks);
+		}
+		return duration(detail::tsc_scale((std::int64_t)_ticks, tsc.conv));
+	}
+
+	static time_point now() noexcept
+	{
+		const detail::tsc_state &tsc = detail::tsc();
+
+		if (!tsc.usable) {
+			return time_point(duration(detail::read_posix(CLOCK_MONOTONIC)));
+		}
+		return time_point(duration((rep)tsc.conv.ns_base + detail::tsc_scale((std::int64_t)(ticks() - tsc.conv.tsc_base), tsc.conv)));
+	}
+};
+
+/* ************************************************************************//**
+ * \brief	clock ticks of a clock to its duration, resolved at compile time
+ * ****************************************************************************/
+template <class Clock>
+constexpr typename Clock::duration to_duration(typename Clock::rep _ticks) noexcept
+{
+	return typename Clock::duration(_ticks);
+}
+
+/* ************************************************************************//**
+ * \brief	any duration to clock ticks of a clock, truncating towards zero
+ * ****************************************************************************/
+template <class Clock, class Rep, class Period>
+constexpr typename Clock::rep to_ticks(const std::chrono::duration<Rep, Period> &_duration) noexcept
+{
+	return std::chrono::duration_cast<typename Clock::duration>(_duration).count();
+}
+
+/* ************************************************************************//**
+ * \brief	measures the time since construction or the last restart
+ * ****************************************************************************/
+template <class Clock = monotonic_clock>
+class stopwatch {
+public:
+	typedef typename Clock::duration	duration;
+	typedef typename Clock::time_point	time_point;
+
+	stopwatch() noexcept : m_start(Clock::now()) {}
+
+	void restart() noexcept
+	{
+		m_start = Clock::now();
+	}
+
+	duration elapsed() const noexcept
+	{
+		return Clock::now() - m_start;
+	}
+
+	/* elapsed time, restarts at the same reading */
+	duration lap() noexcept
+	{
+		time_point now = Clock::now();
+		duration elapsed = now - m_start;
+
+		m_start = now;
+		return elapsed;
+	}
+
+	time_point start() const noexcept
+	{
+		return m_start;
+	}
+
+private:
+	time_point	m_start;
+};
+
+/* ************************************************************************//**
+ * \brief	absolute point in time a timeout ends at
+ * ****************************************************************************/
+template <class Clock = monotonic_clock>
+class deadline {
+public:
+	typedef typename Clock::duration	duration;
+	typedef typename Clock::time_point	time_point;
+
+	template <class Rep, class Period>
+	explicit deadline(const std::chrono::duration<Rep, Period> &_timeout) noexcept
+		: m_at(Clock::now() + std::chrono::duration_cast<duration>(_timeout)) {}
+
+	static deadline at(time_point _at) noexcept
+	{
+		return deadline(_at);
+	}
+
+	bool expired() const noexcept
+	{
+		return Clock::now() >= m_at;
+	}
+
+	/* time left, zero once expired */
+	duration remaining() const noexcept
+	{
+		duration left = m_at - Clock::now();
+
+		return (left > duration::zero()) ? left : duration::zero();
+	}
+
+	time_point time() const noexcept
+	{
+		return m_at;
+	}
+
+private:
+	explicit deadline(time_point _at) noexcept : m_at(_at) {}
+
+	time_point	m_at;
+};
+
+} // namespace lib_clock
+
+#endif
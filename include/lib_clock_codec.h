@@ -0,0 +1,210 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_CODEC_H_
+#define _LIB_CLOCK_CODEC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stddef.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_CODEC_MAGIC			0x3144434CU		// "LCD1" little endian
+#define LIB_CLOCK_CODEC_HEADER_SIZE		32U
+#define LIB_CLOCK_CODEC_BLOCK_VALUES	4096U			// default values per block
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Stream layout: a sequence of self-contained blocks, each one a
+ * little endian header followed by the bit-packed payload.
+ *
+ *	offset	size
+ *	0		4		magic
+ *	4		4		number of values
+ *	8		4		payload bytes
+ *	12		4		reserved, 0
+ *	16		8		first value
+ *	24		8		last value
+ *
+ * The payload holds the delta-of-delta of every further value, MSB first:
+ *	'0'							0
+ *	'10'    + 8bit				-128 ... 127
+ *	'110'   + 13bit				-4096 ... 4095, us jitter of ns stamps
+ *	'1110'  + 20bit				-524288 ... 524287
+ *	'11110' + 32bit
+ *	'11111' + 64bit				any
+ * A reader skips blocks by their header, without touching the payload. */
+
+/* block header as returned by the decoder */
+typedef struct {
+	uint32_t	count;
+	uint32_t	bytes;		// payload bytes
+	uint64_t	first;
+	uint64_t	last;
+	size_t		offset;		// of the header within the stream
+} lib_clock_codec_block_t;
+
+/* Encoder, appends to a caller buffer. The bytes up to 'committed' are
+ * complete blocks which can be written out at any time. */
+typedef struct {
+	uint8_t		*buf;
+	size_t		size;
+	size_t		used;			// written bytes, including an open block
+	size_t		committed;		// bytes of the closed blocks
+	size_t		block;			// header offset of the open block
+	uint32_t	block_values;
+	uint32_t	count;			// values in the open block, 0 = no open block
+	uint64_t	first;
+	uint64_t	prev;
+	uint64_t	prev_delta;
+	uint64_t	acc;			// pending bits
+	uint32_t	bits;			// number of pending bits
+} lib_clock_codec_enc_t;
+
+/* Decoder, reads the stream in place (e.g. a mmap'd file) */
+typedef struct {
+	const uint8_t	*data;
+	size_t			size;
+	size_t			next;		// offset of the next block header
+	const uint8_t	*pos;		// payload read position
+	const uint8_t	*end;		// end of the current payload
+	uint64_t		acc;
+	uint32_t		bits;
+	uint32_t		remain;		// values left in the current block
+	uint64_t		prev;
+	uint64_t		prev_delta;
+	int				started;	// the first value of the block is returned
+	lib_clock_codec_block_t	block;
+} lib_clock_codec_dec_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up an encoder on a caller buffer
+ *
+ * \param	_enc				encoder
+ * \param	_buf				output buffer
+ * \param	_size				size of _buf
+ * \param	_block_values		values per block, 0 = LIB_CLOCK_CODEC_BLOCK_VALUES
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__codec_enc_init(lib_clock_codec_enc_t *_enc, void *_buf, size_t _size, uint32_t _block_values);
+
+/* ************************************************************************//**
+ * \brief	append a timestamp
+ *
+ * A block is closed automatically when it holds the configured number of
+ * values. On -ESTD_NOMEM nothing was written: flush, drain the buffer
+ * and restart the encoder with lib_clock__codec_enc_init.
+ *
+ * \param	_enc				encoder
+ * \param	_value				timestamp, e.g. from lib_clock__get_time_ns
+ * \return	EOK on success, -ESTD_NOMEM if the buffer is full
+ * ****************************************************************************/
+int lib_clock__codec_append(lib_clock_codec_enc_t *_enc, uint64_t _value);
+
+/* ************************************************************************//**
+ * \brief	append an array of timestamps
+ *
+ * \return	number of appended values, less than _count if the buffer is full
+ * ****************************************************************************/
+size_t lib_clock__codec_append_n(lib_clock_codec_enc_t *_enc, const uint64_t *_values, size_t _count);
+
+/* ************************************************************************//**
+ * \brief	close the open block
+ *
+ * \param	_enc				encoder
+ * \return	number of committed bytes
+ * ****************************************************************************/
+size_t lib_clock__codec_flush(lib_clock_codec_enc_t *_enc);
+
+/* ************************************************************************//**
+ * \brief	set up a decoder over an encoded stream
+ *
+ * The data is read in place and must stay valid while decoding.
+ *
+ * \param	_dec				decoder
+ * \param	_data				encoded blocks
+ * \param	_size				size of _data
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__codec_dec_init(lib_clock_codec_dec_t *_dec, const void *_data, size_t _size);
+
+/* ************************************************************************//**
+ * \brief	decode the next values, continuing across blocks
+ *
+ * \param	_dec				decoder
+ * \param	_out				decoded timestamps
+ * \param	_max				capacity of _out
+ * \return	number of decoded values, 0 at the end of the stream,
+ * 			negative error code on corrupt data
+ * ****************************************************************************/
+int64_t lib_clock__codec_decode(lib_clock_codec_dec_t *_dec, uint64_t *_out, size_t _max);
+
+/* ************************************************************************//**
+ * \brief	read the next block header and position the decoder at its
+ * start, the previous block does not have to be decoded
+ *
+ * \param	_dec				decoder
+ * \param	_block				filled with the header, may be NULL
+ * \return	1 if a block was found, 0 at the end of the stream,
+ * 			negative error code on corrupt data
+ * ****************************************************************************/
+int lib_clock__codec_next_block(lib_clock_codec_dec_t *_dec, lib_clock_codec_block_t *_block);
+
+/* ************************************************************************//**
+ * \brief	position the decoder at the block which may contain _value
+ *
+ * Only block headers are read. For monotonic streams this is the last
+ * block starting at or before _value.
+ *
+ * \param	_dec				decoder
+ * \param	_value				timestamp to look for
+ * \param	_block				filled with the header, may be NULL
+ * \return	EOK on success, -ESTD_INVAL if the stream starts after _value,
+ * 			negative error code on corrupt data
+ * ****************************************************************************/
+int lib_clock__codec_seek(lib_clock_codec_dec_t *_dec, uint64_t _value, lib_clock_codec_block_t *_block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
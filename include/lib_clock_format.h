@@ -0,0 +1,118 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_FORMAT_H_
+#define _LIB_CLOCK_FORMAT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stddef.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_FMT_SEC_DIGITS		10		// seconds field of the decimal formats, up to 317 years
+#define LIB_CLOCK_FMT_SEC_US_LEN		17		// "SSSSSSSSSS.uuuuuu"
+#define LIB_CLOCK_FMT_SEC_NS_LEN		20		// "SSSSSSSSSS.nnnnnnnnn"
+#define LIB_CLOCK_FMT_ISO_LEN			30		// "YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ"
+#define LIB_CLOCK_FMT_ISO_PREFIX_LEN	19		// "YYYY-MM-DDTHH:MM:SS"
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Caller owned date cache of lib_clock__fmt_iso8601. The date part is
+ * only recomputed when the day changes and the time part when the
+ * second changes, one cache per formatting thread. */
+typedef struct {
+	uint64_t	sec;		// second of the cached prefix
+	uint64_t	day;		// day of the cached date part
+	char		prefix[LIB_CLOCK_FMT_ISO_PREFIX_LEN];
+} lib_clock_fmt_cache_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	reset a date cache
+ *
+ * \param	_cache				cache to reset
+ * ****************************************************************************/
+void lib_clock__fmt_cache_init(lib_clock_fmt_cache_t *_cache);
+
+/* ************************************************************************//**
+ * \brief	format microseconds as fixed-width decimal seconds
+ *
+ * e.g. 0000012345.000678, zero padded, no locale, no allocation.
+ *
+ * \param	_buf				output, NUL terminated
+ * \param	_size				size of _buf, at least LIB_CLOCK_FMT_SEC_US_LEN + 1
+ * \param	_us					timestamp in microseconds
+ * \return	number of characters written, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__fmt_sec_us(char *_buf, size_t _size, uint64_t _us);
+
+/* ************************************************************************//**
+ * \brief	format nanoseconds as fixed-width decimal seconds
+ *
+ * e.g. 0000012345.000678901
+ *
+ * \param	_buf				output, NUL terminated
+ * \param	_size				size of _buf, at least LIB_CLOCK_FMT_SEC_NS_LEN + 1
+ * \param	_ns					timestamp in nanoseconds
+ * \return	number of characters written, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__fmt_sec_ns(char *_buf, size_t _size, uint64_t _ns);
+
+/* ************************************************************************//**
+ * \brief	format a realtime timestamp as ISO-8601 UTC
+ *
+ * e.g. 2023-11-14T22:13:20.123456789Z with _digits 9. The timestamp is
+ * nanoseconds since the epoch, e.g. from lib_clock__wall_from_ns.
+ *
+ * \param	_buf				output, NUL terminated
+ * \param	_size				size of _buf, at least LIB_CLOCK_FMT_ISO_LEN + 1
+ * \param	_cache				date cache, NULL to compute the date every time
+ * \param	_epoch_ns			nanoseconds since 1970-01-01T00:00:00Z
+ * \param	_digits				fraction digits 0...9, 0 omits the fraction
+ * \return	number of characters written, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__fmt_iso8601(char *_buf, size_t _size, lib_clock_fmt_cache_t *_cache, uint64_t _epoch_ns, unsigned int _digits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_HISTOGRAM_H_
+#define _LIB_CLOCK_HISTOGRAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stddef.h>
+
+/* project */
+#include "lib_clock.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_HIST_MIN_PRECISION	1
+#define LIB_CLOCK_HIST_MAX_PRECISION	14
+
+/* Scoped stopwatch, records the elapsed nanoseconds into _hist when the
+ * enclosing block is left:
+ *
+ *	{
+ *		LIB_CLOCK_STOPWATCH_SCOPED(sw, hist);
+ *		...
+ *	}
+ */
+#define LIB_CLOCK_STOPWATCH_SCOPED(_name, _hist) \
+	lib_clock_stopwatch_t _name __attribute__((cleanup(lib_clock__stopwatch_cleanup))) = lib_clock__stopwatch_begin(_hist)
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Log-linear histogram. Every power-of-two range of values is split into
+ * 2^precision linear buckets, so a recorded value is kept with a relative
+ * error below 2^-precision. Values below 2^(precision+1) are exact. */
+typedef struct {
+	uint32_t	precision;		// linear sub-bucket bits
+	uint32_t	bucket_count;
+	uint64_t	highest;		// larger values are saturated to this value
+	uint64_t	total;			// number of recorded values
+	uint64_t	saturated;		// number of values above highest
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	sum;
+	uint64_t	counts[];
+} lib_clock_hist_t;
+
+typedef struct {
+	lib_clock_hist_t	*hist;
+	uint64_t			start;		// clock ticks
+} lib_clock_stopwatch_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	memory required by a histogram
+ *
+ * \param	_highest			highest value to track
+ * \param	_precision			linear sub-bucket bits (relative error 2^-_precision)
+ * \return	size in bytes, 0 on invalid parameters
+ * ****************************************************************************/
+size_t lib_clock__hist_mem_size(uint64_t _highest, uint32_t _precision);
+
+/* ************************************************************************//**
+ * \brief	set up a histogram in caller provided memory
+ *
+ * \param	_mem				memory of at least lib_clock__hist_mem_size bytes
+ * \param	_size				size of _mem
+ * \param	_highest			highest value to track
+ * \param	_precision			linear sub-bucket bits
+ * \return	histogram, NULL on invalid parameters
+ * ****************************************************************************/
+lib_clock_hist_t *lib_clock__hist_init(void *_mem, size_t _size, uint64_t _highest, uint32_t _precision);
+
+/* ************************************************************************//**
+ * \brief	allocate and set up a histogram
+ *
+ * This is the only allocation, recording never allocates.
+ *
+ * \param	_highest			highest value to track
+ * \param	_precision			linear sub-bucket bits
+ * \return	histogram, NULL on error
+ * ****************************************************************************/
+lib_clock_hist_t *lib_clock__hist_create(uint64_t _highest, uint32_t _precision);
+
+/* ************************************************************************//**
+ * \brief	free a histogram of lib_clock__hist_create
+ * ****************************************************************************/
+void lib_clock__hist_destroy(lib_clock_hist_t *_hist);
+
+/* ************************************************************************//**
+ * \brief	clear all recorded values
+ * ****************************************************************************/
+void lib_clock__hist_reset(lib_clock_hist_t *_hist);
+
+/* ************************************************************************//**
+ * \brief	add the values of _src to _dst
+ *
+ * Used to merge per-thread instances. Both must have the same layout.
+ *
+ * \return	EOK on success, -ESTD_INVAL on different layouts
+ * ****************************************************************************/
+int lib_clock__hist_merge(lib_clock_hist_t *_dst, const lib_clock_hist_t *_src);
+
+/* ************************************************************************//**
+ * \brief	value at the given percentile
+ *
+ * \param	_percentile			0.0 .. 100.0
+ * \return	highest value equivalent to the bucket of the percentile
+ * ****************************************************************************/
+uint64_t lib_clock__hist_percentile(const lib_clock_hist_t *_hist, double _percentile);
+
+/* ************************************************************************//**
+ * \brief	mean of the recorded values
+ * ****************************************************************************/
+double lib_clock__hist_mean(const lib_clock_hist_t *_hist);
+
+/* ************************************************************************//**
+ * \brief	bucket index of a value
+ * ****************************************************************************/
+static inline uint32_t lib_clock__hist_index(const lib_clock_hist_t *_hist, uint64_t _value)
+{
+	uint32_t msb, shift;
+
+	if (_value < (2ULL << _hist->precision)) {
+		return (uint32_t)_value;
+	}
+
+	msb = 63U - (uint32_t)__builtin_clzll(_value);
+	shift = msb - _hist->precision;
+	return (shift << _hist->precision) + (uint32_t)(_value >> shift);
+}
+
+/* ************************************************************************//**
+ * \brief	record a value, O(1)
+ * ****************************************************************************/
+static inline void lib_clock__hist_record(lib_clock_hist_t *_hist, uint64_t _value)
+{
+	if (_value > _hist->highest) {
+		_value = _hist->highest;
+		_hist->saturated++;
+	}
+
+	_hist->counts[lib_clock__hist_index(_hist, _value)]++;
+	_hist->total++;
+	_hist->sum += _value;
+	if (_value < _hist->min) {
+		_hist->min = _value;
+	}
+	if (_value > _hist->max) {
+		_hist->max = _value;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	start a stopwatch on the fastest clock of the backend
+ * ****************************************************************************/
+static inline lib_clock_stopwatch_t lib_clock__stopwatch_begin(lib_clock_hist_t *_hist)
+{
+	lib_clock_stopwatch_t sw;
+
+	sw.hist = _hist;
+	sw.start = lib_clock__get_clock_ticks();
+	return sw;
+}
+
+/* ************************************************************************//**
+ * \brief	stop a stopwatch and record the elapsed time
+ *
+ * \return	elapsed time in nanoseconds
+ * ****************************************************************************/
+static inline uint64_t lib_clock__stopwatch_end(lib_clock_stopwatch_t *_sw)
+{
+	uint64_t ns = lib_clock__ticks_to_ns(lib_clock__get_clock_ticks() - _sw->start);
+
+	if (_sw->hist) {
+		lib_clock__hist_record(_sw->hist, ns);
+	}
+	return ns;
+}
+
+/* cleanup handler of LIB_CLOCK_STOPWATCH_SCOPED */
+static inline void lib_clock__stopwatch_cleanup(lib_clock_stopwatch_t *_sw)
+{
+	lib_clock__stopwatch_end(_sw);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_MONITOR_H_
+#define _LIB_CLOCK_MONITOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_MONITOR_WINDOW		64			// samples of the rolling window
+#define LIB_CLOCK_MONITOR_PERIOD_US		100000U		// default sampling period
+#define LIB_CLOCK_MONITOR_READS			64U			// default source reads per sample
+#define LIB_CLOCK_MONITOR_BUDGET_PPM	1000U		// default share of the time spent sampling
+#define LIB_CLOCK_MONITOR_STEP_NS		1000000ULL	// default offset change treated as a step
+
+/* events of lib_clock_monitor_stats_t and the callback */
+#define LIB_CLOCK_MONITOR_COST			0x1U		// mean read cost above the threshold
+#define LIB_CLOCK_MONITOR_JITTER		0x2U		// jitter above the threshold
+#define LIB_CLOCK_MONITOR_DRIFT			0x4U		// drift rate above the threshold
+#define LIB_CLOCK_MONITOR_STEP_FWD		0x8U		// the source jumped ahead of the reference
+#define LIB_CLOCK_MONITOR_STEP_BACK		0x10U		// the source fell behind the reference or went backwards
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* clock read, returns nanoseconds */
+typedef uint64_t (*lib_clock_monitor_read_t)(void *_arg);
+
+/* Snapshot of the rolling window */
+typedef struct {
+	uint64_t	samples;			// total number of samples
+	uint32_t	window;				// samples in the window
+	uint32_t	reads;				// source reads per sample, lowered to keep the budget
+	double		read_cost_ns;		// mean over the window
+	double		read_cost_max_ns;
+	uint64_t	resolution_ns;		// finest increment seen in the window, 0 if none
+	int64_t		drift_ppb;			// rate of the source against the reference
+	uint64_t	jitter_ns;			// RMS distance of the offset from the drift line
+	uint64_t	steps_fwd;			// total counts
+	uint64_t	steps_back;
+	int64_t		last_step_ns;		// offset change of the last step
+	uint32_t	overhead_ppm;		// time spent in the last sample against the period
+	uint32_t	events;				// LIB_CLOCK_MONITOR_COST/JITTER/DRIFT currently exceeded
+} lib_clock_monitor_stats_t;
+
+/* Called from lib_clock__monitor_sample without locks held. _events are the
+ * thresholds crossed by this sample and the steps found. */
+typedef void (*lib_clock_monitor_cb_t)(uint32_t _events, const lib_clock_monitor_stats_t *_stats, void *_arg);
+
+/* Configuration of lib_clock__monitor_start, zeroed fields select the
+ * defaults, zeroed thresholds are not checked */
+typedef struct {
+	uint32_t					period_us;		// sampling period
+	uint32_t					reads;			// source reads per sample
+	uint32_t					budget_ppm;		// most of the period spent sampling
+	int							manual;			// no thread, the caller runs lib_clock__monitor_sample
+	lib_clock_monitor_read_t	source;			// monitored clock, NULL = lib_clock__get_time_ns
+	lib_clock_monitor_read_t	reference;		// reference clock, NULL = CLOCK_BOOTTIME
+	void						*arg;			// argument of source and reference
+	uint64_t					step_ns;		// offset change treated as a step
+	double						max_read_cost_ns;
+	uint64_t					max_jitter_ns;
+	uint64_t					max_drift_ppb;	// absolute value
+	lib_clock_monitor_cb_t		callback;
+	void						*cb_arg;
+} lib_clock_monitor_cfg_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	start monitoring the clock source
+ *
+ * Every sample reads the source between two reference reads and times
+ * a burst of source reads with the reference. The offset change against
+ * the previous sample is drift, jitter or, from the step threshold on,
+ * a step. CLOCK_BOOTTIME as reference also reveals a suspend, the
+ * monotonic sources fall behind by its length.
+ *
+ * The burst is shortened while a sample takes more than the budget of
+ * the period, a slow source costs little more than a fast one.
+ *
+ * \param	_cfg				configuration, NULL for the defaults
+ * \return	EOK on success, -ESTD_BUSY if already running, negative error
+ * 			code otherwise
+ * ****************************************************************************/
+int lib_clock__monitor_start(const lib_clock_monitor_cfg_t *_cfg);
+
+/* ************************************************************************//**
+ * \brief	stop monitoring, the statistics stay readable
+ *
+ * \return	EOK on success
+ * ****************************************************************************/
+int lib_clock__monitor_stop(void);
+
+/* ************************************************************************//**
+ * \brief	take one sample
+ *
+ * \return	events of this sample, negative error code if not running
+ * ****************************************************************************/
+int lib_clock__monitor_sample(void);
+
+/* ************************************************************************//**
+ * \brief	get a snapshot of the statistics
+ *
+ * \param	_stats				filled with the snapshot
+ * \return	EOK on success, -ESTD_INVAL on a NULL pointer
+ * ****************************************************************************/
+int lib_clock__monitor_get_stats(lib_clock_monitor_stats_t *_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
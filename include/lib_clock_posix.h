@@ -0,0 +1,257 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal 
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_POSIX_H_
+#define _LIB_CLOCK_POSIX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_SKEW_MAX_CPUS		64			// CPUs measured pairwise, beyond only against the reference CPU
+#define LIB_CLOCK_SKEW_UNKNOWN		INT64_MIN	// skew matrix entry which was not measured
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Clock sources of the posix backend */
+typedef enum {
+	LIB_CLOCK_SRC_AUTO = 0,				// cheapest source meeting the requested precision
+	LIB_CLOCK_SRC_MONOTONIC,			// CLOCK_MONOTONIC
+	LIB_CLOCK_SRC_MONOTONIC_RAW,		// CLOCK_MONOTONIC_RAW, immune to NTP slewing
+	LIB_CLOCK_SRC_MONOTONIC_COARSE,		// CLOCK_MONOTONIC_COARSE, cheap, jiffy resolution
+	LIB_CLOCK_SRC_BOOTTIME,				// CLOCK_BOOTTIME, includes suspend
+	LIB_CLOCK_SRC_TSC,					// calibrated invariant TSC (x86-64)
+	LIB_CLOCK_SRC_COUNT
+} lib_clock_src_t;
+
+/* APIs with an individually selectable source */
+typedef enum {
+	LIB_CLOCK_API_NS = 0,				// lib_clock__get_time_ns
+	LIB_CLOCK_API_US,					// lib_clock__get_time_us
+	LIB_CLOCK_API_MS,					// lib_clock__get_time_ms, lib_clock__get_time_since_ms
+	LIB_CLOCK_API_TICKS,				// lib_clock__get_clock_ticks
+	LIB_CLOCK_API_COUNT
+} lib_clock_api_t;
+
+/* Configuration of lib_clock__init_cfg. A zeroed configuration selects
+ * every source automatically with the default precisions. */
+typedef struct {
+	lib_clock_src_t	source[LIB_CLOCK_API_COUNT];
+	uint64_t		precision_ns[LIB_CLOCK_API_COUNT];	// required resolution in auto mode, 0 = unit of the API
+} lib_clock_cfg_t;
+
+/* Source selected for an API */
+typedef struct {
+	lib_clock_src_t	source;
+	const char		*name;
+	uint64_t		resolution_ns;
+	double			read_cost_ns;		// measured in auto mode, 0 otherwise
+	const char		*reason;
+} lib_clock_src_info_t;
+
+/* Strategy of lib_clock__delay_us */
+typedef enum {
+	LIB_CLOCK_DELAY_SLEEP = 0,	// clock_nanosleep for the whole interval
+	LIB_CLOCK_DELAY_HYBRID,		// sleep for the bulk, spin for the measured wakeup slack
+	LIB_CLOCK_DELAY_SPIN		// busy-wait for the whole interval
+} lib_clock_delay_policy_t;
+
+/* Reaction on TSCs which are not synchronized across the CPUs */
+typedef enum {
+	LIB_CLOCK_SKEW_REJECT = 0,	// do not use the TSC
+	LIB_CLOCK_SKEW_CORRECT,		// subtract a per-CPU offset found with rdtscp, reject if not possible
+	LIB_CLOCK_SKEW_IGNORE		// no check, use the TSC as it is
+} lib_clock_skew_policy_t;
+
+/* Outcome of the TSC synchronization check */
+typedef enum {
+	LIB_CLOCK_SKEW_UNCHECKED = 0,	// TSC not calibrated or check disabled
+	LIB_CLOCK_SKEW_SYNCED,			// no skew beyond the tolerance
+	LIB_CLOCK_SKEW_CORRECTED,		// per-CPU offsets are applied
+	LIB_CLOCK_SKEW_REJECTED			// the TSC is not used
+} lib_clock_skew_state_t;
+
+/* Result of the TSC synchronization check */
+typedef struct {
+	lib_clock_skew_state_t	state;
+	uint32_t				cpus;				// dimension of the skew matrix, highest CPU number + 1
+	uint32_t				measured;			// CPUs of the affinity mask which were probed
+	uint32_t				reference;			// CPU the offsets are relative to
+	uint64_t				max_skew_ns;		// largest offset between two CPUs
+	uint64_t				uncertainty_ns;		// largest half round trip of the probes
+	uint64_t				residual_ns;		// largest offset left after the correction
+} lib_clock_skew_info_t;
+
+/* TSC to lib_clock nanoseconds for inline readers:
+ * ns = ns_base + ((tsc - tsc_base) * mult) >> shift with a signed 128bit product */
+typedef struct {
+	uint64_t	tsc_base;
+	uint64_t	ns_base;
+	uint64_t	mult;
+	uint32_t	shift;
+	uint64_t	freq;				// TSC ticks per second
+} lib_clock_tsc_conv_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	Initialization of the timing module with a source configuration
+ *
+ * Every API reads its own source through a function pointer resolved
+ * here, the getters do not branch on the configuration. In auto mode
+ * the read cost and resolution of every candidate is measured and the
+ * cheapest one meeting the requested precision is used. lib_clock__init
+ * is the same as passing the build default (CLOCK_MONOTONIC, or the TSC
+ * with the LIB_CLOCK_TSC option).
+ *
+ * Reconfiguring is only safe while no other thread uses lib_clock.
+ *
+ * \param	_cfg				source configuration, NULL for the build default
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__init_cfg(const lib_clock_cfg_t *_cfg);
+
+/* ************************************************************************//**
+ * \brief	query which source was selected for an API and why
+ *
+ * \param	_api				API to query
+ * \param	_info				filled with the selection
+ * \return	EOK on success, -ESTD_INVAL on an unknown API
+ * ****************************************************************************/
+int lib_clock__get_source_info(lib_clock_api_t _api, lib_clock_src_info_t *_info);
+
+/* ************************************************************************//**
+ * \brief	name of a clock source
+ * ****************************************************************************/
+const char *lib_clock__source_name(lib_clock_src_t _source);
+
+/* ************************************************************************//**
+ * \brief	select the strategy of lib_clock__delay_us
+ *
+ * \param	_policy				delay strategy
+ * \return	EOK on success, -ESTD_INVAL on an unknown policy
+ * ****************************************************************************/
+int lib_clock__set_delay_policy(lib_clock_delay_policy_t _policy);
+
+/* ************************************************************************//**
+ * \brief	get the active strategy of lib_clock__delay_us
+ *
+ * \return	active delay strategy
+ * ****************************************************************************/
+lib_clock_delay_policy_t lib_clock__get_delay_policy(void);
+
+/* ************************************************************************//**
+ * \brief	get the current estimate of the scheduler wakeup slack
+ *
+ * The slack is measured in lib_clock__init and refined by every hybrid
+ * delay. It is the part of a delay which is spun instead of slept.
+ *
+ * \return	wakeup slack in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_delay_slack_ns(void);
+
+/* ************************************************************************//**
+ * \brief	select the reaction on unsynchronized TSCs
+ *
+ * When the TSC is calibrated, a probe thread is pinned to every CPU of
+ * the affinity mask and exchanges TSC readings with the initializing
+ * thread over a shared cache line. Every round trip bounds the offset
+ * between the two TSCs. Offsets which are proven to exceed the
+ * tolerance let a thread migrating between these CPUs see the time go
+ * backwards. Takes effect with the next TSC calibration, i.e. set it
+ * before lib_clock__init.
+ *
+ * \param	_policy				reaction on skewed TSCs
+ * \param	_tolerance_ns		offset which is still accepted
+ * \return	EOK on success, -ESTD_INVAL on an unknown policy
+ * ****************************************************************************/
+int lib_clock__set_skew_policy(lib_clock_skew_policy_t _policy, uint64_t _tolerance_ns);
+
+/* ************************************************************************//**
+ * \brief	result of the last TSC synchronization check
+ *
+ * \param	_info				filled with the result
+ * \return	EOK on success, -ESTD_INVAL on a NULL pointer
+ * ****************************************************************************/
+int lib_clock__get_skew_info(lib_clock_skew_info_t *_info);
+
+/* ************************************************************************//**
+ * \brief	copy the measured TSC skew matrix
+ *
+ * Entry [i * cpus + j] is the TSC of CPU j minus the TSC of CPU i in
+ * nanoseconds, measured before any correction. CPUs outside the
+ * affinity mask are LIB_CLOCK_SKEW_UNKNOWN.
+ *
+ * \param	_matrix				destination, cpus * cpus entries
+ * \param	_cpus				dimension of the destination
+ * \return	EOK on success, -ESTD_RANGE if _cpus is smaller than the
+ * 			dimension reported by lib_clock__get_skew_info, -ESTD_AGAIN
+ * 			if nothing was measured
+ * ****************************************************************************/
+int lib_clock__get_skew_matrix(int64_t *_matrix, uint32_t _cpus);
+
+/* ************************************************************************//**
+ * \brief	get the TSC calibration for reading the TSC inline
+ *
+ * Calibrates the TSC on the first call if lib_clock__init did not. A
+ * TSC which needs per-CPU offsets is not offered, a plain rdtsc would
+ * skip the correction.
+ *
+ * \param	_conv				filled with the calibration
+ * \return	EOK on success, -ESTD_NOSYS if the TSC can not be read
+ * 			inline, -ESTD_INVAL on a NULL pointer
+ * ****************************************************************************/
+int lib_clock__get_tsc_conv(lib_clock_tsc_conv_t *_conv);
+
+/* ************************************************************************//**
+ * \brief	address of the timestamp published by the cached clock ticker
+ *
+ * For inline readers of lib_clock__get_cached_time_ns. The value has to
+ * be read with a relaxed atomic load, 0 means the ticker is stopped.
+ *
+ * \return	published nanosecond timestamp
+ * ****************************************************************************/
+const uint64_t *lib_clock__get_cached_slot(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
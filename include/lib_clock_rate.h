@@ -0,0 +1,127 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_RATE_H_
+#define _LIB_CLOCK_RATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_RATE_FRAC		8		// fraction bits of the internal nanosecond scale
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Rate limiter after the generic cell rate algorithm. The whole mutable
+ * state is the theoretical arrival time, a single 64bit word updated by
+ * compare and swap. This is an exact token bucket: _burst tokens,
+ * refilled by one token per interval. Times are nanoseconds since the
+ * initialization with LIB_CLOCK_RATE_FRAC fraction bits, which lasts for
+ * 2^(64 - LIB_CLOCK_RATE_FRAC) ns (2.2 years).
+ *
+ * Limiters which are hammered by many threads should not share a cache
+ * line with each other. */
+typedef struct {
+	uint64_t	tat;			// theoretical arrival time, only accessed atomically
+	uint64_t	epoch_ns;		// lib_clock__get_time_ns at the initialization
+	uint64_t	interval;		// time per token
+	uint64_t	limit;			// time covered by a full bucket, _burst * interval
+	uint32_t	burst;
+} lib_clock_rate_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up a rate limiter with a full bucket
+ *
+ * \param	_rl					limiter to initialize
+ * \param	_tokens				tokens granted per period
+ * \param	_period_us			length of the period in microseconds
+ * \param	_burst				bucket size, the most tokens granted at once
+ * \return	EOK on success, -ESTD_INVAL on a zero or out of range parameter
+ * ****************************************************************************/
+int lib_clock__rate_init(lib_clock_rate_t *_rl, uint32_t _tokens, uint64_t _period_us, uint32_t _burst);
+
+/* ************************************************************************//**
+ * \brief	take _n tokens, the time is read with lib_clock__get_time_ns
+ *
+ * Lock-free, a failed compare and swap is only retried while the tokens
+ * are available.
+ *
+ * \param	_rl					rate limiter
+ * \param	_n					number of tokens
+ * \param	_wait_us			if not granted, set to the time until _n tokens
+ * 								are available, ready for lib_clock__delay_us.
+ * 								Set to 0 on success. May be NULL.
+ * \return	EOK if granted, -ESTD_AGAIN if not, -ESTD_INVAL if _n is 0 or
+ * 			larger than the bucket
+ * ****************************************************************************/
+int lib_clock__rate_acquire(lib_clock_rate_t *_rl, uint32_t _n, uint32_t *_wait_us);
+
+/* ************************************************************************//**
+ * \brief	take _n tokens, the time is read with lib_clock__get_cached_time_ns
+ *
+ * Saves the clock read per call. The rate is kept exactly, the moment a
+ * token becomes available is only as precise as the cached clock.
+ * ****************************************************************************/
+int lib_clock__rate_acquire_cached(lib_clock_rate_t *_rl, uint32_t _n, uint32_t *_wait_us);
+
+/* ************************************************************************//**
+ * \brief	take _n tokens at a caller provided time
+ *
+ * \param	_now_ns				lib_clock__get_time_ns scale timestamp
+ * ****************************************************************************/
+int lib_clock__rate_acquire_at(lib_clock_rate_t *_rl, uint32_t _n, uint64_t _now_ns, uint32_t *_wait_us);
+
+/* ************************************************************************//**
+ * \brief	number of tokens available now, without taking them
+ * ****************************************************************************/
+uint32_t lib_clock__rate_available(lib_clock_rate_t *_rl);
+
+/* ************************************************************************//**
+ * \brief	refill the bucket completely
+ * ****************************************************************************/
+void lib_clock__rate_reset(lib_clock_rate_t *_rl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_SHM_H_
+#define _LIB_CLOCK_SHM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_SHM_NAME			"/lib_clock"	// default shared memory object
+#define LIB_CLOCK_SHM_PERIOD_US		1000U			// default update period of the coarse time
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* time base the readers compute the fine time from */
+typedef enum {
+	LIB_CLOCK_SHM_MONOTONIC = 0,	// CLOCK_MONOTONIC through the vDSO
+	LIB_CLOCK_SHM_TSC				// the TSC with the calibration of the publisher
+} lib_clock_shm_mode_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	create and maintain the shared clock page
+ *
+ * The page holds the TSC calibration of this process (or selects
+ * CLOCK_MONOTONIC without an invariant TSC) and a coarse time which is
+ * updated every _period_us by a publisher thread. The calibration is
+ * guarded by a seqlock, the coarse time is a single atomic. Only one
+ * publisher per name may run.
+ *
+ * \param	_name				shared memory object, NULL for LIB_CLOCK_SHM_NAME
+ * \param	_period_us			coarse time update period, 0 for the default
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__shm_publish_start(const char *_name, uint32_t _period_us);
+
+/* ************************************************************************//**
+ * \brief	stop publishing and remove the shared memory object
+ *
+ * Attached readers keep their mapping, the coarse time stops.
+ *
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__shm_publish_stop(void);
+
+/* ************************************************************************//**
+ * \brief	map the shared clock page of a publisher read-only
+ *
+ * \param	_name				shared memory object, NULL for LIB_CLOCK_SHM_NAME
+ * \return	EOK on success, -ESTD_INVAL if the object is no clock page,
+ * 			negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__shm_attach(const char *_name);
+
+/* ************************************************************************//**
+ * \brief	unmap the shared clock page
+ * ****************************************************************************/
+void lib_clock__shm_detach(void);
+
+/* ************************************************************************//**
+ * \brief	fine time from the shared page, no system call
+ *
+ * All attached processes compute the time from the same parameters, so
+ * readings are monotonic across processes.
+ *
+ * \return	CLOCK_MONOTONIC scale nanoseconds, 0 if not attached
+ * ****************************************************************************/
+uint64_t lib_clock__shm_get_time_ns(void);
+
+/* ************************************************************************//**
+ * \brief	coarse time from the shared page, a single load
+ *
+ * \return	nanoseconds of the last publisher update, 0 if not attached
+ * ****************************************************************************/
+uint64_t lib_clock__shm_get_coarse_ns(void);
+
+/* ************************************************************************//**
+ * \brief	check whether the publisher updates the page
+ *
+ * \return	1 if the coarse time is at most four periods old, 0 otherwise
+ * ****************************************************************************/
+int lib_clock__shm_is_live(void);
+
+/* ************************************************************************//**
+ * \brief	time base of the attached page
+ *
+ * \return	mode of the page, negative error code if not attached
+ * ****************************************************************************/
+int lib_clock__shm_get_mode(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
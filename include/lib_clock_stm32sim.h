@@ -0,0 +1,133 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_STM32SIM_H_
+#define _LIB_CLOCK_STM32SIM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Parameters of the simulated microcontroller. The timer runs on the
+ * core clock, every access of the TIM4 counter register consumes
+ * access_cycles of simulated time. */
+typedef struct {
+	uint32_t	core_hz;				// simulated core and timer clock
+	uint32_t	access_cycles;			// core cycles per counter register access
+	uint32_t	irq_latency_cycles;		// cycles from a timer event to the ISR entry
+	uint32_t	irq_jitter_cycles;		// random additional latency of 0..jitter cycles
+	uint32_t	isr_cycles;				// cycles spent inside the ISR
+	uint32_t	seed;					// seed of the jitter generator
+} lib_clock_sim_cfg_t;
+
+/* Event counters of the simulation */
+typedef struct {
+	uint64_t	irqs;					// delivered timer interrupts
+	uint64_t	update_events;			// counter overflows
+	uint64_t	lost_updates;			// overflows merged into an already pending flag
+	uint64_t	max_irq_latency_cycles;	// worst event to ISR entry time
+	uint64_t	masked_cycles;			// total time with interrupts masked
+	uint64_t	max_masked_cycles;		// longest interrupt masked section
+	uint64_t	register_reads;			// timer register accesses
+	uint64_t	nested_irqs;			// delivered nested reader interrupts
+} lib_clock_sim_stats_t;
+
+/* Handler of the simulated higher priority interrupt */
+typedef void (*lib_clock_sim_nested_cb_t)(void *_arg);
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	reset the simulated microcontroller
+ *
+ * Has to be called before lib_clock__init, the simulated time restarts at
+ * zero. Without a call a 72MHz core without latency is simulated.
+ *
+ * \param	_cfg				simulation parameters
+ * \return	EOK on success, -ESTD_INVAL on a zero core clock
+ * ****************************************************************************/
+int lib_clock__sim_configure(const lib_clock_sim_cfg_t *_cfg);
+
+/* ************************************************************************//**
+ * \brief	let the simulated main code execute for a number of core cycles
+ *
+ * Timer events raised in the meantime are delivered to the ISR unless
+ * interrupts are masked.
+ *
+ * \param	_cycles				core cycles to advance
+ * ****************************************************************************/
+void lib_clock__sim_run(uint64_t _cycles);
+
+/* ************************************************************************//**
+ * \brief	simulated time in core cycles since lib_clock__sim_configure
+ * ****************************************************************************/
+uint64_t lib_clock__sim_cycles(void);
+
+/* ************************************************************************//**
+ * \brief	exact simulated time in nanoseconds since lib_clock__sim_configure
+ * ****************************************************************************/
+uint64_t lib_clock__sim_time_ns(void);
+
+/* ************************************************************************//**
+ * \brief	read the event counters of the simulation
+ *
+ * \param	_stats				filled with the counters
+ * ****************************************************************************/
+void lib_clock__sim_get_stats(lib_clock_sim_stats_t *_stats);
+
+/* ************************************************************************//**
+ * \brief	install a nested reader
+ *
+ * Models an interrupt with a higher priority than the timer interrupt. It
+ * preempts the main code and the timer ISR right before every _every-th
+ * timer register access while interrupts are unmasked, the timer
+ * interrupt is not taken while it runs. The handler may read the clock.
+ * lib_clock__sim_configure removes the reader.
+ *
+ * \param	_every				register accesses between two nested interrupts, 0 removes the reader
+ * \param	_cb					handler of the nested interrupt
+ * \param	_arg				passed to the handler
+ * ****************************************************************************/
+void lib_clock__sim_set_nested(uint32_t _every, lib_clock_sim_nested_cb_t _cb, void *_arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
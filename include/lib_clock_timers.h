@@ -0,0 +1,184 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_TIMERS_H_
+#define _LIB_CLOCK_TIMERS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_TIMERS_CAPACITY	64U		// initial heap size, doubled on demand
+#define LIB_CLOCK_TIMERS_BATCH		64U		// timers popped before their callbacks run
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+struct lib_clock_timer;
+
+typedef void (*lib_clock_timer_cb_t)(struct lib_clock_timer *_timer, void *_arg);
+
+/* Intrusive timer, embedded into the callers objects */
+typedef struct lib_clock_timer {
+	uint64_t				deadline_ns;	// absolute CLOCK_MONOTONIC ns
+	uint32_t				index;			// heap position + 1, 0 if not armed
+	lib_clock_timer_cb_t	cb;
+	void					*arg;
+} lib_clock_timer_t;
+
+/* heap entry, the deadline is copied so a sift never touches the timers */
+typedef struct {
+	uint64_t				deadline_ns;
+	lib_clock_timer_t		*timer;
+} lib_clock_timers_entry_t;
+
+/* Timer service on one timerfd. Not thread-safe, a service belongs to
+ * one event loop. */
+typedef struct {
+	int							fd;			// timerfd, readable when timers are due
+	uint64_t					slack_ns;	// timers may fire up to this late
+	uint64_t					armed_ns;	// expiry the timerfd is set to, 0 if disarmed
+	lib_clock_timers_entry_t	*heap;		// 4-ary min-heap, see lib_clock_timers.c
+	uint32_t					count;
+	uint32_t					capacity;
+	uint64_t					rearms;		// timerfd_settime calls
+	uint64_t					wakeups;	// dispatches which found the timerfd expired
+	uint64_t					fired;
+} lib_clock_timers_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up a timer service
+ *
+ * All armed deadlines share one CLOCK_MONOTONIC timerfd in absolute
+ * mode. Register lib_clock__timers_fd for EPOLLIN and call
+ * lib_clock__timers_dispatch when it is readable.
+ *
+ * With a slack the timerfd is set to the earliest deadline plus the
+ * slack, rounded down to a multiple of the slack. Every timer due by
+ * then fires in the same wakeup, a timer is late by at most the slack.
+ *
+ * \param	_svc				service to initialize
+ * \param	_slack_ns			coalescing window, 0 fires every deadline exactly
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__timers_init(lib_clock_timers_t *_svc, uint64_t _slack_ns);
+
+/* ************************************************************************//**
+ * \brief	release the timerfd and the heap, armed timers are dropped
+ * ****************************************************************************/
+void lib_clock__timers_close(lib_clock_timers_t *_svc);
+
+/* ************************************************************************//**
+ * \brief	file descriptor to wait on
+ * ****************************************************************************/
+static inline int lib_clock__timers_fd(const lib_clock_timers_t *_svc)
+{
+	return _svc->fd;
+}
+
+/* ************************************************************************//**
+ * \brief	set up a timer before its first use
+ *
+ * \param	_timer				timer to initialize
+ * \param	_cb					expiry callback
+ * \param	_arg				argument of the callback
+ * ****************************************************************************/
+void lib_clock__timer_init(lib_clock_timer_t *_timer, lib_clock_timer_cb_t _cb, void *_arg);
+
+/* ************************************************************************//**
+ * \brief	arm or re-arm a timer on an absolute deadline, O(log n)
+ *
+ * The timerfd is only re-armed if the timer moves its expiry earlier.
+ *
+ * \param	_svc				service to arm the timer in
+ * \param	_timer				timer, an armed timer is moved
+ * \param	_deadline_ns		absolute CLOCK_MONOTONIC ns
+ * \return	EOK on success, -ESTD_NOMEM if the heap can not grow,
+ * 			-ESTD_FAULT if the timerfd can not be set
+ * ****************************************************************************/
+int lib_clock__timers_arm(lib_clock_timers_t *_svc, lib_clock_timer_t *_timer, uint64_t _deadline_ns);
+
+/* ************************************************************************//**
+ * \brief	arm or re-arm a timer relative to now
+ *
+ * \param	_timeout_ns			expiry relative to CLOCK_MONOTONIC now
+ * \return	see lib_clock__timers_arm
+ * ****************************************************************************/
+int lib_clock__timers_arm_in(lib_clock_timers_t *_svc, lib_clock_timer_t *_timer, uint64_t _timeout_ns);
+
+/* ************************************************************************//**
+ * \brief	cancel a timer, O(log n)
+ *
+ * The timerfd is left as it is, an early wakeup costs less than a
+ * timerfd_settime per cancel.
+ *
+ * \return	1 if the timer was pending, 0 otherwise
+ * ****************************************************************************/
+int lib_clock__timers_cancel(lib_clock_timers_t *_svc, lib_clock_timer_t *_timer);
+
+/* ************************************************************************//**
+ * \brief	check whether a timer is armed
+ * ****************************************************************************/
+static inline int lib_clock__timer_pending(const lib_clock_timer_t *_timer)
+{
+	return (_timer->index != 0) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	fire the due timers
+ *
+ * Due timers are taken off the heap in batches of LIB_CLOCK_TIMERS_BATCH
+ * before their callbacks run. Callbacks may arm and cancel timers,
+ * including the fired one. A timer re-armed to a deadline which has
+ * passed fires again within the same dispatch. If _max stops the
+ * dispatch early, the timerfd is set to expire at once and the event
+ * loop comes back for the rest.
+ *
+ * \param	_svc				service to dispatch
+ * \param	_max				most timers to fire, 0 for no limit
+ * \return	number of fired timers
+ * ****************************************************************************/
+uint32_t lib_clock__timers_dispatch(lib_clock_timers_t *_svc, uint32_t _max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
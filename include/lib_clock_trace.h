@@ -0,0 +1,216 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_TRACE_H_
+#define _LIB_CLOCK_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* project */
+#include "lib_clock.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_TRACE_MAGIC		"LCTRACE1"
+#define LIB_CLOCK_TRACE_VERSION		1
+
+/* Span macros. Without LIB_CLOCK_TRACE (cmake option of the same name)
+ * they compile away entirely, including the clock reads.
+ *
+ *	LIB_CLOCK_TRACE_BEGIN(span, MY_SPAN_ID);
+ *	...
+ *	LIB_CLOCK_TRACE_END(span);
+ */
+#ifdef LIB_CLOCK_TRACE
+	#define LIB_CLOCK_TRACE_BEGIN(_span, _id) \
+		const uint64_t _span##_trace_start = lib_clock__get_clock_ticks(); \
+		const uint32_t _span##_trace_id = (uint32_t)(_id)
+	#define LIB_CLOCK_TRACE_END(_span) \
+		lib_clock__trace_record(_span##_trace_id, _span##_trace_start, lib_clock__get_clock_ticks())
+#else
+	#define LIB_CLOCK_TRACE_BEGIN(_span, _id)	((void)0)
+	#define LIB_CLOCK_TRACE_END(_span)			((void)0)
+#endif
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* one recorded span, start and end are raw clock ticks */
+typedef struct {
+	uint64_t	start;
+	uint64_t	end;
+	uint32_t	id;
+	uint32_t	thread;		// index of the recording ring
+} lib_clock_trace_rec_t;
+
+/* Header of the trace file, followed by 'records' lib_clock_trace_rec_t.
+ * A tick value converts to CLOCK_MONOTONIC nanoseconds as
+ *    ns = ref_ns + (ticks - ref_ticks) * 1e9 / tick_freq */
+typedef struct {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	rec_size;
+	uint64_t	tick_freq;
+	uint64_t	ref_ticks;
+	uint64_t	ref_ns;
+	uint64_t	records;	// number of valid records
+	uint64_t	dropped;	// spans lost because a ring or the file was full
+} lib_clock_trace_file_hdr_t;
+
+/* per-thread single-producer ring, written only by its owner thread */
+typedef struct {
+	uint64_t	head;			// written by the producer
+	uint64_t	tail_cache;		// producers copy of tail
+	uint64_t	dropped;
+	uint32_t	mask;
+	uint32_t	index;
+	lib_clock_trace_rec_t *rec;
+	uint64_t	tail __attribute__((aligned(64)));		// written by the collector
+	int			state;
+} lib_clock_trace_ring_t;
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+extern __thread lib_clock_trace_ring_t *g_lib_clock_trace_ring;
+extern __thread uint32_t g_lib_clock_trace_gen;
+extern uint32_t g_lib_clock_trace_active_gen;
+extern lib_clock_trace_ring_t g_lib_clock_trace_unattached;	// sentinel of threads without a ring, counts their spans as dropped
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	create the trace file and the per-thread rings
+ *
+ * All memory is allocated here, recording a span never allocates.
+ *
+ * \param	_path				trace file to create
+ * \param	_max_threads		number of rings, i.e. concurrently recording threads
+ * \param	_ring_records		capacity of a ring, rounded up to a power of two
+ * \param	_file_records		capacity of the trace file
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__trace_init(const char *_path, uint32_t _max_threads, uint32_t _ring_records, uint64_t _file_records);
+
+/* ************************************************************************//**
+ * \brief	drain all rings into the trace file
+ *
+ * \return	number of drained records, negative error code otherwise
+ * ****************************************************************************/
+int64_t lib_clock__trace_collect(void);
+
+/* ************************************************************************//**
+ * \brief	start a thread which calls lib_clock__trace_collect periodically
+ *
+ * \param	_period_ms			collect period in milliseconds
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__trace_start_collector(uint32_t _period_ms);
+
+/* ************************************************************************//**
+ * \brief	stop the collector thread
+ *
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__trace_stop_collector(void);
+
+/* ************************************************************************//**
+ * \brief	drain the rings a last time, truncate and close the trace file
+ *
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__trace_cleanup(void);
+
+/* ************************************************************************//**
+ * \brief	assign a free ring to the calling thread (slow path)
+ *
+ * A thread which finds all rings in use is parked on a sentinel ring until
+ * tracing is initialized again, a ring freed in between is not picked up.
+ *
+ * \return	ring of the calling thread, NULL if tracing is not initialized
+ * 			or all rings are in use
+ * ****************************************************************************/
+lib_clock_trace_ring_t *lib_clock__trace_attach(void);
+
+/* ************************************************************************//**
+ * \brief	record a span into the ring of the calling thread
+ *
+ * \param	_id					span identifier
+ * \param	_start				start of the span in clock ticks
+ * \param	_end				end of the span in clock ticks
+ * ****************************************************************************/
+static inline void lib_clock__trace_record(uint32_t _id, uint64_t _start, uint64_t _end)
+{
+	lib_clock_trace_ring_t *ring = g_lib_clock_trace_ring;
+	lib_clock_trace_rec_t *rec;
+	uint64_t head;
+
+	if (__builtin_expect((ring == 0) || (g_lib_clock_trace_gen != __atomic_load_n(&g_lib_clock_trace_active_gen, __ATOMIC_RELAXED)), 0)) {
+		ring = lib_clock__trace_attach();
+		if (ring == 0) {
+			return;
+		}
+	}
+	if (__builtin_expect(ring == &g_lib_clock_trace_unattached, 0)) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	head = ring->head;
+	if (__builtin_expect(head - ring->tail_cache > ring->mask, 0)) {
+		ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if (head - ring->tail_cache > ring->mask) {
+			__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	rec = &ring->rec[head & ring->mask];
+	rec->start = _start;
+	rec->end = _end;
+	rec->id = _id;
+	rec->thread = ring->index;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
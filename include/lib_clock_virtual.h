@@ -0,0 +1,135 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_VIRTUAL_H_
+#define _LIB_CLOCK_VIRTUAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Behaviour of lib_clock__delay_us and lib_clock__periodic_wait */
+typedef enum {
+	LIB_CLOCK_VIRTUAL_ADVANCE = 0,	// the waiting thread advances the time to its deadline
+	LIB_CLOCK_VIRTUAL_PARK			// the waiting thread blocks until another thread advances the time
+} lib_clock_virtual_delay_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	select how waits behave
+ *
+ * LIB_CLOCK_VIRTUAL_ADVANCE suits single threaded tests, a delay returns
+ * at once with the time moved forward. With LIB_CLOCK_VIRTUAL_PARK a test
+ * thread steps the time for its workers.
+ *
+ * \param	_mode				wait behaviour
+ * \return	EOK on success, -ESTD_INVAL on an unknown mode
+ * ****************************************************************************/
+int lib_clock__virtual_set_delay_mode(lib_clock_virtual_delay_t _mode);
+
+/* ************************************************************************//**
+ * \brief	move the virtual time forward
+ *
+ * Wakes every parked thread whose deadline is reached.
+ *
+ * \param	_ns					nanoseconds to advance
+ * ****************************************************************************/
+void lib_clock__virtual_advance_ns(uint64_t _ns);
+
+/* ************************************************************************//**
+ * \brief	move the virtual time forward in microseconds
+ * ****************************************************************************/
+void lib_clock__virtual_advance_us(uint64_t _us);
+
+/* ************************************************************************//**
+ * \brief	move the virtual time forward in milliseconds
+ * ****************************************************************************/
+void lib_clock__virtual_advance_ms(uint64_t _ms);
+
+/* ************************************************************************//**
+ * \brief	set the virtual time
+ *
+ * The time never goes backwards while threads may observe it. To start a
+ * test at another point, e.g. shortly before the 32bit millisecond wrap,
+ * use lib_clock__virtual_reset.
+ *
+ * \param	_ns					new time in nanoseconds
+ * \return	EOK on success, -ESTD_INVAL if _ns is in the past
+ * ****************************************************************************/
+int lib_clock__virtual_set_ns(uint64_t _ns);
+
+/* ************************************************************************//**
+ * \brief	restart the virtual time at any value
+ *
+ * \param	_ns					new time in nanoseconds
+ * \return	EOK on success, -ESTD_BUSY while threads are parked
+ * ****************************************************************************/
+int lib_clock__virtual_reset(uint64_t _ns);
+
+/* ************************************************************************//**
+ * \brief	advance to the earliest deadline of the parked threads
+ *
+ * \param	_ns					set to the new time, may be NULL
+ * \return	EOK on success, -ESTD_AGAIN if no thread is parked
+ * ****************************************************************************/
+int lib_clock__virtual_advance_next(uint64_t *_ns);
+
+/* ************************************************************************//**
+ * \brief	number of threads parked in a wait
+ * ****************************************************************************/
+uint32_t lib_clock__virtual_parked(void);
+
+/* ************************************************************************//**
+ * \brief	block until at least _count threads are parked
+ *
+ * Lets a test thread advance the time only once its workers reached
+ * their waits, which makes multi-threaded runs deterministic.
+ *
+ * \param	_count				number of parked threads to wait for
+ * \param	_timeout_ms			real time limit of the wait
+ * \return	EOK on success, -ESTD_TIMEDOUT if the limit was reached
+ * ****************************************************************************/
+int lib_clock__virtual_wait_parked(uint32_t _count, uint32_t _timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
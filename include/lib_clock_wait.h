@@ -0,0 +1,135 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_WAIT_H_
+#define _LIB_CLOCK_WAIT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* condition of lib_clock__wait_until, returns nonzero once met */
+typedef int (*lib_clock_wait_pred_t)(void *_arg);
+
+/* Escalation of a wait by the time spent waiting. The clock is only
+ * read every lib_clock__wait_check_interval pause hints. */
+typedef struct {
+	uint64_t	spin_ns;		// busy-wait with pause hints
+	uint64_t	yield_ns;		// then sched_yield between the checks, also the longest yield before the deadline
+	uint64_t	sleep_min_ns;	// then sleep, starting with this length
+	uint64_t	sleep_max_ns;	// the sleep is doubled up to this length
+} lib_clock_backoff_t;
+
+/* Built-in backoff profiles */
+typedef enum {
+	LIB_CLOCK_BACKOFF_LATENCY = 0,		// spins up to the deadline
+	LIB_CLOCK_BACKOFF_BALANCED,			// 20us spin, 200us yield, 50us..1ms sleeps
+	LIB_CLOCK_BACKOFF_POWER,			// 1us spin, 10us yield, 100us..10ms sleeps
+	LIB_CLOCK_BACKOFF_COUNT
+} lib_clock_backoff_profile_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	calibrate how often a spinning wait reads the clock
+ *
+ * The clock read cost and the cost of a pause hint are measured, the
+ * clock is read once per so many hints that the reads stay a small part
+ * of the spin. Runs in lib_clock__init, again after the sources changed.
+ *
+ * \return	pause hints between two clock reads
+ * ****************************************************************************/
+uint32_t lib_clock__wait_calibrate(void);
+
+/* ************************************************************************//**
+ * \brief	pause hints between two clock reads of a spinning wait
+ * ****************************************************************************/
+uint32_t lib_clock__wait_check_interval(void);
+
+/* ************************************************************************//**
+ * \brief	parameters of a built-in backoff profile
+ *
+ * \return	profile, NULL on an unknown one
+ * ****************************************************************************/
+const lib_clock_backoff_t *lib_clock__backoff_profile(lib_clock_backoff_profile_t _profile);
+
+/* ************************************************************************//**
+ * \brief	wait until a condition is met or the deadline passed
+ *
+ * The condition is checked after every pause hint while spinning and
+ * after every yield or sleep. Sleeps end at the deadline at the latest.
+ *
+ * \param	_pred				condition
+ * \param	_arg				argument of the condition
+ * \param	_deadline_ns		lib_clock__get_time_ns timestamp
+ * \param	_backoff			escalation, NULL for LIB_CLOCK_BACKOFF_BALANCED
+ * \return	EOK if the condition is met, -ESTD_TIMEDOUT if the deadline
+ * 			passed first, -ESTD_INVAL on a NULL condition
+ * ****************************************************************************/
+int lib_clock__wait_until(lib_clock_wait_pred_t _pred, void *_arg, uint64_t _deadline_ns, const lib_clock_backoff_t *_backoff);
+
+/* ************************************************************************//**
+ * \brief	wait until a word differs from _old or the deadline passed
+ *
+ * Same escalation as lib_clock__wait_until, but the sleeps are futex
+ * waits on the word. A writer calling lib_clock__wait_wake after the
+ * change ends them at once, otherwise they run to their end.
+ *
+ * \param	_word				word to watch, naturally aligned
+ * \param	_old				value to wait out
+ * \param	_deadline_ns		lib_clock__get_time_ns timestamp
+ * \param	_backoff			escalation, NULL for LIB_CLOCK_BACKOFF_BALANCED
+ * \return	EOK if the word changed, -ESTD_TIMEDOUT if the deadline
+ * 			passed first, -ESTD_INVAL on a NULL word
+ * ****************************************************************************/
+int lib_clock__wait_until_change(const uint32_t *_word, uint32_t _old, uint64_t _deadline_ns, const lib_clock_backoff_t *_backoff);
+
+/* ************************************************************************//**
+ * \brief	wake all threads sleeping in lib_clock__wait_until_change on _word
+ *
+ * Call after changing the word. Costs a system call, skip it if no
+ * waiter can have reached its sleep phase.
+ * ****************************************************************************/
+void lib_clock__wait_wake(uint32_t *_word);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
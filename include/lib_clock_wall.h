@@ -0,0 +1,153 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_WALL_H_
+#define _LIB_CLOCK_WALL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_WALL_REFRESH_US		1000000U	// default refresh period
+#define LIB_CLOCK_WALL_TOLERANCE_NS		100000ULL	// default staleness tolerance
+#define LIB_CLOCK_WALL_STEP_NS			1000000ULL	// default step threshold, above the 500ppm slew limit of a 1s period
+
+/* flags of lib_clock__wall_refresh and lib_clock_wall_status_t */
+#define LIB_CLOCK_WALL_STEP				0x1U		// offset jumped by at least the step threshold
+#define LIB_CLOCK_WALL_STALE			0x2U		// cached offset was off by more than the tolerance
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* realtime source, returns ns since the epoch */
+typedef uint64_t (*lib_clock_wall_read_t)(void *_arg);
+
+/* Configuration of lib_clock__wall_start, zeroed fields select the defaults */
+typedef struct {
+	uint32_t				refresh_us;		// refresh period, whole milliseconds are used, 0 = default
+	int						manual;			// no refresh thread, the caller runs lib_clock__wall_refresh
+	uint64_t				tolerance_ns;	// allowed error of the cached offset
+	uint64_t				step_ns;		// offset change treated as a clock step
+	lib_clock_wall_read_t	source;			// realtime source, NULL = CLOCK_REALTIME
+	void					*arg;			// argument of the source
+} lib_clock_wall_cfg_t;
+
+typedef struct {
+	int64_t		offset_ns;			// realtime - lib_clock ns
+	uint64_t	refreshed_ns;		// lib_clock ns of the last refresh
+	uint64_t	uncertainty_ns;		// width of the reading bracket of the last refresh
+	int64_t		drift_ppb;			// offset change rate seen between the last two refreshes
+	int64_t		last_error_ns;		// offset change found by the last refresh
+	uint64_t	max_error_ns;		// largest change below the step threshold
+	uint32_t	refreshes;
+	uint32_t	steps;
+	uint32_t	stale_events;		// refreshes which found the cached offset off by more than the tolerance
+	uint32_t	flags;				// LIB_CLOCK_WALL_STALE if the cached offset is estimated to be off now
+} lib_clock_wall_status_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	start the monotonic to realtime mapping
+ *
+ * The offset between the realtime source and lib_clock__get_time_ns is
+ * measured and published. A refresh thread re-measures it every period,
+ * and immediately when CLOCK_REALTIME is set (timerfd cancel-on-set).
+ * Steps of an injected source are found by the offset change.
+ *
+ * \param	_cfg				configuration, NULL for the defaults
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__wall_start(const lib_clock_wall_cfg_t *_cfg);
+
+/* ************************************************************************//**
+ * \brief	stop the mapping, the last offset stays published
+ *
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__wall_stop(void);
+
+/* ************************************************************************//**
+ * \brief	re-measure and publish the offset
+ *
+ * \return	LIB_CLOCK_WALL_* flags of this refresh, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__wall_refresh(void);
+
+/* ************************************************************************//**
+ * \brief	convert a lib_clock__get_time_ns timestamp to realtime
+ *
+ * A single load and add, usable from any thread.
+ *
+ * \param	_ns					lib_clock timestamp in nanoseconds
+ * \return	nanoseconds since the epoch
+ * ****************************************************************************/
+uint64_t lib_clock__wall_from_ns(uint64_t _ns);
+
+/* ************************************************************************//**
+ * \brief	current realtime from one lib_clock read
+ *
+ * \return	nanoseconds since the epoch
+ * ****************************************************************************/
+uint64_t lib_clock__wall_now_ns(void);
+
+/* ************************************************************************//**
+ * \brief	check whether the cached offset is estimated to be off by more
+ * than the tolerance
+ *
+ * The estimate is the drift rate of the last refresh interval applied to
+ * the time since the last refresh, e.g. NTP slewing the realtime clock.
+ *
+ * \return	1 if stale, 0 otherwise
+ * ****************************************************************************/
+int lib_clock__wall_is_stale(void);
+
+/* ************************************************************************//**
+ * \brief	get the state of the mapping
+ *
+ * \param	_status				filled with the state
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__wall_get_status(lib_clock_wall_status_t *_status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
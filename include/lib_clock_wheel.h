@@ -0,0 +1,153 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_WHEEL_H_
+#define _LIB_CLOCK_WHEEL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_WHEEL_ROOT_BITS	8		// first level, 1ms slots
+#define LIB_CLOCK_WHEEL_LVL_BITS	6		// each higher level
+#define LIB_CLOCK_WHEEL_LEVELS		5		// 8 + 4 * 6 = 32 bits, the full lib_clock__get_time_ms range
+#define LIB_CLOCK_WHEEL_ROOT_SIZE	(1U << LIB_CLOCK_WHEEL_ROOT_BITS)
+#define LIB_CLOCK_WHEEL_LVL_SIZE	(1U << LIB_CLOCK_WHEEL_LVL_BITS)
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+struct lib_clock_wheel_timer;
+
+typedef void (*lib_clock_wheel_cb_t)(struct lib_clock_wheel_timer *_timer, void *_arg);
+
+/* circular doubly linked list node, slot heads are sentinels */
+typedef struct lib_clock_wheel_node {
+	struct lib_clock_wheel_node	*next;
+	struct lib_clock_wheel_node	*prev;
+} lib_clock_wheel_node_t;
+
+/* Intrusive timer, embedded into the callers objects. Arming never
+ * allocates. */
+typedef struct lib_clock_wheel_timer {
+	lib_clock_wheel_node_t	node;		// must stay the first member
+	uint64_t				expires;	// absolute wheel tick
+	lib_clock_wheel_cb_t	cb;
+	void					*arg;
+} lib_clock_wheel_timer_t;
+
+/* Hierarchical timing wheel with millisecond ticks. Not thread-safe, a
+ * wheel belongs to one event loop. */
+typedef struct {
+	uint64_t				now;		// next wheel tick to process
+	uint32_t				last_ms;	// last lib_clock__get_time_ms value seen
+	uint32_t				pending;	// number of armed timers
+	lib_clock_wheel_node_t	root[LIB_CLOCK_WHEEL_ROOT_SIZE];
+	lib_clock_wheel_node_t	lvl[LIB_CLOCK_WHEEL_LEVELS - 1][LIB_CLOCK_WHEEL_LVL_SIZE];
+} lib_clock_wheel_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up a timer wheel
+ *
+ * \param	_wheel				wheel to initialize
+ * \param	_now_ms				current lib_clock__get_time_ms value
+ * ****************************************************************************/
+void lib_clock__wheel_init(lib_clock_wheel_t *_wheel, uint32_t _now_ms);
+
+/* ************************************************************************//**
+ * \brief	set up a timer before its first use
+ *
+ * \param	_timer				timer to initialize
+ * \param	_cb					expiry callback
+ * \param	_arg				argument of the callback
+ * ****************************************************************************/
+void lib_clock__wheel_timer_init(lib_clock_wheel_timer_t *_timer, lib_clock_wheel_cb_t _cb, void *_arg);
+
+/* ************************************************************************//**
+ * \brief	arm or re-arm a timer, O(1)
+ *
+ * \param	_wheel				wheel to arm the timer in
+ * \param	_timer				timer, an armed timer is moved
+ * \param	_timeout_ms			expiry relative to the last advance of the wheel
+ * ****************************************************************************/
+void lib_clock__wheel_arm(lib_clock_wheel_t *_wheel, lib_clock_wheel_timer_t *_timer, uint32_t _timeout_ms);
+
+/* ************************************************************************//**
+ * \brief	cancel a timer, O(1)
+ *
+ * \param	_wheel				wheel the timer is armed in
+ * \param	_timer				timer to cancel
+ * \return	1 if the timer was pending, 0 otherwise
+ * ****************************************************************************/
+int lib_clock__wheel_cancel(lib_clock_wheel_t *_wheel, lib_clock_wheel_timer_t *_timer);
+
+/* ************************************************************************//**
+ * \brief	check whether a timer is armed
+ * ****************************************************************************/
+static inline int lib_clock__wheel_pending(const lib_clock_wheel_timer_t *_timer)
+{
+	return (_timer->node.next != 0) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	advance the wheel and fire all due timers
+ *
+ * _now_ms is a lib_clock__get_time_ms value. Its 32bit wrap is handled,
+ * as long as the wheel is advanced at least once every 49 days.
+ * Callbacks may arm and cancel timers, including the fired one.
+ *
+ * \param	_wheel				wheel to advance
+ * \param	_now_ms				current lib_clock__get_time_ms value
+ * \return	number of fired timers
+ * ****************************************************************************/
+uint32_t lib_clock__wheel_advance(lib_clock_wheel_t *_wheel, uint32_t _now_ms);
+
+/* ************************************************************************//**
+ * \brief	advance the wheel to lib_clock__get_time_ms
+ *
+ * \return	number of fired timers
+ * ****************************************************************************/
+uint32_t lib_clock__wheel_poll(lib_clock_wheel_t *_wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,688 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* system */
+#if !defined(LIB_CLOCK_NO_SIMD) && defined(__x86_64__)
+	#define BATCH_X86
+	#include <immintrin.h>
+#endif
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_batch.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define BATCH_CHUNK		256		// elements per pass of the two stage conversions
+#define BATCH_CAL_ELEMENTS	512		// elements per timed pass of the kernel selection
+#define BATCH_CAL_PASSES	4		// passes per timing
+#define BATCH_CAL_ROUNDS	5		// the fastest timing counts
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Exact division of a 64bit value by a constant with a 64bit reciprocal
+ * (Granlund-Montgomery): the trailing zero bits of the divisor are
+ * shifted out first, so the reciprocal of the odd rest fits into 64 bits.
+ * x / div == mulhi(x >> pre, mult) >> post */
+typedef struct {
+	uint64_t	div;
+	uint32_t	pre;
+	uint64_t	mult;
+	uint32_t	post;
+} batch_div_t;
+
+typedef struct {
+	const char	*name;
+	void		(*div)(const uint64_t *_src, uint64_t *_dst, size_t _count, const batch_div_t *_div);
+	void		(*mul)(const uint64_t *_src, uint64_t *_dst, size_t _count, uint32_t _factor);
+	void		(*scale)(const uint64_t *_src, uint64_t *_dst, size_t _count, const lib_clock_tick_conv_t *_conv);
+} batch_kernels_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static const batch_kernels_t *lib_clock__batch_kernels(void);
+static void lib_clock__batch_div_scalar(const uint64_t *_src, uint64_t *_dst, size_t _count, const batch_div_t *_div);
+static void lib_clock__batch_mul_scalar(const uint64_t *_src, uint64_t *_dst, size_t _count, uint32_t _factor);
+static void lib_clock__batch_scale_scalar(const uint64_t *_src, uint64_t *_dst, size_t _count, const lib_clock_tick_conv_t *_conv);
+#ifdef BATCH_X86
+static void lib_clock__batch_div_sse2(const uint64_t *_src, uint64_t *_dst, size_t _count, const batch_div_t *_div);
+static void lib_clock__batch_mul_sse2(const uint64_t *_src, uint64_t *_dst, size_t _count, uint32_t _factor);
+static void lib_clock__batch_scale_sse2(const uint64_t *_src, uint64_t *_dst, size_t _count, const lib_clock_tick_conv_t *_conv);
+static void lib_clock__batch_div_avx2(const uint64_t *_src, uint64_t *_dst, size_t _count, const batch_div_t *_div);
+static void lib_clock__batch_mul_avx2(const uint64_t *_src, uint64_t *_dst, size_t _count, uint32_t _factor);
+static void lib_clock__batch_scale_avx2(const uint64_t *_src, uint64_t *_dst, size_t _count, const lib_clock_tick_conv_t *_conv);
+static void lib_clock__batch_calibrate(batch_kernels_t *_kernels, char *_name, size_t _size);
+#endif
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+
+// 1000 = 2^3 * 125, mult = ceil(2^68 / 125)
+static const batch_div_t s_div_us = { 1000ULL, 3, 0x20C49BA5E353F7CFULL, 4 };
+// 1000000 = 2^6 * 15625, mult = ceil(2^72 / 15625)
+static const batch_div_t s_div_ms = { 1000000ULL, 6, 0x0431BDE82D7B634EULL, 8 };
+
+static const batch_kernels_t s_kernels_scalar = { "scalar", &lib_clock__batch_div_scalar, &lib_clock__batch_mul_scalar, &lib_clock__batch_scale_scalar };
+#ifdef BATCH_X86
+static const batch_kernels_t s_kernels_sse2 = { "sse2", &lib_clock__batch_div_sse2, &lib_clock__batch_mul_sse2, &lib_clock__batch_scale_sse2 };
+static const batch_kernels_t s_kernels_avx2 = { "avx2", &lib_clock__batch_div_avx2, &lib_clock__batch_mul_avx2, &lib_clock__batch_scale_avx2 };
+#endif
+
+#ifdef BATCH_X86
+// fastest kernel per operation, measured once on first use
+static batch_kernels_t s_kernels_auto;
+static char s_kernels_auto_name[32];
+static _Atomic int s_kernels_auto_state;		// 0 not measured, 1 measuring, 2 ready
+#endif
+
+// resolved on first use, or forced by lib_clock__batch_select
+static _Atomic(const batch_kernels_t *) s_kernels;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	stamp a batch with a single clock reading
+ * ****************************************************************************/
+uint64_t lib_clock__batch_stamp_ns(uint64_t *_stamps, size_t _count, uint64_t _spacing_ns)
+{
+	uint64_t now = lib_clock__get_time_ns();
+	uint64_t stamp = now;
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_stamps[i] = stamp;
+		stamp += _spacing_ns;
+	}
+
+	return now;
+}
+
+/* ************************************************************************//**
+ * \brief	stamp a batch with a single clock tick reading
+ * ****************************************************************************/
+uint64_t lib_clock__batch_stamp_ticks(uint64_t *_stamps, size_t _count, uint64_t _spacing_ticks)
+{
+	uint64_t now = lib_clock__get_clock_ticks();
+	uint64_t stamp = now;
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_stamps[i] = stamp;
+		stamp += _spacing_ticks;
+	}
+
+	return now;
+}
+
+/* ************************************************************************//**
+ * \brief	interpolate a batch linearly between two readings
+ *
+ * The span is split into a whole step and a remainder which is spread
+ * Bresenham-style, no division per slot.
+ * ****************************************************************************/
+void lib_clock__batch_interpolate(uint64_t *_stamps, size_t _count, uint64_t _first, uint64_t _last)
+{
+	uint64_t span, step, rem, acc = 0, stamp = _first;
+	size_t i, gaps;
+
+	if (_count == 0) {
+		return;
+	}
+
+	if ((_count == 1) || (_last <= _first)) {
+		for (i = 0; i < _count; i++) {
+			_stamps[i] = _first;
+		}
+		return;
+	}
+
+	gaps = _count - 1;
+	span = _last - _first;
+	step = span / gaps;
+	rem = span % gaps;
+
+	for (i = 0; i < gaps; i++) {
+		_stamps[i] = stamp;
+		stamp += step;
+		acc += rem;
+		if (acc >= gaps) {
+			acc -= gaps;
+			stamp++;
+		}
+	}
+	_stamps[gaps] = _last;
+}
+
+/* ************************************************************************//**
+ * \brief	nanoseconds to microseconds
+ * ****************************************************************************/
+void lib_clock__batch_ns_to_us(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	lib_clock__batch_kernels()->div(_src, _dst, _count, &s_div_us);
+}
+
+/* ************************************************************************//**
+ * \brief	nanoseconds to milliseconds
+ * ****************************************************************************/
+void lib_clock__batch_ns_to_ms(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	lib_clock__batch_kernels()->div(_src, _dst, _count, &s_div_ms);
+}
+
+/* ************************************************************************//**
+ * \brief	microseconds to nanoseconds
+ * ****************************************************************************/
+void lib_clock__batch_us_to_ns(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	lib_clock__batch_kernels()->mul(_src, _dst, _count, 1000U);
+}
+
+/* ************************************************************************//**
+ * \brief	milliseconds to nanoseconds
+ * ****************************************************************************/
+void lib_clock__batch_ms_to_ns(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	lib_clock__batch_kernels()->mul(_src, _dst, _count, 1000000U);
+}
+
+/* ************************************************************************//**
+ * \brief	clock ticks to nanoseconds
+ * ****************************************************************************/
+void lib_clock__batch_ticks_to_ns(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	lib_clock_tick_conv_t conv;
+
+	lib_clock__get_tick_conv(&conv, NULL);
+	lib_clock__batch_kernels()->scale(_src, _dst, _count, &conv);
+}
+
+/* ************************************************************************//**
+ * \brief	nanoseconds to clock ticks
+ * ****************************************************************************/
+void lib_clock__batch_ns_to_ticks(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	lib_clock_tick_conv_t conv;
+
+	lib_clock__get_tick_conv(NULL, &conv);
+	lib_clock__batch_kernels()->scale(_src, _dst, _count, &conv);
+}
+
+/* ************************************************************************//**
+ * \brief	clock ticks to microseconds
+ *
+ * Converted in cache sized chunks, the nanoseconds are divided in place
+ * while they are still in L1.
+ * ****************************************************************************/
+void lib_clock__batch_ticks_to_us(const uint64_t *_src, uint64_t *_dst, size_t _count)
+{
+	const batch_kernels_t *kernels = lib_clock__batch_kernels();
+	lib_clock_tick_conv_t conv;
+	size_t done, chunk;
+
+	lib_clock__get_tick_conv(&conv, NULL);
+	for (done = 0; done < _count; done += chunk) {
+		chunk = (_count - done < BATCH_CHUNK) ? _count - done : BATCH_CHUNK;
+		kernels->scale(&_src[done], &_dst[done], chunk, &conv);
+		kernels->div(&_dst[done], &_dst[done], chunk, &s_div_us);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	name of the conversion kernels in use
+ * ****************************************************************************/
+const char *lib_clock__batch_isa(void)
+{
+	return lib_clock__batch_kernels()->name;
+}
+
+/* ************************************************************************//**
+ * \brief	force the conversion kernels of an instruction set
+ * ****************************************************************************/
+int lib_clock__batch_select(const char *_isa)
+{
+	if (_isa == NULL) {
+		atomic_store(&s_kernels, NULL);
+		return EOK;
+	}
+
+	if (strcmp(_isa, s_kernels_scalar.name) == 0) {
+		atomic_store(&s_kernels, &s_kernels_scalar);
+		return EOK;
+	}
+
+#ifdef BATCH_X86
+	__builtin_cpu_init();
+	if (strcmp(_isa, s_kernels_sse2.name) == 0) {
+		atomic_store(&s_kernels, &s_kernels_sse2);
+		return EOK;
+	}
+	if (strcmp(_isa, s_kernels_avx2.name) == 0) {
+		if (!__builtin_cpu_supports("avx2")) {
+			return -ESTD_NOTSUP;
+		}
+		atomic_store(&s_kernels, &s_kernels_avx2);
+		return EOK;
+	}
+#endif
+
+	return -ESTD_NOTSUP;
+}
+
+/* ************************************************************************//**
+ * \brief	select the kernels of the conversions
+ *
+ * The wider kernels are not faster everywhere, e.g. the emulated 64bit
+ * multiply-high of SSE2 loses against the scalar one. On x86 the first
+ * call times every kernel the CPU supports and takes the fastest one per
+ * operation. Calls during the measurement use the scalar kernels.
+ * ****************************************************************************/
+static const batch_kernels_t *lib_clock__batch_kernels(void)
+{
+	const batch_kernels_t *kernels = atomic_load_explicit(&s_kernels, memory_order_acquire);
+#ifdef BATCH_X86
+	int state = 0;
+#endif
+
+	if (kernels != NULL) {
+		return kernels;
+	}
+
+#ifdef BATCH_X86
+	if (!atomic_compare_exchange_strong(&s_kernels_auto_state, &state, 1)) {
+		return (state == 2) ? &s_kernels_auto : &s_kernels_scalar;
+	}
+	lib_clock__batch_calibrate(&s_kernels_auto, s_kernels_auto_name, sizeof(s_kernels_auto_name));
+	atomic_store(&s_kernels_auto_state, 2);
+	kernels = &s_kernels_auto;
+#else
+	kernels = &s_kernels_scalar;
+#endif
+
+	atomic_store_explicit(&s_kernels, kernels, memory_order_release);
+	return kernels;
+}
+
+/* ************************************************************************//**
+ * \brief	scalar division, the compiler emits the reciprocal multiplication
+ * ****************************************************************************/
+static void lib_clock__batch_div_scalar(const uint64_t *_src, uint64_t *_dst, size_t _count, const batch_div_t *_div)
+{
+	size_t i;
+
+	switch (_div->div) {
+		case 1000ULL:
+			for (i = 0; i < _count; i++) {
+				_dst[i] = _src[i] / 1000ULL;
+			}
+			break;
+
+		case 1000000ULL:
+			for (i = 0; i < _count; i++) {
+				_dst[i] = _src[i] / 1000000ULL;
+			}
+			break;
+
+		default:
+			for (i = 0; i < _count; i++) {
+				_dst[i] = _src[i] / _div->div;
+			}
+			break;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	scalar multiplication
+ * ****************************************************************************/
+static void lib_clock__batch_mul_scalar(const uint64_t *_src, uint64_t *_dst, size_t _count, uint32_t _factor)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		_dst[i] = _src[i] * _factor;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	scalar fixed-point scaling, (x * mult) >> shift
+ *
+ * Without compiler support for 128bit integers the product is assembled
+ * from 32x32 multiplications.
+ * ****************************************************************************/
+static void lib_clock__batch_scale_scalar(const uint64_t *_src, uint64_t *_dst, size_t _count, const lib_clock_tick_conv_t *_conv)
+{
+	const uint64_t m_lo = _conv->mult & 0xFFFFFFFFULL;
+	const uint64_t m_hi = _conv->mult >> 32;
+	const uint32_t shift = _conv->shift;
+	size_t i;
+
+#ifdef __SIZEOF_INT128__
+	if (shift < 128) {
+		for (i = 0; i < _count; i++) {
+			_dst[i] = (uint64_t)(((unsigned __int128)_src[i] * _conv->mult) >> shift);
+		}
+		return;
+	}
+#endif
+
+	for (i = 0; i < _count; i++) {
+		uint64_t x_lo = _src[i] & 0xFFFFFFFFULL;
+		uint64_t x_hi = _src[i] >> 32;
+		uint64_t ll = x_lo * m_lo;
+		uint64_t u = x_hi * m_lo + (ll >> 32);
+		uint64_t v = x_lo * m_hi + (u & 0xFFFFFFFFULL);
+		uint64_t hi = x_hi * m_hi + (u >> 32) + (v >> 32);
+		uint64_t lo = (v << 32) | (ll & 0xFFFFFFFFULL);
+
+		if (shift == 0) {
+			_dst[i] = lo;
+		}
+		else if (shift < 64) {
+			_dst[i] = (lo >> shift) | (hi << (64 - shift));
+		}
+		else {
+			_dst[i] = hi >> (shift - 64);
+		}
+	}
+}
+
+#ifdef BATCH_X86
+/* ************************************************************************//**
+ * \brief	time the kernels and take the fastest one per operation
+ *
+ * _name is set to the instruction sets of the division, multiplication
+ * and scaling kernels, e.g. "scalar/avx2/avx2".
+ * ****************************************************************************/
+static void lib_clock__batch_calibrate(batch_kernels_t *_kernels, char *_name, size_t _size)
+{
+	enum { OP_DIV, OP_MUL, OP_SCALE, OP_COUNT };
+	const batch_kernels_t *cand[3], *best[OP_COUNT];
+	uint64_t src[BATCH_CAL_ELEMENTS], dst[BATCH_CAL_ELEMENTS], x = 0x9E3779B97F4A7C15ULL;
+	uint64_t fastest[OP_COUNT], start, elapsed, least;
+	lib_clock_tick_conv_t conv;
+	size_t c, count = 0, i;
+	int op, round, pass;
+
+	cand[count++] = &s_kernels_scalar;
+	cand[count++] = &s_kernels_sse2;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		cand[count++] = &s_kernels_avx2;
+	}
+
+	for (i = 0; i < BATCH_CAL_ELEMENTS; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		src[i] = x;
+	}
+	lib_clock__get_tick_conv(&conv, NULL);
+
+	for (op = 0; op < OP_COUNT; op++) {
+		fastest[op] = UINT64_MAX;
+		best[op] = &s_kernels_scalar;
+		for (c = 0; c < count; c++) {
+			least = UINT64_MAX;
+			for (round = 0; round < BATCH_CAL_ROUNDS; round++) {
+				start = lib_clock__get_time_ns();
+				for (pass = 0; pass < BATCH_CAL_PASSES; pass++) {
+					switch (op) {
+						case OP_DIV:	cand[c]->div(src, dst, BATCH_CAL_ELEMENTS, &s_div_us); break;
+						case OP_MUL:	cand[c]->mul(src, dst, BATCH_CAL_ELEMENTS, 1000U); break;
+						default:		cand[c]->scale(src, dst, BATCH_CAL_ELEMENTS, &conv); break;
+					}
+					__asm__ volatile ("" : : "r"(dst) : "memory");
+				}
+				elapsed = lib_clock__get_time_ns() - start;
+				least = (elapsed < least) ? elapsed : least;
+			}
+			// a tie keeps the narrower kernel
+			if (least < fastest[op]) {
+				fastest[op] = least;
+				best[op] = cand[c];
+			}
+		}
+	}
+
+	_kernels->div = best[OP_DIV]->div;
+	_kernels->mul = best[OP_MUL]->mul;
+	_kernels->scale = best[OP_SCALE]->scale;
+
+	_name[0] = '\0';
+	for (op = 0; op < OP_COUNT; op++) {
+		if (op > 0) {
+			strncat(_name, "/", _size - strlen(_name) - 1);
+		}
+		strncat(_name, best[op]->name, _size - strlen(_name) - 1);
+	}
+	_kernels->name = _name;
+}
+
+/* ************************************************************************//**
+ * \brief	upper 64 bits of the 64x64 products of two lanes
+ *
+ * Assembled from four 32x32 multiplications, _m_lo / _m_hi hold the low
+ * and high half of the multiplier in the low half of every lane.
+ * ****************************************************************************/
+static inline __m128i lib_clock__batch_mulhi_sse2(__m128i _x, __m128i _m_lo, __m128i _m_hi)
+{
+	const __m128i mask = _mm_set1_epi64x(0xFFFFFFFFLL);
+	__m128i x_hi = _mm_srli_epi64(_x, 32);
+	__m128i ll = _mm_mul_epu32(_x, _m_lo);
+	__m128i hl = _mm_mul_epu32(x_hi, _m_lo);
+	__m128i lh = _mm_mul_epu32(_x, _m_hi);
+	__m128i hh = _mm_mul_epu32(x_hi, _m_hi);
+	__m128i u = _mm_add_epi64(hl, _mm_srli_epi64(ll, 32));
+	__m128i v = _mm_add_epi64(lh, _mm_and_si128(u, mask));
+
+	return _mm_add_epi64(_mm_add_epi64(hh, _mm_srli_epi64(u, 32)), _mm_srli_epi64(v, 32));
+}
+
+/* ************************************************************************//**
+ * \brief	SSE2 division, two values per step
+ * ****************************************************************************/
+static void lib_clock__batch_div_sse2(const uint64_t *_src, uint64_t *_dst, size_t _count, const batch_div_t *_div)
+{
+	const __m128i m_lo = _mm_set1_epi64x((long long)(_div->mult & 0xFFFFFFFFULL));
+	const __m128i m_hi = _mm_set1_epi64x((long long)(_div->mult >> 32));
+	const __m128i pre = _mm_cvtsi32_si128((int)_div->pre);
+	const __m128i post = _mm_cvtsi32_si128((int)_div->post);
+	size_t i;
+
+	for (i = 0; i + 2 <= _count; i += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&_src[i]);
+
+		x = lib_clock__batch_mulhi_sse2(_mm_srl_epi64(x, pre), m_lo, m_hi);
+		_mm_storeu_si128((__m128i *)&_dst[i], _mm_srl_epi64(x, post));
+	}
+
+	lib_clock__batch_div_scalar(&_src[i], &_dst[i], _count - i, _div);
+}
+
+/* ************************************************************************//**
+ * \brief	SSE2 multiplication with a 32bit factor, two values per step
+ * ****************************************************************************/
+static void lib_clock__batch_mul_sse2(const uint64_t *_src, uint64_t *_dst, size_t _count, uint32_t _factor)
+{
+	const __m128i factor = _mm_set1_epi64x((long long)_factor);
+	size_t i;
+
+	for (i = 0; i + 2 <= _count; i += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&_src[i]);
+		__m128i lo = _mm_mul_epu32(x, factor);
+		__m128i hi = _mm_mul_epu32(_mm_srli_epi64(x, 32), factor);
+
+		_mm_storeu_si128((__m128i *)&_dst[i], _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+	}
+
+	lib_clock__batch_mul_scalar(&_src[i], &_dst[i], _count - i, _factor);
+}
+
+/* ************************************************************************//**
+ * \brief	SSE2 fixed-point scaling, two values per step
+ *
+ * Variable shifts of 64 and more yield 0, so for shift 0...64 the result
+ * is (lo >> shift) | (hi << (64 - shift)) without any case distinction.
+ * ****************************************************************************/
+static void lib_clock__batch_scale_sse2(const uint64_t *_src, uint64_t *_dst, size_t _count, const lib_clock_tick_conv_t *_conv)
+{
+	const __m128i mask = _mm_set1_epi64x(0xFFFFFFFFLL);
+	const __m128i m_lo = _mm_set1_epi64x((long long)(_conv->mult & 0xFFFFFFFFULL));
+	const __m128i m_hi = _mm_set1_epi64x((long long)(_conv->mult >> 32));
+	const __m128i shr = _mm_cvtsi32_si128((int)_conv->shift);
+	const __m128i shl = _mm_cvtsi32_si128(64 - (int)_conv->shift);
+	size_t i = 0;
+
+	if (_conv->shift > 64) {
+		lib_clock__batch_scale_scalar(_src, _dst, _count, _conv);
+		return;
+	}
+
+	for (; i + 2 <= _count; i += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&_src[i]);
+		__m128i x_hi = _mm_srli_epi64(x, 32);
+		__m128i ll = _mm_mul_epu32(x, m_lo);
+		__m128i u = _mm_add_epi64(_mm_mul_epu32(x_hi, m_lo), _mm_srli_epi64(ll, 32));
+		__m128i v = _mm_add_epi64(_mm_mul_epu32(x, m_hi), _mm_and_si128(u, mask));
+		__m128i hi = _mm_add_epi64(_mm_add_epi64(_mm_mul_epu32(x_hi, m_hi), _mm_srli_epi64(u, 32)), _mm_srli_epi64(v, 32));
+		__m128i lo = _mm_or_si128(_mm_slli_epi64(v, 32), _mm_and_si128(ll, mask));
+
+		_mm_storeu_si128((__m128i *)&_dst[i], _mm_or_si128(_mm_srl_epi64(lo, shr), _mm_sll_epi64(hi, shl)));
+	}
+
+	lib_clock__batch_scale_scalar(&_src[i], &_dst[i], _count - i, _conv);
+}
+
+/* ************************************************************************//**
+ * \brief	upper 64 bits of the 64x64 products of four lanes
+ * ****************************************************************************/
+__attribute__((target("avx2")))
+static inline __m256i lib_clock__batch_mulhi_avx2(__m256i _x, __m256i _m_lo, __m256i _m_hi)
+{
+	const __m256i mask = _mm256_set1_epi64x(0xFFFFFFFFLL);
+	__m256i x_hi = _mm256_srli_epi64(_x, 32);
+	__m256i ll = _mm256_mul_epu32(_x, _m_lo);
+	__m256i hl = _mm256_mul_epu32(x_hi, _m_lo);
+	__m256i lh = _mm256_mul_epu32(_x, _m_hi);
+	__m256i hh = _mm256_mul_epu32(x_hi, _m_hi);
+	__m256i u = _mm256_add_epi64(hl, _mm256_srli_epi64(ll, 32));
+	__m256i v = _mm256_add_epi64(lh, _mm256_and_si256(u, mask));
+
+	return _mm256_add_epi64(_mm256_add_epi64(hh, _mm256_srli_epi64(u, 32)), _mm256_srli_epi64(v, 32));
+}
+
+/* ************************************************************************//**
+ * \brief	AVX2 division, four values per step
+ * ****************************************************************************/
+__attribute__((target("avx2")))
+static void lib_clock__batch_div_avx2(const uint64_t *_src, uint64_t *_dst, size_t _count, const batch_div_t *_div)
+{
+	const __m256i m_lo = _mm256_set1_epi64x((long long)(_div->mult & 0xFFFFFFFFULL));
+	const __m256i m_hi = _mm256_set1_epi64x((long long)(_div->mult >> 32));
+	const __m128i pre = _mm_cvtsi32_si128((int)_div->pre);
+	const __m128i post = _mm_cvtsi32_si128((int)_div->post);
+	size_t i;
+
+	for (i = 0; i + 4 <= _count; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&_src[i]);
+
+		x = lib_clock__batch_mulhi_avx2(_mm256_srl_epi64(x, pre), m_lo, m_hi);
+		_mm256_storeu_si256((__m256i *)&_dst[i], _mm256_srl_epi64(x, post));
+	}
+
+	lib_clock__batch_div_scalar(&_src[i], &_dst[i], _count - i, _div);
+}
+
+/* ************************************************************************//**
+ * \brief	AVX2 multiplication with a 32bit factor, four values per step
+ * ****************************************************************************/
+__attribute__((target("avx2")))
+static void lib_clock__batch_mul_avx2(const uint64_t *_src, uint64_t *_dst, size_t _count, uint32_t _factor)
+{
+	const __m256i factor = _mm256_set1_epi64x((long long)_factor);
+	size_t i;
+
+	for (i = 0; i + 4 <= _count; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&_src[i]);
+		__m256i lo = _mm256_mul_epu32(x, factor);
+		__m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), factor);
+
+		_mm256_storeu_si256((__m256i *)&_dst[i], _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+	}
+
+	lib_clock__batch_mul_scalar(&_src[i], &_dst[i], _count - i, _factor);
+}
+/* ************************************************************************//**
+ * \brief	AVX2 fixed-point scaling, four values per step
+ * ****************************************************************************/
+__attribute__((target("avx2")))
+static void lib_clock__batch_scale_avx2(const uint64_t *_src, uint64_t *_dst, size_t _count, const lib_clock_tick_conv_t *_conv)
+{
+	const __m256i mask = _mm256_set1_epi64x(0xFFFFFFFFLL);
+	const __m256i m_lo = _mm256_set1_epi64x((long long)(_conv->mult & 0xFFFFFFFFULL));
+	const __m256i m_hi = _mm256_set1_epi64x((long long)(_conv->mult >> 32));
+	const __m128i shr = _mm_cvtsi32_si128((int)_conv->shift);
+	const __m128i shl = _mm_cvtsi32_si128(64 - (int)_conv->shift);
+	size_t i = 0;
+
+	if (_conv->shift > 64) {
+		lib_clock__batch_scale_scalar(_src, _dst, _count, _conv);
+		return;
+	}
+
+	for (; i + 4 <= _count; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&_src[i]);
+		__m256i x_hi = _mm256_srli_epi64(x, 32);
+		__m256i ll = _mm256_mul_epu32(x, m_lo);
+		__m256i u = _mm256_add_epi64(_mm256_mul_epu32(x_hi, m_lo), _mm256_srli_epi64(ll, 32));
+		__m256i v = _mm256_add_epi64(_mm256_mul_epu32(x, m_hi), _mm256_and_si256(u, mask));
+		__m256i hi = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(x_hi, m_hi), _mm256_srli_epi64(u, 32)), _mm256_srli_epi64(v, 32));
+		__m256i lo = _mm256_or_si256(_mm256_slli_epi64(v, 32), _mm256_and_si256(ll, mask));
+
+		_mm256_storeu_si256((__m256i *)&_dst[i], _mm256_or_si256(_mm256_srl_epi64(lo, shr), _mm256_sll_epi64(hi, shl)));
+	}
+
+	lib_clock__batch_scale_scalar(&_src[i], &_dst[i], _count - i, _conv);
+}
+#endif
@@ -0,0 +1,484 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stddef.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_codec.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define CODEC_MAX_VALUE_BYTES	10		// 69 bits of the widest code plus the pending bits, rounded up
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void lib_clock__codec_put(lib_clock_codec_enc_t *_enc, uint64_t _value, uint32_t _bits);
+static void lib_clock__codec_put_dod(lib_clock_codec_enc_t *_enc, int64_t _dod);
+static void lib_clock__codec_close(lib_clock_codec_enc_t *_enc);
+static void lib_clock__codec_refill(lib_clock_codec_dec_t *_dec);
+static inline uint64_t lib_clock__codec_get(lib_clock_codec_dec_t *_dec, uint32_t _bits);
+static int64_t lib_clock__codec_get_dod(lib_clock_codec_dec_t *_dec);
+static int lib_clock__codec_header(const lib_clock_codec_dec_t *_dec, size_t _offset, lib_clock_codec_block_t *_block);
+static void lib_clock__codec_wr32(uint8_t *_buf, uint32_t _value);
+static void lib_clock__codec_wr64(uint8_t *_buf, uint64_t _value);
+static uint32_t lib_clock__codec_rd32(const uint8_t *_buf);
+static uint64_t lib_clock__codec_rd64(const uint8_t *_buf);
+static uint64_t lib_clock__codec_rd64be(const uint8_t *_buf);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up an encoder on a caller buffer
+ * ****************************************************************************/
+int lib_clock__codec_enc_init(lib_clock_codec_enc_t *_enc, void *_buf, size_t _size, uint32_t _block_values)
+{
+	if ((_enc == NULL) || (_buf == NULL)) {
+		return -ESTD_INVAL;
+	}
+
+	_enc->buf = (uint8_t *)_buf;
+	_enc->size = _size;
+	_enc->used = 0;
+	_enc->committed = 0;
+	_enc->block = 0;
+	_enc->block_values = _block_values ? _block_values : LIB_CLOCK_CODEC_BLOCK_VALUES;
+	_enc->count = 0;
+	_enc->first = 0;
+	_enc->prev = 0;
+	_enc->prev_delta = 0;
+	_enc->acc = 0;
+	_enc->bits = 0;
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	append a timestamp
+ *
+ * Differences are taken modulo 2^64, so any sequence round trips. For
+ * regular streams the delta-of-delta is 0 and costs a single bit.
+ * ****************************************************************************/
+int lib_clock__codec_append(lib_clock_codec_enc_t *_enc, uint64_t _value)
+{
+	uint64_t delta;
+
+	if (_enc->count == 0) {
+		// the first value of a block is stored in the header
+		if (_enc->used + LIB_CLOCK_CODEC_HEADER_SIZE > _enc->size) {
+			return -ESTD_NOMEM;
+		}
+		_enc->block = _enc->used;
+		_enc->used += LIB_CLOCK_CODEC_HEADER_SIZE;
+		_enc->first = _value;
+		_enc->prev = _value;
+		_enc->prev_delta = 0;
+		_enc->count = 1;
+	}
+	else {
+		if (_enc->used + CODEC_MAX_VALUE_BYTES > _enc->size) {
+			return -ESTD_NOMEM;
+		}
+		delta = _value - _enc->prev;
+		lib_clock__codec_put_dod(_enc, (int64_t)(delta - _enc->prev_delta));
+		_enc->prev = _value;
+		_enc->prev_delta = delta;
+		_enc->count++;
+	}
+
+	if (_enc->count >= _enc->block_values) {
+		lib_clock__codec_close(_enc);
+	}
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	append an array of timestamps
+ * ****************************************************************************/
+size_t lib_clock__codec_append_n(lib_clock_codec_enc_t *_enc, const uint64_t *_values, size_t _count)
+{
+	size_t i;
+
+	for (i = 0; i < _count; i++) {
+		if (lib_clock__codec_append(_enc, _values[i]) < EOK) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/* ************************************************************************//**
+ * \brief	close the open block
+ * ****************************************************************************/
+size_t lib_clock__codec_flush(lib_clock_codec_enc_t *_enc)
+{
+	if (_enc->count != 0) {
+		lib_clock__codec_close(_enc);
+	}
+
+	return _enc->committed;
+}
+
+/* ************************************************************************//**
+ * \brief	set up a decoder over an encoded stream
+ * ****************************************************************************/
+int lib_clock__codec_dec_init(lib_clock_codec_dec_t *_dec, const void *_data, size_t _size)
+{
+	if ((_dec == NULL) || ((_data == NULL) && (_size != 0))) {
+		return -ESTD_INVAL;
+	}
+
+	_dec->data = (const uint8_t *)_data;
+	_dec->size = _size;
+	_dec->next = 0;
+	_dec->pos = _dec->data;
+	_dec->end = _dec->data;
+	_dec->acc = 0;
+	_dec->bits = 0;
+	_dec->remain = 0;
+	_dec->prev = 0;
+	_dec->prev_delta = 0;
+	_dec->started = 0;
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	decode the next values, continuing across blocks
+ * ****************************************************************************/
+int64_t lib_clock__codec_decode(lib_clock_codec_dec_t *_dec, uint64_t *_out, size_t _max)
+{
+	size_t n = 0;
+	int ret;
+
+	while (n < _max) {
+		if (_dec->remain == 0) {
+			ret = lib_clock__codec_next_block(_dec, NULL);
+			if (ret <= 0) {
+				// an error is reported by the next call
+				return (n > 0) ? (int64_t)n : ret;
+			}
+		}
+
+		if (!_dec->started) {
+			_dec->prev = _dec->block.first;
+			_dec->prev_delta = 0;
+			_dec->started = 1;
+		}
+		else {
+			_dec->prev_delta += (uint64_t)lib_clock__codec_get_dod(_dec);
+			_dec->prev += _dec->prev_delta;
+		}
+		_out[n++] = _dec->prev;
+		_dec->remain--;
+	}
+
+	return (int64_t)n;
+}
+
+/* ************************************************************************//**
+ * \brief	read the next block header and position the decoder at its start
+ * ****************************************************************************/
+int lib_clock__codec_next_block(lib_clock_codec_dec_t *_dec, lib_clock_codec_block_t *_block)
+{
+	int ret;
+
+	if (_dec->next >= _dec->size) {
+		return 0;
+	}
+
+	ret = lib_clock__codec_header(_dec, _dec->next, &_dec->block);
+	if (ret < EOK) {
+		return ret;
+	}
+
+	_dec->pos = &_dec->data[_dec->next + LIB_CLOCK_CODEC_HEADER_SIZE];
+	_dec->end = _dec->pos + _dec->block.bytes;
+	_dec->next += LIB_CLOCK_CODEC_HEADER_SIZE + _dec->block.bytes;
+	_dec->acc = 0;
+	_dec->bits = 0;
+	_dec->remain = _dec->block.count;
+	_dec->started = 0;
+
+	if (_block != NULL) {
+		*_block = _dec->block;
+	}
+
+	return 1;
+}
+
+/* ************************************************************************//**
+ * \brief	position the decoder at the block which may contain _value
+ * ****************************************************************************/
+int lib_clock__codec_seek(lib_clock_codec_dec_t *_dec, uint64_t _value, lib_clock_codec_block_t *_block)
+{
+	lib_clock_codec_block_t cur, found = { 0 };
+	size_t offset = 0;
+	int have = 0, ret;
+
+	while (offset < _dec->size) {
+		ret = lib_clock__codec_header(_dec, offset, &cur);
+		if (ret < EOK) {
+			return ret;
+		}
+		if (cur.first > _value) {
+			break;
+		}
+		found = cur;
+		have = 1;
+		if (cur.last >= _value) {
+			break;
+		}
+		offset += LIB_CLOCK_CODEC_HEADER_SIZE + cur.bytes;
+	}
+
+	if (!have) {
+		return -ESTD_INVAL;
+	}
+
+	_dec->next = found.offset;
+	return (lib_clock__codec_next_block(_dec, _block) == 1) ? EOK : -ESTD_FAULT;
+}
+
+/* ************************************************************************//**
+ * \brief	write the lowest _bits bits of _value, at most 56
+ * ****************************************************************************/
+static void lib_clock__codec_put(lib_clock_codec_enc_t *_enc, uint64_t _value, uint32_t _bits)
+{
+	_enc->acc = (_enc->acc << _bits) | (_value & ((1ULL << _bits) - 1U));
+	_enc->bits += _bits;
+	while (_enc->bits >= 8) {
+		_enc->bits -= 8;
+		_enc->buf[_enc->used++] = (uint8_t)(_enc->acc >> _enc->bits);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	write a delta-of-delta with the shortest fitting code
+ * ****************************************************************************/
+static void lib_clock__codec_put_dod(lib_clock_codec_enc_t *_enc, int64_t _dod)
+{
+	if (_dod == 0) {
+		lib_clock__codec_put(_enc, 0x0U, 1);
+	}
+	else if ((_dod >= -128) && (_dod < 128)) {
+		lib_clock__codec_put(_enc, (0x2ULL << 8) | ((uint64_t)_dod & 0xFFU), 2 + 8);
+	}
+	else if ((_dod >= -4096) && (_dod < 4096)) {
+		lib_clock__codec_put(_enc, (0x6ULL << 13) | ((uint64_t)_dod & 0x1FFFU), 3 + 13);
+	}
+	else if ((_dod >= -524288) && (_dod < 524288)) {
+		lib_clock__codec_put(_enc, (0xEULL << 20) | ((uint64_t)_dod & 0xFFFFFU), 4 + 20);
+	}
+	else if ((_dod >= INT32_MIN) && (_dod <= INT32_MAX)) {
+		lib_clock__codec_put(_enc, (0x1EULL << 32) | ((uint64_t)_dod & 0xFFFFFFFFU), 5 + 32);
+	}
+	else {
+		lib_clock__codec_put(_enc, 0x1FU, 5);
+		lib_clock__codec_put(_enc, (uint64_t)_dod >> 32, 32);
+		lib_clock__codec_put(_enc, (uint64_t)_dod, 32);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	pad the payload to a byte and fill in the block header
+ * ****************************************************************************/
+static void lib_clock__codec_close(lib_clock_codec_enc_t *_enc)
+{
+	uint8_t *hdr = &_enc->buf[_enc->block];
+
+	if (_enc->bits > 0) {
+		lib_clock__codec_put(_enc, 0, 8 - _enc->bits);
+	}
+
+	lib_clock__codec_wr32(&hdr[0], LIB_CLOCK_CODEC_MAGIC);
+	lib_clock__codec_wr32(&hdr[4], _enc->count);
+	lib_clock__codec_wr32(&hdr[8], (uint32_t)(_enc->used - _enc->block - LIB_CLOCK_CODEC_HEADER_SIZE));
+	lib_clock__codec_wr32(&hdr[12], 0);
+	lib_clock__codec_wr64(&hdr[16], _enc->first);
+	lib_clock__codec_wr64(&hdr[24], _enc->prev);
+
+	_enc->committed = _enc->used;
+	_enc->count = 0;
+}
+
+/* ************************************************************************//**
+ * \brief	top up the bit buffer to at least 57 bits
+ *
+ * Inside the payload eight bytes are loaded at once, whole bytes are
+ * taken over and the partial rest is loaded again by the next refill.
+ * Beyond the payload end zero bits are shifted in.
+ * ****************************************************************************/
+static void lib_clock__codec_refill(lib_clock_codec_dec_t *_dec)
+{
+	uint32_t take;
+
+	if (_dec->end - _dec->pos >= 8) {
+		_dec->acc |= lib_clock__codec_rd64be(_dec->pos) >> _dec->bits;
+		take = (63U - _dec->bits) >> 3;
+		_dec->pos += take;
+		_dec->bits += take * 8U;
+		return;
+	}
+
+	while (_dec->bits <= 56) {
+		if (_dec->pos < _dec->end) {
+			_dec->acc |= (uint64_t)*_dec->pos++ << (56U - _dec->bits);
+		}
+		_dec->bits += 8;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	read _bits bits, 1 ... 32, refilled by the caller
+ * ****************************************************************************/
+static inline uint64_t lib_clock__codec_get(lib_clock_codec_dec_t *_dec, uint32_t _bits)
+{
+	uint64_t value = _dec->acc >> (64U - _bits);
+
+	_dec->acc <<= _bits;
+	_dec->bits -= _bits;
+	return value;
+}
+
+/* ************************************************************************//**
+ * \brief	read a delta-of-delta
+ * ****************************************************************************/
+static int64_t lib_clock__codec_get_dod(lib_clock_codec_dec_t *_dec)
+{
+	uint64_t hi;
+	uint32_t ones;
+
+	if (_dec->bits < 37) {
+		lib_clock__codec_refill(_dec);
+	}
+
+	// regular streams, the common case
+	if ((_dec->acc >> 63) == 0) {
+		_dec->acc <<= 1;
+		_dec->bits -= 1;
+		return 0;
+	}
+
+	ones = (~_dec->acc != 0) ? (uint32_t)__builtin_clzll(~_dec->acc) : 64U;
+	if (ones > 5) {
+		ones = 5;
+	}
+
+	switch (ones) {
+		case 1:
+			lib_clock__codec_get(_dec, 2);
+			return (int8_t)lib_clock__codec_get(_dec, 8);
+
+		case 2:
+			lib_clock__codec_get(_dec, 3);
+			return ((int32_t)((uint32_t)lib_clock__codec_get(_dec, 13) << 19)) >> 19;
+
+		case 3:
+			lib_clock__codec_get(_dec, 4);
+			return ((int32_t)((uint32_t)lib_clock__codec_get(_dec, 20) << 12)) >> 12;
+
+		case 4:
+			lib_clock__codec_get(_dec, 5);
+			return (int32_t)lib_clock__codec_get(_dec, 32);
+
+		default:
+			lib_clock__codec_get(_dec, 5);
+			hi = lib_clock__codec_get(_dec, 32);
+			lib_clock__codec_refill(_dec);
+			return (int64_t)((hi << 32) | lib_clock__codec_get(_dec, 32));
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	read and check a block header
+ * ****************************************************************************/
+static int lib_clock__codec_header(const lib_clock_codec_dec_t *_dec, size_t _offset, lib_clock_codec_block_t *_block)
+{
+	const uint8_t *hdr = &_dec->data[_offset];
+
+	if (_dec->size - _offset < LIB_CLOCK_CODEC_HEADER_SIZE) {
+		return -ESTD_FAULT;
+	}
+	if (lib_clock__codec_rd32(&hdr[0]) != LIB_CLOCK_CODEC_MAGIC) {
+		return -ESTD_FAULT;
+	}
+
+	_block->count = lib_clock__codec_rd32(&hdr[4]);
+	_block->bytes = lib_clock__codec_rd32(&hdr[8]);
+	_block->first = lib_clock__codec_rd64(&hdr[16]);
+	_block->last = lib_clock__codec_rd64(&hdr[24]);
+	_block->offset = _offset;
+
+	if ((_block->count == 0) || (_block->bytes > _dec->size - _offset - LIB_CLOCK_CODEC_HEADER_SIZE)) {
+		return -ESTD_FAULT;
+	}
+
+	return EOK;
+}
+
+static void lib_clock__codec_wr32(uint8_t *_buf, uint32_t _value)
+{
+	_buf[0] = (uint8_t)_value;
+	_buf[1] = (uint8_t)(_value >> 8);
+	_buf[2] = (uint8_t)(_value >> 16);
+	_buf[3] = (uint8_t)(_value >> 24);
+}
+
+static void lib_clock__codec_wr64(uint8_t *_buf, uint64_t _value)
+{
+	lib_clock__codec_wr32(&_buf[0], (uint32_t)_value);
+	lib_clock__codec_wr32(&_buf[4], (uint32_t)(_value >> 32));
+}
+
+static uint32_t lib_clock__codec_rd32(const uint8_t *_buf)
+{
+	return (uint32_t)_buf[0] | ((uint32_t)_buf[1] << 8) | ((uint32_t)_buf[2] << 16) | ((uint32_t)_buf[3] << 24);
+}
+
+static uint64_t lib_clock__codec_rd64(const uint8_t *_buf)
+{
+	return (uint64_t)lib_clock__codec_rd32(&_buf[0]) | ((uint64_t)lib_clock__codec_rd32(&_buf[4]) << 32);
+}
+
+static uint64_t lib_clock__codec_rd64be(const uint8_t *_buf)
+{
+	return ((uint64_t)_buf[0] << 56) | ((uint64_t)_buf[1] << 48) | ((uint64_t)_buf[2] << 40) | ((uint64_t)_buf[3] << 32) |
+		((uint64_t)_buf[4] << 24) | ((uint64_t)_buf[5] << 16) | ((uint64_t)_buf[6] << 8) | (uint64_t)_buf[7];
+}
@@ -0,0 +1,247 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_format.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define FMT_SECS_PER_DAY		86400ULL
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void lib_clock__fmt_fixed(char *_buf, uint64_t _value, unsigned int _width);
+static void lib_clock__fmt_date(char *_buf, uint64_t _day);
+static void lib_clock__fmt_time(char *_buf, uint32_t _sec_of_day);
+static int lib_clock__fmt_decimal(char *_buf, size_t _size, uint64_t _sec, uint64_t _frac, unsigned int _frac_digits);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+
+// "00" ... "99", two digits per division by 100
+static const char s_digit_pairs[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const uint32_t s_pow10[10] = {
+	1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U, 1000000000U
+};
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	reset a date cache
+ * ****************************************************************************/
+void lib_clock__fmt_cache_init(lib_clock_fmt_cache_t *_cache)
+{
+	_cache->sec = UINT64_MAX;
+	_cache->day = UINT64_MAX;
+	memset(_cache->prefix, 0, sizeof(_cache->prefix));
+}
+
+/* ************************************************************************//**
+ * \brief	format microseconds as fixed-width decimal seconds
+ * ****************************************************************************/
+int lib_clock__fmt_sec_us(char *_buf, size_t _size, uint64_t _us)
+{
+	return lib_clock__fmt_decimal(_buf, _size, _us / 1000000ULL, _us % 1000000ULL, 6);
+}
+
+/* ************************************************************************//**
+ * \brief	format nanoseconds as fixed-width decimal seconds
+ * ****************************************************************************/
+int lib_clock__fmt_sec_ns(char *_buf, size_t _size, uint64_t _ns)
+{
+	return lib_clock__fmt_decimal(_buf, _size, _ns / 1000000000ULL, _ns % 1000000000ULL, 9);
+}
+
+/* ************************************************************************//**
+ * \brief	format a realtime timestamp as ISO-8601 UTC
+ *
+ * The fraction is truncated to the requested digits, like the decimal
+ * formats.
+ * ****************************************************************************/
+int lib_clock__fmt_iso8601(char *_buf, size_t _size, lib_clock_fmt_cache_t *_cache, uint64_t _epoch_ns, unsigned int _digits)
+{
+	uint64_t sec = _epoch_ns / 1000000000ULL;
+	uint32_t frac = (uint32_t)(_epoch_ns % 1000000000ULL);
+	lib_clock_fmt_cache_t local;
+	size_t len;
+	char *pos;
+
+	if ((_buf == NULL) || (_digits > 9)) {
+		return -ESTD_INVAL;
+	}
+
+	len = LIB_CLOCK_FMT_ISO_PREFIX_LEN + (_digits ? _digits + 1 : 0) + 1;
+	if (_size < len + 1) {
+		return -ESTD_INVAL;
+	}
+
+	if (_cache == NULL) {
+		lib_clock__fmt_cache_init(&local);
+		_cache = &local;
+	}
+
+	if (sec != _cache->sec) {
+		uint64_t day = sec / FMT_SECS_PER_DAY;
+
+		if (day != _cache->day) {
+			lib_clock__fmt_date(_cache->prefix, day);
+			_cache->day = day;
+		}
+		lib_clock__fmt_time(&_cache->prefix[10], (uint32_t)(sec - day * FMT_SECS_PER_DAY));
+		_cache->sec = sec;
+	}
+
+	memcpy(_buf, _cache->prefix, LIB_CLOCK_FMT_ISO_PREFIX_LEN);
+	pos = &_buf[LIB_CLOCK_FMT_ISO_PREFIX_LEN];
+	if (_digits) {
+		*pos++ = '.';
+		lib_clock__fmt_fixed(pos, frac / s_pow10[9 - _digits], _digits);
+		pos += _digits;
+	}
+	*pos++ = 'Z';
+	*pos = '\0';
+
+	return (int)len;
+}
+
+/* ************************************************************************//**
+ * \brief	seconds and fraction as fixed-width decimal
+ * ****************************************************************************/
+static int lib_clock__fmt_decimal(char *_buf, size_t _size, uint64_t _sec, uint64_t _frac, unsigned int _frac_digits)
+{
+	size_t len = LIB_CLOCK_FMT_SEC_DIGITS + 1 + _frac_digits;
+
+	if ((_buf == NULL) || (_size < len + 1)) {
+		return -ESTD_INVAL;
+	}
+
+	// the seconds field never grows, wider values do not fit the format
+	if (_sec >= 10000000000ULL) {
+		return -ESTD_INVAL;
+	}
+
+	lib_clock__fmt_fixed(_buf, _sec, LIB_CLOCK_FMT_SEC_DIGITS);
+	_buf[LIB_CLOCK_FMT_SEC_DIGITS] = '.';
+	lib_clock__fmt_fixed(&_buf[LIB_CLOCK_FMT_SEC_DIGITS + 1], _frac, _frac_digits);
+	_buf[len] = '\0';
+
+	return (int)len;
+}
+
+/* ************************************************************************//**
+ * \brief	write _value zero padded to _width digits, right to left
+ *
+ * Two digits per step from the pair table. Values below 2^32 are
+ * continued with 32bit divisions, which are cheaper on 32bit cores.
+ * ****************************************************************************/
+static void lib_clock__fmt_fixed(char *_buf, uint64_t _value, unsigned int _width)
+{
+	char *pos = &_buf[_width];
+	uint32_t v32;
+
+	while ((_value > UINT32_MAX) && (_width >= 2)) {
+		const char *pair = &s_digit_pairs[(_value % 100U) * 2U];
+
+		_value /= 100U;
+		*--pos = pair[1];
+		*--pos = pair[0];
+		_width -= 2;
+	}
+
+	v32 = (uint32_t)_value;
+	while (_width >= 2) {
+		const char *pair = &s_digit_pairs[(v32 % 100U) * 2U];
+
+		v32 /= 100U;
+		*--pos = pair[1];
+		*--pos = pair[0];
+		_width -= 2;
+	}
+	if (_width) {
+		*--pos = (char)('0' + v32 % 10U);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	write "YYYY-MM-DD" of a day since the epoch
+ *
+ * Civil date from days (H. Hinnant): the year is shifted to start in
+ * March, so the leap day is the last day of the year and the month
+ * lengths follow (153 * m + 2) / 5.
+ * ****************************************************************************/
+static void lib_clock__fmt_date(char *_buf, uint64_t _day)
+{
+	uint64_t z = _day + 719468U;			// days since 0000-03-01
+	uint64_t era = z / 146097U;				// 400 year cycles
+	uint32_t doe = (uint32_t)(z - era * 146097U);
+	uint32_t yoe = (doe - doe / 1460U + doe / 36524U - doe / 146096U) / 365U;
+	uint32_t doy = doe - (365U * yoe + yoe / 4U - yoe / 100U);
+	uint32_t mp = (5U * doy + 2U) / 153U;
+	uint32_t day = doy - (153U * mp + 2U) / 5U + 1U;
+	uint32_t month = (mp < 10U) ? mp + 3U : mp - 9U;
+	uint64_t year = yoe + era * 400U + ((month <= 2U) ? 1U : 0U);
+
+	lib_clock__fmt_fixed(&_buf[0], year, 4);
+	_buf[4] = '-';
+	lib_clock__fmt_fixed(&_buf[5], month, 2);
+	_buf[7] = '-';
+	lib_clock__fmt_fixed(&_buf[8], day, 2);
+}
+
+/* ************************************************************************//**
+ * \brief	write "THH:MM:SS" of a second of the day
+ * ****************************************************************************/
+static void lib_clock__fmt_time(char *_buf, uint32_t _sec_of_day)
+{
+	_buf[0] = 'T';
+	lib_clock__fmt_fixed(&_buf[1], _sec_of_day / 3600U, 2);
+	_buf[3] = ':';
+	lib_clock__fmt_fixed(&_buf[4], (_sec_of_day / 60U) % 60U, 2);
+	_buf[6] = ':';
+	lib_clock__fmt_fixed(&_buf[7], _sec_of_day % 60U, 2);
+}
@@ -0,0 +1,224 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_histogram.h"
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static int lib_clock__hist_check(uint64_t _highest, uint32_t _precision);
+static uint64_t lib_clock__hist_upper(const lib_clock_hist_t *_hist, uint32_t _index);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	memory required by a histogram
+ * ****************************************************************************/
+size_t lib_clock__hist_mem_size(uint64_t _highest, uint32_t _precision)
+{
+	lib_clock_hist_t layout;
+
+	if (!lib_clock__hist_check(_highest, _precision)) {
+		return 0;
+	}
+
+	layout.precision = _precision;
+	return sizeof(lib_clock_hist_t) + ((size_t)lib_clock__hist_index(&layout, _highest) + 1) * sizeof(uint64_t);
+}
+
+/* ************************************************************************//**
+ * \brief	set up a histogram in caller provided memory
+ * ****************************************************************************/
+lib_clock_hist_t *lib_clock__hist_init(void *_mem, size_t _size, uint64_t _highest, uint32_t _precision)
+{
+	lib_clock_hist_t *hist = (lib_clock_hist_t *)_mem;
+	size_t required = lib_clock__hist_mem_size(_highest, _precision);
+
+	if ((_mem == NULL) || (required == 0) || (_size < required)) {
+		return NULL;
+	}
+
+	hist->precision = _precision;
+	hist->highest = _highest;
+	hist->bucket_count = lib_clock__hist_index(hist, _highest) + 1;
+	lib_clock__hist_reset(hist);
+
+	return hist;
+}
+
+/* ************************************************************************//**
+ * \brief	allocate and set up a histogram
+ * ****************************************************************************/
+lib_clock_hist_t *lib_clock__hist_create(uint64_t _highest, uint32_t _precision)
+{
+	size_t size = lib_clock__hist_mem_size(_highest, _precision);
+	void *mem;
+
+	if (size == 0) {
+		return NULL;
+	}
+
+	mem = malloc(size);
+	if (mem == NULL) {
+		return NULL;
+	}
+
+	return lib_clock__hist_init(mem, size, _highest, _precision);
+}
+
+/* ************************************************************************//**
+ * \brief	free a histogram of lib_clock__hist_create
+ * ****************************************************************************/
+void lib_clock__hist_destroy(lib_clock_hist_t *_hist)
+{
+	free(_hist);
+}
+
+/* ************************************************************************//**
+ * \brief	clear all recorded values
+ * ****************************************************************************/
+void lib_clock__hist_reset(lib_clock_hist_t *_hist)
+{
+	_hist->total = 0;
+	_hist->saturated = 0;
+	_hist->min = UINT64_MAX;
+	_hist->max = 0;
+	_hist->sum = 0;
+	memset(_hist->counts, 0, (size_t)_hist->bucket_count * sizeof(uint64_t));
+}
+
+/* ************************************************************************//**
+ * \brief	add the values of _src to _dst
+ * ****************************************************************************/
+int lib_clock__hist_merge(lib_clock_hist_t *_dst, const lib_clock_hist_t *_src)
+{
+	uint32_t i;
+
+	if ((_dst->precision != _src->precision) || (_dst->bucket_count != _src->bucket_count)) {
+		return -ESTD_INVAL;
+	}
+
+	for (i = 0; i < _dst->bucket_count; i++) {
+		_dst->counts[i] += _src->counts[i];
+	}
+
+	_dst->total += _src->total;
+	_dst->saturated += _src->saturated;
+	_dst->sum += _src->sum;
+	if (_src->min < _dst->min) {
+		_dst->min = _src->min;
+	}
+	if (_src->max > _dst->max) {
+		_dst->max = _src->max;
+	}
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	value at the given percentile
+ * ****************************************************************************/
+uint64_t lib_clock__hist_percentile(const lib_clock_hist_t *_hist, double _percentile)
+{
+	uint64_t rank, seen = 0, value;
+	uint32_t i;
+
+	if (_hist->total == 0) {
+		return 0;
+	}
+
+	if (_percentile <= 0.0) {
+		return _hist->min;
+	}
+	if (_percentile >= 100.0) {
+		return _hist->max;
+	}
+
+	// rank of the sample at the percentile, counted from 1
+	rank = (uint64_t)((_percentile / 100.0) * (double)_hist->total + 0.5);
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	for (i = 0; i < _hist->bucket_count; i++) {
+		seen += _hist->counts[i];
+		if (seen >= rank) {
+			break;
+		}
+	}
+
+	value = lib_clock__hist_upper(_hist, i);
+	return (value > _hist->max) ? _hist->max : value;
+}
+
+/* ************************************************************************//**
+ * \brief	mean of the recorded values
+ * ****************************************************************************/
+double lib_clock__hist_mean(const lib_clock_hist_t *_hist)
+{
+	if (_hist->total == 0) {
+		return 0.0;
+	}
+	return (double)_hist->sum / (double)_hist->total;
+}
+
+static int lib_clock__hist_check(uint64_t _highest, uint32_t _precision)
+{
+	if ((_precision < LIB_CLOCK_HIST_MIN_PRECISION) || (_precision > LIB_CLOCK_HIST_MAX_PRECISION)) {
+		return 0;
+	}
+	return (_highest > 0) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	highest value which maps to the given bucket
+ * ****************************************************************************/
+static uint64_t lib_clock__hist_upper(const lib_clock_hist_t *_hist, uint32_t _index)
+{
+	uint32_t shift;
+	uint64_t sub;
+
+	if (_index < (2U << _hist->precision)) {
+		return _index;
+	}
+
+	shift = (_index >> _hist->precision) - 1;
+	sub = _index - ((uint64_t)shift << _hist->precision);
+	return ((sub + 1) << shift) - 1;
+}
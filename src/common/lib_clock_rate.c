@@ -0,0 +1,180 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stddef.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_rate.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define RATE_MAX_LIMIT		(1ULL << 62)	// keeps every sum of two times below 2^64
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static inline uint64_t lib_clock__rate_rel(const lib_clock_rate_t *_rl, uint64_t _now_ns);
+static inline uint32_t lib_clock__rate_to_us(uint64_t _time);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up a rate limiter with a full bucket
+ * ****************************************************************************/
+int lib_clock__rate_init(lib_clock_rate_t *_rl, uint32_t _tokens, uint64_t _period_us, uint32_t _burst)
+{
+	uint64_t period;
+
+	if ((_rl == NULL) || (_tokens == 0) || (_period_us == 0) || (_burst == 0)) {
+		return -ESTD_INVAL;
+	}
+	if (_period_us > (UINT64_MAX >> LIB_CLOCK_RATE_FRAC) / 1000ULL) {
+		return -ESTD_INVAL;
+	}
+
+	period = (_period_us * 1000ULL) << LIB_CLOCK_RATE_FRAC;
+	_rl->interval = period / _tokens;
+	if ((_rl->interval == 0) || (_rl->interval > RATE_MAX_LIMIT / _burst)) {
+		return -ESTD_INVAL;
+	}
+
+	_rl->limit = _rl->interval * _burst;
+	_rl->burst = _burst;
+	_rl->epoch_ns = lib_clock__get_time_ns();
+	__atomic_store_n(&_rl->tat, 0, __ATOMIC_RELAXED);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	take _n tokens, the time is read with lib_clock__get_time_ns
+ * ****************************************************************************/
+int lib_clock__rate_acquire(lib_clock_rate_t *_rl, uint32_t _n, uint32_t *_wait_us)
+{
+	return lib_clock__rate_acquire_at(_rl, _n, lib_clock__get_time_ns(), _wait_us);
+}
+
+/* ************************************************************************//**
+ * \brief	take _n tokens, the time is read with lib_clock__get_cached_time_ns
+ * ****************************************************************************/
+int lib_clock__rate_acquire_cached(lib_clock_rate_t *_rl, uint32_t _n, uint32_t *_wait_us)
+{
+	return lib_clock__rate_acquire_at(_rl, _n, lib_clock__get_cached_time_ns(), _wait_us);
+}
+
+/* ************************************************************************//**
+ * \brief	take _n tokens at a caller provided time
+ *
+ * _n tokens are granted if the bucket, i.e. the backlog of the
+ * theoretical arrival time ahead of now, still covers them.
+ * ****************************************************************************/
+int lib_clock__rate_acquire_at(lib_clock_rate_t *_rl, uint32_t _n, uint64_t _now_ns, uint32_t *_wait_us)
+{
+	uint64_t now, tat, next;
+
+	if ((_rl == NULL) || (_n == 0) || (_n > _rl->burst)) {
+		return -ESTD_INVAL;
+	}
+
+	now = lib_clock__rate_rel(_rl, _now_ns);
+	tat = __atomic_load_n(&_rl->tat, __ATOMIC_RELAXED);
+
+	do {
+		next = ((tat > now) ? tat : now) + (uint64_t)_n * _rl->interval;
+		if (next - now > _rl->limit) {
+			if (_wait_us != NULL) {
+				*_wait_us = lib_clock__rate_to_us(next - now - _rl->limit);
+			}
+			return -ESTD_AGAIN;
+		}
+	} while (!__atomic_compare_exchange_n(&_rl->tat, &tat, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	if (_wait_us != NULL) {
+		*_wait_us = 0;
+	}
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	number of tokens available now, without taking them
+ * ****************************************************************************/
+uint32_t lib_clock__rate_available(lib_clock_rate_t *_rl)
+{
+	uint64_t now, tat, backlog;
+
+	if (_rl == NULL) {
+		return 0;
+	}
+
+	now = lib_clock__rate_rel(_rl, lib_clock__get_time_ns());
+	tat = __atomic_load_n(&_rl->tat, __ATOMIC_RELAXED);
+	backlog = (tat > now) ? tat - now : 0;
+
+	return (backlog >= _rl->limit) ? 0 : (uint32_t)((_rl->limit - backlog) / _rl->interval);
+}
+
+/* ************************************************************************//**
+ * \brief	refill the bucket completely
+ * ****************************************************************************/
+void lib_clock__rate_reset(lib_clock_rate_t *_rl)
+{
+	if (_rl != NULL) {
+		__atomic_store_n(&_rl->tat, 0, __ATOMIC_RELAXED);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	convert a timestamp to the internal scale
+ *
+ * Cached or caller provided times may lie slightly before the
+ * initialization, they count as the initialization time.
+ * ****************************************************************************/
+static inline uint64_t lib_clock__rate_rel(const lib_clock_rate_t *_rl, uint64_t _now_ns)
+{
+	return (_now_ns > _rl->epoch_ns) ? (_now_ns - _rl->epoch_ns) << LIB_CLOCK_RATE_FRAC : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	convert an internal duration to microseconds, rounded up
+ * ****************************************************************************/
+static inline uint32_t lib_clock__rate_to_us(uint64_t _time)
+{
+	uint64_t us = ((_time + ((1ULL << LIB_CLOCK_RATE_FRAC) - 1)) >> LIB_CLOCK_RATE_FRAC);
+
+	us = (us + 999ULL) / 1000ULL;
+	return (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+}
@@ -0,0 +1,264 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stddef.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_wheel.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define ROOT_MASK		(LIB_CLOCK_WHEEL_ROOT_SIZE - 1)
+#define LVL_MASK		(LIB_CLOCK_WHEEL_LVL_SIZE - 1)
+#define LVL_SHIFT(_n)	(LIB_CLOCK_WHEEL_ROOT_BITS + (_n) * LIB_CLOCK_WHEEL_LVL_BITS)
+#define MAX_DELTA		((1ULL << LVL_SHIFT(LIB_CLOCK_WHEEL_LEVELS - 1)) - 1)
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static inline void lib_clock__wheel_list_init(lib_clock_wheel_node_t *_head);
+static inline void lib_clock__wheel_list_add(lib_clock_wheel_node_t *_head, lib_clock_wheel_node_t *_node);
+static inline void lib_clock__wheel_list_del(lib_clock_wheel_node_t *_node);
+static void lib_clock__wheel_insert(lib_clock_wheel_t *_wheel, lib_clock_wheel_timer_t *_timer);
+static uint32_t lib_clock__wheel_cascade(lib_clock_wheel_t *_wheel, uint32_t _level, uint32_t _index);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up a timer wheel
+ *
+ * Wheel tick 0 is _now_ms, the next tick to process is 1.
+ * ****************************************************************************/
+void lib_clock__wheel_init(lib_clock_wheel_t *_wheel, uint32_t _now_ms)
+{
+	uint32_t i, l;
+
+	_wheel->now = 1;
+	_wheel->last_ms = _now_ms;
+	_wheel->pending = 0;
+
+	for (i = 0; i < LIB_CLOCK_WHEEL_ROOT_SIZE; i++) {
+		lib_clock__wheel_list_init(&_wheel->root[i]);
+	}
+	for (l = 0; l < LIB_CLOCK_WHEEL_LEVELS - 1; l++) {
+		for (i = 0; i < LIB_CLOCK_WHEEL_LVL_SIZE; i++) {
+			lib_clock__wheel_list_init(&_wheel->lvl[l][i]);
+		}
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	set up a timer before its first use
+ * ****************************************************************************/
+void lib_clock__wheel_timer_init(lib_clock_wheel_timer_t *_timer, lib_clock_wheel_cb_t _cb, void *_arg)
+{
+	_timer->node.next = NULL;
+	_timer->node.prev = NULL;
+	_timer->expires = 0;
+	_timer->cb = _cb;
+	_timer->arg = _arg;
+}
+
+/* ************************************************************************//**
+ * \brief	arm or re-arm a timer
+ * ****************************************************************************/
+void lib_clock__wheel_arm(lib_clock_wheel_t *_wheel, lib_clock_wheel_timer_t *_timer, uint32_t _timeout_ms)
+{
+	if (lib_clock__wheel_pending(_timer)) {
+		lib_clock__wheel_list_del(&_timer->node);
+		_wheel->pending--;
+	}
+
+	// relative to the current tick, which is the one before the next to process
+	_timer->expires = _wheel->now - 1 + _timeout_ms;
+	lib_clock__wheel_insert(_wheel, _timer);
+	_wheel->pending++;
+}
+
+/* ************************************************************************//**
+ * \brief	cancel a timer
+ * ****************************************************************************/
+int lib_clock__wheel_cancel(lib_clock_wheel_t *_wheel, lib_clock_wheel_timer_t *_timer)
+{
+	if (!lib_clock__wheel_pending(_timer)) {
+		return 0;
+	}
+
+	lib_clock__wheel_list_del(&_timer->node);
+	_wheel->pending--;
+	return 1;
+}
+
+/* ************************************************************************//**
+ * \brief	advance the wheel and fire all due timers
+ * ****************************************************************************/
+uint32_t lib_clock__wheel_advance(lib_clock_wheel_t *_wheel, uint32_t _now_ms)
+{
+	// unsigned 32bit difference, correct across the wrap of the ms counter
+	uint32_t delta = _now_ms - _wheel->last_ms;
+	uint64_t target = _wheel->now - 1 + delta;
+	lib_clock_wheel_node_t expired;
+	uint32_t fired = 0;
+
+	_wheel->last_ms = _now_ms;
+
+	while (_wheel->now <= target) {
+		uint32_t index = (uint32_t)(_wheel->now & ROOT_MASK);
+
+		if (_wheel->pending == 0) {
+			// nothing armed, no slot has to be visited
+			_wheel->now = target + 1;
+			break;
+		}
+
+		// the root level wrapped, move the next slots of the higher levels down
+		if (index == 0) {
+			uint32_t l;
+
+			for (l = 0; l < LIB_CLOCK_WHEEL_LEVELS - 1; l++) {
+				if (lib_clock__wheel_cascade(_wheel, l, (uint32_t)((_wheel->now >> LVL_SHIFT(l)) & LVL_MASK)) != 0) {
+					break;
+				}
+			}
+		}
+
+		// timers armed by the callbacks have to see the following tick
+		_wheel->now++;
+
+		if (_wheel->root[index].next == &_wheel->root[index]) {
+			continue;
+		}
+
+		// detach the slot, callbacks may arm or cancel any timer
+		expired.next = _wheel->root[index].next;
+		expired.prev = _wheel->root[index].prev;
+		expired.next->prev = &expired;
+		expired.prev->next = &expired;
+		lib_clock__wheel_list_init(&_wheel->root[index]);
+
+		while (expired.next != &expired) {
+			lib_clock_wheel_timer_t *timer = (lib_clock_wheel_timer_t *)expired.next;
+
+			lib_clock__wheel_list_del(&timer->node);
+			_wheel->pending--;
+			fired++;
+			timer->cb(timer, timer->arg);
+		}
+	}
+
+	return fired;
+}
+
+/* ************************************************************************//**
+ * \brief	advance the wheel to lib_clock__get_time_ms
+ * ****************************************************************************/
+uint32_t lib_clock__wheel_poll(lib_clock_wheel_t *_wheel)
+{
+	return lib_clock__wheel_advance(_wheel, lib_clock__get_time_ms());
+}
+
+/* ************************************************************************//**
+ * \brief	put a timer into the slot of its expiry
+ * ****************************************************************************/
+static void lib_clock__wheel_insert(lib_clock_wheel_t *_wheel, lib_clock_wheel_timer_t *_timer)
+{
+	int64_t delta = (int64_t)(_timer->expires - _wheel->now);
+	uint64_t expires = _timer->expires;
+	lib_clock_wheel_node_t *slot;
+	uint32_t l;
+
+	if (delta < 0) {
+		// already due, fire with the next processed tick
+		slot = &_wheel->root[_wheel->now & ROOT_MASK];
+	}
+	else if (delta < (int64_t)LIB_CLOCK_WHEEL_ROOT_SIZE) {
+		slot = &_wheel->root[expires & ROOT_MASK];
+	}
+	else {
+		if ((uint64_t)delta > MAX_DELTA) {
+			expires = _wheel->now + MAX_DELTA;
+			_timer->expires = expires;
+		}
+
+		for (l = 0; l < LIB_CLOCK_WHEEL_LEVELS - 2; l++) {
+			if ((uint64_t)delta < (1ULL << LVL_SHIFT(l + 1))) {
+				break;
+			}
+		}
+		slot = &_wheel->lvl[l][(expires >> LVL_SHIFT(l)) & LVL_MASK];
+	}
+
+	lib_clock__wheel_list_add(slot, &_timer->node);
+}
+
+/* ************************************************************************//**
+ * \brief	redistribute one slot of a higher level to the lower levels
+ *
+ * \return	the cascaded slot index, 0 means the next level has to follow
+ * ****************************************************************************/
+static uint32_t lib_clock__wheel_cascade(lib_clock_wheel_t *_wheel, uint32_t _level, uint32_t _index)
+{
+	lib_clock_wheel_node_t *head = &_wheel->lvl[_level][_index];
+	lib_clock_wheel_node_t *node, *next;
+
+	for (node = head->next; node != head; node = next) {
+		next = node->next;
+		lib_clock__wheel_insert(_wheel, (lib_clock_wheel_timer_t *)node);
+	}
+	lib_clock__wheel_list_init(head);
+
+	return _index;
+}
+
+static inline void lib_clock__wheel_list_init(lib_clock_wheel_node_t *_head)
+{
+	_head->next = _head;
+	_head->prev = _head;
+}
+
+static inline void lib_clock__wheel_list_add(lib_clock_wheel_node_t *_head, lib_clock_wheel_node_t *_node)
+{
+	_node->prev = _head->prev;
+	_node->next = _head;
+	_head->prev->next = _node;
+	_head->prev = _node;
+}
+
+static inline void lib_clock__wheel_list_del(lib_clock_wheel_node_t *_node)
+{
+	_node->prev->next = _node->next;
+	_node->next->prev = _node->prev;
+	_node->next = NULL;
+	_node->prev = NULL;
+}
@@ -28,8 +28,10 @@
  * ******************************************************************/
 
 /* c-runtime */
+#include <stdatomic.h>
 
 /* system */
+#include <errno.h>
 #include <time.h>
 
 /* own libs */
@@ -37,6 +39,38 @@
 
 /* project */
 #include "lib_clock.h"
+#include "lib_clock_posix.h"
+#include "lib_clock_wait.h"
+#include "lib_clock_cpu.h"
+#include "lib_clock_conv.h"
+#include "lib_clock_source.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define DELAY_SLACK_PROBES		8			// sleeps used to measure the initial wakeup slack
+#define DELAY_SLACK_PROBE_NS	100000ULL	// length of a single probe sleep
+#define DELAY_SLACK_DEFAULT_NS	60000ULL	// used until the slack is measured
+#define DELAY_SLACK_DECAY		32			// slow decay if the wakeup was earlier than estimated
+#define DELAY_SLACK_STEP_NS		20000ULL	// a single sample counts at most twice the estimate plus this
+#define DELAY_SLACK_MAX_NS		2000000ULL	// later wakeups are preemptions, not timer slack
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static inline uint64_t lib_clock__now_ns(void);
+static inline uint64_t lib_clock__mono_ns(void);
+static void lib_clock__sleep_ns(uint64_t _ns);
+static void lib_clock__sleep_until_ns(uint64_t _deadline);
+static void lib_clock__spin_until(uint64_t _deadline);
+static void lib_clock__delay_slack_init(void);
+static void lib_clock__delay_slack_update(uint64_t _overshoot);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static _Atomic int s_delay_policy = LIB_CLOCK_DELAY_SLEEP;
+static _Atomic uint64_t s_delay_slack_ns = DELAY_SLACK_DEFAULT_NS;
 
 /* *******************************************************************
  * function definitions
@@ -44,31 +78,52 @@
 
 /* ************************************************************************//**
  * \brief	Initialization of the timing module
-
+ *
+ * Uses the build default sources, see lib_clock__init_cfg.
  * ****************************************************************************/
 int lib_clock__init(void)
 {
-	return EOK;
+	return lib_clock__init_cfg(NULL);
 }
 
 /* ************************************************************************//**
- * \brief	get current timestamp in milliseconds
+ * \brief	Initialization of the timing module with a source configuration
  *
- * \return	current timestamp in milliseconds
+ * The sources of the getters and the tick conversion factors are resolved,
+ * an invariant TSC is calibrated against CLOCK_MONOTONIC if it may be used.
+ * The wakeup slack used by the hybrid delay policy and the clock check
+ * interval of the spinning waits are measured.
+ * With LIB_CLOCK_CACHED_PERIOD_US set, the ticker of the cached clock is
+ * started as well.
  * ****************************************************************************/
-uint32_t lib_clock__get_time_ms(void)
+int lib_clock__init_cfg(const lib_clock_cfg_t *_cfg)
 {
-	struct timespec tp;
+	int ret;
 
-
-	if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0){
-
-		return 0;
+	ret = lib_clock__source_init(_cfg);
+	if (ret < EOK) {
+		return ret;
 	}
 
+	lib_clock__delay_slack_init();
+	lib_clock__wait_calibrate();
+#if defined(LIB_CLOCK_CACHED_PERIOD_US) && (LIB_CLOCK_CACHED_PERIOD_US > 0)
+	ret = lib_clock__cached_start(LIB_CLOCK_CACHED_PERIOD_US);
+	if ((ret < EOK) && (ret != -ESTD_BUSY)) {
+		return ret;
+	}
+#endif
+	return EOK;
+}
 
-	// convert returned timestamp structure to milliseconds
-	return (uint32_t)(tp.tv_nsec / 1000000 + tp.tv_sec * 1000);
+/* ************************************************************************//**
+ * \brief	get current timestamp in milliseconds
+ *
+ * \return	current timestamp in milliseconds
+ * ****************************************************************************/
+uint32_t lib_clock__get_time_ms(void)
+{
+	return (uint32_t)(g_lib_clock_src.read[LIB_CLOCK_API_MS]() / 1000000ULL);
 }
 
 /* ************************************************************************//**
@@ -78,15 +133,8 @@ uint32_t lib_clock__get_time_ms(void)
  * \return	current timestamp in nanoseconds
  * ****************************************************************************/
 uint64_t lib_clock__get_time_ns(void) {
-	struct timespec tp;
 
-	if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0){
-
-		return 0;
-	}
-
-	// convert returned timestamp structure to nanoseconds
-	return (uint64_t)(tp.tv_nsec + tp.tv_sec * 1000000000ULL);	
+	return g_lib_clock_src.read[LIB_CLOCK_API_NS]();
 }
 
 /* ************************************************************************//**
@@ -96,15 +144,8 @@ uint64_t lib_clock__get_time_ns(void) {
  * \return	current timestamp in microseconds
  * ****************************************************************************/
 uint64_t lib_clock__get_time_us(void){
-	struct timespec tp;
-
-	if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0){
-
-		return 0;
-	}
 
-	// convert returned timestamp structure to microseconds
-	return (uint64_t)(tp.tv_nsec / 1000ULL + tp.tv_sec * 1000000ULL);	
+	return g_lib_clock_src.read[LIB_CLOCK_API_US]() / 1000ULL;
 }
 
 /* ************************************************************************//**
@@ -119,51 +160,300 @@ uint32_t lib_clock__get_time_since_ms(uint32_t _lasttime){
 /* ************************************************************************//**
  * \brief delay the calling thread for the given amount of microseconds
  *
+ * The strategy is selected by lib_clock__set_delay_policy.
  * ****************************************************************************/
 void lib_clock__delay_us(uint32_t _delay){
-	struct timespec rqtp;
+	uint64_t start, delay_ns, slack, wake;
+
+	delay_ns = (uint64_t)_delay * 1000ULL;
+
+	switch (atomic_load_explicit(&s_delay_policy, memory_order_relaxed)) {
+		case LIB_CLOCK_DELAY_SPIN:
+			lib_clock__spin_until(lib_clock__now_ns() + delay_ns);
+			break;
+
+		case LIB_CLOCK_DELAY_HYBRID:
+			start = lib_clock__now_ns();
+			slack = atomic_load_explicit(&s_delay_slack_ns, memory_order_relaxed);
+			if (delay_ns > slack) {
+				lib_clock__sleep_ns(delay_ns - slack);
+				wake = lib_clock__now_ns();
+				lib_clock__delay_slack_update(wake - start - (delay_ns - slack));
+			}
+			else if (slack > DELAY_SLACK_DEFAULT_NS) {
+				// no sample without a sleep, a high estimate decays until delays sleep again
+				lib_clock__delay_slack_update(DELAY_SLACK_DEFAULT_NS);
+			}
+			lib_clock__spin_until(start + delay_ns);
+			break;
+
+		case LIB_CLOCK_DELAY_SLEEP:
+		default:
+			lib_clock__sleep_ns(delay_ns);
+			break;
+	}
+}
 
+/* ************************************************************************//**
+ * \brief	select the strategy of lib_clock__delay_us
+ * ****************************************************************************/
+int lib_clock__set_delay_policy(lib_clock_delay_policy_t _policy)
+{
+	switch (_policy) {
+		case LIB_CLOCK_DELAY_SLEEP:
+		case LIB_CLOCK_DELAY_HYBRID:
+		case LIB_CLOCK_DELAY_SPIN:
+			atomic_store(&s_delay_policy, (int)_policy);
+			return EOK;
+		default:
+			return -ESTD_INVAL;
+	}
+}
 
-	// calculate timespec values
-	rqtp.tv_sec = (time_t)_delay / 1000000;
-	rqtp.tv_nsec = (long)(_delay % 1000000) * 1000;
+/* ************************************************************************//**
+ * \brief	get the active strategy of lib_clock__delay_us
+ * ****************************************************************************/
+lib_clock_delay_policy_t lib_clock__get_delay_policy(void)
+{
+	return (lib_clock_delay_policy_t)atomic_load(&s_delay_policy);
+}
 
+/* ************************************************************************//**
+ * \brief	get the current estimate of the scheduler wakeup slack
+ * ****************************************************************************/
+uint64_t lib_clock__get_delay_slack_ns(void)
+{
+	return atomic_load_explicit(&s_delay_slack_ns, memory_order_relaxed);
+}
 
-	clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+/* ************************************************************************//**
+ * \brief	set up a periodic timer
+ *
+ * The deadlines are CLOCK_MONOTONIC nanoseconds, they are independent of
+ * the TSC as clock_nanosleep needs them on its own clock.
+ * ****************************************************************************/
+int lib_clock__periodic_init(lib_clock_periodic_t *_hdl, uint32_t _period_us)
+{
+	if ((_hdl == NULL) || (_period_us == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	_hdl->period = (uint64_t)_period_us * 1000ULL;
+	_hdl->period_rem = 0;
+	_hdl->next_rem = 0;
+	_hdl->next = lib_clock__mono_ns() + _hdl->period;
+	_hdl->periods = 0;
+	_hdl->missed = 0;
+	_hdl->max_lateness_ns = 0;
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	block until the next deadline of a periodic timer
+ * ****************************************************************************/
+int lib_clock__periodic_wait(lib_clock_periodic_t *_hdl)
+{
+	uint64_t now, missed = 0, lateness;
+
+	if ((_hdl == NULL) || (_hdl->period == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	// skip complete periods which were overrun, the phase stays intact
+	now = lib_clock__mono_ns();
+	if (now >= _hdl->next + _hdl->period) {
+		missed = (now - _hdl->next) / _hdl->period;
+		_hdl->next += missed * _hdl->period;
+		_hdl->missed += missed;
+	}
+
+	lib_clock__sleep_until_ns(_hdl->next);
+
+	now = lib_clock__mono_ns();
+	lateness = (now > _hdl->next) ? now - _hdl->next : 0;
+	if (lateness > _hdl->max_lateness_ns) {
+		_hdl->max_lateness_ns = lateness;
+	}
+
+	_hdl->next += _hdl->period;
+	_hdl->periods++;
+
+	return (missed > (uint64_t)INT32_MAX) ? INT32_MAX : (int)missed;
 }
 
 /* ************************************************************************//**
  * \brief	number of clock ticks as 64bit value
+ *
+ * The ticks are raw TSC values if the TSC is the tick source, otherwise
+ * multiples of the resolution of the selected clock.
  * ****************************************************************************/
 uint64_t lib_clock__get_clock_ticks(void){
-	static uint64_t tick_res = 0;
-	struct timespec tp;
 
+	return g_lib_clock_src.read[LIB_CLOCK_API_TICKS]();
+}
+
+/* ************************************************************************//**
+ * \brief	convert a number of clock ticks to nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__ticks_to_ns(uint64_t _ticks)
+{
+	return lib_clock__conv(_ticks, &g_lib_clock_src.to_ns);
+}
+
+/* ************************************************************************//**
+ * \brief	convert nanoseconds to a number of clock ticks
+ * ****************************************************************************/
+uint64_t lib_clock__ns_to_ticks(uint64_t _ns)
+{
+	return lib_clock__conv(_ns, &g_lib_clock_src.to_ticks);
+}
+
+/* ************************************************************************//**
+ * \brief	get the frequency of the clock ticks
+ * ****************************************************************************/
+uint64_t lib_clock__get_tick_freq(void)
+{
+	return g_lib_clock_src.freq;
+}
+
+/* ************************************************************************//**
+ * \brief	get the factors behind the tick conversions
+ * ****************************************************************************/
+void lib_clock__get_tick_conv(lib_clock_tick_conv_t *_to_ns, lib_clock_tick_conv_t *_to_ticks)
+{
+	if (_to_ns != NULL) {
+		_to_ns->mult = g_lib_clock_src.to_ns.mult;
+		_to_ns->shift = g_lib_clock_src.to_ns.shift;
+	}
+	if (_to_ticks != NULL) {
+		_to_ticks->mult = g_lib_clock_src.to_ticks.mult;
+		_to_ticks->shift = g_lib_clock_src.to_ticks.shift;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	current monotonic time in nanoseconds
+ *
+ * Uses the calibrated TSC if available, CLOCK_MONOTONIC otherwise. The
+ * delays measure with it independent of the sources of the getters.
+ * ****************************************************************************/
+static inline uint64_t lib_clock__now_ns(void)
+{
+	return g_lib_clock_src.fine();
+}
+
+/* ************************************************************************//**
+ * \brief	CLOCK_MONOTONIC in nanoseconds
+ * ****************************************************************************/
+static inline uint64_t lib_clock__mono_ns(void)
+{
+	struct timespec tp;
 
-	// get current absolute system time
 	if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0){
 
 		return 0;
 	}
 
-	// get resolution (only if called for the very first time, as the resolution should never change)
-	if (tick_res == 0){
-		struct timespec res;
+	// convert returned timestamp structure to nanoseconds
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
+
+/* ************************************************************************//**
+ * \brief	relative sleep on CLOCK_MONOTONIC
+ * ****************************************************************************/
+static void lib_clock__sleep_ns(uint64_t _ns)
+{
+	struct timespec rqtp;
+
+	// calculate timespec values
+	rqtp.tv_sec = (time_t)(_ns / 1000000000ULL);
+	rqtp.tv_nsec = (long)(_ns % 1000000000ULL);
 
-		if (clock_getres(CLOCK_MONOTONIC, &res) != 0){
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+}
 
-			return 0;
-		}
+/* ************************************************************************//**
+ * \brief	absolute sleep until the given CLOCK_MONOTONIC time
+ * ****************************************************************************/
+static void lib_clock__sleep_until_ns(uint64_t _deadline)
+{
+	struct timespec rqtp;
 
-		tick_res  = ((uint64_t)res.tv_nsec + (uint64_t)res.tv_sec * 1000000000);
-		if (tick_res == 0){
-			// just in case, to avoid division by 0; should actually never happen, though
-			return 0;
-		}
+	rqtp.tv_sec = (time_t)(_deadline / 1000000000ULL);
+	rqtp.tv_nsec = (long)(_deadline % 1000000000ULL);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &rqtp, NULL) == EINTR) {
 	}
+}
 
+/* ************************************************************************//**
+ * \brief	busy-wait until the given monotonic time
+ * ****************************************************************************/
+static void lib_clock__spin_until(uint64_t _deadline)
+{
+	while (lib_clock__now_ns() < _deadline) {
+		lib_clock__cpu_relax();
+	}
+}
 
-	// calculate tick count by dividing the overall number of elapsed nanoseconds by the timer resolution
-	return ((uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000) / tick_res;
+/* ************************************************************************//**
+ * \brief	measure the initial wakeup slack of the scheduler
+ *
+ * The median overshoot of a few short probe sleeps is used as estimate,
+ * a probe which got preempted does not inflate it.
+ * ****************************************************************************/
+static void lib_clock__delay_slack_init(void)
+{
+	uint64_t start, overshoot, probes[DELAY_SLACK_PROBES];
+	int i, j;
+
+	// insertion sort of the overshoots
+	for (i = 0; i < DELAY_SLACK_PROBES; i++) {
+		start = lib_clock__now_ns();
+		lib_clock__sleep_ns(DELAY_SLACK_PROBE_NS);
+		overshoot = lib_clock__now_ns() - start - DELAY_SLACK_PROBE_NS;
+		for (j = i; (j > 0) && (probes[j - 1] > overshoot); j--) {
+			probes[j] = probes[j - 1];
+		}
+		probes[j] = overshoot;
+	}
+
+	overshoot = probes[DELAY_SLACK_PROBES / 2];
+	atomic_store(&s_delay_slack_ns, (overshoot < DELAY_SLACK_MAX_NS) ? overshoot : DELAY_SLACK_MAX_NS);
 }
 
+/* ************************************************************************//**
+ * \brief	refine the wakeup slack with the overshoot of a hybrid sleep
+ *
+ * A later wakeup than estimated is adopted quickly, as it causes a late
+ * delay. An earlier wakeup only costs spin time and decays slowly.
+ * A single sample raises the estimate at most by half of itself plus
+ * DELAY_SLACK_STEP_NS, a preempted sleep does not turn the following
+ * delays into busy waits. The estimate is capped at DELAY_SLACK_MAX_NS.
+ * Concurrent updates may get lost, which is harmless for an estimate.
+ * ****************************************************************************/
+static void lib_clock__delay_slack_update(uint64_t _overshoot)
+{
+	uint64_t slack = atomic_load_explicit(&s_delay_slack_ns, memory_order_relaxed);
+
+	if ((int64_t)_overshoot < 0) {
+		_overshoot = 0;
+	}
+
+	if (_overshoot > 2 * slack + DELAY_SLACK_STEP_NS) {
+		_overshoot = 2 * slack + DELAY_SLACK_STEP_NS;
+	}
+
+	if (_overshoot > slack) {
+		slack += (_overshoot - slack) / 2;
+		if (slack > DELAY_SLACK_MAX_NS) {
+			slack = DELAY_SLACK_MAX_NS;
+		}
+	}
+	else {
+		slack -= (slack - _overshoot) / DELAY_SLACK_DECAY;
+	}
+
+	atomic_store_explicit(&s_delay_slack_ns, slack, memory_order_relaxed);
+}
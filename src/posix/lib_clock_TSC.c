@@ -0,0 +1,222 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* system */
+#include <pthread.h>
+#include <time.h>
+#if defined(__x86_64__)
+	#include <cpuid.h>
+#endif
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_posix.h"
+#include "lib_clock_TSC.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define TSC_CALIB_PERIOD_NS		50000000ULL		// 50ms calibration interval
+#define TSC_CALIB_SAMPLES		16				// paired readings, the tightest one is used
+#define TSC_MIN_FREQ			100000000ULL	// plausibility window of the measured frequency
+#define TSC_MAX_FREQ			10000000000ULL
+#define CPUID_ADV_POWER_MGMT	0x80000007
+#define CPUID_INVARIANT_TSC		(1U << 8)
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+#ifdef LIB_CLOCK_TSC_HW
+static int lib_clock__tsc_invariant(void);
+static int lib_clock__tsc_pair(uint64_t *_tsc, uint64_t *_ns);
+#endif
+static void lib_clock__tsc_init_once(void);
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+lib_clock_tsc_t g_lib_clock_tsc;
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static pthread_once_t s_tsc_once = PTHREAD_ONCE_INIT;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	Detect an invariant TSC and calibrate it against CLOCK_MONOTONIC
+ * ****************************************************************************/
+#ifdef LIB_CLOCK_TSC_HW
+int lib_clock__tsc_init(void)
+{
+	lib_clock_tsc_t tsc = { 0 };
+	uint64_t tsc0, ns0, tsc1, ns1, hi, lo;
+	struct timespec rqtp;
+	int ret;
+
+	g_lib_clock_tsc.usable = 0;
+
+	if (!lib_clock__tsc_invariant()) {
+		return -ESTD_NOSYS;
+	}
+
+	ret = lib_clock__tsc_pair(&tsc0, &ns0);
+	if (ret < EOK) {
+		return ret;
+	}
+
+	rqtp.tv_sec = (time_t)(TSC_CALIB_PERIOD_NS / 1000000000ULL);
+	rqtp.tv_nsec = (long)(TSC_CALIB_PERIOD_NS % 1000000000ULL);
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+
+	ret = lib_clock__tsc_pair(&tsc1, &ns1);
+	if (ret < EOK) {
+		return ret;
+	}
+
+	if ((tsc1 <= tsc0) || (ns1 <= ns0)) {
+		return -ESTD_FAULT;
+	}
+
+	lo = lib_clock__mul128(tsc1 - tsc0, 1000000000ULL, &hi);
+	tsc.freq = lib_clock__div128(hi, lo, ns1 - ns0, NULL);
+	if ((tsc.freq < TSC_MIN_FREQ) || (tsc.freq > TSC_MAX_FREQ)) {
+		return -ESTD_FAULT;
+	}
+
+	// continue on the CLOCK_MONOTONIC scale from the last calibration point
+	tsc.mult = lib_clock__div128((ns1 - ns0) >> (64 - LIB_CLOCK_TSC_SHIFT), (ns1 - ns0) << LIB_CLOCK_TSC_SHIFT, tsc1 - tsc0, NULL);
+	tsc.tsc_base = tsc1;
+	tsc.ns_base = ns1;
+	tsc.usable = 1;
+
+	g_lib_clock_tsc = tsc;
+
+	// a TSC which is not synchronized across the CPUs is rejected or corrected
+	return lib_clock__tsc_sync();
+}
+#else
+int lib_clock__tsc_init(void)
+{
+	g_lib_clock_tsc.usable = 0;
+	return -ESTD_NOSYS;
+}
+#endif
+
+/* ************************************************************************//**
+ * \brief	get the TSC calibration for reading the TSC inline
+ * ****************************************************************************/
+int lib_clock__get_tsc_conv(lib_clock_tsc_conv_t *_conv)
+{
+	if (_conv == NULL) {
+		return -ESTD_INVAL;
+	}
+
+	pthread_once(&s_tsc_once, &lib_clock__tsc_init_once);
+	if (!g_lib_clock_tsc.usable || (g_lib_clock_tsc.cpu_count != 0)) {
+		return -ESTD_NOSYS;
+	}
+
+	_conv->tsc_base = g_lib_clock_tsc.tsc_base;
+	_conv->ns_base = g_lib_clock_tsc.ns_base;
+	_conv->mult = g_lib_clock_tsc.mult;
+	_conv->shift = LIB_CLOCK_TSC_SHIFT;
+	_conv->freq = g_lib_clock_tsc.freq;
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	calibrate for lib_clock__get_tsc_conv unless lib_clock__init did
+ * ****************************************************************************/
+static void lib_clock__tsc_init_once(void)
+{
+	if (!g_lib_clock_tsc.usable) {
+		lib_clock__tsc_init();
+	}
+}
+
+#ifdef LIB_CLOCK_TSC_HW
+/* ************************************************************************//**
+ * \brief	check the CPUID invariant TSC flag
+ * ****************************************************************************/
+static int lib_clock__tsc_invariant(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0x80000000, NULL) < CPUID_ADV_POWER_MGMT) {
+		return 0;
+	}
+
+	if (!__get_cpuid(CPUID_ADV_POWER_MGMT, &eax, &ebx, &ecx, &edx)) {
+		return 0;
+	}
+
+	return (edx & CPUID_INVARIANT_TSC) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	take a TSC / CLOCK_MONOTONIC reading pair
+ *
+ * The clock_gettime call is bracketed by two TSC reads. Out of several
+ * attempts the pair with the shortest bracket is used, its midpoint is
+ * the TSC value belonging to the nanosecond reading.
+ * ****************************************************************************/
+static int lib_clock__tsc_pair(uint64_t *_tsc, uint64_t *_ns)
+{
+	uint64_t best = UINT64_MAX;
+	struct timespec tp;
+	int i;
+
+	for (i = 0; i < TSC_CALIB_SAMPLES; i++) {
+		uint64_t before, after;
+
+		before = lib_clock__tsc_read();
+		if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0) {
+			return -ESTD_FAULT;
+		}
+		after = lib_clock__tsc_read();
+
+		if ((after - before) < best) {
+			best = after - before;
+			*_tsc = before + (after - before) / 2;
+			*_ns = (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+		}
+	}
+
+	return EOK;
+}
+#endif
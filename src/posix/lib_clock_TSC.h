@@ -0,0 +1,142 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_TSC_H_
+#define _LIB_CLOCK_TSC_H_
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+#if defined(__x86_64__)
+	#include <x86intrin.h>
+#endif
+
+/* project */
+#include "lib_clock_conv.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define LIB_CLOCK_TSC_SHIFT		32		// fixed-point fraction bits of the tick to ns multiplier
+#define LIB_CLOCK_TSC_AUX_CPU	0xfffU	// CPU number in IA32_TSC_AUX as set up by Linux
+
+/* targets with the TSC code, elsewhere lib_clock__tsc_init and
+ * lib_clock__tsc_sync are stubs returning -ESTD_NOSYS */
+#if defined(__x86_64__)
+	#define LIB_CLOCK_TSC_HW
+#endif
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	uint64_t	tsc_base;	// TSC value at the calibration end point
+	uint64_t	ns_base;	// CLOCK_MONOTONIC value at the calibration end point
+	uint64_t	mult;		// ns per TSC tick as fixed-point value with LIB_CLOCK_TSC_SHIFT fraction bits
+	uint64_t	freq;		// measured TSC frequency in Hz
+	int			usable;		// set if the TSC is invariant and calibrated
+	uint32_t	cpu_count;	// entries of cpu_offset, 0 without a per-CPU correction
+	const int64_t *cpu_offset;	// TSC of a CPU minus the TSC of the reference CPU in ticks
+} lib_clock_tsc_t;
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+extern lib_clock_tsc_t g_lib_clock_tsc;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	Detect an invariant TSC and calibrate it against CLOCK_MONOTONIC
+ *
+ * On success g_lib_clock_tsc.usable is set. On any failure, including a
+ * skew rejected by lib_clock__tsc_sync, the TSC stays disabled and the
+ * callers fall back to clock_gettime.
+ *
+ * \return	EOK if the TSC is usable, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__tsc_init(void);
+
+/* ************************************************************************//**
+ * \brief	check the TSC synchronization across the CPUs
+ *
+ * Applies the policy of lib_clock__set_skew_policy. Clears
+ * g_lib_clock_tsc.usable if the TSC is rejected, installs the per-CPU
+ * offsets if it is corrected.
+ *
+ * \return	EOK if the TSC may be used, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__tsc_sync(void);
+
+/* ************************************************************************//**
+ * \brief	read the raw time stamp counter
+ * ****************************************************************************/
+static inline uint64_t lib_clock__tsc_read(void)
+{
+#if defined(__x86_64__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* ************************************************************************//**
+ * \brief	read the TSC with the per-CPU offset removed
+ *
+ * rdtscp returns the CPU number together with the counter, so the
+ * offset matches the CPU the value was read on even if the thread
+ * migrates right after.
+ * ****************************************************************************/
+static inline uint64_t lib_clock__tsc_read_cpu(void)
+{
+#if defined(__x86_64__)
+	unsigned int aux;
+	uint64_t tsc = __rdtscp(&aux);
+
+	aux &= LIB_CLOCK_TSC_AUX_CPU;
+	return (aux < g_lib_clock_tsc.cpu_count) ? tsc - (uint64_t)g_lib_clock_tsc.cpu_offset[aux] : tsc;
+#else
+	return 0;
+#endif
+}
+
+/* ************************************************************************//**
+ * \brief	convert a raw TSC value to CLOCK_MONOTONIC nanoseconds
+ * ****************************************************************************/
+static inline uint64_t lib_clock__tsc_to_ns(uint64_t _tsc)
+{
+	const lib_clock_tsc_t *tsc = &g_lib_clock_tsc;
+
+	// signed delta, a reading taken slightly before tsc_base must not wrap around
+	return tsc->ns_base + (uint64_t)lib_clock__mul_shr_signed((int64_t)(_tsc - tsc->tsc_base), tsc->mult, LIB_CLOCK_TSC_SHIFT);
+}
+
+#endif
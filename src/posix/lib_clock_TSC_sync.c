@@ -0,0 +1,508 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// pthread_setaffinity_np and the CPU_* macros
+#define _GNU_SOURCE
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__)
+	#include <cpuid.h>
+#endif
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_posix.h"
+#include "lib_clock_TSC.h"
+#include "lib_clock_cpu.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define SKEW_ROUNDS				64				// round trips per CPU pair, the bounds tighten with each
+#define SKEW_TIMEOUT_DIV		10ULL			// a probe gives up after 1/10s of TSC ticks
+#define CACHE_LINE_SIZE			64
+#define CPUID_EXT_FEATURES		0x80000001
+#define CPUID_RDTSCP			(1U << 27)
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Cache line shared by the initiator and the probe thread. The
+ * initiator raises ping, the probe answers with its TSC reading and
+ * the same sequence number in pong. */
+typedef struct {
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint32_t ping;
+	_Atomic uint32_t	pong;
+	_Atomic uint64_t	tsc;
+	_Alignas(CACHE_LINE_SIZE) _Atomic int cpu;		// CPU the probe pins itself to, -1 to exit
+	_Atomic uint32_t	cmd;			// raised for every new CPU
+	_Atomic uint32_t	ready;			// cmd value the probe is pinned and waiting for
+	_Atomic int64_t		offset;			// subtracted from the probe readings
+	_Atomic int			aux_ok;			// rdtscp reported the pinned CPU
+	uint64_t			timeout;		// give up after this many TSC ticks
+} skew_line_t;
+
+/* Offset bounds of one CPU pair in ticks, TSC of the probe minus TSC of the initiator */
+typedef struct {
+	int64_t		lo;
+	int64_t		hi;
+} skew_bound_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+#ifdef LIB_CLOCK_TSC_HW
+static int lib_clock__skew_rdtscp(void);
+static int lib_clock__skew_measure(skew_line_t *_line, int _from, int _to, const int64_t *_offset, skew_bound_t *_bound);
+static void *lib_clock__skew_probe(void *_arg);
+static int lib_clock__skew_pin(pthread_t _thread, int _cpu);
+static uint64_t lib_clock__skew_stamp(unsigned int *_aux);
+static int64_t lib_clock__skew_to_ns(int64_t _ticks);
+static int lib_clock__skew_proven(const skew_bound_t *_bound, int64_t _tolerance);
+#endif
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static _Atomic int s_skew_policy = LIB_CLOCK_SKEW_REJECT;
+static _Atomic uint64_t s_skew_tolerance_ns;
+static lib_clock_skew_info_t s_skew_info;
+static int64_t *s_skew_matrix;					// ns, s_skew_info.cpus squared
+static int64_t s_skew_offset[CPU_SETSIZE];		// installed into g_lib_clock_tsc
+static int s_skew_rdtscp;						// rdtscp supported, checked before the first stamp
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	select the reaction on unsynchronized TSCs
+ * ****************************************************************************/
+int lib_clock__set_skew_policy(lib_clock_skew_policy_t _policy, uint64_t _tolerance_ns)
+{
+	switch (_policy) {
+		case LIB_CLOCK_SKEW_REJECT:
+		case LIB_CLOCK_SKEW_CORRECT:
+		case LIB_CLOCK_SKEW_IGNORE:
+			atomic_store(&s_skew_tolerance_ns, _tolerance_ns);
+			atomic_store(&s_skew_policy, (int)_policy);
+			return EOK;
+		default:
+			return -ESTD_INVAL;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	result of the last TSC synchronization check
+ * ****************************************************************************/
+int lib_clock__get_skew_info(lib_clock_skew_info_t *_info)
+{
+	if (_info == NULL) {
+		return -ESTD_INVAL;
+	}
+
+	*_info = s_skew_info;
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	copy the measured TSC skew matrix
+ * ****************************************************************************/
+int lib_clock__get_skew_matrix(int64_t *_matrix, uint32_t _cpus)
+{
+	uint32_t i;
+
+	if (_matrix == NULL) {
+		return -ESTD_INVAL;
+	}
+	if (s_skew_matrix == NULL) {
+		return -ESTD_AGAIN;
+	}
+	if (_cpus < s_skew_info.cpus) {
+		return -ESTD_RANGE;
+	}
+
+	for (i = 0; i < s_skew_info.cpus; i++) {
+		memcpy(&_matrix[i * _cpus], &s_skew_matrix[i * s_skew_info.cpus], s_skew_info.cpus * sizeof(*_matrix));
+	}
+
+	return EOK;
+}
+
+#ifdef LIB_CLOCK_TSC_HW
+/* ************************************************************************//**
+ * \brief	check the TSC synchronization across the CPUs
+ *
+ * The pairs of the first LIB_CLOCK_SKEW_MAX_CPUS CPUs are measured in
+ * both directions, further CPUs only against the reference CPU, which
+ * is the first one of the affinity mask. A correction uses the offsets
+ * to the reference CPU and is verified with a second measurement on
+ * the corrected readings.
+ * ****************************************************************************/
+int lib_clock__tsc_sync(void)
+{
+	lib_clock_skew_policy_t policy = (lib_clock_skew_policy_t)atomic_load(&s_skew_policy);
+	lib_clock_skew_info_t info = { 0 };
+	skew_line_t line = { 0 };
+	skew_bound_t bound;
+	cpu_set_t saved, allowed;
+	pthread_t probe;
+	int64_t tolerance, *matrix = NULL;
+	int cpus[CPU_SETSIZE];
+	int count = 0, skewed = 0, aux_ok = 1, ret = EOK;
+	int i, j, cpu;
+
+	g_lib_clock_tsc.cpu_count = 0;
+	g_lib_clock_tsc.cpu_offset = NULL;
+	memset(s_skew_offset, 0, sizeof(s_skew_offset));
+	free(s_skew_matrix);
+	s_skew_matrix = NULL;
+	s_skew_info = info;
+
+	if (!g_lib_clock_tsc.usable || (policy == LIB_CLOCK_SKEW_IGNORE)) {
+		return EOK;
+	}
+
+	if (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) != 0) {
+		return -ESTD_FAULT;
+	}
+	allowed = saved;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed)) {
+			cpus[count++] = cpu;
+		}
+	}
+	if (count == 0) {
+		return -ESTD_FAULT;
+	}
+
+	info.cpus = (uint32_t)cpus[count - 1] + 1U;
+	info.reference = (uint32_t)cpus[0];
+	matrix = malloc((size_t)info.cpus * info.cpus * sizeof(*matrix));
+	if (matrix == NULL) {
+		return -ESTD_NOMEM;
+	}
+	for (i = 0; i < (int)(info.cpus * info.cpus); i++) {
+		matrix[i] = LIB_CLOCK_SKEW_UNKNOWN;
+	}
+	for (i = 0; i < count; i++) {
+		matrix[cpus[i] * (int)info.cpus + cpus[i]] = 0;
+	}
+
+	tolerance = (int64_t)((atomic_load(&s_skew_tolerance_ns) * g_lib_clock_tsc.freq) / 1000000000ULL);
+	line.timeout = g_lib_clock_tsc.freq / SKEW_TIMEOUT_DIV;
+	atomic_store(&line.cpu, cpus[0]);
+	// without rdtscp the readings cannot be mapped to a CPU, no correction
+	s_skew_rdtscp = lib_clock__skew_rdtscp();
+	atomic_store(&line.aux_ok, s_skew_rdtscp);
+
+	if ((count > 1) && (pthread_create(&probe, NULL, &lib_clock__skew_probe, &line) != 0)) {
+		free(matrix);
+		return -ESTD_FAULT;
+	}
+
+	// offsets between all measured pairs, the diagonal is 0 by definition
+	for (i = 0; (i < count) && (count > 1) && (ret == EOK); i++) {
+		for (j = 0; j < count; j++) {
+			if ((i == j) || ((i != 0) && (j != 0) && ((i >= LIB_CLOCK_SKEW_MAX_CPUS) || (j >= LIB_CLOCK_SKEW_MAX_CPUS)))) {
+				continue;
+			}
+
+			ret = lib_clock__skew_measure(&line, cpus[i], cpus[j], NULL, &bound);
+			if (ret < EOK) {
+				break;
+			}
+
+			skewed |= lib_clock__skew_proven(&bound, tolerance);
+			matrix[cpus[i] * (int)info.cpus + cpus[j]] = lib_clock__skew_to_ns(bound.lo / 2 + bound.hi / 2);
+			if ((uint64_t)llabs(lib_clock__skew_to_ns(bound.lo / 2 + bound.hi / 2)) > info.max_skew_ns) {
+				info.max_skew_ns = (uint64_t)llabs(lib_clock__skew_to_ns(bound.lo / 2 + bound.hi / 2));
+			}
+			if ((uint64_t)lib_clock__skew_to_ns(bound.hi / 2 - bound.lo / 2) > info.uncertainty_ns) {
+				info.uncertainty_ns = (uint64_t)lib_clock__skew_to_ns(bound.hi / 2 - bound.lo / 2);
+			}
+			if (i == 0) {
+				s_skew_offset[cpus[j]] = bound.lo / 2 + bound.hi / 2;
+			}
+		}
+	}
+	aux_ok = atomic_load(&line.aux_ok);
+
+	if ((ret == EOK) && skewed && (policy == LIB_CLOCK_SKEW_CORRECT) && aux_ok) {
+		// verify the offsets to the reference CPU on corrected readings
+		s_skew_offset[cpus[0]] = 0;
+		skewed = 0;
+		for (j = 1; (j < count) && (ret == EOK); j++) {
+			ret = lib_clock__skew_measure(&line, cpus[0], cpus[j], s_skew_offset, &bound);
+			if (ret == EOK) {
+				skewed |= lib_clock__skew_proven(&bound, tolerance);
+				if ((uint64_t)llabs(lib_clock__skew_to_ns(bound.lo / 2 + bound.hi / 2)) > info.residual_ns) {
+					info.residual_ns = (uint64_t)llabs(lib_clock__skew_to_ns(bound.lo / 2 + bound.hi / 2));
+				}
+			}
+		}
+		info.state = skewed ? LIB_CLOCK_SKEW_REJECTED : LIB_CLOCK_SKEW_CORRECTED;
+	}
+	else {
+		info.state = skewed ? LIB_CLOCK_SKEW_REJECTED : LIB_CLOCK_SKEW_SYNCED;
+	}
+
+	if (count > 1) {
+		atomic_store(&line.cpu, -1);
+		atomic_fetch_add(&line.cmd, 1U);
+		pthread_join(probe, NULL);
+		pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+	}
+
+	// a pair which did not answer proves nothing, the TSC is not trusted
+	if (ret < EOK) {
+		info.state = LIB_CLOCK_SKEW_REJECTED;
+	}
+
+	info.measured = (uint32_t)count;
+	s_skew_info = info;
+	s_skew_matrix = matrix;
+
+	if (info.state == LIB_CLOCK_SKEW_REJECTED) {
+		g_lib_clock_tsc.usable = 0;
+		return (ret < EOK) ? ret : -ESTD_NOTSUP;
+	}
+	if (info.state == LIB_CLOCK_SKEW_CORRECTED) {
+		g_lib_clock_tsc.cpu_offset = s_skew_offset;
+		g_lib_clock_tsc.cpu_count = info.cpus;
+	}
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	check whether rdtscp is supported
+ * ****************************************************************************/
+static int lib_clock__skew_rdtscp(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0x80000000, NULL) < CPUID_EXT_FEATURES) {
+		return 0;
+	}
+
+	if (!__get_cpuid(CPUID_EXT_FEATURES, &eax, &ebx, &ecx, &edx)) {
+		return 0;
+	}
+
+	return (edx & CPUID_RDTSCP) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	bound the TSC offset of CPU _to against CPU _from
+ *
+ * Every round trip yields t0 <= probe <= t1 if both TSCs agree, so the
+ * offset lies within [probe - t1, probe - t0]. The intersection over all
+ * rounds is kept.
+ * ****************************************************************************/
+static int lib_clock__skew_measure(skew_line_t *_line, int _from, int _to, const int64_t *_offset, skew_bound_t *_bound)
+{
+	uint64_t t0, t1, start, probe;
+	uint32_t cmd, seq;
+	unsigned int aux;
+	int round;
+
+	if (lib_clock__skew_pin(pthread_self(), _from) < EOK) {
+		return -ESTD_FAULT;
+	}
+
+	atomic_store(&_line->offset, (_offset != NULL) ? _offset[_to] : 0);
+	atomic_store(&_line->cpu, _to);
+	cmd = atomic_fetch_add(&_line->cmd, 1U) + 1U;
+
+	// the probe migrates first, it may share the CPU with us meanwhile
+	start = lib_clock__tsc_read();
+	while (atomic_load_explicit(&_line->ready, memory_order_acquire) != cmd) {
+		if (lib_clock__tsc_read() - start > _line->timeout) {
+			return -ESTD_TIMEDOUT;
+		}
+		sched_yield();
+	}
+	if (atomic_load(&_line->aux_ok) < 0) {
+		return -ESTD_FAULT;
+	}
+
+	_bound->lo = INT64_MIN;
+	_bound->hi = INT64_MAX;
+	seq = atomic_load_explicit(&_line->ping, memory_order_relaxed);
+
+	for (round = 0; round < SKEW_ROUNDS; round++) {
+		seq++;
+		t0 = lib_clock__skew_stamp(&aux);
+		atomic_store_explicit(&_line->ping, seq, memory_order_release);
+
+		while (atomic_load_explicit(&_line->pong, memory_order_acquire) != seq) {
+			if (lib_clock__tsc_read() - t0 > _line->timeout) {
+				return -ESTD_TIMEDOUT;
+			}
+			lib_clock__cpu_relax();
+		}
+		t1 = lib_clock__skew_stamp(&aux);
+		probe = atomic_load_explicit(&_line->tsc, memory_order_relaxed);
+
+		if ((aux & LIB_CLOCK_TSC_AUX_CPU) != (unsigned int)_from) {
+			atomic_store(&_line->aux_ok, 0);
+		}
+		if ((int64_t)(probe - t1) > _bound->lo) {
+			_bound->lo = (int64_t)(probe - t1);
+		}
+		if ((int64_t)(probe - t0) < _bound->hi) {
+			_bound->hi = (int64_t)(probe - t0);
+		}
+	}
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	probe thread, answers the pings on the commanded CPU
+ * ****************************************************************************/
+static void *lib_clock__skew_probe(void *_arg)
+{
+	skew_line_t *line = (skew_line_t *)_arg;
+	uint32_t cmd = 0, seq;
+	uint64_t stamp;
+	int64_t offset;
+	unsigned int aux;
+	int cpu;
+
+	for (;;) {
+		while (atomic_load_explicit(&line->cmd, memory_order_acquire) == cmd) {
+			sched_yield();
+		}
+		cmd = atomic_load_explicit(&line->cmd, memory_order_acquire);
+
+		cpu = atomic_load(&line->cpu);
+		if (cpu < 0) {
+			return NULL;
+		}
+		if (lib_clock__skew_pin(pthread_self(), cpu) < EOK) {
+			atomic_store(&line->aux_ok, -1);
+		}
+		offset = atomic_load(&line->offset);
+		seq = atomic_load_explicit(&line->ping, memory_order_relaxed);
+		atomic_store_explicit(&line->ready, cmd, memory_order_release);
+
+		// answer until the initiator switches to the next CPU
+		while (atomic_load_explicit(&line->cmd, memory_order_relaxed) == cmd) {
+			if (atomic_load_explicit(&line->ping, memory_order_acquire) == seq) {
+				lib_clock__cpu_relax();
+				continue;
+			}
+			seq = atomic_load_explicit(&line->ping, memory_order_acquire);
+			stamp = lib_clock__skew_stamp(&aux);
+			if ((aux & LIB_CLOCK_TSC_AUX_CPU) != (unsigned int)cpu) {
+				atomic_store(&line->aux_ok, 0);
+			}
+			atomic_store_explicit(&line->tsc, stamp - (uint64_t)offset, memory_order_relaxed);
+			atomic_store_explicit(&line->pong, seq, memory_order_release);
+		}
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	pin a thread to a single CPU
+ * ****************************************************************************/
+static int lib_clock__skew_pin(pthread_t _thread, int _cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(_cpu, &set);
+
+	return (pthread_setaffinity_np(_thread, sizeof(set), &set) == 0) ? EOK : -ESTD_FAULT;
+}
+
+/* ************************************************************************//**
+ * \brief	TSC reading ordered against the surrounding memory accesses
+ *
+ * rdtscp waits for all earlier instructions, the lfence keeps later
+ * ones from starting before the counter is read. Without rdtscp a
+ * leading lfence does the same and _aux reports no CPU.
+ * ****************************************************************************/
+static uint64_t lib_clock__skew_stamp(unsigned int *_aux)
+{
+	uint64_t tsc;
+
+	if (s_skew_rdtscp) {
+		tsc = __rdtscp(_aux);
+	}
+	else {
+		_mm_lfence();
+		tsc = __rdtsc();
+		*_aux = 0;
+	}
+
+	_mm_lfence();
+	return tsc;
+}
+
+/* ************************************************************************//**
+ * \brief	convert a signed tick count to nanoseconds
+ * ****************************************************************************/
+static int64_t lib_clock__skew_to_ns(int64_t _ticks)
+{
+	return lib_clock__mul_shr_signed(_ticks, g_lib_clock_tsc.mult, LIB_CLOCK_TSC_SHIFT);
+}
+
+/* ************************************************************************//**
+ * \brief	check whether the bounds prove an offset beyond the tolerance
+ * ****************************************************************************/
+static int lib_clock__skew_proven(const skew_bound_t *_bound, int64_t _tolerance)
+{
+	return ((_bound->lo > _tolerance) || (_bound->hi < -_tolerance)) ? 1 : 0;
+}
+
+#else
+/* ************************************************************************//**
+ * \brief	no TSC on this target, nothing to check
+ * ****************************************************************************/
+int lib_clock__tsc_sync(void)
+{
+	g_lib_clock_tsc.cpu_count = 0;
+	g_lib_clock_tsc.cpu_offset = NULL;
+	return -ESTD_NOSYS;
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+
+/* system */
+#include <pthread.h>
+#include <time.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_posix.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define CACHE_LINE_SIZE		64
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Published timestamps. Each getter needs exactly one of the values,
+ * so every field is stored on its own and read with a single relaxed
+ * load. A value of 0 marks the ticker as stopped. */
+typedef struct {
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t ns;
+	_Atomic uint64_t us;
+	_Atomic uint32_t ms;
+} cached_slot_t;
+
+typedef struct {
+	pthread_t			thread;
+	uint64_t			period_ns;
+	_Atomic int			stop;
+	int					running;
+	_Atomic uint64_t	max_gap_ns;
+} cached_ticker_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void lib_clock__cached_publish(uint64_t _ns);
+static void *lib_clock__cached_ticker(void *_arg);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static cached_slot_t s_cached_slot;
+static cached_ticker_t s_cached_ticker;
+static pthread_mutex_t s_cached_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	start the background ticker of the cached clock
+ * ****************************************************************************/
+int lib_clock__cached_start(uint32_t _period_us)
+{
+	int ret = EOK;
+
+	if (_period_us == 0) {
+		return -ESTD_INVAL;
+	}
+
+	pthread_mutex_lock(&s_cached_lock);
+	if (s_cached_ticker.running) {
+		pthread_mutex_unlock(&s_cached_lock);
+		return -ESTD_BUSY;
+	}
+
+	s_cached_ticker.period_ns = (uint64_t)_period_us * 1000ULL;
+	atomic_store(&s_cached_ticker.stop, 0);
+	atomic_store(&s_cached_ticker.max_gap_ns, 0);
+
+	// valid values are available before the first tick
+	lib_clock__cached_publish(lib_clock__get_time_ns());
+
+	if (pthread_create(&s_cached_ticker.thread, NULL, &lib_clock__cached_ticker, NULL) != 0) {
+		lib_clock__cached_publish(0);
+		ret = -ESTD_FAULT;
+	}
+	else {
+		s_cached_ticker.running = 1;
+	}
+	pthread_mutex_unlock(&s_cached_lock);
+
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	stop the background ticker of the cached clock
+ * ****************************************************************************/
+int lib_clock__cached_stop(void)
+{
+	pthread_mutex_lock(&s_cached_lock);
+	if (!s_cached_ticker.running) {
+		pthread_mutex_unlock(&s_cached_lock);
+		return EOK;
+	}
+
+	atomic_store(&s_cached_ticker.stop, 1);
+	pthread_join(s_cached_ticker.thread, NULL);
+	s_cached_ticker.running = 0;
+
+	// fall back to direct clock reads
+	lib_clock__cached_publish(0);
+	pthread_mutex_unlock(&s_cached_lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	worst observed gap between two ticker updates
+ * ****************************************************************************/
+uint64_t lib_clock__cached_max_staleness_ns(void)
+{
+	return atomic_load_explicit(&s_cached_ticker.max_gap_ns, memory_order_relaxed);
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_ns(void)
+{
+	uint64_t ns = atomic_load_explicit(&s_cached_slot.ns, memory_order_relaxed);
+
+	return ns ? ns : lib_clock__get_time_ns();
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in microseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_us(void)
+{
+	uint64_t us = atomic_load_explicit(&s_cached_slot.us, memory_order_relaxed);
+
+	return us ? us : lib_clock__get_time_us();
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in milliseconds
+ * ****************************************************************************/
+uint32_t lib_clock__get_cached_time_ms(void)
+{
+	uint32_t ms = atomic_load_explicit(&s_cached_slot.ms, memory_order_relaxed);
+
+	return ms ? ms : lib_clock__get_time_ms();
+}
+
+/* ************************************************************************//**
+ * \brief	address of the published nanosecond timestamp
+ * ****************************************************************************/
+const uint64_t *lib_clock__get_cached_slot(void)
+{
+	// a lock-free _Atomic uint64_t has the representation of a uint64_t
+	return (const uint64_t *)&s_cached_slot.ns;
+}
+
+/* ************************************************************************//**
+ * \brief	store a new timestamp into the cache slot
+ * ****************************************************************************/
+static void lib_clock__cached_publish(uint64_t _ns)
+{
+	atomic_store_explicit(&s_cached_slot.ns, _ns, memory_order_relaxed);
+	atomic_store_explicit(&s_cached_slot.us, _ns / 1000ULL, memory_order_relaxed);
+	atomic_store_explicit(&s_cached_slot.ms, (uint32_t)(_ns / 1000000ULL), memory_order_relaxed);
+}
+
+/* ************************************************************************//**
+ * \brief	ticker thread, publishes the time on absolute period boundaries
+ * ****************************************************************************/
+static void *lib_clock__cached_ticker(void *_arg)
+{
+	struct timespec next;
+	uint64_t next_ns, last, now, gap, max_gap;
+
+	(void)_arg;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	last = lib_clock__get_time_ns();
+
+	while (!atomic_load_explicit(&s_cached_ticker.stop, memory_order_relaxed)) {
+		// periods beyond 2.1s do not fit into a 32bit tv_nsec
+		next_ns = (uint64_t)next.tv_nsec + s_cached_ticker.period_ns;
+		next.tv_sec += (time_t)(next_ns / 1000000000ULL);
+		next.tv_nsec = (long)(next_ns % 1000000000ULL);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		now = lib_clock__get_time_ns();
+		lib_clock__cached_publish(now);
+
+		gap = now - last;
+		last = now;
+		max_gap = atomic_load_explicit(&s_cached_ticker.max_gap_ns, memory_order_relaxed);
+		if (gap > max_gap) {
+			atomic_store_explicit(&s_cached_ticker.max_gap_ns, gap, memory_order_relaxed);
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,225 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_CONV_H_
+#define _LIB_CLOCK_CONV_H_
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Division-free scaling of a 64bit value by a rational factor:
+ *    y = (x * mult) >> shift
+ * The factor is resolved once by lib_clock__conv_init. */
+typedef struct {
+	uint64_t	mult;
+	uint32_t	shift;
+} lib_clock_conv_t;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	64x64 -> 128bit product
+ *
+ * Uses the compiler's 128bit integers where the target has them, 32x32
+ * partial products otherwise (i386, armhf).
+ *
+ * \param	_hi				upper 64 bits of the product
+ * \return	lower 64 bits of the product
+ * ****************************************************************************/
+static inline uint64_t lib_clock__mul128(uint64_t _a, uint64_t _b, uint64_t *_hi)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 p = (unsigned __int128)_a * _b;
+
+	*_hi = (uint64_t)(p >> 64);
+	return (uint64_t)p;
+#else
+	uint64_t a_lo = _a & 0xFFFFFFFFULL, a_hi = _a >> 32;
+	uint64_t b_lo = _b & 0xFFFFFFFFULL, b_hi = _b >> 32;
+	uint64_t ll = a_lo * b_lo;
+	uint64_t u = a_hi * b_lo + (ll >> 32);
+	uint64_t v = a_lo * b_hi + (u & 0xFFFFFFFFULL);
+
+	*_hi = a_hi * b_hi + (u >> 32) + (v >> 32);
+	return (v << 32) | (ll & 0xFFFFFFFFULL);
+#endif
+}
+
+/* ************************************************************************//**
+ * \brief	128bit / 64bit division
+ *
+ * \param	_hi				upper 64 bits of the dividend
+ * \param	_lo				lower 64 bits of the dividend
+ * \param	_den			divisor, must not be 0
+ * \param	_rem			remainder, may be NULL
+ * \return	quotient, UINT64_MAX if it does not fit into 64 bits
+ * ****************************************************************************/
+static inline uint64_t lib_clock__div128(uint64_t _hi, uint64_t _lo, uint64_t _den, uint64_t *_rem)
+{
+	uint64_t q = 0, r, carry;
+	int i;
+
+	if (_hi >= _den) {
+		if (_rem != NULL) {
+			*_rem = 0;
+		}
+		return UINT64_MAX;
+	}
+
+#ifdef __SIZEOF_INT128__
+	{
+		unsigned __int128 n = ((unsigned __int128)_hi << 64) | _lo;
+
+		(void)carry;
+		(void)i;
+		q = (uint64_t)(n / _den);
+		r = (uint64_t)(n % _den);
+	}
+#else
+	// restoring division, one quotient bit per step
+	r = _hi;
+	for (i = 0; i < 64; i++) {
+		carry = r >> 63;
+		r = (r << 1) | (_lo >> 63);
+		_lo <<= 1;
+		q <<= 1;
+		if (carry || (r >= _den)) {
+			r -= _den;
+			q |= 1;
+		}
+	}
+#endif
+
+	if (_rem != NULL) {
+		*_rem = r;
+	}
+	return q;
+}
+
+/* ************************************************************************//**
+ * \brief	(_x * _mult) >> _shift with a 128bit intermediate, _shift < 128
+ * ****************************************************************************/
+static inline uint64_t lib_clock__mul_shr(uint64_t _x, uint64_t _mult, uint32_t _shift)
+{
+	uint64_t hi, lo = lib_clock__mul128(_x, _mult, &hi);
+
+	if (_shift == 0) {
+		return lo;
+	}
+	if (_shift < 64) {
+		return (lo >> _shift) | (hi << (64 - _shift));
+	}
+	return hi >> (_shift - 64);
+}
+
+/* ************************************************************************//**
+ * \brief	signed (_x * _mult) >> _shift, rounding towards minus infinity
+ * ****************************************************************************/
+static inline int64_t lib_clock__mul_shr_signed(int64_t _x, uint64_t _mult, uint32_t _shift)
+{
+#ifdef __SIZEOF_INT128__
+	return (int64_t)(((__int128)_x * (__int128)_mult) >> _shift);
+#else
+	uint64_t magnitude, hi, lo;
+
+	if (_x >= 0) {
+		return (int64_t)lib_clock__mul_shr((uint64_t)_x, _mult, _shift);
+	}
+
+	// floor(-a * m / 2^s) == -ceil(a * m / 2^s)
+	magnitude = (uint64_t)0 - (uint64_t)_x;
+	lo = lib_clock__mul128(magnitude, _mult, &hi);
+	if ((_shift != 0) && (_shift < 64) && (lo & ((1ULL << _shift) - 1U))) {
+		return -(int64_t)lib_clock__mul_shr(magnitude, _mult, _shift) - 1;
+	}
+	if ((_shift >= 64) && ((lo != 0) || (hi & ((1ULL << (_shift - 64)) - 1U)))) {
+		return -(int64_t)lib_clock__mul_shr(magnitude, _mult, _shift) - 1;
+	}
+	return -(int64_t)lib_clock__mul_shr(magnitude, _mult, _shift);
+#endif
+}
+
+/* ************************************************************************//**
+ * \brief	(_num << _shift) / _den for _shift <= 64
+ * ****************************************************************************/
+static inline uint64_t lib_clock__conv_quot(uint64_t _num, uint32_t _shift, uint64_t _den, uint64_t *_rem)
+{
+	uint64_t hi = (_shift == 0) ? 0 : ((_shift == 64) ? _num : _num >> (64 - _shift));
+	uint64_t lo = (_shift == 64) ? 0 : _num << _shift;
+
+	return lib_clock__div128(hi, lo, _den, _rem);
+}
+
+/* ************************************************************************//**
+ * \brief	resolve the multiplier and shift for the factor _num / _den
+ *
+ * The shift is chosen as large as possible while the multiplier still
+ * fits into 63 bits, which gives the best available precision.
+ *
+ * \param	_conv			conversion to set up
+ * \param	_num			numerator of the factor
+ * \param	_den			denominator of the factor, must not be 0
+ * ****************************************************************************/
+static inline void lib_clock__conv_init(lib_clock_conv_t *_conv, uint64_t _num, uint64_t _den)
+{
+	uint64_t rem;
+	uint32_t shift = 0;
+
+	if ((_num % _den) == 0) {
+		// integral factor, exact without any fraction bits
+		_conv->mult = _num / _den;
+		_conv->shift = 0;
+		return;
+	}
+
+	while ((shift < 64) && (lib_clock__conv_quot(_num, shift + 1, _den, NULL) < (1ULL << 63))) {
+		shift++;
+	}
+
+	// round up, so exact multiples of _den are not truncated by one
+	_conv->mult = lib_clock__conv_quot(_num, shift, _den, &rem);
+	_conv->mult += (rem != 0) ? 1 : 0;
+	_conv->shift = shift;
+}
+
+/* ************************************************************************//**
+ * \brief	scale a value with a resolved conversion
+ * ****************************************************************************/
+static inline uint64_t lib_clock__conv(uint64_t _x, const lib_clock_conv_t *_conv)
+{
+	return lib_clock__mul_shr(_x, _conv->mult, _conv->shift);
+}
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+/* system */
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_monitor.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define MONITOR_MIN_READS		2		// a cost needs a burst of at least two reads
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* One sample of the rolling window */
+typedef struct {
+	double		cost_ns;		// mean duration of one source read
+	uint64_t	resolution_ns;	// finest increment of the burst, 0 if none
+	int64_t		change_ns;		// offset change against the previous sample
+	uint64_t	interval_ns;	// reference time since the previous sample
+	int			valid;			// change_ns counts for drift and jitter
+} monitor_entry_t;
+
+typedef struct {
+	lib_clock_monitor_cfg_t		cfg;
+	lib_clock_monitor_stats_t	stats;		// guarded by s_monitor_lock
+	monitor_entry_t				window[LIB_CLOCK_MONITOR_WINDOW];
+	uint32_t					head;		// next entry to write
+	uint64_t					last_src;	// source and reference of the previous sample
+	uint64_t					last_ref;
+	pthread_t					thread;
+	int							running;
+	int							stopping;	// a stop is joining the sampling thread
+	int							stop_fd;	// eventfd waking the sampling thread for shutdown
+} monitor_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t lib_clock__monitor_source(void *_arg);
+static uint64_t lib_clock__monitor_boottime(void *_arg);
+static void lib_clock__monitor_burst(monitor_entry_t *_entry);
+static uint32_t lib_clock__monitor_update(void);
+static void *lib_clock__monitor_thread(void *_arg);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static monitor_t s_monitor = { .stop_fd = -1 };
+static pthread_mutex_t s_monitor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	start monitoring the clock source
+ * ****************************************************************************/
+int lib_clock__monitor_start(const lib_clock_monitor_cfg_t *_cfg)
+{
+	lib_clock_monitor_cfg_t *cfg = &s_monitor.cfg;
+	int ret;
+
+	pthread_mutex_lock(&s_monitor_lock);
+	if (s_monitor.running || s_monitor.stopping) {
+		pthread_mutex_unlock(&s_monitor_lock);
+		return -ESTD_BUSY;
+	}
+
+	if (_cfg != NULL) {
+		*cfg = *_cfg;
+	}
+	else {
+		memset(cfg, 0, sizeof(*cfg));
+	}
+	if (cfg->period_us == 0) {
+		cfg->period_us = LIB_CLOCK_MONITOR_PERIOD_US;
+	}
+	if (cfg->reads == 0) {
+		cfg->reads = LIB_CLOCK_MONITOR_READS;
+	}
+	if (cfg->reads < MONITOR_MIN_READS) {
+		cfg->reads = MONITOR_MIN_READS;
+	}
+	if (cfg->budget_ppm == 0) {
+		cfg->budget_ppm = LIB_CLOCK_MONITOR_BUDGET_PPM;
+	}
+	if (cfg->step_ns == 0) {
+		cfg->step_ns = LIB_CLOCK_MONITOR_STEP_NS;
+	}
+	if (cfg->source == NULL) {
+		cfg->source = &lib_clock__monitor_source;
+	}
+	if (cfg->reference == NULL) {
+		cfg->reference = &lib_clock__monitor_boottime;
+	}
+
+	memset(&s_monitor.stats, 0, sizeof(s_monitor.stats));
+	memset(s_monitor.window, 0, sizeof(s_monitor.window));
+	s_monitor.stats.reads = cfg->reads;
+	s_monitor.head = 0;
+
+	if (cfg->manual) {
+		s_monitor.running = 1;
+		pthread_mutex_unlock(&s_monitor_lock);
+		return EOK;
+	}
+
+	s_monitor.stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (s_monitor.stop_fd < 0) {
+		pthread_mutex_unlock(&s_monitor_lock);
+		return -ESTD_FAULT;
+	}
+
+	ret = EOK;
+	if (pthread_create(&s_monitor.thread, NULL, &lib_clock__monitor_thread, NULL) != 0) {
+		close(s_monitor.stop_fd);
+		s_monitor.stop_fd = -1;
+		ret = -ESTD_FAULT;
+	}
+	else {
+		s_monitor.running = 1;
+	}
+	pthread_mutex_unlock(&s_monitor_lock);
+
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	stop monitoring
+ * ****************************************************************************/
+int lib_clock__monitor_stop(void)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&s_monitor_lock);
+	if (!s_monitor.running || s_monitor.stopping) {
+		pthread_mutex_unlock(&s_monitor_lock);
+		return EOK;
+	}
+	if (s_monitor.cfg.manual) {
+		s_monitor.running = 0;
+		pthread_mutex_unlock(&s_monitor_lock);
+		return EOK;
+	}
+	s_monitor.stopping = 1;
+	pthread_mutex_unlock(&s_monitor_lock);
+
+	// the thread samples under the lock, join without holding it
+	if (write(s_monitor.stop_fd, &one, sizeof(one)) == (ssize_t)sizeof(one)) {
+		pthread_join(s_monitor.thread, NULL);
+	}
+
+	pthread_mutex_lock(&s_monitor_lock);
+	close(s_monitor.stop_fd);
+	s_monitor.stop_fd = -1;
+	s_monitor.running = 0;
+	s_monitor.stopping = 0;
+	pthread_mutex_unlock(&s_monitor_lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	take one sample
+ *
+ * The source read is bracketed by two reference reads, the midpoint is
+ * the reference time belonging to it. The change of source - reference
+ * against the previous sample is a step from the step threshold on or
+ * if the source went backwards, otherwise it enters drift and jitter.
+ * Steps are left out of the window, one step would dominate the drift
+ * of the whole window.
+ * ****************************************************************************/
+int lib_clock__monitor_sample(void)
+{
+	lib_clock_monitor_cfg_t *cfg = &s_monitor.cfg;
+	lib_clock_monitor_stats_t stats;
+	monitor_entry_t *entry;
+	uint64_t begin, ref0, src, ref1, ref, change_abs, overhead;
+	int64_t change;
+	uint32_t events = 0, raised;
+
+	pthread_mutex_lock(&s_monitor_lock);
+	if (!s_monitor.running) {
+		pthread_mutex_unlock(&s_monitor_lock);
+		return -ESTD_INVAL;
+	}
+
+	begin = cfg->reference(cfg->arg);
+	ref0 = cfg->reference(cfg->arg);
+	src = cfg->source(cfg->arg);
+	ref1 = cfg->reference(cfg->arg);
+	ref = ref0 + (ref1 - ref0) / 2;
+
+	entry = &s_monitor.window[s_monitor.head];
+	memset(entry, 0, sizeof(*entry));
+	lib_clock__monitor_burst(entry);
+
+	if (s_monitor.stats.samples > 0) {
+		entry->interval_ns = ref - s_monitor.last_ref;
+		change = (int64_t)(src - s_monitor.last_src) - (int64_t)entry->interval_ns;
+		change_abs = (change < 0) ? (uint64_t)-change : (uint64_t)change;
+
+		if ((int64_t)(src - s_monitor.last_src) < 0) {
+			events |= LIB_CLOCK_MONITOR_STEP_BACK;
+		}
+		else if (change_abs >= cfg->step_ns) {
+			events |= (change > 0) ? LIB_CLOCK_MONITOR_STEP_FWD : LIB_CLOCK_MONITOR_STEP_BACK;
+		}
+
+		if (events) {
+			if (events & LIB_CLOCK_MONITOR_STEP_FWD) {
+				s_monitor.stats.steps_fwd++;
+			}
+			else {
+				s_monitor.stats.steps_back++;
+			}
+			s_monitor.stats.last_step_ns = change;
+		}
+		else {
+			entry->change_ns = change;
+			entry->valid = 1;
+		}
+	}
+	s_monitor.last_src = src;
+	s_monitor.last_ref = ref;
+	s_monitor.head = (s_monitor.head + 1) % LIB_CLOCK_MONITOR_WINDOW;
+	s_monitor.stats.samples++;
+
+	// keep the share of the period spent sampling within the budget
+	overhead = (cfg->reference(cfg->arg) - begin) * 1000ULL / cfg->period_us;
+	s_monitor.stats.overhead_ppm = (overhead > UINT32_MAX) ? UINT32_MAX : (uint32_t)overhead;
+	if ((overhead > cfg->budget_ppm) && (s_monitor.stats.reads > MONITOR_MIN_READS)) {
+		s_monitor.stats.reads /= 2;
+	}
+	else if ((overhead * 4 < cfg->budget_ppm) && (s_monitor.stats.reads < cfg->reads)) {
+		s_monitor.stats.reads *= 2;
+		if (s_monitor.stats.reads > cfg->reads) {
+			s_monitor.stats.reads = cfg->reads;
+		}
+	}
+
+	// thresholds are reported when they are crossed, steps every time
+	raised = lib_clock__monitor_update();
+	events |= raised;
+	stats = s_monitor.stats;
+	pthread_mutex_unlock(&s_monitor_lock);
+
+	if (events && (cfg->callback != NULL)) {
+		cfg->callback(events, &stats, cfg->cb_arg);
+	}
+
+	return (int)events;
+}
+
+/* ************************************************************************//**
+ * \brief	get a snapshot of the statistics
+ * ****************************************************************************/
+int lib_clock__monitor_get_stats(lib_clock_monitor_stats_t *_stats)
+{
+	if (_stats == NULL) {
+		return -ESTD_INVAL;
+	}
+
+	pthread_mutex_lock(&s_monitor_lock);
+	*_stats = s_monitor.stats;
+	pthread_mutex_unlock(&s_monitor_lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	default monitored clock
+ * ****************************************************************************/
+static uint64_t lib_clock__monitor_source(void *_arg)
+{
+	(void)_arg;
+	return lib_clock__get_time_ns();
+}
+
+/* ************************************************************************//**
+ * \brief	default reference clock, keeps counting during a suspend
+ * ****************************************************************************/
+static uint64_t lib_clock__monitor_boottime(void *_arg)
+{
+	struct timespec tp;
+
+	(void)_arg;
+	clock_gettime(CLOCK_BOOTTIME, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
+
+/* ************************************************************************//**
+ * \brief	measure read cost and resolution with a burst of source reads
+ *
+ * The burst is timed with the reference, a coarse source which returns
+ * the same value for the whole burst still gets its cost. The smallest
+ * non-zero increment between two reads is the resolution.
+ * ****************************************************************************/
+static void lib_clock__monitor_burst(monitor_entry_t *_entry)
+{
+	lib_clock_monitor_cfg_t *cfg = &s_monitor.cfg;
+	uint64_t begin, end, prev, value, resolution = UINT64_MAX;
+	uint32_t i, reads = s_monitor.stats.reads;
+
+	begin = cfg->reference(cfg->arg);
+	prev = cfg->source(cfg->arg);
+	for (i = 1; i < reads; i++) {
+		value = cfg->source(cfg->arg);
+		if ((value > prev) && (value - prev < resolution)) {
+			resolution = value - prev;
+		}
+		prev = value;
+	}
+	end = cfg->reference(cfg->arg);
+
+	_entry->cost_ns = (double)(end - begin) / (double)reads;
+	_entry->resolution_ns = (resolution == UINT64_MAX) ? 0 : resolution;
+}
+
+/* ************************************************************************//**
+ * \brief	recompute the window statistics and check the thresholds
+ *
+ * The offset changes of the window add up to the offset against the
+ * reference over time. Drift is the slope of a least-squares line
+ * through it, jitter the RMS distance from that line. Both are only
+ * checked against their thresholds from a full window on, a few noisy
+ * samples look like a large drift.
+ *
+ * \return	threshold events not exceeded by the previous sample
+ * ****************************************************************************/
+static uint32_t lib_clock__monitor_update(void)
+{
+	lib_clock_monitor_cfg_t *cfg = &s_monitor.cfg;
+	lib_clock_monitor_stats_t *stats = &s_monitor.stats;
+	const monitor_entry_t *entry;
+	double x[LIB_CLOCK_MONITOR_WINDOW + 1], y[LIB_CLOCK_MONITOR_WINDOW + 1];
+	double cost = 0.0, cost_max = 0.0, mean_x = 0.0, mean_y = 0.0, sxx = 0.0, sxy = 0.0;
+	double drift = 0.0, residual, square = 0.0;
+	uint64_t resolution = 0;
+	uint32_t i, count, oldest, events = 0, raised;
+
+	count = (stats->samples < LIB_CLOCK_MONITOR_WINDOW) ? (uint32_t)stats->samples : LIB_CLOCK_MONITOR_WINDOW;
+	oldest = (stats->samples < LIB_CLOCK_MONITOR_WINDOW) ? 0 : s_monitor.head;
+
+	// x: reference time, y: offset, both relative to the oldest sample
+	x[0] = 0.0;
+	y[0] = 0.0;
+	for (i = 0; i < count; i++) {
+		entry = &s_monitor.window[(oldest + i) % LIB_CLOCK_MONITOR_WINDOW];
+		cost += entry->cost_ns;
+		if (entry->cost_ns > cost_max) {
+			cost_max = entry->cost_ns;
+		}
+		if ((entry->resolution_ns != 0) && ((resolution == 0) || (entry->resolution_ns < resolution))) {
+			resolution = entry->resolution_ns;
+		}
+		x[i + 1] = x[i] + (double)entry->interval_ns;
+		y[i + 1] = y[i] + (entry->valid ? (double)entry->change_ns : 0.0);
+		mean_x += x[i + 1];
+		mean_y += y[i + 1];
+	}
+
+	mean_x /= count + 1;
+	mean_y /= count + 1;
+	for (i = 0; i <= count; i++) {
+		sxx += (x[i] - mean_x) * (x[i] - mean_x);
+		sxy += (x[i] - mean_x) * (y[i] - mean_y);
+	}
+	if (sxx > 0.0) {
+		drift = sxy / sxx;
+	}
+	for (i = 0; i <= count; i++) {
+		residual = y[i] - mean_y - drift * (x[i] - mean_x);
+		square += residual * residual;
+	}
+
+	stats->window = count;
+	stats->read_cost_ns = (count > 0) ? cost / count : 0.0;
+	stats->read_cost_max_ns = cost_max;
+	stats->resolution_ns = resolution;
+	stats->drift_ppb = (int64_t)(drift * 1e9);
+	stats->jitter_ns = (uint64_t)sqrt(square / (count + 1));
+
+	if ((cfg->max_read_cost_ns > 0.0) && (stats->read_cost_ns > cfg->max_read_cost_ns)) {
+		events |= LIB_CLOCK_MONITOR_COST;
+	}
+	if (count == LIB_CLOCK_MONITOR_WINDOW) {
+		if ((cfg->max_jitter_ns != 0) && (stats->jitter_ns > cfg->max_jitter_ns)) {
+			events |= LIB_CLOCK_MONITOR_JITTER;
+		}
+		if ((cfg->max_drift_ppb != 0) && ((uint64_t)llabs(stats->drift_ppb) > cfg->max_drift_ppb)) {
+			events |= LIB_CLOCK_MONITOR_DRIFT;
+		}
+	}
+
+	raised = events & ~stats->events;
+	stats->events = events;
+	return raised;
+}
+
+/* ************************************************************************//**
+ * \brief	sampling thread
+ * ****************************************************************************/
+static void *lib_clock__monitor_thread(void *_arg)
+{
+	struct pollfd fds;
+	int timeout_ms;
+
+	(void)_arg;
+
+	timeout_ms = (int)((s_monitor.cfg.period_us + 999U) / 1000U);
+
+	fds.fd = s_monitor.stop_fd;
+	fds.events = POLLIN;
+
+	for (;;) {
+		if (poll(&fds, 1, timeout_ms) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (fds.revents & POLLIN) {
+			break;
+		}
+
+		lib_clock__monitor_sample();
+	}
+
+	return NULL;
+}
@@ -0,0 +1,397 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/* system */
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_shm.h"
+#include "lib_clock_TSC.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define SHM_MAGIC			0x4D48534CU		// "LSHM"
+#define SHM_VERSION			1U
+#define SHM_LIVE_PERIODS	4				// coarse time age of a live publisher
+#define CACHE_LINE_SIZE		64
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* The shared page. The calibration is written under the seqlock 'seq'
+ * (odd while an update is in progress), the coarse time lives on its own
+ * cache line so its updates do not disturb the calibration readers. */
+typedef struct {
+	_Atomic uint32_t	magic;		// stored last, a page is valid once it is set
+	uint32_t			version;
+	int32_t				pid;		// of the publisher
+	uint32_t			reserved;
+	uint64_t			period_ns;
+
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint32_t seq;
+	_Atomic uint32_t	mode;
+	_Atomic uint32_t	shift;
+	_Atomic uint64_t	tsc_base;
+	_Atomic uint64_t	ns_base;
+	_Atomic uint64_t	mult;
+
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t coarse_ns;
+} shm_page_t;
+
+typedef struct {
+	shm_page_t	*page;
+	char		name[64];
+	pthread_t	thread;
+	_Atomic int	stop;
+	int			running;
+} shm_publisher_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t lib_clock__shm_fine(const shm_page_t *_page);
+static uint64_t lib_clock__shm_monotonic(void);
+static void *lib_clock__shm_thread(void *_arg);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static shm_publisher_t s_shm_pub;
+static const shm_page_t *s_shm_page;		// attached page of the readers
+static pthread_mutex_t s_shm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	create and maintain the shared clock page
+ * ****************************************************************************/
+int lib_clock__shm_publish_start(const char *_name, uint32_t _period_us)
+{
+	const char *name = (_name != NULL) ? _name : LIB_CLOCK_SHM_NAME;
+	shm_page_t *page;
+	uint32_t seq;
+	int fd;
+
+	if (strlen(name) >= sizeof(s_shm_pub.name)) {
+		return -ESTD_INVAL;
+	}
+
+	pthread_mutex_lock(&s_shm_lock);
+	if (s_shm_pub.running) {
+		pthread_mutex_unlock(&s_shm_lock);
+		return -ESTD_BUSY;
+	}
+
+	fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		pthread_mutex_unlock(&s_shm_lock);
+		return -ESTD_FAULT;
+	}
+	if (ftruncate(fd, sizeof(shm_page_t)) != 0) {
+		close(fd);
+		pthread_mutex_unlock(&s_shm_lock);
+		return -ESTD_FAULT;
+	}
+	page = mmap(NULL, sizeof(shm_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED) {
+		pthread_mutex_unlock(&s_shm_lock);
+		return -ESTD_FAULT;
+	}
+
+	// a page left behind by a publisher which is gone is taken over,
+	// EPERM is a live publisher of another user
+	if ((atomic_load(&page->magic) == SHM_MAGIC) && (page->pid != (int32_t)getpid())
+		&& ((kill(page->pid, 0) == 0) || (errno == EPERM))) {
+		munmap(page, sizeof(shm_page_t));
+		pthread_mutex_unlock(&s_shm_lock);
+		return -ESTD_BUSY;
+	}
+
+	// readers of a previous publisher still see a consistent calibration
+	if (!g_lib_clock_tsc.usable) {
+		lib_clock__tsc_init();
+	}
+	seq = atomic_load_explicit(&page->seq, memory_order_relaxed) | 1U;
+	atomic_store_explicit(&page->seq, seq, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	// per-CPU TSC offsets are not published, readers fall back to CLOCK_MONOTONIC
+	if (g_lib_clock_tsc.usable && (g_lib_clock_tsc.cpu_count == 0)) {
+		atomic_store_explicit(&page->mode, LIB_CLOCK_SHM_TSC, memory_order_relaxed);
+		atomic_store_explicit(&page->tsc_base, g_lib_clock_tsc.tsc_base, memory_order_relaxed);
+		atomic_store_explicit(&page->ns_base, g_lib_clock_tsc.ns_base, memory_order_relaxed);
+		atomic_store_explicit(&page->mult, g_lib_clock_tsc.mult, memory_order_relaxed);
+		atomic_store_explicit(&page->shift, LIB_CLOCK_TSC_SHIFT, memory_order_relaxed);
+	}
+	else {
+		atomic_store_explicit(&page->mode, LIB_CLOCK_SHM_MONOTONIC, memory_order_relaxed);
+		atomic_store_explicit(&page->tsc_base, 0, memory_order_relaxed);
+		atomic_store_explicit(&page->ns_base, 0, memory_order_relaxed);
+		atomic_store_explicit(&page->mult, 0, memory_order_relaxed);
+		atomic_store_explicit(&page->shift, 0, memory_order_relaxed);
+	}
+	atomic_store_explicit(&page->seq, seq + 1U, memory_order_release);
+
+	page->version = SHM_VERSION;
+	page->pid = (int32_t)getpid();
+	page->period_ns = (uint64_t)(_period_us ? _period_us : LIB_CLOCK_SHM_PERIOD_US) * 1000ULL;
+	atomic_store_explicit(&page->coarse_ns, lib_clock__shm_fine(page), memory_order_relaxed);
+	atomic_store_explicit(&page->magic, SHM_MAGIC, memory_order_release);
+
+	s_shm_pub.page = page;
+	strcpy(s_shm_pub.name, name);
+	atomic_store(&s_shm_pub.stop, 0);
+	if (pthread_create(&s_shm_pub.thread, NULL, &lib_clock__shm_thread, NULL) != 0) {
+		atomic_store(&page->magic, 0);
+		munmap(page, sizeof(shm_page_t));
+		shm_unlink(name);
+		s_shm_pub.page = NULL;
+		pthread_mutex_unlock(&s_shm_lock);
+		return -ESTD_FAULT;
+	}
+	s_shm_pub.running = 1;
+	pthread_mutex_unlock(&s_shm_lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	stop publishing and remove the shared memory object
+ * ****************************************************************************/
+int lib_clock__shm_publish_stop(void)
+{
+	pthread_mutex_lock(&s_shm_lock);
+	if (!s_shm_pub.running) {
+		pthread_mutex_unlock(&s_shm_lock);
+		return EOK;
+	}
+
+	atomic_store(&s_shm_pub.stop, 1);
+	pthread_join(s_shm_pub.thread, NULL);
+
+	shm_unlink(s_shm_pub.name);
+	munmap(s_shm_pub.page, sizeof(shm_page_t));
+	s_shm_pub.page = NULL;
+	s_shm_pub.running = 0;
+	pthread_mutex_unlock(&s_shm_lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	map the shared clock page of a publisher read-only
+ * ****************************************************************************/
+int lib_clock__shm_attach(const char *_name)
+{
+	const char *name = (_name != NULL) ? _name : LIB_CLOCK_SHM_NAME;
+	const shm_page_t *page;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return -ESTD_FAULT;
+	}
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(shm_page_t))) {
+		close(fd);
+		return -ESTD_INVAL;
+	}
+	page = mmap(NULL, sizeof(shm_page_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED) {
+		return -ESTD_FAULT;
+	}
+
+	if ((atomic_load_explicit(&((shm_page_t *)page)->magic, memory_order_acquire) != SHM_MAGIC) || (page->version != SHM_VERSION)) {
+		munmap((void *)page, sizeof(shm_page_t));
+		return -ESTD_INVAL;
+	}
+
+	pthread_mutex_lock(&s_shm_lock);
+	if (s_shm_page != NULL) {
+		munmap((void *)s_shm_page, sizeof(shm_page_t));
+	}
+	s_shm_page = page;
+	pthread_mutex_unlock(&s_shm_lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	unmap the shared clock page
+ *
+ * Not safe against concurrent readers of the same process.
+ * ****************************************************************************/
+void lib_clock__shm_detach(void)
+{
+	pthread_mutex_lock(&s_shm_lock);
+	if (s_shm_page != NULL) {
+		munmap((void *)s_shm_page, sizeof(shm_page_t));
+		s_shm_page = NULL;
+	}
+	pthread_mutex_unlock(&s_shm_lock);
+}
+
+/* ************************************************************************//**
+ * \brief	fine time from the shared page, no system call
+ * ****************************************************************************/
+uint64_t lib_clock__shm_get_time_ns(void)
+{
+	const shm_page_t *page = s_shm_page;
+
+	return (page != NULL) ? lib_clock__shm_fine(page) : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	coarse time from the shared page, a single load
+ * ****************************************************************************/
+uint64_t lib_clock__shm_get_coarse_ns(void)
+{
+	const shm_page_t *page = s_shm_page;
+
+	return (page != NULL) ? atomic_load_explicit(&((shm_page_t *)page)->coarse_ns, memory_order_relaxed) : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	check whether the publisher updates the page
+ * ****************************************************************************/
+int lib_clock__shm_is_live(void)
+{
+	const shm_page_t *page = s_shm_page;
+	uint64_t coarse;
+
+	if (page == NULL) {
+		return 0;
+	}
+
+	coarse = atomic_load_explicit(&((shm_page_t *)page)->coarse_ns, memory_order_relaxed);
+	return ((lib_clock__shm_fine(page) - coarse) <= SHM_LIVE_PERIODS * page->period_ns) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	time base of the attached page
+ * ****************************************************************************/
+int lib_clock__shm_get_mode(void)
+{
+	const shm_page_t *page = s_shm_page;
+
+	if (page == NULL) {
+		return -ESTD_INVAL;
+	}
+
+	return (int)atomic_load_explicit(&((shm_page_t *)page)->mode, memory_order_relaxed);
+}
+
+/* ************************************************************************//**
+ * \brief	read the calibration under the seqlock and compute the time
+ *
+ * Same arithmetic as lib_clock__tsc_to_ns, with the parameters of the
+ * publisher.
+ * ****************************************************************************/
+static uint64_t lib_clock__shm_fine(const shm_page_t *_page)
+{
+	shm_page_t *page = (shm_page_t *)_page;
+	uint64_t tsc_base, ns_base, mult;
+	uint32_t seq, mode, shift;
+
+	for (;;) {
+		seq = atomic_load_explicit(&page->seq, memory_order_acquire);
+		if (seq & 1U) {
+			continue;
+		}
+		mode = atomic_load_explicit(&page->mode, memory_order_relaxed);
+		shift = atomic_load_explicit(&page->shift, memory_order_relaxed);
+		tsc_base = atomic_load_explicit(&page->tsc_base, memory_order_relaxed);
+		ns_base = atomic_load_explicit(&page->ns_base, memory_order_relaxed);
+		mult = atomic_load_explicit(&page->mult, memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&page->seq, memory_order_relaxed) == seq) {
+			break;
+		}
+	}
+
+	if (mode != LIB_CLOCK_SHM_TSC) {
+		return lib_clock__shm_monotonic();
+	}
+
+	return ns_base + (uint64_t)lib_clock__mul_shr_signed((int64_t)(lib_clock__tsc_read() - tsc_base), mult, shift);
+}
+
+static uint64_t lib_clock__shm_monotonic(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
+
+/* ************************************************************************//**
+ * \brief	publisher thread, updates the coarse time on period boundaries
+ * ****************************************************************************/
+static void *lib_clock__shm_thread(void *_arg)
+{
+	shm_page_t *page = s_shm_pub.page;
+	struct timespec next;
+	uint64_t next_ns;
+
+	(void)_arg;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!atomic_load_explicit(&s_shm_pub.stop, memory_order_relaxed)) {
+		// periods beyond 2.1s do not fit into a 32bit tv_nsec
+		next_ns = (uint64_t)next.tv_nsec + page->period_ns;
+		next.tv_sec += (time_t)(next_ns / 1000000000ULL);
+		next.tv_nsec = (long)(next_ns % 1000000000ULL);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		atomic_store_explicit(&page->coarse_ns, lib_clock__shm_fine(page), memory_order_relaxed);
+	}
+
+	return NULL;
+}
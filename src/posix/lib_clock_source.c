@@ -0,0 +1,401 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stddef.h>
+
+/* system */
+#include <time.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_source.h"
+#include "lib_clock_TSC.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define SRC_COST_READS		1000		// reads per cost measurement round
+#define SRC_COST_ROUNDS		5			// the fastest round is used
+
+#ifndef CLOCK_MONOTONIC_RAW
+	#define CLOCK_MONOTONIC_RAW		((clockid_t)-1)
+#endif
+#ifndef CLOCK_MONOTONIC_COARSE
+	#define CLOCK_MONOTONIC_COARSE	((clockid_t)-1)
+#endif
+#ifndef CLOCK_BOOTTIME
+	#define CLOCK_BOOTTIME			((clockid_t)-1)
+#endif
+
+#ifdef LIB_CLOCK_TSC
+	#define SRC_BUILD_DEFAULT		LIB_CLOCK_SRC_TSC
+#else
+	#define SRC_BUILD_DEFAULT		LIB_CLOCK_SRC_MONOTONIC
+#endif
+
+/* clock_gettime based readers of a source, ticks are multiples of its resolution */
+#define SRC_CLOCK_READERS(_name, _clock_id)										\
+	static uint64_t lib_clock__read_ns_##_name(void)							\
+	{																			\
+		struct timespec tp;														\
+		if (clock_gettime(_clock_id, &tp) != 0) {								\
+			return 0;															\
+		}																		\
+		return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;		\
+	}																			\
+	static uint64_t lib_clock__read_ticks_##_name(void)							\
+	{																			\
+		return lib_clock__conv(lib_clock__read_ns_##_name(), &g_lib_clock_src.to_ticks);	\
+	}
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	const char			*name;
+	clockid_t			clock_id;		// clock queried for the resolution
+	int					auto_candidate;	// on the CLOCK_MONOTONIC scale, eligible for auto mode
+	lib_clock_read_t	read_ns;
+	lib_clock_read_t	read_ticks;
+} clock_src_desc_t;
+
+typedef struct {
+	int			available;
+	uint64_t	res_ns;
+	double		cost_ns;		// 0 until measured
+} clock_src_probe_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+SRC_CLOCK_READERS(mono, CLOCK_MONOTONIC)
+SRC_CLOCK_READERS(mono_raw, CLOCK_MONOTONIC_RAW)
+SRC_CLOCK_READERS(mono_coarse, CLOCK_MONOTONIC_COARSE)
+SRC_CLOCK_READERS(boottime, CLOCK_BOOTTIME)
+static uint64_t lib_clock__read_ns_tsc(void);
+static uint64_t lib_clock__read_ticks_tsc(void);
+static uint64_t lib_clock__read_ns_tsc_cpu(void);
+static uint64_t lib_clock__read_ticks_tsc_cpu(void);
+static void lib_clock__source_probe(lib_clock_src_t _source);
+static double lib_clock__source_cost(lib_clock_read_t _read);
+static lib_clock_src_t lib_clock__source_auto(uint64_t _precision_ns);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const clock_src_desc_t s_src_desc[LIB_CLOCK_SRC_COUNT] = {
+	[LIB_CLOCK_SRC_AUTO]				= { "auto",				CLOCK_MONOTONIC,		0, NULL, NULL },
+	[LIB_CLOCK_SRC_MONOTONIC]			= { "monotonic",		CLOCK_MONOTONIC,		1, &lib_clock__read_ns_mono, &lib_clock__read_ticks_mono },
+	[LIB_CLOCK_SRC_MONOTONIC_RAW]		= { "monotonic_raw",	CLOCK_MONOTONIC_RAW,	0, &lib_clock__read_ns_mono_raw, &lib_clock__read_ticks_mono_raw },
+	[LIB_CLOCK_SRC_MONOTONIC_COARSE]	= { "monotonic_coarse",	CLOCK_MONOTONIC_COARSE,	1, &lib_clock__read_ns_mono_coarse, &lib_clock__read_ticks_mono_coarse },
+	[LIB_CLOCK_SRC_BOOTTIME]			= { "boottime",			CLOCK_BOOTTIME,			0, &lib_clock__read_ns_boottime, &lib_clock__read_ticks_boottime },
+	[LIB_CLOCK_SRC_TSC]					= { "tsc",				CLOCK_MONOTONIC,		1, &lib_clock__read_ns_tsc, &lib_clock__read_ticks_tsc }
+};
+
+// default precision of auto mode: the unit of the API
+static const uint64_t s_default_precision_ns[LIB_CLOCK_API_COUNT] = {
+	[LIB_CLOCK_API_NS]		= 1ULL,
+	[LIB_CLOCK_API_US]		= 1000ULL,
+	[LIB_CLOCK_API_MS]		= 1000000ULL,
+	[LIB_CLOCK_API_TICKS]	= 1ULL
+};
+
+static clock_src_probe_t s_src_probe[LIB_CLOCK_SRC_COUNT];
+static lib_clock_src_info_t s_src_info[LIB_CLOCK_API_COUNT];
+static volatile uint64_t s_src_sink;
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+
+// CLOCK_MONOTONIC with nanosecond ticks until lib_clock__init has run
+lib_clock_dispatch_t g_lib_clock_src = {
+	.read = {
+		[LIB_CLOCK_API_NS]		= &lib_clock__read_ns_mono,
+		[LIB_CLOCK_API_US]		= &lib_clock__read_ns_mono,
+		[LIB_CLOCK_API_MS]		= &lib_clock__read_ns_mono,
+		[LIB_CLOCK_API_TICKS]	= &lib_clock__read_ns_mono
+	},
+	.fine = &lib_clock__read_ns_mono,
+	.freq = 1000000000ULL,
+	.to_ns = { .mult = 1, .shift = 0 },
+	.to_ticks = { .mult = 1, .shift = 0 }
+};
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	resolve the sources of all APIs into g_lib_clock_src
+ *
+ * Auto mode only considers sources on the CLOCK_MONOTONIC scale, so its
+ * choice never changes the epoch or rate of an API. Explicitly configured
+ * sources which are not available fall back to CLOCK_MONOTONIC.
+ * ****************************************************************************/
+int lib_clock__source_init(const lib_clock_cfg_t *_cfg)
+{
+	lib_clock_dispatch_t src = g_lib_clock_src;
+	lib_clock_cfg_t cfg;
+	lib_clock_src_t source;
+	const char *reason;
+	uint64_t precision;
+	int api, need_tsc = 0;
+
+	if (_cfg == NULL) {
+		for (api = 0; api < LIB_CLOCK_API_COUNT; api++) {
+			cfg.source[api] = SRC_BUILD_DEFAULT;
+			cfg.precision_ns[api] = 0;
+		}
+	}
+	else {
+		cfg = *_cfg;
+	}
+
+	for (api = 0; api < LIB_CLOCK_API_COUNT; api++) {
+		if ((unsigned)cfg.source[api] >= LIB_CLOCK_SRC_COUNT) {
+			return -ESTD_INVAL;
+		}
+		if ((cfg.source[api] == LIB_CLOCK_SRC_TSC) || (cfg.source[api] == LIB_CLOCK_SRC_AUTO)) {
+			need_tsc = 1;
+		}
+	}
+
+	// the calibration takes a while, only pay for it if the TSC may be used
+	if (need_tsc && !g_lib_clock_tsc.usable) {
+		lib_clock__tsc_init();
+	}
+
+	for (source = LIB_CLOCK_SRC_MONOTONIC; source < LIB_CLOCK_SRC_COUNT; source++) {
+		lib_clock__source_probe(source);
+	}
+
+	if (!s_src_probe[LIB_CLOCK_SRC_MONOTONIC].available) {
+		return -ESTD_FAULT;
+	}
+
+	for (api = 0; api < LIB_CLOCK_API_COUNT; api++) {
+		source = cfg.source[api];
+		reason = "configured";
+
+		if (source == LIB_CLOCK_SRC_AUTO) {
+			precision = cfg.precision_ns[api] ? cfg.precision_ns[api] : s_default_precision_ns[api];
+			source = lib_clock__source_auto(precision);
+			reason = "auto: cheapest source meeting the precision";
+		}
+		else if (!s_src_probe[source].available) {
+			source = LIB_CLOCK_SRC_MONOTONIC;
+			reason = "fallback: configured source not available";
+		}
+
+		src.read[api] = (api == LIB_CLOCK_API_TICKS) ? s_src_desc[source].read_ticks : s_src_desc[source].read_ns;
+		if ((source == LIB_CLOCK_SRC_TSC) && (g_lib_clock_tsc.cpu_count != 0)) {
+			// skewed TSCs, the per-CPU offsets are removed on every read
+			src.read[api] = (api == LIB_CLOCK_API_TICKS) ? &lib_clock__read_ticks_tsc_cpu : &lib_clock__read_ns_tsc_cpu;
+		}
+
+		s_src_info[api].source = source;
+		s_src_info[api].name = s_src_desc[source].name;
+		s_src_info[api].resolution_ns = s_src_probe[source].res_ns;
+		s_src_info[api].read_cost_ns = s_src_probe[source].cost_ns;
+		s_src_info[api].reason = reason;
+	}
+
+	// tick conversion factors follow the source of the tick API
+	source = s_src_info[LIB_CLOCK_API_TICKS].source;
+	if (source == LIB_CLOCK_SRC_TSC) {
+		src.freq = g_lib_clock_tsc.freq;
+		lib_clock__conv_init(&src.to_ns, 1000000000ULL, src.freq);
+		lib_clock__conv_init(&src.to_ticks, src.freq, 1000000000ULL);
+	}
+	else {
+		src.freq = 1000000000ULL / s_src_probe[source].res_ns;
+		lib_clock__conv_init(&src.to_ns, s_src_probe[source].res_ns, 1);
+		lib_clock__conv_init(&src.to_ticks, 1, s_src_probe[source].res_ns);
+	}
+
+	src.fine = s_src_probe[LIB_CLOCK_SRC_TSC].available ? &lib_clock__read_ns_tsc : &lib_clock__read_ns_mono;
+	if (s_src_probe[LIB_CLOCK_SRC_TSC].available && (g_lib_clock_tsc.cpu_count != 0)) {
+		src.fine = &lib_clock__read_ns_tsc_cpu;
+	}
+
+	g_lib_clock_src = src;
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	query which source was selected for an API and why
+ * ****************************************************************************/
+int lib_clock__get_source_info(lib_clock_api_t _api, lib_clock_src_info_t *_info)
+{
+	if (((unsigned)_api >= LIB_CLOCK_API_COUNT) || (_info == NULL)) {
+		return -ESTD_INVAL;
+	}
+
+	if (s_src_info[_api].name == NULL) {
+		// not initialized yet
+		_info->source = LIB_CLOCK_SRC_MONOTONIC;
+		_info->name = s_src_desc[LIB_CLOCK_SRC_MONOTONIC].name;
+		_info->resolution_ns = 1;
+		_info->read_cost_ns = 0;
+		_info->reason = "default before lib_clock__init";
+		return EOK;
+	}
+
+	*_info = s_src_info[_api];
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	name of a clock source
+ * ****************************************************************************/
+const char *lib_clock__source_name(lib_clock_src_t _source)
+{
+	if ((unsigned)_source >= LIB_CLOCK_SRC_COUNT) {
+		return "unknown";
+	}
+
+	return s_src_desc[_source].name;
+}
+
+/* ************************************************************************//**
+ * \brief	TSC reader on the CLOCK_MONOTONIC nanosecond scale
+ * ****************************************************************************/
+static uint64_t lib_clock__read_ns_tsc(void)
+{
+	return lib_clock__tsc_to_ns(lib_clock__tsc_read());
+}
+
+/* ************************************************************************//**
+ * \brief	raw TSC ticks
+ * ****************************************************************************/
+static uint64_t lib_clock__read_ticks_tsc(void)
+{
+	return lib_clock__tsc_read();
+}
+
+/* ************************************************************************//**
+ * \brief	TSC reader with the per-CPU offset removed
+ * ****************************************************************************/
+static uint64_t lib_clock__read_ns_tsc_cpu(void)
+{
+	return lib_clock__tsc_to_ns(lib_clock__tsc_read_cpu());
+}
+
+/* ************************************************************************//**
+ * \brief	TSC ticks with the per-CPU offset removed
+ * ****************************************************************************/
+static uint64_t lib_clock__read_ticks_tsc_cpu(void)
+{
+	return lib_clock__tsc_read_cpu();
+}
+
+/* ************************************************************************//**
+ * \brief	determine availability and resolution of a source
+ *
+ * The read cost is measured lazily by auto mode, it is kept from an
+ * earlier initialization.
+ * ****************************************************************************/
+static void lib_clock__source_probe(lib_clock_src_t _source)
+{
+	clock_src_probe_t *probe = &s_src_probe[_source];
+	struct timespec res;
+
+	if (_source == LIB_CLOCK_SRC_TSC) {
+		probe->available = g_lib_clock_tsc.usable;
+		probe->res_ns = 1;
+		return;
+	}
+
+	if (clock_getres(s_src_desc[_source].clock_id, &res) != 0) {
+		probe->available = 0;
+		return;
+	}
+
+	probe->res_ns = (uint64_t)res.tv_nsec + (uint64_t)res.tv_sec * 1000000000ULL;
+	probe->available = (probe->res_ns > 0) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	measure the average cost of a single read
+ * ****************************************************************************/
+static double lib_clock__source_cost(lib_clock_read_t _read)
+{
+	uint64_t start, elapsed, best = UINT64_MAX, sum;
+	int round, i;
+
+	for (round = 0; round < SRC_COST_ROUNDS; round++) {
+		sum = 0;
+		start = lib_clock__read_ns_mono();
+		for (i = 0; i < SRC_COST_READS; i++) {
+			sum += _read();
+		}
+		elapsed = lib_clock__read_ns_mono() - start;
+		s_src_sink = sum;
+
+		if (elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	return (double)best / SRC_COST_READS;
+}
+
+/* ************************************************************************//**
+ * \brief	cheapest auto mode candidate with the given precision
+ *
+ * CLOCK_MONOTONIC is the answer if no candidate meets the precision.
+ * ****************************************************************************/
+static lib_clock_src_t lib_clock__source_auto(uint64_t _precision_ns)
+{
+	lib_clock_src_t source, best = LIB_CLOCK_SRC_MONOTONIC;
+	double best_cost = -1.0;
+
+	for (source = LIB_CLOCK_SRC_MONOTONIC; source < LIB_CLOCK_SRC_COUNT; source++) {
+		clock_src_probe_t *probe = &s_src_probe[source];
+
+		if (!s_src_desc[source].auto_candidate || !probe->available || (probe->res_ns > _precision_ns)) {
+			continue;
+		}
+
+		if (probe->cost_ns == 0) {
+			probe->cost_ns = lib_clock__source_cost(s_src_desc[source].read_ns);
+		}
+
+		if ((best_cost < 0) || (probe->cost_ns < best_cost)) {
+			best = source;
+			best_cost = probe->cost_ns;
+		}
+	}
+
+	return best;
+}
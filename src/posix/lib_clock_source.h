@@ -0,0 +1,72 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_SOURCE_H_
+#define _LIB_CLOCK_SOURCE_H_
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+
+/* project */
+#include "lib_clock_posix.h"
+#include "lib_clock_conv.h"
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef uint64_t (*lib_clock_read_t)(void);
+
+/* Readers resolved by lib_clock__source_init. The NS, US and MS entries
+ * return nanoseconds, the TICKS entry returns raw ticks. */
+typedef struct {
+	lib_clock_read_t	read[LIB_CLOCK_API_COUNT];
+	lib_clock_read_t	fine;		// finest CLOCK_MONOTONIC scale reader, used for busy waiting
+	uint64_t			freq;		// ticks per second
+	lib_clock_conv_t	to_ns;		// ticks -> ns
+	lib_clock_conv_t	to_ticks;	// ns -> ticks
+} lib_clock_dispatch_t;
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+extern lib_clock_dispatch_t g_lib_clock_src;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	resolve the sources of all APIs into g_lib_clock_src
+ *
+ * \param	_cfg				source configuration, NULL for the build default
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__source_init(const lib_clock_cfg_t *_cfg);
+
+#endif
@@ -0,0 +1,391 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_timers.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define CACHE_LINE_SIZE		64
+
+/* Heap element k lives at heap[k + HEAP_PAD]. The children of k are
+ * 4k+1 .. 4k+4, i.e. array positions 4k+4 .. 4k+7: with 16 byte entries
+ * and a cache line aligned array all four share one cache line. */
+#define HEAP_PAD			3U
+#define HEAP_AT(svc, k)		((svc)->heap[(k) + HEAP_PAD])
+
+/* index of a timer popped for the running dispatch, a cancel or re-arm
+ * by an earlier callback of the batch keeps it from firing */
+#define TIMER_FIRING		UINT32_MAX
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t lib_clock__timers_now(void);
+static int lib_clock__timers_grow(lib_clock_timers_t *_svc);
+static void lib_clock__timers_place(lib_clock_timers_t *_svc, uint32_t _k, lib_clock_timers_entry_t _entry);
+static void lib_clock__timers_sift_up(lib_clock_timers_t *_svc, uint32_t _k);
+static void lib_clock__timers_sift_down(lib_clock_timers_t *_svc, uint32_t _k);
+static void lib_clock__timers_remove(lib_clock_timers_t *_svc, uint32_t _k);
+static int lib_clock__timers_update(lib_clock_timers_t *_svc);
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	set up a timer service
+ * ****************************************************************************/
+int lib_clock__timers_init(lib_clock_timers_t *_svc, uint64_t _slack_ns)
+{
+	void *heap;
+
+	memset(_svc, 0, sizeof(*_svc));
+	_svc->fd = -1;
+
+	if (posix_memalign(&heap, CACHE_LINE_SIZE, (LIB_CLOCK_TIMERS_CAPACITY + HEAP_PAD) * sizeof(lib_clock_timers_entry_t)) != 0) {
+		return -ESTD_NOMEM;
+	}
+
+	_svc->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (_svc->fd < 0) {
+		free(heap);
+		return -ESTD_FAULT;
+	}
+
+	_svc->heap = (lib_clock_timers_entry_t *)heap;
+	_svc->capacity = LIB_CLOCK_TIMERS_CAPACITY;
+	_svc->slack_ns = _slack_ns;
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	release the timerfd and the heap
+ * ****************************************************************************/
+void lib_clock__timers_close(lib_clock_timers_t *_svc)
+{
+	uint32_t k;
+
+	for (k = 0; k < _svc->count; k++) {
+		HEAP_AT(_svc, k).timer->index = 0;
+	}
+	if (_svc->fd >= 0) {
+		close(_svc->fd);
+	}
+	free(_svc->heap);
+	memset(_svc, 0, sizeof(*_svc));
+	_svc->fd = -1;
+}
+
+/* ************************************************************************//**
+ * \brief	set up a timer before its first use
+ * ****************************************************************************/
+void lib_clock__timer_init(lib_clock_timer_t *_timer, lib_clock_timer_cb_t _cb, void *_arg)
+{
+	_timer->deadline_ns = 0;
+	_timer->index = 0;
+	_timer->cb = _cb;
+	_timer->arg = _arg;
+}
+
+/* ************************************************************************//**
+ * \brief	arm or re-arm a timer on an absolute deadline
+ * ****************************************************************************/
+int lib_clock__timers_arm(lib_clock_timers_t *_svc, lib_clock_timer_t *_timer, uint64_t _deadline_ns)
+{
+	lib_clock_timers_entry_t entry = { _deadline_ns, _timer };
+	uint64_t previous;
+	uint32_t k;
+
+	if ((_timer->index != 0) && (_timer->index != TIMER_FIRING)) {
+		k = _timer->index - 1;
+		previous = HEAP_AT(_svc, k).deadline_ns;
+		_timer->deadline_ns = _deadline_ns;
+		HEAP_AT(_svc, k).deadline_ns = _deadline_ns;
+		if (_deadline_ns < previous) {
+			lib_clock__timers_sift_up(_svc, k);
+		}
+		else {
+			lib_clock__timers_sift_down(_svc, k);
+		}
+	}
+	else {
+		if ((_svc->count == _svc->capacity) && (lib_clock__timers_grow(_svc) < EOK)) {
+			return -ESTD_NOMEM;
+		}
+		_timer->deadline_ns = _deadline_ns;
+		lib_clock__timers_place(_svc, _svc->count++, entry);
+		lib_clock__timers_sift_up(_svc, _svc->count - 1);
+	}
+
+	return lib_clock__timers_update(_svc);
+}
+
+/* ************************************************************************//**
+ * \brief	arm or re-arm a timer relative to now
+ * ****************************************************************************/
+int lib_clock__timers_arm_in(lib_clock_timers_t *_svc, lib_clock_timer_t *_timer, uint64_t _timeout_ns)
+{
+	return lib_clock__timers_arm(_svc, _timer, lib_clock__timers_now() + _timeout_ns);
+}
+
+/* ************************************************************************//**
+ * \brief	cancel a timer
+ * ****************************************************************************/
+int lib_clock__timers_cancel(lib_clock_timers_t *_svc, lib_clock_timer_t *_timer)
+{
+	if (_timer->index == 0) {
+		return 0;
+	}
+	if (_timer->index == TIMER_FIRING) {
+		_timer->index = 0;
+		return 1;
+	}
+
+	lib_clock__timers_remove(_svc, _timer->index - 1);
+	return 1;
+}
+
+/* ************************************************************************//**
+ * \brief	fire the due timers
+ * ****************************************************************************/
+uint32_t lib_clock__timers_dispatch(lib_clock_timers_t *_svc, uint32_t _max)
+{
+	lib_clock_timer_t *batch[LIB_CLOCK_TIMERS_BATCH];
+	uint64_t now, expirations;
+	uint32_t fired = 0, limit, count, i;
+
+	// clears the readiness, the expiry count itself is of no interest
+	if (read(_svc->fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations)) {
+		_svc->wakeups++;
+	}
+
+	now = lib_clock__timers_now();
+	if ((_svc->armed_ns != 0) && (_svc->armed_ns <= now)) {
+		// expired one-shot, nothing is armed any more
+		_svc->armed_ns = 0;
+	}
+
+	while ((_svc->count != 0) && ((_max == 0) || (fired < _max))) {
+		limit = LIB_CLOCK_TIMERS_BATCH;
+		if ((_max != 0) && (_max - fired < limit)) {
+			limit = _max - fired;
+		}
+
+		// pop first, the callbacks may change the heap
+		count = 0;
+		while ((count < limit) && (_svc->count != 0) && (HEAP_AT(_svc, 0).deadline_ns <= now)) {
+			batch[count] = HEAP_AT(_svc, 0).timer;
+			lib_clock__timers_remove(_svc, 0);
+			batch[count++]->index = TIMER_FIRING;
+		}
+		if (count == 0) {
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (batch[i]->index != TIMER_FIRING) {
+				continue;
+			}
+			batch[i]->index = 0;
+			batch[i]->cb(batch[i], batch[i]->arg);
+			fired++;
+		}
+	}
+
+	_svc->fired += fired;
+
+	// left over due timers set the timerfd into the past, it fires at once
+	lib_clock__timers_update(_svc);
+	return fired;
+}
+
+/* ************************************************************************//**
+ * \brief	CLOCK_MONOTONIC in nanoseconds, the clock of the timerfd
+ * ****************************************************************************/
+static uint64_t lib_clock__timers_now(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
+
+/* ************************************************************************//**
+ * \brief	double the heap, keeping the cache line alignment
+ * ****************************************************************************/
+static int lib_clock__timers_grow(lib_clock_timers_t *_svc)
+{
+	uint32_t capacity = _svc->capacity * 2U;
+	void *heap;
+
+	if ((capacity <= _svc->capacity) || (capacity > UINT32_MAX - HEAP_PAD)) {
+		return -ESTD_NOMEM;
+	}
+	if (posix_memalign(&heap, CACHE_LINE_SIZE, (size_t)(capacity + HEAP_PAD) * sizeof(lib_clock_timers_entry_t)) != 0) {
+		return -ESTD_NOMEM;
+	}
+
+	memcpy(heap, _svc->heap, (size_t)(_svc->count + HEAP_PAD) * sizeof(lib_clock_timers_entry_t));
+	free(_svc->heap);
+	_svc->heap = (lib_clock_timers_entry_t *)heap;
+	_svc->capacity = capacity;
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	store an entry at heap element _k and tell its timer
+ * ****************************************************************************/
+static void lib_clock__timers_place(lib_clock_timers_t *_svc, uint32_t _k, lib_clock_timers_entry_t _entry)
+{
+	HEAP_AT(_svc, _k) = _entry;
+	_entry.timer->index = _k + 1;
+}
+
+static void lib_clock__timers_sift_up(lib_clock_timers_t *_svc, uint32_t _k)
+{
+	lib_clock_timers_entry_t entry = HEAP_AT(_svc, _k);
+	uint32_t parent;
+
+	while (_k > 0) {
+		parent = (_k - 1) / 4U;
+		if (HEAP_AT(_svc, parent).deadline_ns <= entry.deadline_ns) {
+			break;
+		}
+		lib_clock__timers_place(_svc, _k, HEAP_AT(_svc, parent));
+		_k = parent;
+	}
+	lib_clock__timers_place(_svc, _k, entry);
+}
+
+static void lib_clock__timers_sift_down(lib_clock_timers_t *_svc, uint32_t _k)
+{
+	lib_clock_timers_entry_t entry = HEAP_AT(_svc, _k);
+	uint32_t child, last, best, c;
+
+	for (;;) {
+		child = 4U * _k + 1U;
+		if (child >= _svc->count) {
+			break;
+		}
+		last = (child + 4U < _svc->count) ? child + 4U : _svc->count;
+
+		best = child;
+		for (c = child + 1U; c < last; c++) {
+			if (HEAP_AT(_svc, c).deadline_ns < HEAP_AT(_svc, best).deadline_ns) {
+				best = c;
+			}
+		}
+		if (HEAP_AT(_svc, best).deadline_ns >= entry.deadline_ns) {
+			break;
+		}
+		lib_clock__timers_place(_svc, _k, HEAP_AT(_svc, best));
+		_k = best;
+	}
+	lib_clock__timers_place(_svc, _k, entry);
+}
+
+/* ************************************************************************//**
+ * \brief	take heap element _k out, the last element fills the gap
+ * ****************************************************************************/
+static void lib_clock__timers_remove(lib_clock_timers_t *_svc, uint32_t _k)
+{
+	lib_clock_timers_entry_t removed = HEAP_AT(_svc, _k);
+	lib_clock_timers_entry_t last = HEAP_AT(_svc, _svc->count - 1);
+
+	removed.timer->index = 0;
+	_svc->count--;
+	if (_k == _svc->count) {
+		return;
+	}
+
+	lib_clock__timers_place(_svc, _k, last);
+	if (last.deadline_ns < removed.deadline_ns) {
+		lib_clock__timers_sift_up(_svc, _k);
+	}
+	else {
+		lib_clock__timers_sift_down(_svc, _k);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	move the timerfd expiry earlier if the earliest timer needs it
+ *
+ * The expiry is the earliest deadline plus the slack, rounded down to
+ * the slack grid: later than the deadline and at most one slack late.
+ * It is never moved later, a cancel leaves at most an early wakeup
+ * which re-arms from lib_clock__timers_dispatch.
+ * ****************************************************************************/
+static int lib_clock__timers_update(lib_clock_timers_t *_svc)
+{
+	struct itimerspec its;
+	uint64_t expiry;
+
+	if (_svc->count == 0) {
+		return EOK;
+	}
+
+	expiry = HEAP_AT(_svc, 0).deadline_ns;
+	if (_svc->slack_ns != 0) {
+		expiry += _svc->slack_ns;
+		expiry -= expiry % _svc->slack_ns;
+	}
+	if (expiry == 0) {
+		// an all zero it_value disarms the timerfd
+		expiry = 1;
+	}
+
+	if ((_svc->armed_ns != 0) && (_svc->armed_ns <= expiry)) {
+		return EOK;
+	}
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = (time_t)(expiry / 1000000000ULL);
+	its.it_value.tv_nsec = (long)(expiry % 1000000000ULL);
+	if (timerfd_settime(_svc->fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+		return -ESTD_FAULT;
+	}
+	_svc->armed_ns = expiry;
+	_svc->rearms++;
+	return EOK;
+}
@@ -0,0 +1,437 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdlib.h>
+#include <string.h>
+
+/* system */
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_trace.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define RING_FREE		0
+#define RING_OWNED		1
+#define RING_RELEASED	2		// owner thread exited, drained rings become free
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	pthread_mutex_t				lock;			// serializes collectors, init and cleanup
+	lib_clock_trace_ring_t		*rings;
+	lib_clock_trace_rec_t		*ring_mem;
+	uint32_t					ring_count;
+	int							fd;
+	lib_clock_trace_file_hdr_t	*hdr;			// mmap'd file, records follow the header
+	size_t						map_size;
+	uint64_t					file_records;
+	uint64_t					file_dropped;	// records which did not fit into the file
+	pthread_t					collector;
+	int							collector_running;
+	int							collector_stop;
+	uint32_t					collector_period_ms;
+} trace_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void lib_clock__trace_key_create(void);
+static void lib_clock__trace_thread_exit(void *_ring);
+static uint64_t lib_clock__trace_drain(lib_clock_trace_ring_t *_ring);
+static void *lib_clock__trace_collector(void *_arg);
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+__thread lib_clock_trace_ring_t *g_lib_clock_trace_ring;
+__thread uint32_t g_lib_clock_trace_gen;
+uint32_t g_lib_clock_trace_active_gen;		// 0 while tracing is not initialized
+lib_clock_trace_ring_t g_lib_clock_trace_unattached;
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static trace_t s_trace = { .lock = PTHREAD_MUTEX_INITIALIZER, .fd = -1 };
+static pthread_once_t s_trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_trace_key;
+static uint32_t s_trace_next_gen;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	create the trace file and the per-thread rings
+ * ****************************************************************************/
+int lib_clock__trace_init(const char *_path, uint32_t _max_threads, uint32_t _ring_records, uint64_t _file_records)
+{
+	lib_clock_trace_file_hdr_t hdr;
+	uint32_t ring_size = 1, i;
+	void *map;
+	int ret = EOK;
+
+	if ((_path == NULL) || (_max_threads == 0) || (_ring_records == 0) || (_file_records == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	while ((ring_size < _ring_records) && (ring_size < 0x80000000U)) {
+		ring_size <<= 1;
+	}
+
+	pthread_once(&s_trace_key_once, &lib_clock__trace_key_create);
+
+	pthread_mutex_lock(&s_trace.lock);
+	if (s_trace.hdr != NULL) {
+		ret = -ESTD_BUSY;
+		goto ERR_UNLOCK;
+	}
+
+	s_trace.rings = calloc(_max_threads, sizeof(lib_clock_trace_ring_t));
+	s_trace.ring_mem = calloc((size_t)_max_threads * ring_size, sizeof(lib_clock_trace_rec_t));
+	if ((s_trace.rings == NULL) || (s_trace.ring_mem == NULL)) {
+		ret = -ESTD_NOMEM;
+		goto ERR_FREE;
+	}
+
+	for (i = 0; i < _max_threads; i++) {
+		s_trace.rings[i].mask = ring_size - 1;
+		s_trace.rings[i].index = i;
+		s_trace.rings[i].rec = &s_trace.ring_mem[(size_t)i * ring_size];
+	}
+	s_trace.ring_count = _max_threads;
+
+	s_trace.fd = open(_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (s_trace.fd < 0) {
+		ret = -ESTD_FAULT;
+		goto ERR_FREE;
+	}
+
+	s_trace.file_records = _file_records;
+	s_trace.file_dropped = 0;
+	__atomic_store_n(&g_lib_clock_trace_unattached.dropped, 0, __ATOMIC_RELAXED);
+	s_trace.map_size = sizeof(lib_clock_trace_file_hdr_t) + (size_t)_file_records * sizeof(lib_clock_trace_rec_t);
+	if (ftruncate(s_trace.fd, (off_t)s_trace.map_size) != 0) {
+		ret = -ESTD_FAULT;
+		goto ERR_CLOSE;
+	}
+
+	map = mmap(NULL, s_trace.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, s_trace.fd, 0);
+	if (map == MAP_FAILED) {
+		ret = -ESTD_NOMEM;
+		goto ERR_CLOSE;
+	}
+
+	// calibration reference to convert the recorded ticks
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LIB_CLOCK_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = LIB_CLOCK_TRACE_VERSION;
+	hdr.rec_size = sizeof(lib_clock_trace_rec_t);
+	hdr.tick_freq = lib_clock__get_tick_freq();
+	hdr.ref_ticks = lib_clock__get_clock_ticks();
+	hdr.ref_ns = lib_clock__get_time_ns();
+	memcpy(map, &hdr, sizeof(hdr));
+	s_trace.hdr = (lib_clock_trace_file_hdr_t *)map;
+
+	// a new generation invalidates ring assignments of a previous session
+	if (++s_trace_next_gen == 0) {
+		s_trace_next_gen = 1;
+	}
+	__atomic_store_n(&g_lib_clock_trace_active_gen, s_trace_next_gen, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&s_trace.lock);
+	return EOK;
+
+ERR_CLOSE:
+	close(s_trace.fd);
+	s_trace.fd = -1;
+	unlink(_path);
+ERR_FREE:
+	free(s_trace.rings);
+	free(s_trace.ring_mem);
+	s_trace.rings = NULL;
+	s_trace.ring_mem = NULL;
+	s_trace.ring_count = 0;
+ERR_UNLOCK:
+	pthread_mutex_unlock(&s_trace.lock);
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	drain all rings into the trace file
+ * ****************************************************************************/
+int64_t lib_clock__trace_collect(void)
+{
+	uint64_t drained = 0, dropped = 0;
+	uint32_t i;
+
+	pthread_mutex_lock(&s_trace.lock);
+	if (s_trace.hdr == NULL) {
+		pthread_mutex_unlock(&s_trace.lock);
+		return -ESTD_FAULT;
+	}
+
+	for (i = 0; i < s_trace.ring_count; i++) {
+		lib_clock_trace_ring_t *ring = &s_trace.rings[i];
+		int released = RING_RELEASED;
+
+		drained += lib_clock__trace_drain(ring);
+		dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+		// a drained ring of an exited thread can be handed out again
+		if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+			__atomic_compare_exchange_n(&ring->state, &released, RING_FREE, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+		}
+	}
+
+	s_trace.hdr->dropped = dropped + s_trace.file_dropped + __atomic_load_n(&g_lib_clock_trace_unattached.dropped, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&s_trace.lock);
+
+	return (int64_t)drained;
+}
+
+/* ************************************************************************//**
+ * \brief	start a thread which calls lib_clock__trace_collect periodically
+ * ****************************************************************************/
+int lib_clock__trace_start_collector(uint32_t _period_ms)
+{
+	int ret = EOK;
+
+	if (_period_ms == 0) {
+		return -ESTD_INVAL;
+	}
+
+	pthread_mutex_lock(&s_trace.lock);
+	if (s_trace.hdr == NULL) {
+		ret = -ESTD_FAULT;
+	}
+	else if (s_trace.collector_running) {
+		ret = -ESTD_BUSY;
+	}
+	else {
+		s_trace.collector_period_ms = _period_ms;
+		__atomic_store_n(&s_trace.collector_stop, 0, __ATOMIC_RELAXED);
+		if (pthread_create(&s_trace.collector, NULL, &lib_clock__trace_collector, NULL) != 0) {
+			ret = -ESTD_FAULT;
+		}
+		else {
+			s_trace.collector_running = 1;
+		}
+	}
+	pthread_mutex_unlock(&s_trace.lock);
+
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	stop the collector thread
+ * ****************************************************************************/
+int lib_clock__trace_stop_collector(void)
+{
+	pthread_mutex_lock(&s_trace.lock);
+	if (!s_trace.collector_running) {
+		pthread_mutex_unlock(&s_trace.lock);
+		return EOK;
+	}
+	__atomic_store_n(&s_trace.collector_stop, 1, __ATOMIC_RELAXED);
+	s_trace.collector_running = 0;
+	pthread_mutex_unlock(&s_trace.lock);
+
+	// joined outside the lock, the collector takes it on every period
+	pthread_join(s_trace.collector, NULL);
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	drain the rings a last time, truncate and close the trace file
+ *
+ * Threads still recording must have stopped, their rings are released.
+ * ****************************************************************************/
+int lib_clock__trace_cleanup(void)
+{
+	size_t used;
+
+	lib_clock__trace_stop_collector();
+	if (lib_clock__trace_collect() < 0) {
+		return -ESTD_FAULT;
+	}
+
+	pthread_mutex_lock(&s_trace.lock);
+	__atomic_store_n(&g_lib_clock_trace_active_gen, 0, __ATOMIC_RELEASE);
+
+	used = sizeof(lib_clock_trace_file_hdr_t) + (size_t)s_trace.hdr->records * sizeof(lib_clock_trace_rec_t);
+	msync(s_trace.hdr, s_trace.map_size, MS_SYNC);
+	munmap(s_trace.hdr, s_trace.map_size);
+	s_trace.hdr = NULL;
+
+	if (ftruncate(s_trace.fd, (off_t)used) != 0) {
+		// the file stays valid, the header holds the record count
+	}
+	close(s_trace.fd);
+	s_trace.fd = -1;
+
+	free(s_trace.rings);
+	free(s_trace.ring_mem);
+	s_trace.rings = NULL;
+	s_trace.ring_mem = NULL;
+	s_trace.ring_count = 0;
+	pthread_mutex_unlock(&s_trace.lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	assign a free ring to the calling thread (slow path)
+ * ****************************************************************************/
+lib_clock_trace_ring_t *lib_clock__trace_attach(void)
+{
+	uint32_t gen = __atomic_load_n(&g_lib_clock_trace_active_gen, __ATOMIC_ACQUIRE);
+	lib_clock_trace_ring_t *ring = NULL;
+	uint32_t i;
+
+	g_lib_clock_trace_ring = NULL;
+	if (gen == 0) {
+		// a ring of an earlier session is freed, the exit hook must not see it
+		if (g_lib_clock_trace_gen != 0) {
+			pthread_setspecific(s_trace_key, NULL);
+			g_lib_clock_trace_gen = 0;
+		}
+		return NULL;
+	}
+
+	pthread_mutex_lock(&s_trace.lock);
+	for (i = 0; i < s_trace.ring_count; i++) {
+		int expected = RING_FREE;
+
+		if (__atomic_compare_exchange_n(&s_trace.rings[i].state, &expected, RING_OWNED, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			ring = &s_trace.rings[i];
+			break;
+		}
+	}
+	if (ring == NULL) {
+		// all rings in use, the span is lost; the thread stays on the sentinel
+		// until the next generation instead of taking the lock on every span
+		pthread_mutex_unlock(&s_trace.lock);
+		__atomic_fetch_add(&g_lib_clock_trace_unattached.dropped, 1, __ATOMIC_RELAXED);
+		g_lib_clock_trace_ring = &g_lib_clock_trace_unattached;
+		g_lib_clock_trace_gen = gen;
+		pthread_setspecific(s_trace_key, NULL);
+		return NULL;
+	}
+	pthread_mutex_unlock(&s_trace.lock);
+
+	g_lib_clock_trace_ring = ring;
+	g_lib_clock_trace_gen = gen;
+	pthread_setspecific(s_trace_key, ring);
+
+	return ring;
+}
+
+static void lib_clock__trace_key_create(void)
+{
+	pthread_key_create(&s_trace_key, &lib_clock__trace_thread_exit);
+}
+
+/* ************************************************************************//**
+ * \brief	thread exit hook, hands the ring back once it is drained
+ * ****************************************************************************/
+static void lib_clock__trace_thread_exit(void *_ring)
+{
+	lib_clock_trace_ring_t *ring = (lib_clock_trace_ring_t *)_ring;
+
+	pthread_mutex_lock(&s_trace.lock);
+	if ((g_lib_clock_trace_gen == __atomic_load_n(&g_lib_clock_trace_active_gen, __ATOMIC_RELAXED)) && (s_trace.rings != NULL)) {
+		__atomic_store_n(&ring->state, RING_RELEASED, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&s_trace.lock);
+}
+
+/* ************************************************************************//**
+ * \brief	copy the pending records of one ring into the trace file
+ *
+ * Called with the trace lock held. Records which do not fit into the file
+ * are discarded and counted as dropped.
+ * ****************************************************************************/
+static uint64_t lib_clock__trace_drain(lib_clock_trace_ring_t *_ring)
+{
+	lib_clock_trace_rec_t *file_rec = (lib_clock_trace_rec_t *)(s_trace.hdr + 1);
+	uint64_t tail = _ring->tail;
+	uint64_t head = __atomic_load_n(&_ring->head, __ATOMIC_ACQUIRE);
+	uint64_t pending = head - tail;
+	uint64_t space = s_trace.file_records - s_trace.hdr->records;
+	uint64_t count = (pending < space) ? pending : space;
+	uint64_t copied = 0;
+
+	// batch copy in at most two contiguous chunks of the ring
+	while (copied < count) {
+		uint64_t pos = (tail + copied) & _ring->mask;
+		uint64_t chunk = (uint64_t)_ring->mask + 1 - pos;
+
+		if (chunk > count - copied) {
+			chunk = count - copied;
+		}
+		memcpy(&file_rec[s_trace.hdr->records + copied], &_ring->rec[pos], (size_t)chunk * sizeof(lib_clock_trace_rec_t));
+		copied += chunk;
+	}
+
+	s_trace.hdr->records += count;
+	s_trace.file_dropped += pending - count;
+
+	__atomic_store_n(&_ring->tail, head, __ATOMIC_RELEASE);
+	return count;
+}
+
+static void *lib_clock__trace_collector(void *_arg)
+{
+	struct timespec rqtp;
+
+	(void)_arg;
+
+	rqtp.tv_sec = (time_t)(s_trace.collector_period_ms / 1000);
+	rqtp.tv_nsec = (long)(s_trace.collector_period_ms % 1000) * 1000000L;
+
+	while (!__atomic_load_n(&s_trace.collector_stop, __ATOMIC_RELAXED)) {
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+		lib_clock__trace_collect();
+	}
+
+	return NULL;
+}
@@ -0,0 +1,282 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stddef.h>
+#include <limits.h>
+
+/* system */
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_posix.h"
+#include "lib_clock_wait.h"
+#include "lib_clock_cpu.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define WAIT_CHECK_DEFAULT		16			// used until the calibration ran
+#define WAIT_CLOCK_SHARE		16			// the spin takes this many times the clock read
+#define WAIT_MAX_CHECK_NS		1000ULL		// longest spin between two clock reads
+#define WAIT_CAL_PAUSES			10000
+#define WAIT_CAL_READS			1000
+#define WAIT_CAL_ROUNDS			3			// the fastest round is used
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	const uint32_t	*word;
+	uint32_t		old;
+} wait_change_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static inline __attribute__((always_inline)) int lib_clock__wait_core(lib_clock_wait_pred_t _pred, void *_arg, const uint32_t *_word, uint64_t _deadline_ns, const lib_clock_backoff_t *_backoff);
+static int lib_clock__wait_changed(void *_arg);
+static void lib_clock__wait_sleep(const uint32_t *_word, uint32_t _old, uint64_t _ns);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static const lib_clock_backoff_t s_backoff_profiles[LIB_CLOCK_BACKOFF_COUNT] = {
+	[LIB_CLOCK_BACKOFF_LATENCY]		= { .spin_ns = UINT64_MAX,	.yield_ns = 0,			.sleep_min_ns = 0,			.sleep_max_ns = 0 },
+	[LIB_CLOCK_BACKOFF_BALANCED]	= { .spin_ns = 20000,		.yield_ns = 200000,		.sleep_min_ns = 50000,		.sleep_max_ns = 1000000 },
+	[LIB_CLOCK_BACKOFF_POWER]		= { .spin_ns = 1000,		.yield_ns = 10000,		.sleep_min_ns = 100000,		.sleep_max_ns = 10000000 },
+};
+
+static _Atomic uint32_t s_wait_check = WAIT_CHECK_DEFAULT;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	calibrate how often a spinning wait reads the clock
+ * ****************************************************************************/
+uint32_t lib_clock__wait_calibrate(void)
+{
+	uint64_t start, pause_ns = UINT64_MAX, read_ns = UINT64_MAX, elapsed, check;
+	volatile uint64_t sink = 0;
+	int round, i;
+
+	for (round = 0; round < WAIT_CAL_ROUNDS; round++) {
+		start = lib_clock__get_time_ns();
+		for (i = 0; i < WAIT_CAL_PAUSES; i++) {
+			lib_clock__cpu_relax();
+		}
+		elapsed = lib_clock__get_time_ns() - start;
+		pause_ns = (elapsed < pause_ns) ? elapsed : pause_ns;
+
+		start = lib_clock__get_time_ns();
+		for (i = 0; i < WAIT_CAL_READS; i++) {
+			sink += lib_clock__get_time_ns();
+		}
+		elapsed = lib_clock__get_time_ns() - start;
+		read_ns = (elapsed < read_ns) ? elapsed : read_ns;
+	}
+	(void)sink;
+
+	// per-operation costs kept in 1/1000 ns, a pause may take less than a nanosecond
+	pause_ns = (pause_ns * 1000ULL) / WAIT_CAL_PAUSES;
+	read_ns = (read_ns * 1000ULL) / WAIT_CAL_READS;
+	if (pause_ns == 0) {
+		pause_ns = 1;
+	}
+
+	check = (read_ns * WAIT_CLOCK_SHARE + pause_ns - 1) / pause_ns;
+	if (check * pause_ns > WAIT_MAX_CHECK_NS * 1000ULL) {
+		check = (WAIT_MAX_CHECK_NS * 1000ULL) / pause_ns;
+	}
+	check = (check == 0) ? 1 : check;
+	check = (check > UINT32_MAX) ? UINT32_MAX : check;
+
+	atomic_store_explicit(&s_wait_check, (uint32_t)check, memory_order_relaxed);
+	return (uint32_t)check;
+}
+
+/* ************************************************************************//**
+ * \brief	pause hints between two clock reads of a spinning wait
+ * ****************************************************************************/
+uint32_t lib_clock__wait_check_interval(void)
+{
+	return atomic_load_explicit(&s_wait_check, memory_order_relaxed);
+}
+
+/* ************************************************************************//**
+ * \brief	parameters of a built-in backoff profile
+ * ****************************************************************************/
+const lib_clock_backoff_t *lib_clock__backoff_profile(lib_clock_backoff_profile_t _profile)
+{
+	if ((unsigned)_profile >= LIB_CLOCK_BACKOFF_COUNT) {
+		return NULL;
+	}
+
+	return &s_backoff_profiles[_profile];
+}
+
+/* ************************************************************************//**
+ * \brief	wait until a condition is met or the deadline passed
+ * ****************************************************************************/
+int lib_clock__wait_until(lib_clock_wait_pred_t _pred, void *_arg, uint64_t _deadline_ns, const lib_clock_backoff_t *_backoff)
+{
+	if (_pred == NULL) {
+		return -ESTD_INVAL;
+	}
+
+	return lib_clock__wait_core(_pred, _arg, NULL, _deadline_ns, _backoff);
+}
+
+/* ************************************************************************//**
+ * \brief	wait until a word differs from _old or the deadline passed
+ * ****************************************************************************/
+int lib_clock__wait_until_change(const uint32_t *_word, uint32_t _old, uint64_t _deadline_ns, const lib_clock_backoff_t *_backoff)
+{
+	wait_change_t change = { .word = _word, .old = _old };
+
+	if (_word == NULL) {
+		return -ESTD_INVAL;
+	}
+
+	return lib_clock__wait_core(&lib_clock__wait_changed, &change, _word, _deadline_ns, _backoff);
+}
+
+/* ************************************************************************//**
+ * \brief	wake all threads sleeping in lib_clock__wait_until_change on _word
+ * ****************************************************************************/
+void lib_clock__wait_wake(uint32_t *_word)
+{
+	if (_word != NULL) {
+		syscall(SYS_futex, _word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	spin, yield and sleep until the condition is met
+ *
+ * The phases follow the time since the start of the wait. A sleep is
+ * cut to end one wakeup slack before the deadline, it is a futex sleep
+ * on _word if given, a plain one otherwise. The slack is limited to the
+ * yield time of the profile, a power saving wait does not yield through
+ * a large slack but rather wakes late.
+ * ****************************************************************************/
+static inline __attribute__((always_inline)) int lib_clock__wait_core(lib_clock_wait_pred_t _pred, void *_arg, const uint32_t *_word, uint64_t _deadline_ns, const lib_clock_backoff_t *_backoff)
+{
+	const lib_clock_backoff_t *backoff = (_backoff != NULL) ? _backoff : &s_backoff_profiles[LIB_CLOCK_BACKOFF_BALANCED];
+	uint32_t check = atomic_load_explicit(&s_wait_check, memory_order_relaxed);
+	uint64_t start, now, waited, sleep_ns, left, slack;
+	uint32_t i;
+
+	if (_pred(_arg)) {
+		return EOK;
+	}
+
+	start = lib_clock__get_time_ns();
+	sleep_ns = backoff->sleep_min_ns;
+
+	for (;;) {
+		for (i = 0; i < check; i++) {
+			lib_clock__cpu_relax();
+			if (_pred(_arg)) {
+				return EOK;
+			}
+		}
+
+		now = lib_clock__get_time_ns();
+		if (now >= _deadline_ns) {
+			return _pred(_arg) ? EOK : -ESTD_TIMEDOUT;
+		}
+
+		waited = now - start;
+		if (waited < backoff->spin_ns) {
+			continue;
+		}
+		if ((waited - backoff->spin_ns < backoff->yield_ns) || (backoff->sleep_max_ns == 0)) {
+			sched_yield();
+			continue;
+		}
+
+		// the scheduler wakes late by about the delay slack, the rest before the deadline is yielded
+		left = _deadline_ns - now;
+		slack = lib_clock__get_delay_slack_ns();
+		slack = (slack < backoff->yield_ns) ? slack : backoff->yield_ns;
+		if (left <= slack) {
+			sched_yield();
+			continue;
+		}
+		lib_clock__wait_sleep(_word, (_word != NULL) ? ((wait_change_t *)_arg)->old : 0, (sleep_ns < left - slack) ? sleep_ns : left - slack);
+		if (_pred(_arg)) {
+			return EOK;
+		}
+		sleep_ns = (sleep_ns * 2 < backoff->sleep_max_ns) ? sleep_ns * 2 : backoff->sleep_max_ns;
+		sleep_ns = (sleep_ns == 0) ? 1 : sleep_ns;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	condition of lib_clock__wait_until_change
+ * ****************************************************************************/
+static int lib_clock__wait_changed(void *_arg)
+{
+	const wait_change_t *change = (const wait_change_t *)_arg;
+
+	return (__atomic_load_n(change->word, __ATOMIC_ACQUIRE) != change->old) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	sleep for _ns, on the futex of _word if given
+ *
+ * The futex sleep returns at once if the word already changed, so a
+ * wake between the last check and the sleep is not lost.
+ * ****************************************************************************/
+static void lib_clock__wait_sleep(const uint32_t *_word, uint32_t _old, uint64_t _ns)
+{
+	struct timespec rqtp;
+
+	rqtp.tv_sec = (time_t)(_ns / 1000000000ULL);
+	rqtp.tv_nsec = (long)(_ns % 1000000000ULL);
+
+	if (_word != NULL) {
+		syscall(SYS_futex, _word, FUTEX_WAIT_PRIVATE, _old, &rqtp, NULL, 0);
+	}
+	else {
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &rqtp, NULL);
+	}
+}
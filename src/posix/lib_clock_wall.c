@@ -0,0 +1,423 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+/* system */
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_wall.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define WALL_PAIR_SAMPLES		8		// bracketed readings per refresh, the tightest one is used
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* Values read by the converters, each one is a single atomic */
+typedef struct {
+	_Atomic int64_t		offset_ns;
+	_Atomic uint64_t	refreshed_ns;
+	_Atomic int64_t		drift_ppb;
+} wall_pub_t;
+
+typedef struct {
+	lib_clock_wall_cfg_t	cfg;
+	lib_clock_wall_status_t	status;		// writer side, guarded by s_wall_lock
+	pthread_t				thread;
+	int						running;
+	int						stopping;	// a stop is joining the refresh thread
+	int						set_fd;		// timerfd cancelled on CLOCK_REALTIME changes, -1 for injected sources
+	int						stop_fd;	// eventfd waking the refresh thread for shutdown
+} wall_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static uint64_t lib_clock__wall_realtime(void *_arg);
+static uint64_t lib_clock__wall_measure(int64_t *_offset);
+static int lib_clock__wall_arm(int _fd);
+static void *lib_clock__wall_thread(void *_arg);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static wall_pub_t s_wall_pub;
+static wall_t s_wall = { .set_fd = -1, .stop_fd = -1 };
+static pthread_mutex_t s_wall_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	start the monotonic to realtime mapping
+ * ****************************************************************************/
+int lib_clock__wall_start(const lib_clock_wall_cfg_t *_cfg)
+{
+	int ret;
+
+	pthread_mutex_lock(&s_wall_lock);
+	if (s_wall.running || s_wall.stopping) {
+		pthread_mutex_unlock(&s_wall_lock);
+		return -ESTD_BUSY;
+	}
+
+	if (_cfg != NULL) {
+		s_wall.cfg = *_cfg;
+	}
+	else {
+		memset(&s_wall.cfg, 0, sizeof(s_wall.cfg));
+	}
+	if (s_wall.cfg.refresh_us == 0) {
+		s_wall.cfg.refresh_us = LIB_CLOCK_WALL_REFRESH_US;
+	}
+	if (s_wall.cfg.tolerance_ns == 0) {
+		s_wall.cfg.tolerance_ns = LIB_CLOCK_WALL_TOLERANCE_NS;
+	}
+	if (s_wall.cfg.step_ns == 0) {
+		s_wall.cfg.step_ns = LIB_CLOCK_WALL_STEP_NS;
+	}
+	if (s_wall.cfg.source == NULL) {
+		s_wall.cfg.source = &lib_clock__wall_realtime;
+	}
+
+	memset(&s_wall.status, 0, sizeof(s_wall.status));
+	s_wall.status.refreshed_ns = lib_clock__wall_measure(&s_wall.status.offset_ns);
+	atomic_store(&s_wall_pub.drift_ppb, 0);
+	atomic_store(&s_wall_pub.refreshed_ns, s_wall.status.refreshed_ns);
+	atomic_store(&s_wall_pub.offset_ns, s_wall.status.offset_ns);
+	s_wall.status.refreshes = 1;
+
+	if (s_wall.cfg.manual) {
+		s_wall.running = 1;
+		pthread_mutex_unlock(&s_wall_lock);
+		return EOK;
+	}
+
+	s_wall.stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (s_wall.stop_fd < 0) {
+		pthread_mutex_unlock(&s_wall_lock);
+		return -ESTD_FAULT;
+	}
+
+	// realtime clock changes are only signalled for the system clock
+	s_wall.set_fd = -1;
+	if (s_wall.cfg.source == &lib_clock__wall_realtime) {
+		s_wall.set_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+		if ((s_wall.set_fd >= 0) && (lib_clock__wall_arm(s_wall.set_fd) < EOK)) {
+			close(s_wall.set_fd);
+			s_wall.set_fd = -1;
+		}
+	}
+
+	ret = EOK;
+	if (pthread_create(&s_wall.thread, NULL, &lib_clock__wall_thread, NULL) != 0) {
+		if (s_wall.set_fd >= 0) {
+			close(s_wall.set_fd);
+			s_wall.set_fd = -1;
+		}
+		close(s_wall.stop_fd);
+		s_wall.stop_fd = -1;
+		ret = -ESTD_FAULT;
+	}
+	else {
+		s_wall.running = 1;
+	}
+	pthread_mutex_unlock(&s_wall_lock);
+
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	stop the mapping, the last offset stays published
+ * ****************************************************************************/
+int lib_clock__wall_stop(void)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&s_wall_lock);
+	if (!s_wall.running || s_wall.stopping) {
+		pthread_mutex_unlock(&s_wall_lock);
+		return EOK;
+	}
+	if (s_wall.cfg.manual) {
+		s_wall.running = 0;
+		pthread_mutex_unlock(&s_wall_lock);
+		return EOK;
+	}
+	s_wall.stopping = 1;
+	pthread_mutex_unlock(&s_wall_lock);
+
+	// the thread refreshes under the lock, join without holding it
+	if (write(s_wall.stop_fd, &one, sizeof(one)) == (ssize_t)sizeof(one)) {
+		pthread_join(s_wall.thread, NULL);
+	}
+
+	pthread_mutex_lock(&s_wall_lock);
+	close(s_wall.stop_fd);
+	s_wall.stop_fd = -1;
+	if (s_wall.set_fd >= 0) {
+		close(s_wall.set_fd);
+		s_wall.set_fd = -1;
+	}
+	s_wall.running = 0;
+	s_wall.stopping = 0;
+	pthread_mutex_unlock(&s_wall_lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	re-measure and publish the offset
+ *
+ * The change against the published offset classifies the refresh: from
+ * the step threshold on it is a clock step, otherwise it is drift (NTP
+ * slewing, frequency error) and sets the drift rate for the staleness
+ * estimate.
+ * ****************************************************************************/
+int lib_clock__wall_refresh(void)
+{
+	lib_clock_wall_status_t *status = &s_wall.status;
+	uint64_t now, interval, error_abs;
+	int64_t offset, error;
+	int flags = 0;
+
+	pthread_mutex_lock(&s_wall_lock);
+	if (!s_wall.running) {
+		pthread_mutex_unlock(&s_wall_lock);
+		return -ESTD_INVAL;
+	}
+
+	now = lib_clock__wall_measure(&offset);
+	interval = now - status->refreshed_ns;
+	error = offset - status->offset_ns;
+	error_abs = (error < 0) ? (uint64_t)-error : (uint64_t)error;
+
+	if (error_abs >= s_wall.cfg.step_ns) {
+		// the rate of a step says nothing about the drift
+		flags |= LIB_CLOCK_WALL_STEP;
+		status->steps++;
+	}
+	else {
+		if (error_abs > s_wall.cfg.tolerance_ns) {
+			flags |= LIB_CLOCK_WALL_STALE;
+			status->stale_events++;
+		}
+		if (error_abs > status->max_error_ns) {
+			status->max_error_ns = error_abs;
+		}
+		if (interval > 0) {
+			status->drift_ppb = (int64_t)((double)error * 1e9 / (double)interval);
+		}
+	}
+
+	status->offset_ns = offset;
+	status->refreshed_ns = now;
+	status->last_error_ns = error;
+	status->refreshes++;
+
+	atomic_store_explicit(&s_wall_pub.drift_ppb, status->drift_ppb, memory_order_relaxed);
+	atomic_store_explicit(&s_wall_pub.refreshed_ns, now, memory_order_relaxed);
+	atomic_store_explicit(&s_wall_pub.offset_ns, offset, memory_order_release);
+	pthread_mutex_unlock(&s_wall_lock);
+
+	return flags;
+}
+
+/* ************************************************************************//**
+ * \brief	convert a lib_clock__get_time_ns timestamp to realtime
+ * ****************************************************************************/
+uint64_t lib_clock__wall_from_ns(uint64_t _ns)
+{
+	return _ns + (uint64_t)atomic_load_explicit(&s_wall_pub.offset_ns, memory_order_relaxed);
+}
+
+/* ************************************************************************//**
+ * \brief	current realtime from one lib_clock read
+ * ****************************************************************************/
+uint64_t lib_clock__wall_now_ns(void)
+{
+	return lib_clock__wall_from_ns(lib_clock__get_time_ns());
+}
+
+/* ************************************************************************//**
+ * \brief	check whether the cached offset is estimated to be off by more
+ * than the tolerance
+ * ****************************************************************************/
+int lib_clock__wall_is_stale(void)
+{
+	int64_t drift = atomic_load_explicit(&s_wall_pub.drift_ppb, memory_order_relaxed);
+	uint64_t refreshed = atomic_load_explicit(&s_wall_pub.refreshed_ns, memory_order_relaxed);
+	uint64_t age = lib_clock__get_time_ns() - refreshed;
+	double error = (double)((drift < 0) ? -drift : drift) * (double)age / 1e9;
+
+	return (error > (double)s_wall.cfg.tolerance_ns) ? 1 : 0;
+}
+
+/* ************************************************************************//**
+ * \brief	get the state of the mapping
+ * ****************************************************************************/
+int lib_clock__wall_get_status(lib_clock_wall_status_t *_status)
+{
+	if (_status == NULL) {
+		return -ESTD_INVAL;
+	}
+
+	pthread_mutex_lock(&s_wall_lock);
+	*_status = s_wall.status;
+	pthread_mutex_unlock(&s_wall_lock);
+
+	_status->flags = lib_clock__wall_is_stale() ? LIB_CLOCK_WALL_STALE : 0;
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	default realtime source
+ * ****************************************************************************/
+static uint64_t lib_clock__wall_realtime(void *_arg)
+{
+	struct timespec tp;
+
+	(void)_arg;
+	clock_gettime(CLOCK_REALTIME, &tp);
+	return (uint64_t)tp.tv_nsec + (uint64_t)tp.tv_sec * 1000000000ULL;
+}
+
+/* ************************************************************************//**
+ * \brief	measure the realtime offset
+ *
+ * The realtime read is bracketed by two lib_clock reads, the tightest
+ * bracket out of several attempts is used and its midpoint is the
+ * lib_clock time belonging to the realtime reading. The bracket width is
+ * stored as the uncertainty.
+ *
+ * \param	_offset				realtime - lib_clock ns
+ * \return	lib_clock ns of the measurement
+ * ****************************************************************************/
+static uint64_t lib_clock__wall_measure(int64_t *_offset)
+{
+	uint64_t before, after, real, mid = 0, best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < WALL_PAIR_SAMPLES; i++) {
+		before = lib_clock__get_time_ns();
+		real = s_wall.cfg.source(s_wall.cfg.arg);
+		after = lib_clock__get_time_ns();
+
+		if ((after - before) < best) {
+			best = after - before;
+			mid = before + (after - before) / 2;
+			*_offset = (int64_t)(real - mid);
+		}
+	}
+
+	s_wall.status.uncertainty_ns = best;
+	return mid;
+}
+
+/* ************************************************************************//**
+ * \brief	arm the timerfd which is cancelled by a CLOCK_REALTIME change
+ *
+ * The expiry is far in the future, only the cancellation is of interest.
+ * ****************************************************************************/
+static int lib_clock__wall_arm(int _fd)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = INT32_MAX;
+	if (timerfd_settime(_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) != 0) {
+		return -ESTD_FAULT;
+	}
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	refresh thread, waits for the period, a clock set or the stop event
+ * ****************************************************************************/
+static void *lib_clock__wall_thread(void *_arg)
+{
+	struct pollfd fds[2];
+	uint64_t expirations;
+	nfds_t count = 1;
+	int timeout_ms;
+
+	(void)_arg;
+
+	timeout_ms = (int)((s_wall.cfg.refresh_us + 999U) / 1000U);
+
+	fds[0].fd = s_wall.stop_fd;
+	fds[0].events = POLLIN;
+	if (s_wall.set_fd >= 0) {
+		fds[1].fd = s_wall.set_fd;
+		fds[1].events = POLLIN;
+		count = 2;
+	}
+
+	for (;;) {
+		if (poll(fds, count, timeout_ms) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (fds[0].revents & POLLIN) {
+			break;
+		}
+		if ((count == 2) && (fds[1].revents & POLLIN)) {
+			// a clock set cancels the timer, it has to be re-armed
+			if ((read(s_wall.set_fd, &expirations, sizeof(expirations)) < 0) && (errno == ECANCELED)) {
+				lib_clock__wall_arm(s_wall.set_fd);
+			}
+		}
+
+		lib_clock__wall_refresh();
+	}
+
+	return NULL;
+}
@@ -29,8 +29,12 @@
 #include <lib_clock.h>
 #include <lib_convention__errno.h>
 
-/* frame */
-#include <lib_isr.h>
+#ifdef ARCH_STM32SIM
+	#include "sim/lib_clock_stm32sim_hal.h"	// host emulation of TIM4, RCC, PRIMASK and lib_isr
+#else
+	/* frame */
+	#include <lib_isr.h>
+#endif
 
 #ifdef ARCH_STM32F1
 	#include <stm32f1xx.h>
@@ -42,6 +46,8 @@
 	#include <stm32f4xx_hal_rcc.h>		// RCC_* functions
 	#include <stm32f4xx_hal_dma.h>		// Recursively required from tm32f1xx_hal_tim.h
 	#include <stm32f4xx_hal_tim.h>		// TIM_* functions
+#elif ARCH_STM32SIM
+	// HAL subset provided by the simulation
 #else
 	#error No Architecture is set at lib_clock
 #endif
@@ -50,12 +56,13 @@
  * defines
  * ******************************************************************/
 
-static inline __attribute__((always_inline)) void __DISABLE_IRQ(void)
-{__asm volatile("CPSID i");}
-
-/*enable all interrupts*/
-static inline __attribute__((always_inline)) void __ENABLE_IRQ(void)
-{__asm volatile("CPSIE i");}
+#ifdef ARCH_STM32SIM
+/*access of the timer counter register, advances the simulated time*/
+#define JF_CNT_REG(_reg)	LIB_CLOCK_SIM_REG(_reg)
+#else
+/*access of the timer counter register*/
+#define JF_CNT_REG(_reg)	(_reg)
+#endif
 
 #define JF_TIM_TIMER		  TIM4;
 #define JF_MAX_TIM_VALUE      (0xFFFF)    // 16bit counters
@@ -74,22 +81,41 @@ typedef struct {
 	jiffy_t     jpus;          // Variable for the delay function
 }jf_t;
 
+/* Multiplication by a rational factor without division: integral part
+ * plus a 0.32 fixed-point fraction */
+typedef struct {
+	uint32_t	integ;
+	uint32_t	frac;
+} jf_scale_t;
+
 /* *******************************************************************
  * static function declarations
  * ******************************************************************/
 static int lib_clock__jf_init (jf_t *_jf, uint32_t _jf_freq, uint32_t _jiffies);
-static int lib_clock__jf_check_usec (int32_t _usec);
-static jiffy_t lib_clock__jf_per_usec (jf_t *_jf);
+static int32_t lib_clock__jf_per_usec (jf_t *_jf);
 static int lib_clock__jf_timer_setfreq (jf_t *_jf, uint32_t _jf_freq, uint32_t _jiffies);
 static void lib_clock__jf_timer_event(IRQn_Type _isr_vector, unsigned int _vector, void *_arg);
+static uint64_t lib_clock__jf_ticks(void);
+static uint64_t lib_clock__jf_overflow_ticks(void);
+static uint64_t lib_clock__jf_sleep_until(uint64_t _ticks);
+static void lib_clock__periodic_advance(lib_clock_periodic_t *_hdl, uint64_t _periods);
+static void lib_clock__jf_scale_init(jf_scale_t *_scale, uint64_t _num, uint64_t _den);
+static inline uint64_t lib_clock__jf_scale(uint64_t _x, const jf_scale_t *_scale);
 
 /* *******************************************************************
  * (static) variables declarations
  * ******************************************************************/
 static jf_t s_jf;
 static lib_isr_hdl_t s_jf_isr;
-static unsigned int s_milliseconds_ticks;
-static uint64_t s_milliseconds_ticks_64bits;
+static volatile uint32_t s_milliseconds_ticks;
+static volatile uint64_t s_jf_overflows;	// number of TIM4 update events
+static volatile uint32_t s_jf_gen;			// incremented by every update interrupt, guards the readers
+static uint32_t s_jf_period_ms;				// length of a timer period, whole milliseconds
+static uint32_t s_jf_period_rem_ns;			// and the remaining nanoseconds
+static uint32_t s_ms_rem_ns;				// nanoseconds not yet counted in s_milliseconds_ticks
+static jf_scale_t s_tick_ns;				// nanoseconds per timer tick
+static jf_scale_t s_tick_us;				// microseconds per timer tick
+static jf_scale_t s_ns_tick;				// timer ticks per nanosecond
 
 /* ************************************************************************//**
  * \brief	Initialization of the timing module
@@ -101,16 +127,32 @@ static uint64_t s_milliseconds_ticks_64bits;
  * ****************************************************************************/
 int lib_clock__init(void)
 {
+	uint64_t period_ns;
 	int ret;
-	s_milliseconds_ticks_64bits = 0;
 	s_milliseconds_ticks = 0;
+	s_jf_overflows = 0;
+	s_jf_gen = 0;
+	s_ms_rem_ns = 0;
 
 	ret = lib_isr__attach(&s_jf_isr,TIM4_IRQn,&lib_clock__jf_timer_event, NULL);
 	if (ret < EOK) {
 		return -ESTD_FAULT;
 	}
 
-	lib_clock__jf_init(&s_jf,1000000, 1000);  // 1MHz timer, 1000 counts, 1 usec per count
+	ret = lib_clock__jf_init(&s_jf,1000000, 1000);  // 1MHz timer, 1000 counts, 1 usec per count
+	if (ret < EOK) {
+		return ret;
+	}
+
+	// resolve all factors from the real timer frequency once, neither the
+	// accessors nor the interrupt divide
+	lib_clock__jf_scale_init(&s_tick_ns, 1000000000ULL, s_jf.freq);
+	lib_clock__jf_scale_init(&s_tick_us, 1000000ULL, s_jf.freq);
+	lib_clock__jf_scale_init(&s_ns_tick, s_jf.freq, 1000000000ULL);
+
+	period_ns = ((uint64_t)s_jf.jiffies * 1000000000ULL) / s_jf.freq;
+	s_jf_period_ms = (uint32_t)(period_ns / 1000000ULL);
+	s_jf_period_rem_ns = (uint32_t)(period_ns % 1000000ULL);
 	return EOK;
 }
 
@@ -134,16 +176,7 @@ uint32_t lib_clock__get_time_ms(void)
  * ****************************************************************************/
 uint64_t lib_clock__get_time_ns(void)
 {
-	uint64_t ns;
-
-	__DISABLE_IRQ();
-	ns = s_milliseconds_ticks_64bits * 1000000ULL;
-	if (s_jf.value) {
-		ns += *((uint64_t*)s_jf.value) * 1000ULL;
-	}
-	__ENABLE_IRQ();
-
-	return ns;
+	return lib_clock__jf_scale(lib_clock__jf_ticks(), &s_tick_ns);
 }
 
 /* ************************************************************************//**
@@ -153,16 +186,7 @@ uint64_t lib_clock__get_time_ns(void)
  * ****************************************************************************/
 uint64_t lib_clock__get_time_us(void)
 {
-	uint64_t us;
-
-	__DISABLE_IRQ();
-	us = s_milliseconds_ticks_64bits * 1000ULL;
-	if (s_jf.value) {
-		us += *s_jf.value;
-	}
-	__ENABLE_IRQ();
-	return us;
-
+	return lib_clock__jf_scale(lib_clock__jf_ticks(), &s_tick_us);
 }
 
 /* ************************************************************************//**
@@ -183,29 +207,234 @@ uint32_t lib_clock__get_time_since_ms(uint32_t _lasttime)
  * ****************************************************************************/
 void lib_clock__delay_us(uint32_t _delay)
 {
-	jiffy_t m, m2, m1 = *s_jf.value;
-
-	_delay *= s_jf.jpus;
-	if (*s_jf.value - m1 > _delay) // Very small delays will return here.
-		return;
+	jiffy_t m, m2, m1 = *JF_CNT_REG(s_jf.value);
+	int64_t remain = (int64_t)_delay * s_jf.jpus + 1;
 
 	// Delay loop: Eat the time difference from usec value.
-	while (_delay > 0) {
-		m2 = *s_jf.value;
+	// The first read lands anywhere inside a tick, one edge more than the
+	// delay keeps a partial first tick from making the delay short.
+	// An unchanged counter is no wrap around, and the remainder is signed,
+	// a step larger than the rest must not underflow into a huge delay.
+	while (remain > 0) {
+		m2 = *JF_CNT_REG(s_jf.value);
 	    m = m2 - m1;
-	    _delay -= (m>0) ? m : s_jf.jiffies + m;
+	    remain -= (m >= 0) ? m : (int32_t)s_jf.jiffies + m;
 	    m1 = m2;
 	}
 }
 
+/* ************************************************************************//**
+ * \brief	set up a periodic timer
+ *
+ * The deadlines are absolute TIM4 tick values.
+ *
+ * \param	_hdl				periodic timer handle
+ * \param	_period_us			period in microseconds
+ * \return	EOK on success, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__periodic_init(lib_clock_periodic_t *_hdl, uint32_t _period_us)
+{
+	if ((_hdl == NULL) || (_period_us == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	// exact in millionths of a tick, a truncated period drifts by every wait
+	_hdl->period = ((uint64_t)_period_us * s_jf.freq) / 1000000ULL;
+	_hdl->period_rem = (uint32_t)(((uint64_t)_period_us * s_jf.freq) % 1000000ULL);
+	if (_hdl->period == 0) {
+		return -ESTD_INVAL;
+	}
+
+	_hdl->next = lib_clock__get_clock_ticks();
+	_hdl->next_rem = 0;
+	lib_clock__periodic_advance(_hdl, 1);
+	_hdl->periods = 0;
+	_hdl->missed = 0;
+	_hdl->max_lateness_ns = 0;
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	block until the next deadline of a periodic timer
+ *
+ * The core sleeps with WFI. Whole timer periods are bridged by the update
+ * interrupt, the final part by a TIM4 channel 1 compare match on the
+ * deadline.
+ *
+ * \param	_hdl				periodic timer handle
+ * \return	number of periods missed before this wait, negative error code otherwise
+ * ****************************************************************************/
+int lib_clock__periodic_wait(lib_clock_periodic_t *_hdl)
+{
+	uint64_t now, missed = 0, lateness;
+
+	if ((_hdl == NULL) || (_hdl->period == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	// skip complete periods which were overrun, the phase stays intact
+	now = lib_clock__get_clock_ticks();
+	if (now >= _hdl->next + _hdl->period) {
+		missed = (now - _hdl->next) / _hdl->period;
+		lib_clock__periodic_advance(_hdl, missed);
+		_hdl->missed += missed;
+	}
+
+	// update interrupts wake the core at least once per timer period
+	if (_hdl->next > s_jf.jiffies) {
+		lib_clock__jf_sleep_until(_hdl->next - s_jf.jiffies);
+	}
+
+	// arm the compare channel on the deadline within the last timer period
+	__HAL_TIM_SET_COMPARE(&s_jf.timer_hdl, TIM_CHANNEL_1, (uint32_t)(_hdl->next % s_jf.jiffies));
+	__HAL_TIM_CLEAR_FLAG(&s_jf.timer_hdl, TIM_FLAG_CC1);
+	__HAL_TIM_ENABLE_IT(&s_jf.timer_hdl, TIM_IT_CC1);
+
+	now = lib_clock__jf_sleep_until(_hdl->next);
+	__HAL_TIM_DISABLE_IT(&s_jf.timer_hdl, TIM_IT_CC1);
+
+	lateness = lib_clock__ticks_to_ns(now - _hdl->next);
+	if (lateness > _hdl->max_lateness_ns) {
+		_hdl->max_lateness_ns = lateness;
+	}
+
+	lib_clock__periodic_advance(_hdl, 1);
+	_hdl->periods++;
+
+	return (missed > (uint64_t)INT32_MAX) ? INT32_MAX : (int)missed;
+}
+
 /* ************************************************************************//**
  * \brief	get clock ticks since system startup
  *
+ * The ticks are the TIM4 counts, extended to 64bit by the overflow count.
+ *
  * \return	number of clock ticks as 64bit value
  * ****************************************************************************/
 uint64_t lib_clock__get_clock_ticks(void)
 {
+	return lib_clock__jf_ticks();
+}
+
+/* ************************************************************************//**
+ * \brief	convert a number of clock ticks to nanoseconds
+ *
+ * \param	_ticks				number of clock ticks
+ * \return	duration in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__ticks_to_ns(uint64_t _ticks)
+{
+	return lib_clock__jf_scale(_ticks, &s_tick_ns);
+}
+
+/* ************************************************************************//**
+ * \brief	convert nanoseconds to a number of clock ticks
+ *
+ * Multiplication with the fixed-point tick rate, no division.
+ *
+ * \param	_ns					duration in nanoseconds
+ * \return	number of clock ticks
+ * ****************************************************************************/
+uint64_t lib_clock__ns_to_ticks(uint64_t _ns)
+{
+	return lib_clock__jf_scale(_ns, &s_ns_tick);
+}
+
+/* ************************************************************************//**
+ * \brief	get the frequency of the clock ticks
+ *
+ * \return	clock ticks per second
+ * ****************************************************************************/
+uint64_t lib_clock__get_tick_freq(void)
+{
+	return s_jf.freq;
+}
 
+/* ************************************************************************//**
+ * \brief	get the factors behind the tick conversions
+ *
+ * The integral part and the 0.32 fraction of a scale form a 32.32
+ * fixed-point factor.
+ *
+ * \param	_to_ns				ticks -> ns factor, may be NULL
+ * \param	_to_ticks			ns -> ticks factor, may be NULL
+ * ****************************************************************************/
+void lib_clock__get_tick_conv(lib_clock_tick_conv_t *_to_ns, lib_clock_tick_conv_t *_to_ticks)
+{
+	if (_to_ns != NULL) {
+		_to_ns->mult = ((uint64_t)s_tick_ns.integ << 32) | s_tick_ns.frac;
+		_to_ns->shift = 32;
+	}
+	if (_to_ticks != NULL) {
+		_to_ticks->mult = ((uint64_t)s_ns_tick.integ << 32) | s_ns_tick.frac;
+		_to_ticks->shift = 32;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	start the background ticker of the cached clock
+ *
+ * The millisecond counter maintained by the TIM4 overflow interrupt is
+ * already a cached clock, no ticker is necessary.
+ *
+ * \param	_period_us			ignored
+ * \return	EOK
+ * ****************************************************************************/
+int lib_clock__cached_start(uint32_t _period_us)
+{
+	(void)_period_us;
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	stop the background ticker of the cached clock
+ *
+ * \return	EOK
+ * ****************************************************************************/
+int lib_clock__cached_stop(void)
+{
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	worst observed gap between two updates of the cached clock
+ *
+ * \return	period of the overflow interrupt in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__cached_max_staleness_ns(void)
+{
+	return 1000000ULL;
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in nanoseconds
+ *
+ * \return	time of the last counter overflow in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_ns(void)
+{
+	return lib_clock__jf_scale(lib_clock__jf_overflow_ticks(), &s_tick_ns);
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in microseconds
+ *
+ * \return	time of the last counter overflow in microseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_us(void)
+{
+	return lib_clock__jf_scale(lib_clock__jf_overflow_ticks(), &s_tick_us);
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in milliseconds
+ *
+ * \return	millisecond counter
+ * ****************************************************************************/
+uint32_t lib_clock__get_cached_time_ms(void)
+{
+	return s_milliseconds_ticks;
 }
 
 
@@ -218,51 +447,18 @@ static int lib_clock__jf_init (jf_t *_jf, uint32_t _jf_freq, uint32_t _jiffies)
     	return ret;
     }
     _jf->jiffies = _jiffies;
-    _jf->freq = _jf_freq;
     _jf->jpus = lib_clock__jf_per_usec (_jf);
    return EOK;
 }
 
 
-/*!
- * \brief
- *    A code based polling version delay implementation, using jiffies for timing.
- *    This is NOT accurate but it ensures that the time passed is always
- *    more than the requested value.
- *    The delay values are multiplications of 1 usec.
- * \param
- *    usec     Time in usec for delay
- */
- static int lib_clock__jf_check_usec (int32_t _usec)
- {
-   static jiffy_t m1=-1, cnt;
-   jiffy_t m, m2;
-
-   if (m1 == -1) {
-      m1 = *s_jf.value;
-      cnt = s_jf.jpus * _usec;
-   }
-
-   if (cnt>0) {
-      m2 = *s_jf.value;
-      m = m2-m1;
-      cnt-= (m>0) ? m : s_jf.jiffies + m;
-      m1 = m2;
-      return 1;   // wait
-   }
-   else {
-      m1 = -1;
-      return 0;   // do not wait any more
-   }
-}
-
  // Return the systems best approximation for jiffies per usec
- static jiffy_t lib_clock__jf_per_usec (jf_t *_jf)
+ static int32_t lib_clock__jf_per_usec (jf_t *_jf)
  {
-    jiffy_t jf = _jf->freq / 1000000;
+    uint32_t jf = _jf->freq / 1000000;
 
     if (jf <= _jf->jiffies)
-       return jf;
+       return (int32_t)jf;
     else
        // We can not count beyond timer's reload
        return 0;
@@ -288,11 +484,15 @@ static int lib_clock__jf_timer_setfreq (jf_t *_jf, uint32_t _jf_freq, uint32_t _
 	else
 		Ftim_Hz = HAL_RCC_GetPCLK2Freq();
 
+	if ((_jf_freq == 0) || (_jf_freq > (uint32_t)Ftim_Hz) || (_jiffies == 0) || (_jiffies > JF_MAX_TIM_VALUE + 1)) {
+		return -ESTD_INVAL;
+	}
+
 	/* setup Timer 4 for counting mode */
 	/* Time Base configuration */
-	init_arg.Prescaler 			= Ftim_Hz /_jf_freq ;										// Specifies the prescaler value used to divide the TIM clock. (0 = div by 1) This parameter can be a number between 0x0000 and 0xFFFF
+	init_arg.Prescaler 			= (Ftim_Hz /_jf_freq) - 1;									// Specifies the prescaler value used to divide the TIM clock. (0 = div by 1) This parameter can be a number between 0x0000 and 0xFFFF
 	init_arg.CounterMode 		= TIM_COUNTERMODE_UP;
-	init_arg.Period 			= _jiffies & JF_MAX_TIM_VALUE;						// Auto reload register (upcounting mode => reset cnt when value is hit, and throw an overflow interrupt)
+	init_arg.Period 			= (_jiffies - 1) & JF_MAX_TIM_VALUE;				// Auto reload register (upcounting mode => reset cnt when value is hit, and throw an overflow interrupt), counts 0.._jiffies-1
 	init_arg.ClockDivision 		= TIM_CLOCKDIVISION_DIV1;		// not available for TIM6 and 7 => will be ignored
 	init_arg.RepetitionCounter 	= 0;							// start with 0 again after overflow
 
@@ -302,6 +502,9 @@ static int lib_clock__jf_timer_setfreq (jf_t *_jf, uint32_t _jf_freq, uint32_t _
 	HAL_TIM_Base_Init(&_jf->timer_hdl);
 	_jf->value = (jiffy_t*) &_jf->timer_hdl.Instance->CNT;
 
+	// the resolution is the real counting rate, the prescaler divides by integers only
+	_jf->freq = (uint32_t)Ftim_Hz / (init_arg.Prescaler + 1);
+
 	__HAL_TIM_CLEAR_FLAG(&_jf->timer_hdl, TIM_IT_UPDATE | TIM_IT_CC1 | TIM_IT_CC2 | TIM_IT_CC3 | TIM_IT_CC4);
 	__HAL_TIM_ENABLE(&_jf->timer_hdl);
 	__HAL_TIM_ENABLE_IT(&_jf->timer_hdl, TIM_IT_UPDATE);
@@ -312,15 +515,157 @@ static int lib_clock__jf_timer_setfreq (jf_t *_jf, uint32_t _jf_freq, uint32_t _
 
 static void lib_clock__jf_timer_event(IRQn_Type _isr_vector, unsigned int _vector, void *_arg)
 {
-	unsigned int tick_time = 0;
+	(void)_isr_vector;
+	(void)_vector;
+	(void)_arg;
+
+	// compare match of a periodic deadline, it only has to wake the waiter
+	if (__HAL_TIM_GET_FLAG(&s_jf.timer_hdl, TIM_FLAG_CC1) && __HAL_TIM_GET_IT_SOURCE(&s_jf.timer_hdl, TIM_IT_CC1)) {
+		__HAL_TIM_DISABLE_IT(&s_jf.timer_hdl, TIM_IT_CC1);
+		__HAL_TIM_CLEAR_FLAG(&s_jf.timer_hdl, TIM_FLAG_CC1);
+	}
 
-	if (s_jf.freq) {
-		tick_time = (s_jf.jiffies * 1000.0)/s_jf.freq;
+	if (!__HAL_TIM_GET_FLAG(&s_jf.timer_hdl, TIM_FLAG_UPDATE)) {
+		return;
+	}
+
+	// integer only, the period is split into milliseconds and a remainder at init
+	s_milliseconds_ticks += s_jf_period_ms;
+	s_ms_rem_ns += s_jf_period_rem_ns;
+	if (s_ms_rem_ns >= 1000000UL) {
+		s_ms_rem_ns -= 1000000UL;
+		s_milliseconds_ticks++;
 	}
-	s_milliseconds_ticks += tick_time;
-	s_milliseconds_ticks_64bits += tick_time;
-	 __HAL_TIM_CLEAR_FLAG(&s_jf.timer_hdl, TIM_IT_UPDATE);
 
+	// readers in higher priority interrupts must not see the new count
+	// together with the still pending flag, the update is masked
+	__disable_irq();
+	s_jf_overflows++;
+	__HAL_TIM_CLEAR_FLAG(&s_jf.timer_hdl, TIM_IT_UPDATE);
+	// publish last, readers which overlapped this interrupt retry
+	s_jf_gen++;
+	__enable_irq();
+}
+
+/* ************************************************************************//**
+ * \brief	lock-free read of the 64bit tick count
+ *
+ * Interrupts stay enabled. The overflow count and the counter register are
+ * read between two samples of the interrupt generation, a changed
+ * generation means the overflow interrupt preempted the read and it is
+ * repeated. A wrap which is flagged but not yet served by the interrupt
+ * (interrupt latency, or a caller running with interrupts masked) is
+ * accounted for by the pending update flag. This requires the interrupt
+ * to be served within half a timer period. The interrupt updates the
+ * count and the flag with interrupts masked, so a reader in a higher
+ * priority interrupt sees either both old or both new.
+ *
+ * \return	number of timer ticks since lib_clock__init
+ * ****************************************************************************/
+static uint64_t lib_clock__jf_ticks(void)
+{
+	uint64_t overflows;
+	uint32_t gen, cnt;
+	int pending;
+
+	do {
+		gen = s_jf_gen;
+		overflows = s_jf_overflows;
+		cnt = (uint16_t)*JF_CNT_REG(s_jf.value);
+		pending = __HAL_TIM_GET_FLAG(&s_jf.timer_hdl, TIM_FLAG_UPDATE);
+	} while (gen != s_jf_gen);
+
+	// a small count with the flag set has wrapped after the last interrupt,
+	// a large one was read before a wrap that just happened
+	if (pending && (cnt < s_jf.jiffies / 2)) {
+		overflows++;
+	}
+
+	return overflows * s_jf.jiffies + cnt;
+}
+
+/* ************************************************************************//**
+ * \brief	tick count at the last served counter overflow
+ * ****************************************************************************/
+static uint64_t lib_clock__jf_overflow_ticks(void)
+{
+	uint64_t overflows;
+	uint32_t gen;
+
+	do {
+		gen = s_jf_gen;
+		overflows = s_jf_overflows;
+	} while (gen != s_jf_gen);
+
+	return overflows * s_jf.jiffies;
+}
+
+/* ************************************************************************//**
+ * \brief	sleep with WFI until the tick count reached _ticks
+ *
+ * The check and the WFI run with interrupts masked. An interrupt which
+ * arrives after the check stays pending and ends the WFI, it is served
+ * on the unmask, the wakeup cannot be lost between check and sleep.
+ *
+ * \return	tick count which ended the sleep
+ * ****************************************************************************/
+static uint64_t lib_clock__jf_sleep_until(uint64_t _ticks)
+{
+	uint64_t now;
+
+	for (;;) {
+		__disable_irq();
+		now = lib_clock__jf_ticks();
+		if (now >= _ticks) {
+			__enable_irq();
+			return now;
+		}
+		__WFI();
+		__enable_irq();
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	move the deadline of a periodic timer by whole periods
+ *
+ * The fractional tick of each period is collected in next_rem, a whole
+ * tick is carried into the deadline.
+ * ****************************************************************************/
+static void lib_clock__periodic_advance(lib_clock_periodic_t *_hdl, uint64_t _periods)
+{
+	uint64_t rem = _periods * _hdl->period_rem + _hdl->next_rem;
+
+	_hdl->next += _periods * _hdl->period + rem / 1000000ULL;
+	_hdl->next_rem = (uint32_t)(rem % 1000000ULL);
+}
+
+/* ************************************************************************//**
+ * \brief	set up a division-free scaling factor of _num / _den
+ *
+ * The fraction is rounded up, so exact multiples of _den are not truncated
+ * by one, e.g. one second converts to exactly 1000000 ticks at 1MHz.
+ * ****************************************************************************/
+static void lib_clock__jf_scale_init(jf_scale_t *_scale, uint64_t _num, uint64_t _den)
+{
+	uint64_t frac = (((_num % _den) << 32) + _den - 1) / _den;
+
+	_scale->integ = (uint32_t)(_num / _den);
+	if (frac > 0xFFFFFFFFULL) {
+		_scale->integ++;
+		frac = 0;
+	}
+	_scale->frac = (uint32_t)frac;
+}
+
+/* ************************************************************************//**
+ * \brief	multiply with a scaling factor, the fraction with a 64x32 multiply-high
+ * ****************************************************************************/
+static inline uint64_t lib_clock__jf_scale(uint64_t _x, const jf_scale_t *_scale)
+{
+	uint64_t hi = (_x >> 32) * _scale->frac;
+	uint64_t lo = ((_x & 0xFFFFFFFFULL) * _scale->frac) >> 32;
+
+	return _x * _scale->integ + hi + lo;
 }
 
 
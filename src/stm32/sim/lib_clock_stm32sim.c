@@ -0,0 +1,522 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stddef.h>
+#include <string.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock_stm32sim_hal.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define SIM_DEFAULT_CORE_HZ			72000000U
+#define SIM_DEFAULT_ACCESS_CYCLES	4U
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef struct {
+	lib_clock_sim_cfg_t		cfg;
+	lib_clock_sim_stats_t	stats;
+	uint64_t		now;			// simulated core cycles
+	uint64_t		synced_at;		// cycle of the last timer update
+	int				running;		// counter enabled
+	uint64_t		enable_at;		// cycle the counter was started
+	uint64_t		ticks;			// counter ticks processed so far
+	uint64_t		uif_at;			// cycle the update flag was raised
+	uint64_t		cc1_at;			// cycle the compare flag was raised
+	int				masked;			// PRIMASK
+	uint64_t		masked_at;
+	int				in_isr;
+	int				nvic_pending;	// interrupt latched by the NVIC
+	uint64_t		event_at;		// cycle of the event which latched it
+	uint64_t		due_at;			// event_at plus the injected latency
+	uint32_t		rng;
+	lib_isr_hdl_t	*isr;
+	uint32_t		nested_every;	// register accesses between nested reader interrupts
+	uint32_t		nested_count;
+	int				in_nested;
+	lib_clock_sim_nested_cb_t	nested_cb;
+	void			*nested_arg;
+} sim_state_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void lib_clock__sim_advance(uint64_t _target);
+static void lib_clock__sim_timer_update(void);
+static uint64_t lib_clock__sim_next_event(void);
+static int lib_clock__sim_deliverable(void);
+static void lib_clock__sim_isr(void);
+static uint64_t lib_clock__sim_first_hit(uint64_t _after, uint64_t _rem, uint64_t _period);
+static uint64_t lib_clock__sim_hits(uint64_t _after, uint64_t _upto, uint64_t _rem, uint64_t _period);
+static uint32_t lib_clock__sim_random(void);
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+TIM_TypeDef g_lib_clock_sim_tim4;
+RCC_TypeDef g_lib_clock_sim_rcc;
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static sim_state_t s_sim = {
+	.cfg = {
+		.core_hz = SIM_DEFAULT_CORE_HZ,
+		.access_cycles = SIM_DEFAULT_ACCESS_CYCLES,
+		.seed = 1
+	},
+	.rng = 1
+};
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	reset the simulated microcontroller
+ * ****************************************************************************/
+int lib_clock__sim_configure(const lib_clock_sim_cfg_t *_cfg)
+{
+	if ((_cfg == NULL) || (_cfg->core_hz == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	memset(&s_sim, 0, sizeof(s_sim));
+	memset(&g_lib_clock_sim_tim4, 0, sizeof(g_lib_clock_sim_tim4));
+	memset(&g_lib_clock_sim_rcc, 0, sizeof(g_lib_clock_sim_rcc));
+
+	s_sim.cfg = *_cfg;
+	// a polling loop on the counter has to make progress
+	if (s_sim.cfg.access_cycles == 0) {
+		s_sim.cfg.access_cycles = 1;
+	}
+	s_sim.rng = s_sim.cfg.seed ? s_sim.cfg.seed : 1;
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	let the simulated main code execute for a number of core cycles
+ * ****************************************************************************/
+void lib_clock__sim_run(uint64_t _cycles)
+{
+	lib_clock__sim_advance(s_sim.now + _cycles);
+}
+
+/* ************************************************************************//**
+ * \brief	simulated time in core cycles
+ * ****************************************************************************/
+uint64_t lib_clock__sim_cycles(void)
+{
+	return s_sim.now;
+}
+
+/* ************************************************************************//**
+ * \brief	exact simulated time in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__sim_time_ns(void)
+{
+	uint64_t hz = s_sim.cfg.core_hz;
+
+	return (s_sim.now / hz) * 1000000000ULL + ((s_sim.now % hz) * 1000000000ULL) / hz;
+}
+
+/* ************************************************************************//**
+ * \brief	read the event counters of the simulation
+ * ****************************************************************************/
+void lib_clock__sim_get_stats(lib_clock_sim_stats_t *_stats)
+{
+	if (_stats != NULL) {
+		*_stats = s_sim.stats;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	install a nested reader
+ * ****************************************************************************/
+void lib_clock__sim_set_nested(uint32_t _every, lib_clock_sim_nested_cb_t _cb, void *_arg)
+{
+	s_sim.nested_every = (_cb != NULL) ? _every : 0;
+	s_sim.nested_cb = _cb;
+	s_sim.nested_arg = _arg;
+	s_sim.nested_count = 0;
+}
+
+/* ************************************************************************//**
+ * \brief	one access of a timer register
+ *
+ * The nested reader preempts right before the access, it does not nest
+ * into itself.
+ * ****************************************************************************/
+void lib_clock__sim_sync(void)
+{
+	if (s_sim.nested_every && !s_sim.masked && !s_sim.in_nested
+		&& (++s_sim.nested_count >= s_sim.nested_every)) {
+		s_sim.nested_count = 0;
+		s_sim.stats.nested_irqs++;
+		s_sim.in_nested = 1;
+		s_sim.nested_cb(s_sim.nested_arg);
+		s_sim.in_nested = 0;
+	}
+
+	s_sim.stats.register_reads++;
+	lib_clock__sim_advance(s_sim.now + s_sim.cfg.access_cycles);
+}
+
+/* ************************************************************************//**
+ * \brief	wait for interrupt
+ *
+ * Like the core, a pending interrupt also ends the wait while interrupts
+ * are masked, the ISR then runs on the next unmask. The core wakes at the
+ * due time of the interrupt in both cases.
+ * ****************************************************************************/
+void lib_clock__sim_wfi(void)
+{
+	uint64_t irqs = s_sim.stats.irqs;
+	uint64_t next;
+
+	for (;;) {
+		lib_clock__sim_timer_update();
+
+		if (s_sim.nvic_pending) {
+			lib_clock__sim_advance((s_sim.due_at > s_sim.now) ? s_sim.due_at : s_sim.now);
+			return;
+		}
+
+		next = lib_clock__sim_next_event();
+		if (next == UINT64_MAX) {
+			// nothing could ever wake the core
+			return;
+		}
+
+		lib_clock__sim_advance(next);
+		if (s_sim.stats.irqs != irqs) {
+			return;
+		}
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	CPSID i
+ * ****************************************************************************/
+void lib_clock__sim_irq_disable(void)
+{
+	if (!s_sim.masked) {
+		s_sim.masked = 1;
+		s_sim.masked_at = s_sim.now;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	CPSIE i, a pending interrupt is taken immediately
+ * ****************************************************************************/
+void lib_clock__sim_irq_enable(void)
+{
+	uint64_t masked;
+
+	if (!s_sim.masked) {
+		return;
+	}
+
+	masked = s_sim.now - s_sim.masked_at;
+	s_sim.stats.masked_cycles += masked;
+	if (masked > s_sim.stats.max_masked_cycles) {
+		s_sim.stats.max_masked_cycles = masked;
+	}
+	s_sim.masked = 0;
+
+	lib_clock__sim_advance(s_sim.now);
+}
+
+/* ************************************************************************//**
+ * \brief	set the counter enable bit
+ * ****************************************************************************/
+void lib_clock__sim_tim_enable(TIM_TypeDef *_tim)
+{
+	_tim->CR1 |= TIM_CR1_CEN;
+	_tim->CNT = 0;
+
+	s_sim.running = 1;
+	s_sim.enable_at = s_sim.now;
+	s_sim.synced_at = s_sim.now;
+	s_sim.ticks = 0;
+}
+
+/* ************************************************************************//**
+ * \brief	time base setup, like the HAL it generates an update event
+ * ****************************************************************************/
+int HAL_TIM_Base_Init(TIM_HandleTypeDef *_htim)
+{
+	if ((_htim == NULL) || (_htim->Instance == NULL)) {
+		return 1;
+	}
+
+	_htim->Instance->PSC = _htim->Init.Prescaler & 0xFFFFU;
+	_htim->Instance->ARR = _htim->Init.Period & 0xFFFFU;
+	_htim->Instance->CNT = 0;
+	_htim->Instance->SR |= TIM_FLAG_UPDATE;
+	s_sim.uif_at = s_sim.now;
+
+	if (s_sim.running) {
+		s_sim.enable_at = s_sim.now;
+		s_sim.ticks = 0;
+	}
+
+	return 0;
+}
+
+/* ************************************************************************//**
+ * \brief	APB1 runs at half the core clock
+ * ****************************************************************************/
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return s_sim.cfg.core_hz / 2;
+}
+
+/* ************************************************************************//**
+ * \brief	APB2 runs at the core clock, it is also the timer clock
+ * ****************************************************************************/
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+	return s_sim.cfg.core_hz;
+}
+
+/* ************************************************************************//**
+ * \brief	attach the handler of the simulated timer interrupt
+ * ****************************************************************************/
+int lib_isr__attach(lib_isr_hdl_t *_hdl, IRQn_Type _vector, lib_isr_cb_t _cb, void *_arg)
+{
+	if ((_hdl == NULL) || (_cb == NULL) || (_vector != TIM4_IRQn)) {
+		return -ESTD_INVAL;
+	}
+
+	_hdl->vector = _vector;
+	_hdl->cb = _cb;
+	_hdl->arg = _arg;
+	s_sim.isr = _hdl;
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	advance the simulated time, delivering interrupts on their due time
+ * ****************************************************************************/
+static void lib_clock__sim_advance(uint64_t _target)
+{
+	uint64_t next;
+
+	for (;;) {
+		lib_clock__sim_timer_update();
+
+		if (lib_clock__sim_deliverable()) {
+			lib_clock__sim_isr();
+			continue;
+		}
+
+		if (s_sim.now >= _target) {
+			break;
+		}
+
+		// step from event to event, so flags and latencies are exact
+		next = lib_clock__sim_next_event();
+		s_sim.now = (next < _target) ? next : _target;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	bring the timer registers and flags up to the current time
+ * ****************************************************************************/
+static void lib_clock__sim_timer_update(void)
+{
+	TIM_TypeDef *tim = &g_lib_clock_sim_tim4;
+	uint64_t psc, period, ticks, hits, first, latency;
+	uint32_t pending;
+
+	if (s_sim.running) {
+		psc = (uint64_t)tim->PSC + 1;
+		period = (uint64_t)tim->ARR + 1;
+		ticks = (s_sim.now - s_sim.enable_at) / psc;
+
+		if (ticks > s_sim.ticks) {
+			hits = lib_clock__sim_hits(s_sim.ticks, ticks, 0, period);
+			if (hits) {
+				s_sim.stats.update_events += hits;
+				if (tim->SR & TIM_FLAG_UPDATE) {
+					s_sim.stats.lost_updates += hits;
+				}
+				else {
+					s_sim.stats.lost_updates += hits - 1;
+					first = lib_clock__sim_first_hit(s_sim.ticks, 0, period);
+					s_sim.uif_at = s_sim.enable_at + first * psc;
+					tim->SR |= TIM_FLAG_UPDATE;
+				}
+			}
+
+			if ((tim->CCR1 <= tim->ARR) && !(tim->SR & TIM_FLAG_CC1)
+				&& lib_clock__sim_hits(s_sim.ticks, ticks, tim->CCR1, period)) {
+				first = lib_clock__sim_first_hit(s_sim.ticks, tim->CCR1, period);
+				s_sim.cc1_at = s_sim.enable_at + first * psc;
+				tim->SR |= TIM_FLAG_CC1;
+			}
+
+			s_sim.ticks = ticks;
+		}
+
+		tim->CNT = (uint32_t)(ticks % period);
+	}
+
+	// latch the interrupt line, an enable after the flag counts from the sync
+	pending = tim->SR & tim->DIER & (TIM_IT_UPDATE | TIM_IT_CC1);
+	if (pending && !s_sim.nvic_pending) {
+		s_sim.event_at = UINT64_MAX;
+		if ((pending & TIM_IT_UPDATE) && (s_sim.uif_at < s_sim.event_at)) {
+			s_sim.event_at = s_sim.uif_at;
+		}
+		if ((pending & TIM_IT_CC1) && (s_sim.cc1_at < s_sim.event_at)) {
+			s_sim.event_at = s_sim.cc1_at;
+		}
+		if (s_sim.event_at < s_sim.synced_at) {
+			s_sim.event_at = s_sim.synced_at;
+		}
+
+		latency = s_sim.cfg.irq_latency_cycles;
+		if (s_sim.cfg.irq_jitter_cycles) {
+			latency += lib_clock__sim_random() % (s_sim.cfg.irq_jitter_cycles + 1U);
+		}
+		s_sim.due_at = s_sim.event_at + latency;
+		s_sim.nvic_pending = 1;
+	}
+
+	s_sim.synced_at = s_sim.now;
+}
+
+/* ************************************************************************//**
+ * \brief	cycle of the next timer event or interrupt delivery after now
+ * ****************************************************************************/
+static uint64_t lib_clock__sim_next_event(void)
+{
+	TIM_TypeDef *tim = &g_lib_clock_sim_tim4;
+	uint64_t next = UINT64_MAX, psc, period, at;
+
+	if (s_sim.nvic_pending && !s_sim.masked && !s_sim.in_isr && !s_sim.in_nested && (s_sim.due_at > s_sim.now)) {
+		next = s_sim.due_at;
+	}
+
+	if (s_sim.running) {
+		psc = (uint64_t)tim->PSC + 1;
+		period = (uint64_t)tim->ARR + 1;
+
+		at = s_sim.enable_at + lib_clock__sim_first_hit(s_sim.ticks, 0, period) * psc;
+		if (at < next) {
+			next = at;
+		}
+
+		if (tim->CCR1 <= tim->ARR) {
+			at = s_sim.enable_at + lib_clock__sim_first_hit(s_sim.ticks, tim->CCR1, period) * psc;
+			if (at < next) {
+				next = at;
+			}
+		}
+	}
+
+	return next;
+}
+
+/* ************************************************************************//**
+ * \brief	check if the latched interrupt can be taken now
+ * ****************************************************************************/
+static int lib_clock__sim_deliverable(void)
+{
+	return s_sim.nvic_pending && !s_sim.masked && !s_sim.in_isr && !s_sim.in_nested
+		&& (s_sim.isr != NULL) && (s_sim.now >= s_sim.due_at);
+}
+
+/* ************************************************************************//**
+ * \brief	take the timer interrupt
+ * ****************************************************************************/
+static void lib_clock__sim_isr(void)
+{
+	uint64_t latency = s_sim.now - s_sim.event_at;
+
+	s_sim.nvic_pending = 0;
+	s_sim.stats.irqs++;
+	if (latency > s_sim.stats.max_irq_latency_cycles) {
+		s_sim.stats.max_irq_latency_cycles = latency;
+	}
+
+	s_sim.in_isr = 1;
+	s_sim.isr->cb(s_sim.isr->vector, (unsigned int)s_sim.isr->vector, s_sim.isr->arg);
+	lib_clock__sim_advance(s_sim.now + s_sim.cfg.isr_cycles);
+	s_sim.in_isr = 0;
+}
+
+/* ************************************************************************//**
+ * \brief	first counter tick after _after with tick % _period == _rem
+ * ****************************************************************************/
+static uint64_t lib_clock__sim_first_hit(uint64_t _after, uint64_t _rem, uint64_t _period)
+{
+	if (_after < _rem) {
+		return _rem;
+	}
+
+	return _rem + ((_after - _rem) / _period + 1) * _period;
+}
+
+/* ************************************************************************//**
+ * \brief	number of counter ticks in (_after, _upto] with tick % _period == _rem
+ * ****************************************************************************/
+static uint64_t lib_clock__sim_hits(uint64_t _after, uint64_t _upto, uint64_t _rem, uint64_t _period)
+{
+	uint64_t upto = (_upto >= _rem) ? (_upto - _rem) / _period + 1 : 0;
+	uint64_t after = (_after >= _rem) ? (_after - _rem) / _period + 1 : 0;
+
+	return upto - after;
+}
+
+/* ************************************************************************//**
+ * \brief	xorshift32 generator of the latency jitter
+ * ****************************************************************************/
+static uint32_t lib_clock__sim_random(void)
+{
+	uint32_t x = s_sim.rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	s_sim.rng = x;
+
+	return x;
+}
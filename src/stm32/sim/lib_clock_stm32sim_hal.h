@@ -0,0 +1,163 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_CLOCK_STM32SIM_HAL_H_
+#define _LIB_CLOCK_STM32SIM_HAL_H_
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stddef.h>
+#include <stdint.h>
+
+/* project */
+#include "lib_clock_stm32sim.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+
+/* Subset of the CMSIS / STM32 HAL names used by lib_clock_STM32.c */
+#define TIM4						(&g_lib_clock_sim_tim4)
+#define RCC							(&g_lib_clock_sim_rcc)
+#define RCC_CFGR_PPRE1_2			(0x1U << 10)
+
+#define TIM_CR1_CEN					(0x1U << 0)
+#define TIM_FLAG_UPDATE				(0x1U << 0)
+#define TIM_FLAG_CC1				(0x1U << 1)
+#define TIM_IT_UPDATE				(0x1U << 0)
+#define TIM_IT_CC1					(0x1U << 1)
+#define TIM_IT_CC2					(0x1U << 2)
+#define TIM_IT_CC3					(0x1U << 3)
+#define TIM_IT_CC4					(0x1U << 4)
+#define TIM_CHANNEL_1				0x00000000U
+#define TIM_COUNTERMODE_UP			0x00000000U
+#define TIM_CLOCKDIVISION_DIV1		0x00000000U
+
+#define __HAL_RCC_TIM4_CLK_ENABLE()						((void)0)
+#define __HAL_TIM_ENABLE(__HANDLE__)					lib_clock__sim_tim_enable((__HANDLE__)->Instance)
+#define __HAL_TIM_GET_FLAG(__HANDLE__, __FLAG__)		((LIB_CLOCK_SIM_SR((__HANDLE__)->Instance) & (__FLAG__)) == (__FLAG__))
+#define __HAL_TIM_CLEAR_FLAG(__HANDLE__, __FLAG__)		(LIB_CLOCK_SIM_SR((__HANDLE__)->Instance) &= ~(uint32_t)(__FLAG__))
+#define __HAL_TIM_ENABLE_IT(__HANDLE__, __IT__)			((__HANDLE__)->Instance->DIER |= (__IT__))
+#define __HAL_TIM_DISABLE_IT(__HANDLE__, __IT__)		((__HANDLE__)->Instance->DIER &= ~(uint32_t)(__IT__))
+#define __HAL_TIM_GET_IT_SOURCE(__HANDLE__, __IT__)		((((__HANDLE__)->Instance->DIER & (__IT__)) == (__IT__)) ? 1 : 0)
+#define __HAL_TIM_SET_COMPARE(__HANDLE__, __CHANNEL__, __COMPARE__)	\
+	(*(&((__HANDLE__)->Instance->CCR1) + ((__CHANNEL__) >> 2U)) = (__COMPARE__))
+
+#define __WFI()						lib_clock__sim_wfi()
+#define __disable_irq()				lib_clock__sim_irq_disable()
+#define __enable_irq()				lib_clock__sim_irq_enable()
+
+/* Access of a timer register (counter or status). The simulated time
+ * advances by one register access and due interrupts, including the
+ * nested reader, are delivered before the register content is refreshed,
+ * i.e. an interrupt can preempt the caller right before the access. */
+#define LIB_CLOCK_SIM_REG(_reg)		(lib_clock__sim_sync(), (_reg))
+#define LIB_CLOCK_SIM_SR(_tim)		(*(lib_clock__sim_sync(), &(_tim)->SR))
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+typedef enum {
+	TIM4_IRQn = 30
+} IRQn_Type;
+
+/* register layout of a general purpose timer */
+typedef struct {
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t SMCR;
+	volatile uint32_t DIER;
+	volatile uint32_t SR;
+	volatile uint32_t EGR;
+	volatile uint32_t CCMR1;
+	volatile uint32_t CCMR2;
+	volatile uint32_t CCER;
+	volatile uint32_t CNT;
+	volatile uint32_t PSC;
+	volatile uint32_t ARR;
+	volatile uint32_t RCR;
+	volatile uint32_t CCR1;
+	volatile uint32_t CCR2;
+	volatile uint32_t CCR3;
+	volatile uint32_t CCR4;
+	volatile uint32_t BDTR;
+	volatile uint32_t DCR;
+	volatile uint32_t DMAR;
+} TIM_TypeDef;
+
+typedef struct {
+	volatile uint32_t CR;
+	volatile uint32_t CFGR;
+} RCC_TypeDef;
+
+typedef struct {
+	uint32_t Prescaler;
+	uint32_t CounterMode;
+	uint32_t Period;
+	uint32_t ClockDivision;
+	uint32_t RepetitionCounter;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+	TIM_TypeDef				*Instance;
+	TIM_Base_InitTypeDef	Init;
+} TIM_HandleTypeDef;
+
+/* lib_isr replacement, the simulation dispatches the timer interrupt */
+typedef void (*lib_isr_cb_t)(IRQn_Type _isr_vector, unsigned int _vector, void *_arg);
+
+typedef struct {
+	IRQn_Type		vector;
+	lib_isr_cb_t	cb;
+	void			*arg;
+} lib_isr_hdl_t;
+
+/* *******************************************************************
+ * global variables
+ * ******************************************************************/
+extern TIM_TypeDef g_lib_clock_sim_tim4;
+extern RCC_TypeDef g_lib_clock_sim_rcc;
+
+/* *******************************************************************
+ * Function Prototypes
+ * ******************************************************************/
+
+/* simulated core */
+void lib_clock__sim_sync(void);
+void lib_clock__sim_wfi(void);
+void lib_clock__sim_irq_disable(void);
+void lib_clock__sim_irq_enable(void);
+void lib_clock__sim_tim_enable(TIM_TypeDef *_tim);
+
+/* simulated HAL */
+int HAL_TIM_Base_Init(TIM_HandleTypeDef *_htim);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+int lib_isr__attach(lib_isr_hdl_t *_hdl, IRQn_Type _vector, lib_isr_cb_t _cb, void *_arg);
+
+#endif
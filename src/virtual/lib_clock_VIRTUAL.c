@@ -0,0 +1,508 @@
+/*
+ * This file is part of the EMBTOM project
+ * Copyright (c) 2018-2020 Thomas Willetal
+ * (https://github.com/embtom)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* *******************************************************************
+ * includes
+ * ******************************************************************/
+
+/* c-runtime */
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* system */
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+/* own libs */
+#include <lib_convention__errno.h>
+
+/* project */
+#include "lib_clock.h"
+#include "lib_clock_virtual.h"
+
+/* *******************************************************************
+ * defines
+ * ******************************************************************/
+#define VIRTUAL_TICK_FREQ		1000000000ULL	// ticks are nanoseconds
+
+/* *******************************************************************
+ * custom data types (e.g. enumerations, structures, unions)
+ * ******************************************************************/
+
+/* a parked thread, lives on the stack of the waiting thread */
+typedef struct virtual_waiter {
+	uint64_t				deadline;
+	struct virtual_waiter	*next;
+} virtual_waiter_t;
+
+typedef struct {
+	_Atomic uint64_t			now_ns;		// read without the lock, written under it
+	lib_clock_virtual_delay_t	mode;
+	virtual_waiter_t			*waiters;
+	uint32_t					parked;
+	pthread_mutex_t				lock;
+	pthread_cond_t				advanced;	// the time moved forward
+	pthread_cond_t				park;		// a thread parked
+} virtual_clock_t;
+
+/* *******************************************************************
+ * static function declarations
+ * ******************************************************************/
+static void lib_clock__virtual_sleep_until(uint64_t _deadline);
+static void lib_clock__virtual_move(uint64_t _ns);
+
+/* *******************************************************************
+ * (static) variables declarations
+ * ******************************************************************/
+static virtual_clock_t s_virtual = {
+	.mode = LIB_CLOCK_VIRTUAL_ADVANCE,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.advanced = PTHREAD_COND_INITIALIZER,
+	.park = PTHREAD_COND_INITIALIZER,
+};
+
+/* *******************************************************************
+ * function definitions
+ * ******************************************************************/
+
+/* ************************************************************************//**
+ * \brief	Initialization of the timing module
+ *
+ * The virtual time is kept, it only changes through the
+ * lib_clock__virtual_* functions and the waits.
+ * ****************************************************************************/
+int lib_clock__init(void)
+{
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	get current timestamp in milliseconds, wraps after 2^32ms
+ * ****************************************************************************/
+uint32_t lib_clock__get_time_ms(void)
+{
+	return (uint32_t)(atomic_load_explicit(&s_virtual.now_ns, memory_order_acquire) / 1000000ULL);
+}
+
+/* ************************************************************************//**
+ * \brief	get current timestamp in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_time_ns(void)
+{
+	return atomic_load_explicit(&s_virtual.now_ns, memory_order_acquire);
+}
+
+/* ************************************************************************//**
+ * \brief	get current timestamp in microseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_time_us(void)
+{
+	return atomic_load_explicit(&s_virtual.now_ns, memory_order_acquire) / 1000ULL;
+}
+
+/* ************************************************************************//**
+ * \brief	get relative time difference since the given timestamp in milliseconds
+ * ****************************************************************************/
+uint32_t lib_clock__get_time_since_ms(uint32_t _lasttime)
+{
+	return (lib_clock__get_time_ms() - _lasttime);
+}
+
+/* ************************************************************************//**
+ * \brief	wait for _delay microseconds of virtual time
+ * ****************************************************************************/
+void lib_clock__delay_us(uint32_t _delay)
+{
+	lib_clock__virtual_sleep_until(lib_clock__get_time_ns() + (uint64_t)_delay * 1000ULL);
+}
+
+/* ************************************************************************//**
+ * \brief	number of clock ticks as 64bit value, the ticks are nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_clock_ticks(void)
+{
+	return lib_clock__get_time_ns();
+}
+
+/* ************************************************************************//**
+ * \brief	convert a number of clock ticks to nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__ticks_to_ns(uint64_t _ticks)
+{
+	return _ticks;
+}
+
+/* ************************************************************************//**
+ * \brief	convert nanoseconds to a number of clock ticks
+ * ****************************************************************************/
+uint64_t lib_clock__ns_to_ticks(uint64_t _ns)
+{
+	return _ns;
+}
+
+/* ************************************************************************//**
+ * \brief	get the frequency of the clock ticks
+ * ****************************************************************************/
+uint64_t lib_clock__get_tick_freq(void)
+{
+	return VIRTUAL_TICK_FREQ;
+}
+
+/* ************************************************************************//**
+ * \brief	get the factors behind the tick conversions, both are 1
+ * ****************************************************************************/
+void lib_clock__get_tick_conv(lib_clock_tick_conv_t *_to_ns, lib_clock_tick_conv_t *_to_ticks)
+{
+	if (_to_ns != NULL) {
+		_to_ns->mult = 1;
+		_to_ns->shift = 0;
+	}
+	if (_to_ticks != NULL) {
+		_to_ticks->mult = 1;
+		_to_ticks->shift = 0;
+	}
+}
+
+/* ************************************************************************//**
+ * \brief	set up a periodic timer, the deadlines are virtual nanoseconds
+ * ****************************************************************************/
+int lib_clock__periodic_init(lib_clock_periodic_t *_hdl, uint32_t _period_us)
+{
+	if ((_hdl == NULL) || (_period_us == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	_hdl->period = (uint64_t)_period_us * 1000ULL;
+	_hdl->period_rem = 0;
+	_hdl->next_rem = 0;
+	_hdl->next = lib_clock__get_time_ns() + _hdl->period;
+	_hdl->periods = 0;
+	_hdl->missed = 0;
+	_hdl->max_lateness_ns = 0;
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	block until the next deadline of a periodic timer
+ * ****************************************************************************/
+int lib_clock__periodic_wait(lib_clock_periodic_t *_hdl)
+{
+	uint64_t now, missed = 0, lateness;
+
+	if ((_hdl == NULL) || (_hdl->period == 0)) {
+		return -ESTD_INVAL;
+	}
+
+	// skip complete periods which were overrun, the phase stays intact
+	now = lib_clock__get_time_ns();
+	if (now >= _hdl->next + _hdl->period) {
+		missed = (now - _hdl->next) / _hdl->period;
+		_hdl->next += missed * _hdl->period;
+		_hdl->missed += missed;
+	}
+
+	lib_clock__virtual_sleep_until(_hdl->next);
+
+	now = lib_clock__get_time_ns();
+	lateness = (now > _hdl->next) ? now - _hdl->next : 0;
+	if (lateness > _hdl->max_lateness_ns) {
+		_hdl->max_lateness_ns = lateness;
+	}
+
+	_hdl->next += _hdl->period;
+	_hdl->periods++;
+
+	return (missed > (uint64_t)INT32_MAX) ? INT32_MAX : (int)missed;
+}
+
+/* ************************************************************************//**
+ * \brief	start the cached clock
+ *
+ * Reading the virtual time is a single load already, no ticker is
+ * necessary.
+ * ****************************************************************************/
+int lib_clock__cached_start(uint32_t _period_us)
+{
+	return (_period_us == 0) ? -ESTD_INVAL : EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	stop the cached clock
+ * ****************************************************************************/
+int lib_clock__cached_stop(void)
+{
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	worst observed gap between two updates of the cached clock
+ * ****************************************************************************/
+uint64_t lib_clock__cached_max_staleness_ns(void)
+{
+	return 0;
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in nanoseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_ns(void)
+{
+	return lib_clock__get_time_ns();
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in microseconds
+ * ****************************************************************************/
+uint64_t lib_clock__get_cached_time_us(void)
+{
+	return lib_clock__get_time_us();
+}
+
+/* ************************************************************************//**
+ * \brief	get cached timestamp in milliseconds
+ * ****************************************************************************/
+uint32_t lib_clock__get_cached_time_ms(void)
+{
+	return lib_clock__get_time_ms();
+}
+
+/* ************************************************************************//**
+ * \brief	select how waits behave
+ * ****************************************************************************/
+int lib_clock__virtual_set_delay_mode(lib_clock_virtual_delay_t _mode)
+{
+	if ((_mode != LIB_CLOCK_VIRTUAL_ADVANCE) && (_mode != LIB_CLOCK_VIRTUAL_PARK)) {
+		return -ESTD_INVAL;
+	}
+
+	pthread_mutex_lock(&s_virtual.lock);
+	s_virtual.mode = _mode;
+	pthread_mutex_unlock(&s_virtual.lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	move the virtual time forward
+ * ****************************************************************************/
+void lib_clock__virtual_advance_ns(uint64_t _ns)
+{
+	pthread_mutex_lock(&s_virtual.lock);
+	lib_clock__virtual_move(atomic_load_explicit(&s_virtual.now_ns, memory_order_relaxed) + _ns);
+	pthread_mutex_unlock(&s_virtual.lock);
+}
+
+/* ************************************************************************//**
+ * \brief	move the virtual time forward in microseconds
+ * ****************************************************************************/
+void lib_clock__virtual_advance_us(uint64_t _us)
+{
+	lib_clock__virtual_advance_ns(_us * 1000ULL);
+}
+
+/* ************************************************************************//**
+ * \brief	move the virtual time forward in milliseconds
+ * ****************************************************************************/
+void lib_clock__virtual_advance_ms(uint64_t _ms)
+{
+	lib_clock__virtual_advance_ns(_ms * 1000000ULL);
+}
+
+/* ************************************************************************//**
+ * \brief	set the virtual time
+ * ****************************************************************************/
+int lib_clock__virtual_set_ns(uint64_t _ns)
+{
+	int ret = EOK;
+
+	pthread_mutex_lock(&s_virtual.lock);
+	if (_ns < atomic_load_explicit(&s_virtual.now_ns, memory_order_relaxed)) {
+		ret = -ESTD_INVAL;
+	}
+	else {
+		lib_clock__virtual_move(_ns);
+	}
+	pthread_mutex_unlock(&s_virtual.lock);
+
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	restart the virtual time at any value
+ * ****************************************************************************/
+int lib_clock__virtual_reset(uint64_t _ns)
+{
+	int ret = EOK;
+
+	pthread_mutex_lock(&s_virtual.lock);
+	if (s_virtual.parked != 0) {
+		ret = -ESTD_BUSY;
+	}
+	else {
+		atomic_store_explicit(&s_virtual.now_ns, _ns, memory_order_release);
+	}
+	pthread_mutex_unlock(&s_virtual.lock);
+
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	advance to the earliest deadline of the parked threads
+ * ****************************************************************************/
+int lib_clock__virtual_advance_next(uint64_t *_ns)
+{
+	virtual_waiter_t *waiter;
+	uint64_t next = UINT64_MAX;
+
+	pthread_mutex_lock(&s_virtual.lock);
+	for (waiter = s_virtual.waiters; waiter != NULL; waiter = waiter->next) {
+		if (waiter->deadline < next) {
+			next = waiter->deadline;
+		}
+	}
+	if (s_virtual.waiters == NULL) {
+		pthread_mutex_unlock(&s_virtual.lock);
+		return -ESTD_AGAIN;
+	}
+
+	if (next > atomic_load_explicit(&s_virtual.now_ns, memory_order_relaxed)) {
+		lib_clock__virtual_move(next);
+	}
+	if (_ns != NULL) {
+		*_ns = atomic_load_explicit(&s_virtual.now_ns, memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&s_virtual.lock);
+
+	return EOK;
+}
+
+/* ************************************************************************//**
+ * \brief	number of threads parked in a wait
+ * ****************************************************************************/
+uint32_t lib_clock__virtual_parked(void)
+{
+	uint32_t parked;
+
+	pthread_mutex_lock(&s_virtual.lock);
+	parked = s_virtual.parked;
+	pthread_mutex_unlock(&s_virtual.lock);
+
+	return parked;
+}
+
+/* ************************************************************************//**
+ * \brief	block until at least _count threads are parked
+ * ****************************************************************************/
+int lib_clock__virtual_wait_parked(uint32_t _count, uint32_t _timeout_ms)
+{
+	struct timespec limit;
+	int ret = EOK;
+
+	clock_gettime(CLOCK_REALTIME, &limit);
+	limit.tv_sec += (time_t)(_timeout_ms / 1000U);
+	limit.tv_nsec += (long)(_timeout_ms % 1000U) * 1000000L;
+	if (limit.tv_nsec >= 1000000000L) {
+		limit.tv_nsec -= 1000000000L;
+		limit.tv_sec++;
+	}
+
+	pthread_mutex_lock(&s_virtual.lock);
+	while (s_virtual.parked < _count) {
+		if (pthread_cond_timedwait(&s_virtual.park, &s_virtual.lock, &limit) == ETIMEDOUT) {
+			ret = (s_virtual.parked < _count) ? -ESTD_TIMEDOUT : EOK;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&s_virtual.lock);
+
+	return ret;
+}
+
+/* ************************************************************************//**
+ * \brief	wait until the virtual time reaches _deadline
+ *
+ * In advance mode the caller moves the time itself, in park mode it
+ * blocks until another thread advanced the time far enough.
+ * ****************************************************************************/
+static void lib_clock__virtual_sleep_until(uint64_t _deadline)
+{
+	virtual_waiter_t self;
+
+	pthread_mutex_lock(&s_virtual.lock);
+	if (_deadline <= atomic_load_explicit(&s_virtual.now_ns, memory_order_relaxed)) {
+		pthread_mutex_unlock(&s_virtual.lock);
+		return;
+	}
+
+	if (s_virtual.mode == LIB_CLOCK_VIRTUAL_ADVANCE) {
+		lib_clock__virtual_move(_deadline);
+		pthread_mutex_unlock(&s_virtual.lock);
+		return;
+	}
+
+	self.deadline = _deadline;
+	self.next = s_virtual.waiters;
+	s_virtual.waiters = &self;
+	s_virtual.parked++;
+	pthread_cond_broadcast(&s_virtual.park);
+
+	// lib_clock__virtual_move unlinks the waiter once the deadline is reached
+	while (atomic_load_explicit(&s_virtual.now_ns, memory_order_relaxed) < _deadline) {
+		pthread_cond_wait(&s_virtual.advanced, &s_virtual.lock);
+	}
+	pthread_mutex_unlock(&s_virtual.lock);
+}
+
+/* ************************************************************************//**
+ * \brief	publish a new time and wake the parked threads, called locked
+ *
+ * Threads which are due are unlinked right here, so a thread counts as
+ * parked exactly until its deadline is reached, not until it runs again.
+ * ****************************************************************************/
+static void lib_clock__virtual_move(uint64_t _ns)
+{
+	virtual_waiter_t **link = &s_virtual.waiters;
+	int woken = 0;
+
+	atomic_store_explicit(&s_virtual.now_ns, _ns, memory_order_release);
+
+	while (*link != NULL) {
+		if ((*link)->deadline <= _ns) {
+			*link = (*link)->next;
+			s_virtual.parked--;
+			woken = 1;
+		}
+		else {
+			link = &(*link)->next;
+		}
+	}
+
+	if (woken) {
+		pthread_cond_broadcast(&s_virtual.advanced);
+	}
+}